@@ -0,0 +1,106 @@
+// arena.c
+#include "defs.h"
+
+/*
+    An arena hands out memory by bumping a pointer through one large block and frees it all at
+    once. The Arena header lives at the start of its own first block, so creating an arena is one
+    malloc and destroying it is one free, as long as the first block was sized well. If it was
+    not, further blocks are chained on and freed with it.
+*/
+
+#define ARENA_ALIGN 16
+
+// A further block chained on when the first one runs out
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+/*
+    Rounds a size up to the arena's alignment.
+*/
+static size_t alignUp(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+/*
+  Function: arenaCreate(size_t size)
+  Purpose: Creates an arena with room for size bytes of allocations in its first block.
+
+  return
+    the new arena; free it and everything allocated from it with arenaDestroy
+*/
+Arena* arenaCreate(size_t size) {
+    size_t header = alignUp(sizeof(Arena));
+    Arena* arena = malloc(header + alignUp(size));
+    if (arena == NULL) {
+        perror("Error creating arena");
+        exit(EXIT_FAILURE);
+    }
+    arena->base = (char*) arena + header;
+    arena->size = alignUp(size);
+    arena->used = 0;
+    arena->more = NULL;
+    memset(&arena->stats, 0, sizeof(ArenaStats));
+    arena->stats.blocks = 1;
+    arena->stats.reserved = header + arena->size;
+    return arena;
+}
+
+/*
+  Function: arenaAlloc(Arena* arena, size_t size)
+  Purpose: Allocates size bytes, aligned to 16, that live until the arena is destroyed.
+
+  Description:
+    Comes out of the first block if it fits, otherwise out of a chained block, adding one twice as large as needed if none has room.
+
+  return
+    the memory, which is not cleared
+*/
+void* arenaAlloc(Arena* arena, size_t size) {
+    size = alignUp(size);
+    arena->stats.allocations++;
+    arena->stats.used += size;
+
+    if (arena->size - arena->used >= size) {
+        void* memory = arena->base + arena->used;
+        arena->used += size;
+        return memory;
+    }
+
+    ArenaBlock* block = arena->more;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = 2 * (size > arena->size ? size : arena->size);
+        block = malloc(sizeof(ArenaBlock) + blockSize);
+        if (block == NULL) {
+            perror("Error growing arena");
+            exit(EXIT_FAILURE);
+        }
+        block->next = arena->more;
+        block->size = blockSize;
+        block->used = 0;
+        arena->more = block;
+        arena->stats.blocks++;
+        arena->stats.reserved += sizeof(ArenaBlock) + blockSize;
+    }
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+/*
+  Function: arenaDestroy(Arena* arena)
+  Purpose: Frees the arena and everything allocated from it.
+*/
+void arenaDestroy(Arena* arena) {
+    if (arena == NULL) return;
+    ArenaBlock* block = arena->more;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,369 @@
+// batch.c
+#include "defs.h"
+
+// Packs a worker's remaining games [begin, end) into one word so it can be split with a single CAS
+#define RANGE(begin, end)   (((uint64_t) (end) << 32) | (uint32_t) (begin))
+#define RANGE_BEGIN(range)  ((uint32_t) (range))
+#define RANGE_END(range)    ((uint32_t) ((range) >> 32))
+
+// One worker of the batch pool, on its own cache line so that stealing does not slow the owner
+typedef struct BatchWorker {
+    _Alignas(64) _Atomic uint64_t range;    // game indices this worker still has to play
+    struct BatchPool* pool;
+    int index;
+    BatchStats stats;
+    WorkerStats work;
+    ArenaStats memory;                      // of the worker's simulation context
+    long resets;
+    pthread_t thread;
+} BatchWorker;
+
+typedef struct BatchPool {
+    const HouseLayout* layout;
+    TraceFile* trace;
+    ResultsFile* results;               // every game's result is stored here too, unless NULL
+    uint64_t seed;
+    int numHunters;
+    const SimSnapshot* from;            // when set, every game is a continuation of this snapshot
+    int lanes;                          // when set, every worker plays its games in a lockstep block this wide
+    enum LaneIsa isa;                   // ... with these kernels
+    BatchWorker* workers;
+    int numWorkers;
+} BatchPool;
+
+/*
+  Adds one game result to a running total.
+*/
+static void addResult(BatchStats* stats, const GameResult* result) {
+    stats->games++;
+    stats->ghostWins += result->ghostWon;
+    if (result->identifiedType != GH_UNKNOWN) {
+        stats->identified++;
+        stats->identifiedCorrect += (result->identifiedType == result->ghostType);
+    }
+    stats->exitFear += result->exitFear;
+    stats->exitBored += result->exitBored;
+    stats->exitEvidence += result->exitEvidence;
+    stats->ticks += result->ticks;
+}
+
+/*
+  Takes the next game off the front of a worker's own range.
+  Returns C_FALSE once the range is empty.
+*/
+static int popGame(BatchWorker* worker, uint32_t* game) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        if (atomic_compare_exchange_weak_explicit(&worker->range, &range, RANGE(RANGE_BEGIN(range) + 1, RANGE_END(range)),
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            *game = RANGE_BEGIN(range);
+            return C_TRUE;
+        }
+    }
+    return C_FALSE;
+}
+
+/*
+  Steals the back half of the busiest other worker's range into the thief's own, which is empty.
+  Returns C_FALSE once no worker has any games left to take.
+*/
+static int stealGames(BatchWorker* thief) {
+    BatchPool* pool = thief->pool;
+    for (;;) {
+        BatchWorker* victim = NULL;
+        uint64_t range = 0;
+        uint32_t most = 0;
+        for (int i = 1; i < pool->numWorkers; i++) {
+            BatchWorker* other = &pool->workers[(thief->index + i) % pool->numWorkers];
+            uint64_t r = atomic_load_explicit(&other->range, memory_order_relaxed);
+            if (RANGE_END(r) > RANGE_BEGIN(r) && RANGE_END(r) - RANGE_BEGIN(r) > most) {
+                victim = other;
+                range = r;
+                most = RANGE_END(r) - RANGE_BEGIN(r);
+            }
+        }
+        if (victim == NULL) return C_FALSE;
+
+        // Take the back half, rounded up so that a last remaining game can be stolen too
+        uint32_t middle = RANGE_END(range) - (most + 1) / 2;
+        if (atomic_compare_exchange_strong_explicit(&victim->range, &range, RANGE(RANGE_BEGIN(range), middle),
+                                                    memory_order_relaxed, memory_order_relaxed)) {
+            atomic_store_explicit(&thief->range, RANGE(middle, RANGE_END(range)), memory_order_relaxed);
+            thief->work.steals++;
+            return C_TRUE;
+        }
+    }
+}
+
+/*
+  Takes the worker's next game, stealing more once its own range is empty.
+  Returns C_FALSE once no worker has any games left.
+*/
+static int nextGame(BatchWorker* worker, uint32_t* game) {
+    while (!popGame(worker, game)) {
+        if (!stealGames(worker)) return C_FALSE;
+    }
+    return C_TRUE;
+}
+
+/*
+  Returns the monotonic clock in seconds.
+*/
+static double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+  Plays a worker's games in the lanes of a lockstep block, starting the next game in a lane at the end of the period its last one ended in.
+*/
+static void playLanes(BatchWorker* worker) {
+    BatchPool* pool = worker->pool;
+    Lockstep* block = lockstepCreate(pool->layout, pool->numHunters, pool->lanes, pool->isa);
+    ResultsBuffer results;
+    uint64_t* keys = NULL;              // the stream key of the game in each lane
+    if (pool->results != NULL) {
+        initResultsBuffer(&results, pool->results);
+        keys = malloc(block->lanes * sizeof(uint64_t));
+        if (keys == NULL) {
+            perror("Error starting batch");
+            exit(EXIT_FAILURE);
+        }
+    }
+    double started = monotonicSeconds();
+    int playing;
+    do {
+        playing = 0;
+        for (int lane = 0; lane < block->lanes; lane++) {
+            GameResult result;
+            uint32_t game;
+            if (lockstepResult(block, lane, &result)) {
+                addResult(&worker->stats, &result);
+                telemetryCount(&result, block->collected[lane], &block->fear[lane], &block->boredom[lane],
+                               block->numHunters, block->lanes * sizeof(int32_t));
+                if (keys != NULL) {
+                    recordResult(&results, keys[lane], 0, &result, block->collected[lane], &block->exitReason[lane],
+                                 block->numHunters, block->lanes * sizeof(int32_t));
+                }
+            }
+            if (!block->busy[lane] && nextGame(worker, &game)) {
+                uint64_t key = rngDerive(pool->seed, game);
+                lockstepLoad(block, lane, key);
+                if (keys != NULL) keys[lane] = key;
+            }
+            playing += block->busy[lane];
+        }
+        if (playing > 0) lockstepPeriod(block);
+    } while (playing > 0);
+    worker->work.busy += monotonicSeconds() - started;
+
+    worker->memory = block->arena->stats;
+    worker->resets = block->games > block->lanes ? block->games - block->lanes : 0;
+    lockstepDestroy(block);
+    if (keys != NULL) {
+        cleanupResultsBuffer(&results);
+        free(keys);
+    }
+}
+
+static void* batchThread(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    BatchPool* pool = worker->pool;
+    if (pool->lanes > 0) {
+        playLanes(worker);
+        return NULL;
+    }
+    TraceBuffer buffer;
+    if (pool->trace != NULL) initTraceBuffer(&buffer, pool->trace);
+    ResultsBuffer results;
+    if (pool->results != NULL) initResultsBuffer(&results, pool->results);
+
+    // One context per worker, reset for every game it plays
+    LogSink silent = { C_FALSE, STDOUT_FILENO };
+    SimConfig config = { pool->layout, 0, pool->numHunters, NULL, silent, pool->trace != NULL ? &buffer : NULL, NULL };
+    SimContext* sim = pool->from != NULL ? simCreateFromSnapshot(pool->layout, pool->from, silent, config.trace)
+                                         : simCreate(&config);
+
+    uint32_t game;
+    do {
+        double started = monotonicSeconds();
+        while (popGame(worker, &game)) {
+            GameResult result;
+            if (pool->from != NULL) {
+                simRestore(sim, pool->from);
+                simBranch(sim, rngDerive(pool->seed, game));
+            } else {
+                simReset(sim, rngDerive(pool->seed, game));
+            }
+            simRun(sim);
+            simResult(sim, &result);
+            addResult(&worker->stats, &result);
+            telemetryGame(sim, &result);
+            if (pool->results != NULL) recordGame(&results, 0, sim, &result);
+        }
+        worker->work.busy += monotonicSeconds() - started;
+    } while (stealGames(worker));
+
+    worker->memory = sim->arena->stats;
+    worker->resets = sim->resets;
+    simDestroy(sim);
+    if (pool->trace != NULL) cleanupTraceBuffer(&buffer);
+    if (pool->results != NULL) cleanupResultsBuffer(&results);
+    return NULL;
+}
+
+/*
+  Plays runs games on jobs workers of a pool and adds them up, see runBatch.
+*/
+static void runPool(BatchPool* pool, long runs, int jobs, BatchStats* stats) {
+    if (runs > UINT32_MAX) runs = UINT32_MAX;
+    if (jobs < 1) jobs = 1;
+    if (jobs > runs) jobs = runs > 0 ? (int) runs : 1;
+
+    pool->numWorkers = jobs;
+    pool->workers = aligned_alloc(_Alignof(BatchWorker), jobs * sizeof(BatchWorker));
+    if (pool->workers == NULL) {
+        perror("Error starting batch");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool->workers, 0, jobs * sizeof(BatchWorker));
+
+    long first = 0;
+    for (int i = 0; i < jobs; i++) {
+        long share = runs / jobs + (i < runs % jobs);
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        atomic_init(&pool->workers[i].range, RANGE(first, first + share));
+        first += share;
+    }
+    double started = monotonicSeconds();
+    for (int i = 0; i < jobs; i++) {
+        pthread_create(&pool->workers[i].thread, NULL, batchThread, &pool->workers[i]);
+    }
+
+    memset(stats, 0, sizeof(BatchStats));
+    stats->workers = calloc(jobs, sizeof(WorkerStats));
+    if (stats->workers == NULL) {
+        perror("Error starting batch");
+        exit(EXIT_FAILURE);
+    }
+    stats->numWorkers = jobs;
+    for (int i = 0; i < jobs; i++) {
+        BatchWorker* worker = &pool->workers[i];
+        pthread_join(worker->thread, NULL);
+        stats->games += worker->stats.games;
+        stats->ghostWins += worker->stats.ghostWins;
+        stats->identified += worker->stats.identified;
+        stats->identifiedCorrect += worker->stats.identifiedCorrect;
+        stats->exitFear += worker->stats.exitFear;
+        stats->exitBored += worker->stats.exitBored;
+        stats->exitEvidence += worker->stats.exitEvidence;
+        stats->ticks += worker->stats.ticks;
+        stats->memory.reserved += worker->memory.reserved;
+        stats->memory.used += worker->memory.used;
+        stats->memory.allocations += worker->memory.allocations;
+        stats->memory.blocks += worker->memory.blocks;
+        stats->resets += worker->resets;
+        stats->workers[i] = worker->work;
+        stats->workers[i].games = worker->stats.games;
+    }
+    stats->wall = monotonicSeconds() - started;
+    free(pool->workers);
+}
+
+
+/*
+  Function: runBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, TraceFile* trace, ResultsFile* results, const SimSnapshot* from, BatchStats* stats)
+  Purpose: Plays many games in parallel with logging turned off.
+
+  Parameters:
+    in layout: the house to play in.
+    in seed: master seed; game i is played with stream key rngDerive(seed, i), so the totals
+             only depend on the seed and the number of runs, not on the number of jobs.
+    in numHunters: hunters in every game.
+    in runs: the number of games to play, at most UINT32_MAX.
+    in jobs: the number of worker threads.
+    in/out trace: an open trace file every game is recorded to, or NULL.
+    in/out results: an open results file every game's result is stored in, with config 0, or NULL.
+    in from: a snapshot to fork every game from, or NULL to play whole games. Game i then
+             continues the snapshot with its random streams rekeyed to rngDerive(seed, i), and
+             numHunters is taken from the snapshot. The snapshot must belong to the layout.
+    out stats: the totals over all games, and how busy each worker was; free with cleanupBatchStats.
+
+  Description:
+    Each worker starts with an equal share of the game indices and plays them from the front. A worker that runs out steals the back half of the largest remaining share, so short and long games even out across the workers instead of leaving some of them idle at the end.
+
+  return
+    none
+*/
+void runBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, TraceFile* trace,
+              ResultsFile* results, const SimSnapshot* from, BatchStats* stats) {
+    BatchPool pool = { layout, trace, results, seed, numHunters, from, 0, LANES_AUTO, NULL, 0 };
+    runPool(&pool, runs, jobs, stats);
+}
+
+/*
+  Function: runLockstepBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, int lanes, enum LaneIsa isa, ResultsFile* results, BatchStats* stats)
+  Purpose: Plays many games like runBatch, with each worker playing its games side by side in the lanes of a lockstep block.
+
+  Parameters:
+    in layout, seed, numHunters, runs, jobs, results: as for runBatch; game i is the same game, so the totals are the same.
+    in lanes: games each worker plays at once, see lockstepCreate.
+    in isa: the kernels the blocks use, see resolveLaneIsa.
+    out stats: the totals over all games; free with cleanupBatchStats.
+
+  return
+    none
+*/
+void runLockstepBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, int lanes,
+                      enum LaneIsa isa, ResultsFile* results, BatchStats* stats) {
+    BatchPool pool = { layout, NULL, results, seed, numHunters, NULL, lanes > 0 ? lanes : LOCKSTEP_LANES, isa, NULL, 0 };
+    runPool(&pool, runs, jobs, stats);
+}
+
+/*
+  Function: cleanupBatchStats(BatchStats* stats)
+  Purpose: Frees the per-worker figures allocated by runBatch.
+*/
+void cleanupBatchStats(BatchStats* stats) {
+    free(stats->workers);
+    stats->workers = NULL;
+    stats->numWorkers = 0;
+}
+
+/*
+  Function: printBatchStats(const BatchStats* stats, double seconds)
+  Purpose: Prints the aggregated outcome of a batch run.
+
+  Parameters:
+    in stats: the totals from runBatch.
+    in seconds: wall-clock time the batch took.
+
+  return
+    none
+*/
+void printBatchStats(const BatchStats* stats, double seconds) {
+    double games = stats->games > 0 ? (double) stats->games : 1.0;
+    double identified = stats->identified > 0 ? (double) stats->identified : 1.0;
+
+    printf("Games played:            %ld\n", stats->games);
+    printf("Ghost win rate:          %.2f%%\n", 100.0 * stats->ghostWins / games);
+    printf("Games with 3 evidence:   %ld (%.2f%%)\n", stats->identified, 100.0 * stats->identified / games);
+    printf("Identification accuracy: %.2f%%\n", 100.0 * stats->identifiedCorrect / identified);
+    printf("Hunter exits:            %ld fear, %ld bored, %ld evidence\n",
+           stats->exitFear, stats->exitBored, stats->exitEvidence);
+    printf("Average game length:     %.1f simulated seconds\n", stats->ticks / games / 1000.0);
+    if (seconds > 0) {
+        printf("Throughput:              %.0f games/sec (%.3f s)\n", stats->games / seconds, seconds);
+    }
+    if (stats->numWorkers > 0) {
+        printf("Memory:                  %.1f KB in %ld blocks for %d contexts, %ld games reset without allocating\n",
+               stats->memory.reserved / 1024.0, stats->memory.blocks, stats->numWorkers, stats->resets);
+    }
+    for (int i = 0; i < stats->numWorkers; i++) {
+        const WorkerStats* worker = &stats->workers[i];
+        double utilization = stats->wall > 0 ? 100.0 * worker->busy / stats->wall : 100.0;
+        printf("Worker %-3d               %ld games, %ld steals, %.1f%% busy\n", i, worker->games, worker->steals, utilization);
+    }
+}
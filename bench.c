@@ -0,0 +1,579 @@
+// bench.c
+#include "defs.h"
+#include <fcntl.h>
+
+/*
+    ghost_bench: measures the simulator's hot paths and its end-to-end throughput.
+
+    Microbenchmarks time one call at a time: the random number generators, room selection,
+    dropping, taking and finding evidence, the shared evidence board under 1..N contending threads, and every l_*
+    logger call writing to /dev/null, both directly and through the asynchronous logger.
+    End-to-end benchmarks play whole games on the default house and on large generated houses
+    and report games per second, with the default engine and with each lockstep kernel, and
+    nanoseconds per turn (one hunter or ghost step).
+
+    Each benchmark is repeated with more iterations until it runs for at least --min-time
+    seconds. Results go to stdout or --output as JSON or CSV, and a readable summary goes to
+    stderr, so two builds can be compared by diffing or loading their result files.
+*/
+
+#define BENCH_MAX_RESULTS   128
+#define BENCH_MAX_HOUSES    8
+
+enum BenchFormat { BENCH_JSON, BENCH_CSV };
+
+typedef struct BenchResult {
+    char name[MAX_STR];
+    char house[MAX_STR];        // empty for benchmarks that do not depend on the house
+    int threads;
+    const char* unit;           // what one operation is: a call, a game, a turn
+    long ops;
+    double seconds;
+} BenchResult;
+
+typedef struct BenchOptions {
+    enum BenchFormat format;
+    const char* output;
+    const char* filter;         // only benchmarks whose name contains this
+    int maxThreads;
+    double minTime;
+    uint64_t seed;
+    const char* map;
+    int numGenerated;
+    uint32_t generatedRooms[BENCH_MAX_HOUSES];
+} BenchOptions;
+
+// State shared by the threads of one microbenchmark
+typedef struct BenchShared BenchShared;
+typedef void (*BenchOp)(BenchShared* shared, int id, long iters);
+
+struct BenchShared {
+    BenchOp op;
+    long iters;                 // per thread
+    const HouseLayout* layout;
+    HouseType* house;
+    LogSink log;
+    atomic_long claimed;        // successful evidence claims in the last run, see claimEvidence
+    pthread_barrier_t start;
+};
+
+typedef struct BenchThread {
+    BenchShared* shared;
+    int id;
+} BenchThread;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int numResults = 0;
+static volatile long benchSink;     // keeps the compiler from dropping the measured calls
+
+static double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--format json|csv] [--output FILE] [--threads N] [--min-time S] [--seed S]\n", program);
+    fprintf(stderr, "          [--map FILE] [--rooms R[,R...]] [--filter TEXT]\n");
+    fprintf(stderr, "  --format    json (default) or csv\n");
+    fprintf(stderr, "  --output    write the results to FILE instead of stdout\n");
+    fprintf(stderr, "  --threads   most contending threads for the evidence board benchmarks (default: cores, at least 4)\n");
+    fprintf(stderr, "  --min-time  seconds each benchmark runs for at least (default 0.25)\n");
+    fprintf(stderr, "  --map       play the end-to-end games in this house instead of the built-in one\n");
+    fprintf(stderr, "  --rooms     sizes of the generated houses for the end-to-end games (default 1000,100000)\n");
+    fprintf(stderr, "  --filter    only run benchmarks whose name contains TEXT\n");
+}
+
+/*
+    Records one result and prints it to stderr as it comes in.
+*/
+static void addResult(const char* name, const char* house, int threads, const char* unit, long ops, double seconds) {
+    if (numResults == BENCH_MAX_RESULTS) return;
+    BenchResult* result = &results[numResults++];
+    snprintf(result->name, MAX_STR, "%s", name);
+    snprintf(result->house, MAX_STR, "%s", house != NULL ? house : "");
+    result->threads = threads;
+    result->unit = unit;
+    result->ops = ops;
+    result->seconds = seconds;
+    fprintf(stderr, "%-38s %-18s %3d thread%s %12.1f ns/%-5s %14.0f %s/sec\n", name, result->house, threads,
+            threads == 1 ? " " : "s", seconds * 1e9 * threads / ops, unit, ops / seconds, unit);
+}
+
+static int selected(const BenchOptions* options, const char* name) {
+    return options->filter == NULL || strstr(name, options->filter) != NULL;
+}
+
+// Microbenchmark bodies; each runs iters calls on one thread
+
+static void opRandInt(BenchShared* shared, int id, long iters) {
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += randInt(0, 100);
+    benchSink = sum;
+}
+
+static void opRandFloat(BenchShared* shared, int id, long iters) {
+    float sum = 0;
+    for (long i = 0; i < iters; i++) sum += randFloat(0, 1);
+    benchSink = (long) sum;
+}
+
+static void opRngRange(BenchShared* shared, int id, long iters) {
+    Rng rng;
+    rngSeed(&rng, id);
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += rngRange(&rng, 100);
+    benchSink = sum;
+}
+
+static void opConnectedRoom(BenchShared* shared, int id, long iters) {
+    Rng rng;
+    rngSeed(&rng, id);
+    RoomId room = 0;
+    for (long i = 0; i < iters; i++) room = getRandomConnectedRoom(shared->layout, room, &rng);
+    benchSink = room;
+}
+
+static void opAddEvidence(BenchShared* shared, int id, long iters) {
+    HouseType* house = shared->house;
+    for (long i = 0; i < iters; i++) {
+        RoomId room = i % house->numRooms;
+        addEvidenceToRoom(house, room, (enum EvidenceType) (i & 3));
+        takeEvidenceFromRoom(house, room, (enum EvidenceType) (i & 3));
+    }
+}
+
+static void opFindEvidence(BenchShared* shared, int id, long iters) {
+    HouseType* house = shared->house;
+    RoomId found = 0;
+    for (long i = 0; i < iters; i++) {
+        found = nextEvidenceRoom(house, (enum EvidenceType) (i & 3), found == NO_ROOM ? 0 : found + 1);
+    }
+    benchSink = found;
+}
+
+/*
+    Claims a piece of evidence on the shared board. Whoever finds the board full empties it again, so
+    the threads keep racing for free pieces, and successful inserts are measured as well as failed ones.
+*/
+static int claimEvidence(BenchShared* shared, int id, long i) {
+    EvidenceBoard* board = &shared->house->evidence;
+    unsigned full = (1u << EV_COUNT) - 1;
+    if (atomic_load_explicit(&board->collected, memory_order_relaxed) == full &&
+        atomic_compare_exchange_strong(&board->collected, &full, 0)) {
+        for (int e = 0; e < EV_COUNT; e++) atomic_store(&board->contributor[e], -1);
+    }
+    return collectEvidence(shared->house, (enum EvidenceType) ((id + i) & 3), id);
+}
+
+static void opCollectEvidence(BenchShared* shared, int id, long iters) {
+    long found = 0;
+    for (long i = 0; i < iters; i++) found += claimEvidence(shared, id, i);
+    atomic_fetch_add(&shared->claimed, found);
+    benchSink = found;
+}
+
+static void opReviewEvidence(BenchShared* shared, int id, long iters) {
+    long sufficient = 0;
+    for (long i = 0; i < iters; i++) sufficient += reviewEvidence(shared->house);
+    benchSink = sufficient;
+}
+
+static void opCollectReview(BenchShared* shared, int id, long iters) {
+    long sufficient = 0;
+    long found = 0;
+    for (long i = 0; i < iters; i++) {
+        found += claimEvidence(shared, id, i);
+        sufficient += reviewEvidence(shared->house);
+    }
+    atomic_fetch_add(&shared->claimed, found);
+    benchSink = sufficient;
+}
+
+static void opHunterInit(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_hunterInit(&shared->log, "Hunter 1", EMF);
+}
+
+static void opHunterMove(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_hunterMove(&shared->log, "Hunter 1", "Master Bedroom");
+}
+
+static void opHunterReview(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_hunterReview(&shared->log, "Hunter 1", LOG_INSUFFICIENT);
+}
+
+static void opHunterCollect(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_hunterCollect(&shared->log, "Hunter 1", FINGERPRINTS, "Kitchen");
+}
+
+static void opHunterExit(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_hunterExit(&shared->log, "Hunter 1", LOG_BORED);
+}
+
+static void opGhostInit(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_ghostInit(&shared->log, BANSHEE, "Basement");
+}
+
+static void opGhostMove(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_ghostMove(&shared->log, "Basement Hallway");
+}
+
+static void opGhostEvidence(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_ghostEvidence(&shared->log, SOUND, "Garage");
+}
+
+static void opGhostExit(BenchShared* shared, int id, long iters) {
+    for (long i = 0; i < iters; i++) l_ghostExit(&shared->log, LOG_BORED);
+}
+
+static const struct { const char* name; BenchOp op; } loggerOps[] = {
+    { "l_hunterInit", opHunterInit },
+    { "l_hunterMove", opHunterMove },
+    { "l_hunterReview", opHunterReview },
+    { "l_hunterCollect", opHunterCollect },
+    { "l_hunterExit", opHunterExit },
+    { "l_ghostInit", opGhostInit },
+    { "l_ghostMove", opGhostMove },
+    { "l_ghostEvidence", opGhostEvidence },
+    { "l_ghostExit", opGhostExit },
+};
+
+static void* benchThread(void* arg) {
+    BenchThread* thread = (BenchThread*) arg;
+    seedRandom(rngDerive(0xbe4c, thread->id));
+    pthread_barrier_wait(&thread->shared->start);
+    thread->shared->op(thread->shared, thread->id, thread->shared->iters);
+    return NULL;
+}
+
+/*
+    Runs a microbenchmark once on the given number of threads and returns the wall-clock seconds,
+    counted from the moment every thread is ready. With async set, the asynchronous logger runs
+    for the duration and the time includes draining it.
+*/
+static double runOnce(BenchShared* shared, int threads, long iters, int async) {
+    BenchThread* workers = malloc(threads * sizeof(BenchThread));
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    if (workers == NULL || ids == NULL) {
+        perror("Error starting benchmark");
+        exit(EXIT_FAILURE);
+    }
+    shared->iters = iters;
+    atomic_store(&shared->claimed, 0);
+    pthread_barrier_init(&shared->start, NULL, threads + 1);
+    for (int i = 0; i < threads; i++) {
+        workers[i].shared = shared;
+        workers[i].id = i;
+        pthread_create(&ids[i], NULL, benchThread, &workers[i]);
+    }
+    if (async) l_startAsync(LOG_BLOCK);
+    pthread_barrier_wait(&shared->start);
+    double start = nowSeconds();
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    if (async) l_stopAsync();
+    double seconds = nowSeconds() - start;
+
+    pthread_barrier_destroy(&shared->start);
+    free(ids);
+    free(workers);
+    return seconds;
+}
+
+/*
+    Times a microbenchmark on each thread count from 1 to maxThreads, doubling. The number of
+    calls is found on one thread and then split between the threads, so every thread count does
+    the same total work. Benchmarks that claim evidence also get a NAME/claimed result, the
+    successful claims among the calls.
+*/
+static void runMicro(const BenchOptions* options, const char* name, BenchShared* shared, int maxThreads, int async) {
+    if (!selected(options, name)) return;
+
+    long iters = 1024;
+    double seconds = runOnce(shared, 1, iters, async);
+    while (seconds < options->minTime) {
+        iters = seconds > options->minTime / 16 ? (long) (iters * 1.2 * options->minTime / seconds) : iters * 8;
+        seconds = runOnce(shared, 1, iters, async);
+    }
+    char claimedName[MAX_STR];
+    snprintf(claimedName, MAX_STR, "%s/claimed", name);
+    addResult(name, NULL, 1, "call", iters, seconds);
+    if (atomic_load(&shared->claimed) > 0) addResult(claimedName, NULL, 1, "claim", atomic_load(&shared->claimed), seconds);
+
+    for (int threads = 2; threads <= maxThreads; threads *= 2) {
+        long each = iters / threads;
+        seconds = runOnce(shared, threads, each, async);
+        addResult(name, NULL, threads, "call", each * threads, seconds);
+        if (atomic_load(&shared->claimed) > 0) addResult(claimedName, NULL, threads, "claim", atomic_load(&shared->claimed), seconds);
+    }
+}
+
+/*
+    Builds a connected house of the given size: each new room is connected to a random earlier
+    one, and a quarter as many extra connections again join random pairs of rooms.
+*/
+static void generateLayout(HouseLayout* layout, uint32_t numRooms, uint64_t seed) {
+    HouseBuilder builder;
+    Rng rng;
+    char name[MAX_STR];
+
+    initBuilder(&builder);
+    rngSeed(&rng, seed);
+    createRoom(&builder, "Van");
+    for (uint32_t i = 1; i < numRooms; i++) {
+        snprintf(name, MAX_STR, "Room %u", i);
+        RoomId room = createRoom(&builder, name);
+        connectRooms(&builder, room, rngRange(&rng, room));
+    }
+    for (uint32_t i = 0; i < numRooms / 4; i++) {
+        RoomId a = rngRange(&rng, numRooms), b = rngRange(&rng, numRooms);
+        if (a != b) connectRooms(&builder, a, b);
+    }
+    buildLayout(&builder, layout);
+    cleanupBuilder(&builder);
+}
+
+/*
+    Plays batches of silent games in a house, doubling until a batch takes --min-time, and
+    records games per second on every core and nanoseconds per turn on one core.
+*/
+static void runEndToEnd(const BenchOptions* options, const HouseLayout* layout, const char* house, int jobs) {
+    if (selected(options, "games")) {
+        BatchStats stats;
+        long games = 64;
+        double seconds;
+        for (;;) {
+            double start = nowSeconds();
+            runBatch(layout, options->seed, NUM_HUNTERS, games, jobs, NULL, NULL, NULL, &stats);
+            seconds = nowSeconds() - start;
+            cleanupBatchStats(&stats);
+            if (seconds >= options->minTime) break;
+            games *= seconds > options->minTime / 16 ? 2 : 8;
+        }
+        addResult("games", house, jobs, "game", games, seconds);
+    }
+
+    // The same batches played by the lockstep engine, once with each kind of kernel the CPU has
+    const enum LaneIsa isas[] = { LANES_SCALAR, LANES_SSE4, LANES_AVX2 };
+    for (int i = 0; i < 3; i++) {
+        char name[MAX_STR];
+        snprintf(name, MAX_STR, "lockstep/%s", laneIsaName(isas[i]));
+        if (resolveLaneIsa(isas[i]) != isas[i] || !selected(options, name)) continue;
+        BatchStats stats;
+        long games = 64;
+        double seconds;
+        for (;;) {
+            double start = nowSeconds();
+            runLockstepBatch(layout, options->seed, NUM_HUNTERS, games, jobs, 0, isas[i], NULL, &stats);
+            seconds = nowSeconds() - start;
+            cleanupBatchStats(&stats);
+            if (seconds >= options->minTime) break;
+            games *= seconds > options->minTime / 16 ? 2 : 8;
+        }
+        addResult(name, house, jobs, "game", games, seconds);
+    }
+
+    if (selected(options, "turns")) {
+        SimConfig config = { layout, options->seed, NUM_HUNTERS, NULL, { C_FALSE, STDOUT_FILENO }, NULL, NULL };
+        SimContext* sim = simCreate(&config);
+        long turns = 0;
+        long game = 0;
+        double start = nowSeconds();
+        double seconds;
+        do {
+            simReset(sim, rngDerive(options->seed, game++));
+            while (simStep(sim)) turns++;
+            seconds = nowSeconds() - start;
+        } while (seconds < options->minTime);
+        simDestroy(sim);
+        addResult("turns", house, 1, "turn", turns, seconds);
+    }
+}
+
+/*
+    Writes a string as a JSON string literal.
+*/
+static void putJsonString(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') fputc('\\', out);
+        if ((unsigned char) *str >= 0x20) fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void writeJson(FILE* out, const BenchOptions* options, int cores) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(out, "  \"cores\": %d,\n", cores);
+    fprintf(out, "  \"seed\": %llu,\n", (unsigned long long) options->seed);
+    fprintf(out, "  \"min_time\": %g,\n", options->minTime);
+    fprintf(out, "  \"timestamp\": %ld,\n", (long) time(NULL));
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < numResults; i++) {
+        const BenchResult* result = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"house\": ", result->name);
+        putJsonString(out, result->house);
+        fprintf(out, ", \"threads\": %d, \"unit\": \"%s\", \"ops\": %ld, "
+                     "\"seconds\": %.6f, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f}%s\n",
+                result->threads, result->unit, result->ops, result->seconds,
+                result->seconds * 1e9 * result->threads / result->ops, result->ops / result->seconds,
+                i + 1 < numResults ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void writeCsv(FILE* out) {
+    fprintf(out, "name,house,threads,unit,ops,seconds,ns_per_op,ops_per_sec\n");
+    for (int i = 0; i < numResults; i++) {
+        const BenchResult* result = &results[i];
+        fprintf(out, "%s,%s,%d,%s,%ld,%.6f,%.3f,%.1f\n", result->name, result->house, result->threads, result->unit,
+                result->ops, result->seconds, result->seconds * 1e9 * result->threads / result->ops,
+                result->ops / result->seconds);
+    }
+}
+
+/*
+    Splits a comma-separated list of room counts into the options.
+*/
+static int parseRooms(BenchOptions* options, char* list) {
+    options->numGenerated = 0;
+    for (char* part = strtok(list, ","); part != NULL; part = strtok(NULL, ",")) {
+        long rooms = atol(part);
+        if (rooms < 2 || rooms > 10000000 || options->numGenerated == BENCH_MAX_HOUSES) return C_FALSE;
+        options->generatedRooms[options->numGenerated++] = rooms;
+    }
+    return C_TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    BenchOptions options = { BENCH_JSON, NULL, NULL, cores > 4 ? cores : 4, 0.25, 42, NULL, 2, { 1000, 100000 } };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "json") == 0) {
+                options.format = BENCH_JSON;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                options.format = BENCH_CSV;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.maxThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            options.minTime = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            options.map = argv[++i];
+        } else if (strcmp(argv[i], "--rooms") == 0 && i + 1 < argc) {
+            if (!parseRooms(&options, argv[++i])) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.maxThreads < 1 || options.minTime <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (options.output != NULL && (out = fopen(options.output, "w")) == NULL) {
+        perror(options.output);
+        return 1;
+    }
+
+    HouseLayout layout;
+    if (options.map != NULL) {
+        if (!loadLayout(options.map, &layout)) return 1;
+    } else {
+        populateRooms(&layout);
+    }
+
+    // A silent house for the evidence benchmarks
+    Arena* arena = arenaCreate(layout.numRooms * (sizeof(Room) + sizeof(pthread_mutex_t))
+                               + EV_COUNT * EVIDENCE_INDEX_WORDS(layout.numRooms) * sizeof(atomic_ullong) + 64);
+    HouseType house;
+    initHouse(&house, &layout, options.seed, arena);
+    house.log.enabled = C_FALSE;
+
+    BenchShared shared;
+    memset(&shared, 0, sizeof(shared));
+    shared.layout = &layout;
+    shared.house = &house;
+
+    shared.op = opRandInt;
+    runMicro(&options, "randInt", &shared, 1, C_FALSE);
+    shared.op = opRandFloat;
+    runMicro(&options, "randFloat", &shared, 1, C_FALSE);
+    shared.op = opRngRange;
+    runMicro(&options, "rngRange", &shared, 1, C_FALSE);
+    shared.op = opConnectedRoom;
+    runMicro(&options, "getRandomConnectedRoom", &shared, 1, C_FALSE);
+    shared.op = opAddEvidence;
+    runMicro(&options, "addEvidenceToRoom+take", &shared, 1, C_FALSE);
+    makeHouseThreaded(&house);
+    runMicro(&options, "addEvidenceToRoom+take/locked", &shared, 1, C_FALSE);
+
+    // One room in 64 holds each kind of evidence, for the index scan
+    for (int r = 0; r < house.numRooms; r += 64) addEvidenceToRoom(&house, r, (enum EvidenceType) ((r / 64) & 3));
+    shared.op = opFindEvidence;
+    runMicro(&options, "nextEvidenceRoom", &shared, 1, C_FALSE);
+
+    shared.op = opCollectEvidence;
+    runMicro(&options, "collectEvidence", &shared, options.maxThreads, C_FALSE);
+    shared.op = opReviewEvidence;
+    runMicro(&options, "reviewEvidence", &shared, options.maxThreads, C_FALSE);
+    shared.op = opCollectReview;
+    runMicro(&options, "collectEvidence+reviewEvidence", &shared, options.maxThreads, C_FALSE);
+
+    shared.log.enabled = C_TRUE;
+    shared.log.fd = open("/dev/null", O_WRONLY);
+    if (shared.log.fd < 0) {
+        perror("/dev/null");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(loggerOps) / sizeof(loggerOps[0]); i++) {
+        char name[MAX_STR];
+        shared.op = loggerOps[i].op;
+        snprintf(name, MAX_STR, "%s/direct", loggerOps[i].name);
+        runMicro(&options, name, &shared, 1, C_FALSE);
+        snprintf(name, MAX_STR, "%s/async", loggerOps[i].name);
+        runMicro(&options, name, &shared, 1, C_TRUE);
+    }
+    close(shared.log.fd);
+    cleanupHouse(&house);
+    arenaDestroy(arena);
+
+    runEndToEnd(&options, &layout, options.map != NULL ? options.map : "default", cores);
+    for (int i = 0; i < options.numGenerated; i++) {
+        HouseLayout generated;
+        char name[MAX_STR];
+        generateLayout(&generated, options.generatedRooms[i], options.seed);
+        snprintf(name, MAX_STR, "generated-%u", options.generatedRooms[i]);
+        runEndToEnd(&options, &generated, name, cores);
+        cleanupLayout(&generated);
+    }
+    cleanupLayout(&layout);
+
+    if (options.format == BENCH_JSON) {
+        writeJson(out, &options, cores);
+    } else {
+        writeCsv(out);
+    }
+    if (out != stdout) fclose(out);
+    return 0;
+}
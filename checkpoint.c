@@ -0,0 +1,432 @@
+// checkpoint.c
+#include "defs.h"
+
+/*
+    A snapshot is the complete dynamic state of a game in simulated time, laid out as:
+
+        SnapshotHeader
+        SnapshotRoom[numEvidence]       every piece of evidence in the rooms, oldest first in each room
+        SnapshotHunter[numHunters]
+        SnapshotGhost
+        Event[numEvents]                the pending turns, in heap order
+        names                           numHunters names, each a length byte and the characters
+
+    Room occupancy is not stored: it follows from where the hunters and the ghost are. The
+    layout itself is not stored either, only a hash of it, so a snapshot can only be restored
+    over the layout it was taken in.
+*/
+
+#define SNAPSHOT_MAGIC      "GHSNAP\0\0"
+#define SNAPSHOT_VERSION    4
+
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numRooms;
+    uint64_t layoutHash;
+    uint32_t numHunters;
+    uint32_t numEvidence;
+    uint32_t numEvents;
+    uint32_t started;
+    uint64_t seed;
+    int64_t now;
+    int64_t seq;
+    Rng rng;
+    uint32_t collected;
+    int32_t contributor[EV_COUNT];
+    uint32_t lead[EV_COUNT];
+    uint32_t sighting;
+    uint32_t evidenceSlots;
+    int32_t fearMax;
+    int32_t boredomMax;
+    uint32_t unused;
+    int64_t hunterWait;
+    int64_t ghostWait;
+} SnapshotHeader;
+
+typedef struct SnapshotRoom {
+    uint32_t room;
+    uint32_t evidence;
+} SnapshotRoom;
+
+typedef struct SnapshotHunter {
+    Rng rng;
+    uint32_t room;
+    int32_t fear;
+    int32_t boredom;
+    int32_t exitReason;
+} SnapshotHunter;
+
+typedef struct SnapshotGhost {
+    Rng rng;
+    uint32_t room;
+    int32_t boredom;
+    int32_t type;
+    uint32_t unused;
+} SnapshotGhost;
+
+/*
+    Returns an FNV-1a hash of a layout's topology, computed once per context.
+*/
+static uint64_t layoutHash(SimContext* sim) {
+    if (sim->layoutHash == 0) {
+        const HouseLayout* layout = sim->house.layout;
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char* parts[2] = { (const unsigned char*) layout->adjStart, (const unsigned char*) layout->adj };
+        size_t sizes[2] = { (layout->numRooms + 1) * sizeof(uint32_t), layout->numAdj * sizeof(RoomId) };
+        for (int p = 0; p < 2; p++) {
+            for (size_t i = 0; i < sizes[p]; i++) {
+                hash ^= parts[p][i];
+                hash *= 1099511628211ull;
+            }
+        }
+        sim->layoutHash = hash | 1;
+    }
+    return sim->layoutHash;
+}
+
+/*
+    Returns the first room from a given one on that holds any evidence, from the evidence index.
+*/
+static RoomId nextRoomWithEvidence(const HouseType* house, RoomId from) {
+    RoomId next = NO_ROOM;
+    for (int e = 0; e < EV_COUNT; e++) {
+        RoomId room = nextEvidenceRoom(house, (enum EvidenceType) e, from);
+        if (room < next) next = room;
+    }
+    return next;
+}
+
+/*
+  Function: simCheckpoint(SimContext* sim, SimSnapshot* snapshot)
+  Purpose: Captures the complete state of a game played with simStep.
+
+  Parameters:
+    in sim: the game; it must not be running on threads.
+    out snapshot: the captured state, freed with freeSnapshot.
+
+  Description:
+    Captures the rules, room evidence and how much of it a room holds, the evidence board, every entity's position, fear, boredom and random stream, and the pending turns, so that the game continues exactly as it would have.
+
+  return
+    none
+*/
+void simCheckpoint(SimContext* sim, SimSnapshot* snapshot) {
+    const HouseType* house = &sim->house;
+
+    uint32_t numEvidence = 0;
+    for (RoomId r = nextRoomWithEvidence(house, 0); r != NO_ROOM; r = nextRoomWithEvidence(house, r + 1)) {
+        numEvidence += house->rooms[r].numEvidence;
+    }
+    size_t namesSize = 0;
+    for (int i = 0; i < house->numHunters; i++) {
+        namesSize += 1 + strlen(house->hunters[i].name);
+    }
+    snapshot->size = sizeof(SnapshotHeader) + numEvidence * sizeof(SnapshotRoom)
+                   + house->numHunters * sizeof(SnapshotHunter) + sizeof(SnapshotGhost)
+                   + sim->sched.size * sizeof(Event) + namesSize;
+    snapshot->data = malloc(snapshot->size);
+    if (snapshot->data == NULL) {
+        perror("Error creating snapshot");
+        exit(EXIT_FAILURE);
+    }
+    unsigned char* out = snapshot->data;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.numRooms = house->numRooms;
+    header.layoutHash = layoutHash(sim);
+    header.numHunters = house->numHunters;
+    header.numEvidence = numEvidence;
+    header.numEvents = sim->sched.size;
+    header.started = sim->started;
+    header.seed = house->seed;
+    header.now = sim->sched.now;
+    header.seq = sim->sched.seq;
+    header.rng = house->rng;
+    header.collected = atomic_load(&((HouseType*) house)->evidence.collected);
+    for (int i = 0; i < EV_COUNT; i++) {
+        header.contributor[i] = atomic_load(&((HouseType*) house)->evidence.contributor[i]);
+        header.lead[i] = atomic_load(&((HouseType*) house)->evidence.lead[i]);
+    }
+    header.sighting = atomic_load(&((HouseType*) house)->evidence.sighting);
+    header.evidenceSlots = house->evidenceSlots;
+    header.fearMax = house->rules.fearMax;
+    header.boredomMax = house->rules.boredomMax;
+    header.hunterWait = house->rules.hunterWait;
+    header.ghostWait = house->rules.ghostWait;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    for (RoomId r = nextRoomWithEvidence(house, 0); r != NO_ROOM; r = nextRoomWithEvidence(house, r + 1)) {
+        for (int i = 0; i < house->rooms[r].numEvidence; i++) {
+            SnapshotRoom room = { r, house->rooms[r].evidence[i] };
+            memcpy(out, &room, sizeof(room));
+            out += sizeof(room);
+        }
+    }
+
+    for (int i = 0; i < house->numHunters; i++) {
+        const Hunter* h = &house->hunters[i];
+        SnapshotHunter hunter = { h->rng, h->currentRoom, h->fear, h->boredom, h->exitReason };
+        memcpy(out, &hunter, sizeof(hunter));
+        out += sizeof(hunter);
+    }
+
+    SnapshotGhost ghost = { sim->ghost.rng, sim->ghost.currentRoom, sim->ghost.boredom, sim->ghost.type, 0 };
+    memcpy(out, &ghost, sizeof(ghost));
+    out += sizeof(ghost);
+
+    memcpy(out, sim->sched.heap, sim->sched.size * sizeof(Event));
+    out += sim->sched.size * sizeof(Event);
+
+    for (int i = 0; i < house->numHunters; i++) {
+        size_t length = strlen(house->hunters[i].name);
+        *out++ = (unsigned char) length;
+        memcpy(out, house->hunters[i].name, length);
+        out += length;
+    }
+}
+
+/*
+    Checks that a snapshot is well formed and returns its header, or NULL.
+*/
+static const SnapshotHeader* snapshotHeader(const SimSnapshot* snapshot) {
+    if (snapshot->size < sizeof(SnapshotHeader)) return NULL;
+    const SnapshotHeader* header = (const SnapshotHeader*) snapshot->data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION) {
+        return NULL;
+    }
+    if (header->numHunters < 1 || header->numHunters > OCC_MAX_HUNTERS || header->numRooms < 1 ||
+        header->evidenceSlots < 1 || header->evidenceSlots > ROOM_EVIDENCE_SLOTS ||
+        header->fearMax < 1 || header->boredomMax < 1 || header->hunterWait < 1 || header->ghostWait < 1 ||
+        header->numEvidence > (uint64_t) header->numRooms * header->evidenceSlots || header->numEvents > header->numHunters + 1) {
+        return NULL;
+    }
+    size_t fixed = sizeof(SnapshotHeader) + header->numEvidence * sizeof(SnapshotRoom)
+                 + header->numHunters * sizeof(SnapshotHunter) + sizeof(SnapshotGhost)
+                 + header->numEvents * sizeof(Event);
+    if (snapshot->size < fixed + header->numHunters) return NULL;
+    return header;
+}
+
+/*
+  Function: simRestore(SimContext* sim, const SimSnapshot* snapshot)
+  Purpose: Puts a context back into the state captured by simCheckpoint.
+
+  Parameters:
+    in/out sim: a context over the snapshot's layout with the same number of hunters, e.g. from simCreateFromSnapshot.
+    in snapshot: the state to restore.
+
+  Description:
+    Costs about as much as simReset: the rooms are copied back from the template, then the evidence, the entities and their room occupancy, and the pending turns are put back. Nothing is allocated, so many continuations can be restored one after another in the same context.
+
+  return
+    C_TRUE on success, C_FALSE if the snapshot is damaged or was taken in a different house or with different hunters
+*/
+int simRestore(SimContext* sim, const SimSnapshot* snapshot) {
+    HouseType* house = &sim->house;
+    const SnapshotHeader* header = snapshotHeader(snapshot);
+    if (header == NULL || header->numRooms != (uint32_t) house->numRooms || header->numHunters != (uint32_t) house->numHunters ||
+        header->layoutHash != layoutHash(sim)) {
+        return C_FALSE;
+    }
+    const unsigned char* in = snapshot->data + sizeof(SnapshotHeader);
+
+    // Empty rooms first; the template has every hunter in the Van, so take them out again
+    memcpy(house->rooms, sim->templateRooms, house->numRooms * sizeof(Room));
+    memcpy(sim->hunters, sim->templateHunters, house->numHunters * sizeof(Hunter));
+    clearEvidenceIndex(house);
+    for (int i = 0; i < house->numHunters; i++) {
+        moveHunter(house, i, sim->hunters[i].currentRoom, NO_ROOM);
+    }
+
+    house->evidenceSlots = header->evidenceSlots;
+    house->rules.fearMax = header->fearMax;
+    house->rules.boredomMax = header->boredomMax;
+    house->rules.hunterWait = header->hunterWait;
+    house->rules.ghostWait = header->ghostWait;
+    for (uint32_t i = 0; i < header->numEvidence; i++) {
+        SnapshotRoom room;
+        memcpy(&room, in, sizeof(room));
+        in += sizeof(room);
+        if (room.room < header->numRooms && room.evidence < EV_COUNT) storeEvidence(house, room.room, room.evidence);
+    }
+
+    for (int i = 0; i < house->numHunters; i++) {
+        SnapshotHunter saved;
+        memcpy(&saved, in, sizeof(saved));
+        in += sizeof(saved);
+        Hunter* hunter = &sim->hunters[i];
+        hunter->rng = saved.rng;
+        hunter->currentRoom = saved.room < header->numRooms ? saved.room : NO_ROOM;
+        hunter->fear = saved.fear;
+        hunter->boredom = saved.boredom;
+        hunter->exitReason = saved.exitReason;
+        moveHunter(house, i, NO_ROOM, hunter->currentRoom);
+    }
+
+    SnapshotGhost ghost;
+    memcpy(&ghost, in, sizeof(ghost));
+    in += sizeof(ghost);
+    sim->ghost.type = ghost.type;
+    sim->ghost.boredom = ghost.boredom;
+    sim->ghost.rng = ghost.rng;
+    sim->ghost.currentRoom = ghost.room < header->numRooms ? ghost.room : NO_ROOM;
+    moveGhost(house, NO_ROOM, sim->ghost.currentRoom);
+
+    atomic_store(&house->evidence.collected, header->collected);
+    for (int i = 0; i < EV_COUNT; i++) {
+        atomic_store(&house->evidence.contributor[i], header->contributor[i]);
+        atomic_store(&house->evidence.lead[i], header->lead[i] < header->numRooms ? header->lead[i] : NO_ROOM);
+    }
+    atomic_store(&house->evidence.sighting, header->sighting < header->numRooms ? header->sighting : NO_ROOM);
+    house->seed = header->seed;
+    house->rng = header->rng;
+    house->now = header->now;
+
+    resetScheduler(&sim->sched);
+    memcpy(sim->sched.heap, in, header->numEvents * sizeof(Event));
+    for (uint32_t i = 0; i < header->numEvents; i++) {
+        const Event* event = &sim->sched.heap[i];
+        if (event->kind != EVENT_GHOST && (event->kind != EVENT_HUNTER || event->entity < 0 || event->entity >= house->numHunters)) {
+            return C_FALSE;
+        }
+    }
+    sim->sched.size = header->numEvents;
+    sim->sched.now = header->now;
+    sim->sched.seq = header->seq;
+    sim->started = header->started;
+    sim->resets++;
+    return C_TRUE;
+}
+
+/*
+  Function: simCreateFromSnapshot(const HouseLayout* layout, const SimSnapshot* snapshot, LogSink log, TraceBuffer* trace)
+  Purpose: Creates a context with the snapshot's hunters and restores the snapshot into it.
+
+  return
+    the new context, or NULL if the snapshot does not belong to this layout
+*/
+SimContext* simCreateFromSnapshot(const HouseLayout* layout, const SimSnapshot* snapshot, LogSink log, TraceBuffer* trace) {
+    const SnapshotHeader* header = snapshotHeader(snapshot);
+    if (header == NULL || header->numRooms != layout->numRooms) return NULL;
+
+    // The names are the last part of the snapshot
+    int numHunters = header->numHunters;
+    char (*names)[MAX_STR] = malloc(numHunters * sizeof(*names));
+    const char** pointers = malloc(numHunters * sizeof(char*));
+    if (names == NULL || pointers == NULL) {
+        perror("Error restoring snapshot");
+        exit(EXIT_FAILURE);
+    }
+    const unsigned char* in = snapshot->data + sizeof(SnapshotHeader) + header->numEvidence * sizeof(SnapshotRoom)
+                            + numHunters * sizeof(SnapshotHunter) + sizeof(SnapshotGhost) + header->numEvents * sizeof(Event);
+    const unsigned char* end = snapshot->data + snapshot->size;
+    for (int i = 0; i < numHunters; i++) {
+        size_t length = in < end ? *in++ : 0;
+        if (length > (size_t) (end - in)) length = end - in;
+        if (length > MAX_STR - 1) length = MAX_STR - 1;
+        memcpy(names[i], in, length);
+        names[i][length] = '\0';
+        in += length;
+        pointers[i] = names[i];
+    }
+
+    SimConfig config = { layout, header->seed, numHunters, pointers, log, trace, NULL };
+    SimContext* sim = simCreate(&config);
+    free(pointers);
+    free(names);
+
+    if (!simRestore(sim, snapshot)) {
+        simDestroy(sim);
+        return NULL;
+    }
+    sim->resets = 0;
+    return sim;
+}
+
+/*
+  Function: simBranch(SimContext* sim, uint64_t key)
+  Purpose: Gives every random stream of a game a new key, so a restored game takes a different continuation.
+
+  Parameters:
+    in/out sim: the game, e.g. just restored from a snapshot.
+    in key: the continuation's stream key; the same key always gives the same continuation.
+
+  return
+    none
+*/
+void simBranch(SimContext* sim, uint64_t key) {
+    HouseType* house = &sim->house;
+    house->seed = key;
+    rngSeed(&house->rng, key);
+    for (int i = 0; i < house->numHunters; i++) {
+        rngSeed(&sim->hunters[i].rng, rngDerive(key, i));
+    }
+    rngSeed(&sim->ghost.rng, rngDerive(key, TRACE_GHOST));
+}
+
+/*
+  Function: freeSnapshot(SimSnapshot* snapshot)
+  Purpose: Frees the memory of a snapshot.
+*/
+void freeSnapshot(SimSnapshot* snapshot) {
+    free(snapshot->data);
+    snapshot->data = NULL;
+    snapshot->size = 0;
+}
+
+/*
+  Function: saveSnapshot(const SimSnapshot* snapshot, const char* path)
+  Purpose: Writes a snapshot to a file.
+
+  return
+    C_TRUE on success, C_FALSE (after printing why) on failure
+*/
+int saveSnapshot(const SimSnapshot* snapshot, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return C_FALSE;
+    }
+    int ok = fwrite(snapshot->data, 1, snapshot->size, file) == snapshot->size;
+    if (fclose(file) != 0) ok = C_FALSE;
+    if (!ok) fprintf(stderr, "%s: could not write snapshot\n", path);
+    return ok;
+}
+
+/*
+  Function: loadSnapshot(SimSnapshot* snapshot, const char* path)
+  Purpose: Reads a snapshot written by saveSnapshot.
+
+  return
+    C_TRUE on success, C_FALSE (after printing why) if the file cannot be read or is not a snapshot
+*/
+int loadSnapshot(SimSnapshot* snapshot, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return C_FALSE;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    snapshot->data = size > 0 ? malloc(size) : NULL;
+    snapshot->size = size > 0 ? (size_t) size : 0;
+    if (snapshot->data == NULL || fread(snapshot->data, 1, snapshot->size, file) != snapshot->size) {
+        fprintf(stderr, "%s: could not read snapshot\n", path);
+        fclose(file);
+        freeSnapshot(snapshot);
+        return C_FALSE;
+    }
+    fclose(file);
+    if (snapshotHeader(snapshot) == NULL) {
+        fprintf(stderr, "%s: not a game snapshot\n", path);
+        freeSnapshot(snapshot);
+        return C_FALSE;
+    }
+    return C_TRUE;
+}
@@ -5,9 +5,10 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 
-#define MAX_CONNECTED_ROOMS 5
 #define MAX_COLLECTED_EVIDENCE 3
 #define MAX_STR         64
 #define MAX_RUNS        50
@@ -26,6 +27,23 @@ typedef enum GhostClass GhostClass;
 enum EvidenceType { EMF, TEMPERATURE, FINGERPRINTS, SOUND, EV_COUNT, EV_UNKNOWN };
 enum GhostClass { POLTERGEIST, BANSHEE, BULLIES, PHANTOM, GHOST_COUNT, GH_UNKNOWN };
 enum LoggerDetails { LOG_FEAR, LOG_BORED, LOG_EVIDENCE, LOG_SUFFICIENT, LOG_INSUFFICIENT, LOG_UNKNOWN };
+enum LogPolicy { LOG_BLOCK, LOG_DROP };  // what the asynchronous logger does when a thread's buffer is full
+
+// Where one game's log lines go, see logger.c
+typedef struct LogSink {
+    int enabled;                // C_FALSE silences the game, as in batch mode
+    int fd;                     // file descriptor the lines are written to, STDOUT_FILENO by default
+} LogSink;
+
+// Thresholds and pacing of a game; every engine plays defaultRules, simulations can be given others
+typedef struct GameRules {
+    int fearMax;                // a hunter leaves once this afraid, FEAR_MAX by default
+    int boredomMax;             // hunters and the ghost leave once this bored, BOREDOM_MAX by default
+    long hunterWait;            // milliseconds between a hunter's turns, HUNTER_WAIT by default
+    long ghostWait;             // milliseconds between the ghost's turns, GHOST_WAIT by default
+} GameRules;
+
+extern const GameRules defaultRules;
 
 // Forward declaration for Hunter
 typedef struct Hunter Hunter;
@@ -35,79 +53,675 @@ typedef struct Ghost Ghost;
 
 
 //type cast stuff
+typedef uint32_t RoomId;       // index into a house's rooms, 0 is always the Van
+#define NO_ROOM ((RoomId) -1)
+
+// Read-only house topology shared by every game played in it, see layout.c
+typedef struct NavTable NavTable;
+
+typedef struct HouseLayout {
+    uint32_t numRooms;
+    uint32_t numAdj;            // adjacency entries, twice the number of connections
+    const uint32_t* adjStart;   // neighbours of room r are adj[adjStart[r] .. adjStart[r + 1])
+    const RoomId* adj;
+    const uint32_t* nameOffset; // name of room r starts at names + nameOffset[r]
+    const char* names;          // interned, NUL-terminated room names
+    uint32_t namesSize;
+    void* storage;              // single allocation or file mapping backing the arrays
+    size_t mappedSize;          // non-zero when storage is a compiled map mapped with mmap
+    const NavTable* nav;        // navigation tables from buildNavTable, NULL when hunters move at random
+    int evidenceSlots;          // pieces of evidence a room holds at once, 1..ROOM_EVIDENCE_SLOTS
+} HouseLayout;
+
+// Next room and distance between rooms, see nav.c
+#define NAV_MAX_ROOMS   4096        // largest house with a table for every pair of rooms
+#define NAV_FAR         UINT32_MAX  // navDistance when there is no way
+
+struct NavTable {
+    uint32_t numRooms;
+    int allPairs;               // C_TRUE: hop and dist for every pair; C_FALSE: routes along a spanning tree
+    uint16_t* hop;              // all pairs, [to * numRooms + from]: next room on a shortest route
+    uint16_t* dist;             // all pairs, [to * numRooms + from]: moves on that route, UINT16_MAX if none
+    RoomId* up;                 // tree: parent, NO_ROOM for a root
+    RoomId* root;               // tree: the root of the room's part of the house
+    uint32_t* depth;            // tree
+    uint32_t* pre;              // tree: preorder number
+    uint32_t* last;             // tree: the highest preorder number in the room's subtree
+    uint32_t* childStart;       // tree: children of r, in preorder, at child[childStart[r] .. childStart[r + 1])
+    RoomId* child;
+};
+
+// Growable scratch state used to put a layout together
+typedef struct HouseBuilder {
+    char* names;
+    uint32_t namesSize, namesCapacity;
+    uint32_t* nameOffset;
+    uint32_t numRooms, roomsCapacity;
+    RoomId* edges;              // pairs of connected rooms
+    uint32_t numEdges, edgesCapacity;
+    uint32_t* hash;             // open-addressing name -> room id table
+    uint32_t hashCapacity;
+} HouseBuilder;
+
+// xoshiro256** generator, see utils.c
+typedef struct Rng {
+    uint64_t s[4];
+} Rng;
+
+// Binary event trace, see trace.c
+#define TRACE_MAGIC     "GHTRACE\0"
+#define TRACE_VERSION   1
+#define TRACE_GHOST     0xffff      // entity id used for the ghost
+
+enum TraceType {
+    TRACE_GAME_START,       // detail: ghost class, entity: hunter count, time: game number
+    TRACE_GAME_END,
+    TRACE_HUNTER_NAME,      // room: name length, followed by the name in raw 16-byte blocks
+    TRACE_HUNTER_INIT,      // detail: equipment
+    TRACE_HUNTER_MOVE,
+    TRACE_HUNTER_REVIEW,    // detail: LOG_SUFFICIENT or LOG_INSUFFICIENT
+    TRACE_HUNTER_COLLECT,   // detail: evidence
+    TRACE_HUNTER_EXIT,      // detail: LoggerDetails reason
+    TRACE_GHOST_INIT,       // detail: ghost class
+    TRACE_GHOST_MOVE,
+    TRACE_GHOST_EVIDENCE,   // detail: evidence
+    TRACE_GHOST_EXIT,       // detail: LoggerDetails reason
+    TRACE_TYPE_COUNT
+};
+
+typedef struct TraceRecord {
+    uint64_t time;          // simulated milliseconds since the game started
+    uint32_t room;          // RoomId, or NO_ROOM
+    uint16_t entity;        // hunter id, or TRACE_GHOST
+    uint8_t type;           // enum TraceType
+    uint8_t detail;
+} TraceRecord;
+
+typedef struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numRooms;      // followed by numRooms name offsets and namesSize bytes of names,
+    uint32_t namesSize;     // padded to a multiple of 16 bytes
+    uint32_t unused;
+} TraceFileHeader;
+
+typedef struct TraceFile {
+    FILE* file;
+    pthread_mutex_t lock;
+    atomic_long nextGame;
+} TraceFile;
+
+// Records of the games played on one thread, written to the file between games
+typedef struct TraceBuffer {
+    TraceFile* trace;
+    TraceRecord* records;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;       // only taken by the threaded engine
+    struct timespec started;
+} TraceBuffer;
+
+// Evidence the hunters have collected between them, updated without locks
+typedef struct EvidenceBoard {
+    atomic_uint collected;                  // bit e is set once evidence e has been collected
+    atomic_int contributor[EV_COUNT];       // id of the hunter who found each piece, -1 if none
+    atomic_uint lead[EV_COUNT];             // navigating hunters: where evidence e was last seen, NO_ROOM if nowhere
+    atomic_uint sighting;                   // navigating hunters: where the ghost was last seen, NO_ROOM if nowhere
+} EvidenceBoard;
+
+// Room occupancy word: who is in a room, readable with a single atomic load.
+// Hunters 0..OCC_MASK_HUNTERS-1 also own a presence bit; every hunter adds OCC_ONE_HUNTER.
+#define OCC_MASK_HUNTERS    16
+#define OCC_HUNTER_MASK     0x0000ffffu
+#define OCC_ONE_HUNTER      0x00010000u
+#define OCC_COUNT_MASK      0x7fff0000u
+#define OCC_GHOST           0x80000000u
+#define OCC_MAX_HUNTERS     (int) (OCC_COUNT_MASK / OCC_ONE_HUNTER)
+#define OCC_HUNTER_COUNT(occ) (((occ) & OCC_COUNT_MASK) / OCC_ONE_HUNTER)
+
+// Most pieces of evidence a room can hold; the ghost's evidence is dropped while its room is full
+#define ROOM_EVIDENCE_SLOTS 3
+
+// Hot per-game state of one room, 8 rooms to a cache line
 typedef struct Room {
-    char name[MAX_STR];
-    pthread_mutex_t roomMutex;
-    int numConnectedRooms;
-    struct Room** connectedRooms;
-    enum EvidenceType evidenceType;
-    // Add any other room-related information if needed
-    Hunter* hunters[NUM_HUNTERS];
-    Ghost* ghost;
-    struct Room* nextRoom;  // Add this line to include the nextRoom field
+    atomic_uint occupancy;                          // OCC_* bits, updated atomically on every move
+    unsigned char numEvidence;                      // pieces held, at most the layout's evidenceSlots
+    unsigned char evidence[ROOM_EVIDENCE_SLOTS];    // enum EvidenceType, oldest first
 } Room;
 
+// Event counter of one room, with --wake events: bumped when the ghost enters or leaves evidence, and
+// waited on with a futex by the hunters in the room
+typedef struct RoomSignal {
+    atomic_uint seq;
+#ifdef INSTRUMENT
+    atomic_ullong at;               // instNow() of the last event, for the reaction histogram
+#endif
+} RoomSignal;
+
+// Words in each bitset of the house-wide evidence index
+#define EVIDENCE_INDEX_WORDS(numRooms) (((numRooms) + 63) / 64)
+
+// Allocator statistics of an arena, see arena.c
+typedef struct ArenaStats {
+    size_t reserved;            // bytes obtained from malloc, including the header
+    size_t used;                // bytes handed out
+    long allocations;
+    long blocks;                // mallocs made, 1 if the first block was big enough
+} ArenaStats;
+
+// Bump allocator freed all at once
+typedef struct Arena {
+    char* base;                 // the first block, right after this header
+    size_t size;
+    size_t used;
+    struct ArenaBlock* more;    // further blocks, only if the first one ran out
+    ArenaStats stats;
+} Arena;
+
 typedef struct HouseType {
-    Room* rooms;
+    const HouseLayout* layout;  // topology, shared and never modified
+    Arena* arena;               // where the rooms and room locks are allocated
+    Room* rooms;                // indexed by RoomId
+    pthread_mutex_t* roomLocks; // cold, guard room evidence; only allocated for the threaded engine
     int numRooms;
+    int evidenceSlots;          // from the layout, or from the snapshot a game was restored from
+    atomic_ullong* evidenceIndex;   // EV_COUNT bitsets over rooms: bit r of set e while room r holds evidence e
+    Hunter* hunters;            // the hunters taking part in this hunt
+    int numHunters;
+    EvidenceBoard evidence;     // shared by all hunters
+    int threaded;               // C_TRUE when entities run on their own threads and need the locks
+    GameRules rules;            // defaultRules unless the simulation was given others
+    RoomSignal* roomSignals;    // per-room events hunter threads wait on, NULL when they only sleep between turns
+    long now;                   // simulated milliseconds, kept up to date by the virtual-time engine
+    uint64_t seed;              // stream key of this game; entities derive their own streams from it
+    Rng rng;                    // the game's own draws, e.g. where the ghost starts
+    TraceBuffer* trace;         // where events are recorded, NULL when not tracing
+    LogSink log;                // where events are logged
 } HouseType;
 
 typedef struct Hunter {
     char name[MAX_STR];
     enum EvidenceType equipment;
-    Room* currentRoom;
+    RoomId currentRoom;         // NO_ROOM once the hunter has left
+    HouseType* house;
     int fear;
     int boredom;
+    enum LoggerDetails exitReason;  // LOG_UNKNOWN while still hunting
+    Rng rng;
     pthread_t thread;
     int id;  // Add this line to include the id field
+    int turns;                  // turns taken, only counted when built with INSTRUMENT
 } Hunter;
 
 typedef struct Ghost {
     enum GhostClass type;
-    Room* currentRoom;
+    RoomId currentRoom;
+    HouseType* house;
     int boredom; // Add this line to include the boredom field
+    Rng rng;
     pthread_t thread;
+    int turns;                  // turns taken, only counted when built with INSTRUMENT
 } Ghost;
 
+// Outcome of one complete game, filled in by simResult()
+typedef struct GameResult {
+    enum GhostClass ghostType;
+    enum GhostClass identifiedType;     // GH_UNKNOWN if fewer than 3 pieces were collected
+    int ghostWon;                       // C_TRUE if no hunter left with enough evidence
+    int exitFear;
+    int exitBored;
+    int exitEvidence;
+    long ticks;                         // simulated milliseconds until every entity left
+} GameResult;
+
+// Virtual-time event scheduler, see sched.c
+typedef enum EventKind { EVENT_HUNTER, EVENT_GHOST } EventKind;
+
+typedef struct Event {
+    long time;              // simulated milliseconds
+    long seq;               // insertion order, breaks ties between events at the same time
+    EventKind kind;
+    int entity;             // hunter index for EVENT_HUNTER
+} Event;
+
+typedef struct Scheduler {
+    Event* heap;            // binary min-heap ordered by (time, seq)
+    int size;
+    int capacity;
+    int owned;              // C_TRUE if heap was malloc'd by the scheduler, C_FALSE if supplied by the caller
+    long now;
+    long seq;
+} Scheduler;
+
+// How to set up a simulation, see simCreate
+typedef struct SimConfig {
+    const HouseLayout* layout;          // must outlive the simulation
+    uint64_t seed;                      // the game's stream key, see rngDerive
+    int numHunters;                     // at most OCC_MAX_HUNTERS
+    const char* const* names;           // numHunters hunter names, or NULL for "Hunter 1", "Hunter 2", ...
+    LogSink log;
+    TraceBuffer* trace;                 // NULL when not tracing
+    const GameRules* rules;             // NULL for defaultRules
+} SimConfig;
+
+// Everything one game owns; games share nothing but the layout, so any number can run side by side.
+// The context and all of its storage come from one arena.
+typedef struct SimContext {
+    Arena* arena;
+    HouseType house;                    // rooms, evidence board, random stream and log sink
+    Hunter* hunters;
+    Ghost ghost;
+    Scheduler sched;                    // pending turns in simulated time
+    int started;                        // C_TRUE once the first turns have been queued
+    Room* templateRooms;                // the rooms and hunters as every game starts: empty rooms,
+    Hunter* templateHunters;            // ... and the named hunters in the Van
+    long resets;                        // games started with simReset or simRestore
+    uint64_t layoutHash;                // identifies the layout in snapshots, 0 until needed
+    GameRules rules;                    // the rules every game in the context starts with
+} SimContext;
+
+// The complete state of a game, see checkpoint.c
+typedef struct SimSnapshot {
+    unsigned char* data;
+    size_t size;
+} SimSnapshot;
 
+// How one batch worker spent the batch
+typedef struct WorkerStats {
+    long games;
+    long steals;                        // times it took half of another worker's games
+    double busy;                        // seconds spent playing games
+} WorkerStats;
 
-extern Hunter hunters[NUM_HUNTERS];
-extern pthread_mutex_t evidenceMutex;
+// Totals over many games, see batch.c
+typedef struct BatchStats {
+    long games;
+    long ghostWins;
+    long identified;                    // games where 3 pieces of evidence were collected
+    long identifiedCorrect;             // ... and they matched Ghost.type
+    long exitFear;
+    long exitBored;
+    long exitEvidence;
+    long ticks;
+    ArenaStats memory;                  // summed over the workers' simulation contexts
+    long resets;                        // games that reused a context instead of allocating
+    WorkerStats* workers;               // one per worker thread, see cleanupBatchStats
+    int numWorkers;
+    double wall;                        // seconds from starting the workers to the last one finishing
+} BatchStats;
 
+// Games played side by side, one per lane, in struct-of-arrays form, see lockstep.c
+#define LOCKSTEP_LANES  256         // default lanes of a block
+#define LOCKSTEP_WIDTH  8           // lanes of the widest kernel; a block's lanes are a multiple of it
+
+// Which kernels update the lanes; LANES_AUTO picks the widest one the CPU supports
+enum LaneIsa { LANES_AUTO, LANES_SCALAR, LANES_SSE4, LANES_AVX2 };
+
+typedef struct LaneKernels LaneKernels;
+
+// Entity e of lane k is at [e * lanes + k] in the per-entity arrays; the ghost is entity numHunters
+typedef struct Lockstep {
+    const HouseLayout* layout;
+    const LaneKernels* kernels;
+    enum LaneIsa isa;                   // the kernels' instruction set
+    Arena* arena;                       // every array below
+    int lanes;
+    int numHunters;
+    long period;                        // simulated ms after which the hunters' and the ghost's turns line up again
+    long now;                           // simulated ms since the block started, a multiple of period between calls
+    uint64_t* rng[4];                   // xoshiro256** state words of every entity
+    int32_t* room;                      // every entity's RoomId
+    int32_t* present;                   // ~0 while the entity is in the house, 0 once it has left
+    int32_t* boredom;                   // every entity
+    int32_t* fear;                      // hunters only
+    int32_t* exitReason;                // hunters only, enum LoggerDetails
+    int32_t* ghostType;                 // per lane from here on
+    uint32_t* collected;                // evidence board, bit e set once evidence e was collected
+    int32_t* busy;                      // C_TRUE from lockstepLoad until lockstepResult takes the result
+    int32_t* fresh;                     // ~0 until the lane's game has taken its first turns
+    long* startedAt;                    // block time the lane's game started
+    long* lastTurn;                     // block time an entity last left the house, the game's last turn once all have
+    unsigned char* evidence;            // evidence left in room r of lane k at [k * numRooms + r]
+    int32_t* active;                    // scratch: the lanes whose ghost takes the turn
+    long games;                         // games loaded
+} Lockstep;
+
+// Exact averages over every way a game can go, see solver.c
+#define SOLVE_STATES    20000000    // default limit on the states the solver explores
+#define SOLVE_STATES_MAX 1000000000 // most --solve-states accepts; the hash table alone then takes 8 GB
+
+typedef struct SolveResult {
+    long states;                        // reachable states
+    long levels;                        // longest game, in turns
+    int threads;
+    double seconds;
+    double ghostWin;                    // probabilities per game
+    double identified;
+    double identifiedCorrect;
+    double exitFear;                    // expected counts per game
+    double exitBored;
+    double exitEvidence;
+    double ticks;                       // expected simulated ms
+} SolveResult;
+
+// Live statistics published to shared memory while games run, see telemetry.c
+#define STATS_MAGIC             "GHSTATS\0"
+#define STATS_VERSION           1
+#define STATS_BOREDOM_BUCKETS   10          // boredom is counted in tenths of BOREDOM_MAX
+
+typedef struct StatsBlock {
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;                           // of the publishing process
+    _Atomic uint32_t seq;                   // seqlock: odd while the publisher is writing
+    uint32_t running;                       // C_FALSE once the publisher has stopped
+    uint64_t gamesPlanned;                  // 0 when unknown
+    uint64_t gamesDone;
+    uint64_t ghostWins;
+    uint64_t identified;                    // games where 3 pieces of evidence were collected
+    uint64_t identifiedCorrect;
+    uint64_t exitFear;
+    uint64_t exitBored;
+    uint64_t exitEvidence;
+    uint64_t evidence[EV_COUNT];            // games in which each kind of evidence was collected
+    uint64_t fear[FEAR_MAX + 1];            // hunters by fear, see telemetryWatch
+    uint64_t boredom[STATS_BOREDOM_BUCKETS + 1];
+    double started;                         // CLOCK_REALTIME seconds
+    double updated;
+    double gamesPerSec;                     // over the last publishing interval, or the whole run once finished
+} StatsBlock;
+
+// Per-game results stored column by column, see results.c
+#define RESULTS_MAGIC           "GHRESULT"
+#define RESULTS_VERSION         1
+#define RESULTS_BLOCK_ROWS      4096        // games in a block; the last block a worker writes may hold fewer
+#define RESULTS_EXIT_HUNTERS    32          // hunters whose exit reasons are also kept one by one
+
+// Columns of a block in the order they are stored, widest first so that every column is aligned
+enum ResultsColumn {
+    RES_SEED,                   // uint64_t: the game's stream key, see simReset
+    RES_EXITS,                  // uint64_t: exit reason + 1 of hunter h in bits 2h and 2h + 1, 0 if none
+    RES_CONFIG,                 // uint32_t: what the game was played with, e.g. the point of a ghost_sweep
+    RES_TICKS,                  // uint32_t: simulated ms until every entity left, at most UINT32_MAX
+    RES_EXIT_FEAR,              // uint16_t: hunters who left afraid
+    RES_EXIT_BORED,             // uint16_t
+    RES_EXIT_EVIDENCE,          // uint16_t
+    RES_GHOST,                  // uint8_t: enum GhostClass
+    RES_IDENTIFIED,             // uint8_t: enum GhostClass, GH_UNKNOWN if fewer than 3 pieces were collected
+    RES_EVIDENCE,               // uint8_t: bit e set if evidence e was collected
+    RES_COLUMN_COUNT
+};
+
+typedef struct ResultsFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockRows;
+    uint64_t numGames;
+    uint64_t numBlocks;
+    uint64_t indexOffset;       // where the offsets of the blocks are, 0 until the file is closed
+} ResultsFileHeader;
+
+// Precedes the columns of every block; queries skip blocks whose bounds rule them out
+typedef struct ResultsBlockHeader {
+    uint32_t rows;
+    uint32_t unused;
+    uint64_t min[RES_COLUMN_COUNT];
+    uint64_t max[RES_COLUMN_COUNT];
+} ResultsBlockHeader;
+
+typedef struct ResultsFile {
+    FILE* file;
+    pthread_mutex_t lock;
+    uint64_t offset;            // where the next block goes
+    uint64_t numGames;
+    uint64_t* blocks;           // offsets of the blocks written so far
+    size_t numBlocks;
+    size_t capacity;
+} ResultsFile;
+
+// The results of the games played on one thread, written to the file a block at a time
+typedef struct ResultsBuffer {
+    ResultsFile* results;
+    uint32_t rows;
+    unsigned char* columns[RES_COLUMN_COUNT];   // RESULTS_BLOCK_ROWS values each
+    void* storage;
+} ResultsBuffer;
+
+// A results file mapped read-only
+typedef struct ResultsView {
+    const unsigned char* data;
+    size_t size;
+    const ResultsFileHeader* header;
+    const uint64_t* blocks;     // header->numBlocks offsets
+} ResultsView;
+
+// Opt-in instrumentation, see instrument.c. Build with make INSTRUMENT=1; otherwise every INST_* macro is empty.
+enum InstCounter {
+    INST_HUNTER_TURNS,
+    INST_GHOST_TURNS,
+    INST_ROOM_LOCKS,                    // room lock acquisitions
+    INST_ROOM_LOCKS_CONTENDED,          // ... that had to wait for another thread
+    INST_EVIDENCE_CLAIMED,              // collectEvidence calls that added new evidence to the board
+    INST_EVIDENCE_LOST,                 // ... that found another hunter had already claimed it
+    INST_SLEEPS,                        // pacing sleeps and task runtime waits
+    INST_WAKEUPS,                       // hunters woken early by the ghost or evidence arriving in their room
+    INST_EVENTS,                        // one counter per enum TraceType follows
+    INST_COUNTER_COUNT = INST_EVENTS + TRACE_TYPE_COUNT
+};
+
+enum InstHistogram {
+    INST_ROOM_LOCK_WAIT,                // nanoseconds waited for a contended room lock
+    INST_HUNTER_TURN,                   // nanoseconds one hunterStep took
+    INST_GHOST_TURN,                    // nanoseconds one ghostStep took
+    INST_OVERSLEEP,                     // nanoseconds a turn started later than it was due
+    INST_HUNTER_LIFETIME,               // turns a hunter took before leaving
+    INST_GHOST_LIFETIME,                // turns a ghost took before leaving
+    INST_REACTION,                      // nanoseconds from an event in a room to a hunter there waking up
+    INST_HISTOGRAM_COUNT
+};
+
+#ifdef INSTRUMENT
+void instStart();
+uint64_t instNow();
+void instCount(enum InstCounter counter);
+void instRecord(enum InstHistogram histogram, uint64_t value);
+void instSlept(uint64_t asleep, long millis);
+void instLate(const struct timespec* origin, long dueMillis);
+void instDump(FILE* out);
+#define INST_START()                instStart()
+#define INST_COUNT(counter)         instCount(counter)
+#define INST_RECORD(histogram, v)   instRecord(histogram, v)
+#define INST_TIME(var)              uint64_t var = instNow()
+#define INST_SINCE(histogram, var)  instRecord(histogram, instNow() - (var))
+#define INST_TURN(entity)           ((entity)->turns++)
+#define INST_SLEPT(var, millis)     instSlept(var, millis)
+#define INST_LATE(origin, due)      instLate(origin, due)
+#define INST_SIGNAL(signal)         atomic_store_explicit(&(signal)->at, instNow(), memory_order_relaxed)
+#define INST_REACTED(signal)        instRecord(INST_REACTION, instNow() - atomic_load_explicit(&(signal)->at, memory_order_relaxed))
+#else
+// Statements that do nothing, so they still work as the body of an if; INST_TIME declares nothing
+#define INST_START()                ((void) 0)
+#define INST_COUNT(counter)         ((void) 0)
+#define INST_RECORD(histogram, v)   ((void) 0)
+#define INST_TIME(var)
+#define INST_SINCE(histogram, var)  ((void) 0)
+#define INST_TURN(entity)           ((void) 0)
+#define INST_SLEPT(var, millis)     ((void) 0)
+#define INST_LATE(origin, due)      ((void) 0)
+#define INST_SIGNAL(signal)         ((void) 0)
+#define INST_REACTED(signal)        ((void) 0)
+#endif
 
 //declarations 
 void* hunterThread(void* arg);
 void* ghostThread(void* arg);
-void addEvidenceToRoom(Room* room, enum EvidenceType evidenceType);
-Room* getRandomConnectedRoom(Room* currentRoom);
-void collectEvidence(enum EvidenceType evidenceType);
-int reviewEvidence();
-
-struct Room* createRoom(const char* name);
-void connectRooms(struct Room* room1, struct Room* room2);
-void addRoom(struct Room** head, struct Room* room);
-void populateRooms(HouseType* house);
-
-void initHouse(HouseType* house);
-enum EvidenceType randomGhostEvidence();
+int hunterStep(Hunter* hunter);
+int ghostStep(Ghost* ghost);
+void initHunter(Hunter* hunter, HouseType* house, const char* name, enum EvidenceType equipment, int id);
+void initGhost(Ghost* ghost, HouseType* house);
+void addEvidenceToRoom(HouseType* house, RoomId room, enum EvidenceType evidenceType);
+enum EvidenceType takeEvidenceFromRoom(HouseType* house, RoomId room, enum EvidenceType equipment);
+unsigned roomEvidenceKinds(const HouseType* house, RoomId room);
+uint32_t countEvidenceRooms(const HouseType* house, enum EvidenceType evidenceType);
+RoomId nextEvidenceRoom(const HouseType* house, enum EvidenceType evidenceType, RoomId from);
+int storeEvidence(HouseType* house, RoomId room, enum EvidenceType evidenceType);
+void clearEvidenceIndex(HouseType* house);
+void enableRoomSignals(HouseType* house);
+unsigned roomSignal(HouseType* house, RoomId room);
+int waitForRoomSignal(HouseType* house, RoomId room, unsigned seen, const struct timespec* deadline);
+void roomSignalDeadline(struct timespec* deadline, long millis);
+RoomId getRandomConnectedRoom(const HouseLayout* layout, RoomId currentRoom, Rng* rng);
+void moveHunter(HouseType* house, int hunterId, RoomId from, RoomId to);
+void moveGhost(HouseType* house, RoomId from, RoomId to);
+void initEvidenceBoard(EvidenceBoard* board);
+int collectEvidence(HouseType* house, enum EvidenceType evidenceType, int hunterId);
+int reviewEvidence(HouseType* house);
+
+void initBuilder(HouseBuilder* builder);
+void cleanupBuilder(HouseBuilder* builder);
+RoomId createRoom(HouseBuilder* builder, const char* name);
+void connectRooms(HouseBuilder* builder, RoomId room1, RoomId room2);
+RoomId findRoom(const HouseBuilder* builder, const char* name);
+void buildLayout(const HouseBuilder* builder, HouseLayout* layout);
+void cleanupLayout(HouseLayout* layout);
+const char* roomName(const HouseLayout* layout, RoomId room);
+void buildNavTable(HouseLayout* layout, int jobs);
+void freeNavTable(NavTable* nav);
+RoomId navNextRoom(const NavTable* nav, RoomId from, RoomId to);
+uint32_t navDistance(const NavTable* nav, RoomId from, RoomId to);
+void populateRooms(HouseLayout* layout);    // generated from maps/default.map by ghost_housegen
+int loadTextMap(const char* path, HouseLayout* layout);
+int saveCompiledMap(const HouseLayout* layout, const char* path);
+int mapCompiledMap(const char* path, HouseLayout* layout);
+int loadLayout(const char* path, HouseLayout* layout);
+
+void initHouse(HouseType* house, const HouseLayout* layout, uint64_t seed, Arena* arena);
+void makeHouseThreaded(HouseType* house);
+void cleanupHouse(HouseType* house);
+void finalizeResults(const HouseType* house, const Ghost* ghost);
+enum EvidenceType randomGhostEvidence(enum GhostClass ghost, Rng* rng);
+enum EvidenceType ghostEvidenceKind(enum GhostClass ghost, int which);
 GhostClass identifyGhost(enum EvidenceType evidence[]);
+GhostClass identifyGhostMask(unsigned evidence);
+
+// Virtual-time engine
+void initScheduler(Scheduler* sched, int capacity);
+void initSchedulerIn(Scheduler* sched, Event* heap, int capacity);
+void cleanupScheduler(Scheduler* sched);
+void resetScheduler(Scheduler* sched);
+void scheduleEvent(Scheduler* sched, long time, EventKind kind, int entity);
+int nextEvent(Scheduler* sched, Event* event);
+
+// Arena allocation
+Arena* arenaCreate(size_t size);
+void* arenaAlloc(Arena* arena, size_t size);
+void arenaDestroy(Arena* arena);
+
+// Simulation context
+SimContext* simCreate(const SimConfig* config);
+void simReset(SimContext* sim, uint64_t seed);
+int simStep(SimContext* sim);
+long simRun(SimContext* sim);
+int simRunUntil(SimContext* sim, long time);
+void simResult(const SimContext* sim, GameResult* result);
+void simDestroy(SimContext* sim);
+
+// Checkpoints
+void simCheckpoint(SimContext* sim, SimSnapshot* snapshot);
+int simRestore(SimContext* sim, const SimSnapshot* snapshot);
+SimContext* simCreateFromSnapshot(const HouseLayout* layout, const SimSnapshot* snapshot, LogSink log, TraceBuffer* trace);
+void simBranch(SimContext* sim, uint64_t key);
+void freeSnapshot(SimSnapshot* snapshot);
+int saveSnapshot(const SimSnapshot* snapshot, const char* path);
+int loadSnapshot(SimSnapshot* snapshot, const char* path);
+
+// Telemetry
+int telemetryStart(const char* shmName, const char* socketPath, long gamesPlanned);
+void telemetryGame(const SimContext* sim, const GameResult* result);
+void telemetryWatch(const HouseType* house);
+void telemetryStop();
+int readStats(const StatsBlock* shared, StatsBlock* copy);
+int statsToJson(const StatsBlock* stats, char* out, size_t size);
+void telemetryCount(const GameResult* result, unsigned collected, const int* fear, const int* boredom, int numHunters,
+                    size_t stride);
+
+// Lockstep engine
+Lockstep* lockstepCreate(const HouseLayout* layout, int numHunters, int lanes, enum LaneIsa isa);
+void lockstepLoad(Lockstep* block, int lane, uint64_t seed);
+void lockstepPeriod(Lockstep* block);
+int lockstepResult(Lockstep* block, int lane, GameResult* result);
+void lockstepDestroy(Lockstep* block);
+enum LaneIsa resolveLaneIsa(enum LaneIsa isa);
+const char* laneIsaName(enum LaneIsa isa);
+
+// Exact solver
+int solveExact(const HouseLayout* layout, int numHunters, int jobs, long maxStates, SolveResult* result);
+void printSolveResult(const SolveResult* result);
+
+// Task runtime
+void runTaskGame(SimContext* sim, int workers);
+
+// Event tracing
+int openTrace(TraceFile* trace, const char* path, const HouseLayout* layout);
+int closeTrace(TraceFile* trace);
+void initTraceBuffer(TraceBuffer* buffer, TraceFile* trace);
+void cleanupTraceBuffer(TraceBuffer* buffer);
+void recordTrace(TraceBuffer* buffer, HouseType* house, enum TraceType type, int entity, RoomId room, int detail);
+void traceEvent(HouseType* house, enum TraceType type, int entity, RoomId room, int detail);
+void traceGameStart(HouseType* house, const Ghost* ghost);
+void traceGameEnd(HouseType* house);
+const char* traceTypeName(enum TraceType type);
+
+// Results store
+int openResults(ResultsFile* results, const char* path);
+int closeResults(ResultsFile* results);
+void initResultsBuffer(ResultsBuffer* buffer, ResultsFile* results);
+void cleanupResultsBuffer(ResultsBuffer* buffer);
+void recordResult(ResultsBuffer* buffer, uint64_t seed, uint32_t config, const GameResult* result, unsigned collected,
+                  const int* exitReason, int numHunters, size_t stride);
+void recordGame(ResultsBuffer* buffer, uint32_t config, const SimContext* sim, const GameResult* result);
+int mapResults(ResultsView* view, const char* path);
+void unmapResults(ResultsView* view);
+const ResultsBlockHeader* resultsBlock(const ResultsView* view, uint64_t block);
+const void* resultsColumn(const ResultsBlockHeader* block, enum ResultsColumn column);
+int resultsColumnWidth(enum ResultsColumn column);
+const char* resultsColumnName(enum ResultsColumn column);
+
+// Batch mode
+void runBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, TraceFile* trace,
+              ResultsFile* results, const SimSnapshot* from, BatchStats* stats);
+void runLockstepBatch(const HouseLayout* layout, uint64_t seed, int numHunters, long runs, int jobs, int lanes,
+                      enum LaneIsa isa, ResultsFile* results, BatchStats* stats);
+void cleanupBatchStats(BatchStats* stats);
+void printBatchStats(const BatchStats* stats, double seconds);
 
 
 
 // Helper Utilies
+uint64_t rngDerive(uint64_t key, uint64_t stream);  // Key of an independent sub-stream, e.g. per game or per entity
+void rngSeed(Rng* rng, uint64_t key);               // Start a generator on a stream
+uint64_t rngNext(Rng* rng);                         // 64 random bits
+uint32_t rngRange(Rng* rng, uint32_t n);            // Unbiased integer in [0, n)
+double rngDouble(Rng* rng);                         // Double in [0, 1)
+void rngFill(Rng* rng, uint64_t* out, size_t count);  // Many random words at once
+void seedRandom(uint64_t seed);  // Seed the calling thread's generator behind randInt/randFloat
 int randInt(int,int);        // Pseudo-random number generator function
 float randFloat(float, float);  // Pseudo-random float generator function
 enum GhostClass randomGhost();  // Return a randomly selected a ghost type
 void ghostToString(enum GhostClass, char*); // Convert a ghost type to a string, stored in output paremeter
 void evidenceToString(enum EvidenceType, char*); // Convert an evidence type to a string, stored in output parameter
+const char* evidenceName(enum EvidenceType);    // Static name of an evidence type
+const char* ghostName(enum GhostClass);         // Static name of a ghost type
 
 // Logging Utilities
-void l_hunterInit(char* name, enum EvidenceType equipment);
-void l_hunterMove(char* name, char* room);
-void l_hunterReview(char* name, enum LoggerDetails reviewResult);
-void l_hunterCollect(char* name, enum EvidenceType evidence, char* room);
-void l_hunterExit(char* name, enum LoggerDetails reason);
-void l_ghostInit(enum GhostClass type, char* room);
-void l_ghostMove(char* room);
-void l_ghostEvidence(enum EvidenceType evidence, char* room);
-void l_ghostExit(enum LoggerDetails reason);
+void l_startAsync(enum LogPolicy policy);   // buffer log lines per thread and write them from a background thread
+void l_stopAsync();                         // write out everything buffered and go back to printing directly
+void l_hunterInit(const LogSink* sink, const char* name, enum EvidenceType equipment);
+void l_hunterMove(const LogSink* sink, const char* name, const char* room);
+void l_hunterReview(const LogSink* sink, const char* name, enum LoggerDetails reviewResult);
+void l_hunterCollect(const LogSink* sink, const char* name, enum EvidenceType evidence, const char* room);
+void l_hunterExit(const LogSink* sink, const char* name, enum LoggerDetails reason);
+void l_ghostInit(const LogSink* sink, enum GhostClass type, const char* room);
+void l_ghostMove(const LogSink* sink, const char* room);
+void l_ghostEvidence(const LogSink* sink, enum EvidenceType evidence, const char* room);
+void l_ghostExit(const LogSink* sink, enum LoggerDetails reason);
@@ -1,6 +1,227 @@
 // ghost.c
 #include "defs.h"
 
+// The three kinds of evidence each ghost class can leave behind
+static const enum EvidenceType ghostEvidence[GHOST_COUNT][3] = {
+    [POLTERGEIST] = { EMF, TEMPERATURE, FINGERPRINTS },
+    [BANSHEE]     = { EMF, TEMPERATURE, SOUND },
+    [BULLIES]     = { EMF, FINGERPRINTS, SOUND },
+    [PHANTOM]     = { TEMPERATURE, FINGERPRINTS, SOUND },
+};
+
+/*
+  Function: initGhost(Ghost* ghost, HouseType* house)
+  Purpose: Gives the ghost a random class and places it in a random room that is not the Van.
+    The ghost gets its own random stream derived from the game's.
+
+  Parameters:
+    out ghost: the ghost to initialize.
+    in/out house: the house the ghost haunts.
+
+  return
+    none
+*/
+void initGhost(Ghost* ghost, HouseType* house) {
+    ghost->type = (enum GhostClass) rngRange(&house->rng, GHOST_COUNT);
+    ghost->house = house;
+    ghost->boredom = 0;
+    ghost->turns = 0;
+    ghost->currentRoom = 1 + rngRange(&house->rng, house->numRooms - 1); // Random room (not the Van)
+    rngSeed(&ghost->rng, rngDerive(house->seed, TRACE_GHOST));
+    moveGhost(house, NO_ROOM, ghost->currentRoom);
+}
+
+/*
+  Function: randomGhostEvidence(enum GhostClass ghost, Rng* rng)
+  Purpose: Picks one of the three evidence types the given ghost class can leave.
+
+  return
+    a random EvidenceType valid for the ghost, or EV_UNKNOWN for an unknown class
+*/
+enum EvidenceType randomGhostEvidence(enum GhostClass ghost, Rng* rng) {
+    if (ghost < 0 || ghost >= GHOST_COUNT) return EV_UNKNOWN;
+    return ghostEvidence[ghost][rngRange(rng, 3)];
+}
+
+/*
+  Function: ghostEvidenceKind(enum GhostClass ghost, int which)
+  Purpose: Returns one of the three evidence types a ghost class can leave, the one randomGhostEvidence picks for a draw of which.
+
+  Parameters:
+    in ghost: a ghost class below GHOST_COUNT.
+    in which: 0, 1 or 2.
+
+  return
+    the evidence type
+*/
+enum EvidenceType ghostEvidenceKind(enum GhostClass ghost, int which) {
+    return ghostEvidence[ghost][which];
+}
+
+/*
+  Function: identifyGhostMask(unsigned evidence)
+  Purpose: Identifies the ghost class from a set of collected evidence.
+
+  Parameters:
+    in evidence: bit e set for each collected evidence type e, as on the EvidenceBoard.
+
+  return
+    the ghost class that leaves exactly those three kinds of evidence, or GH_UNKNOWN
+*/
+GhostClass identifyGhostMask(unsigned evidence) {
+    for (int g = 0; g < GHOST_COUNT; g++) {
+        unsigned mask = 0;
+        for (int j = 0; j < 3; j++) {
+            mask |= 1u << ghostEvidence[g][j];
+        }
+        if (mask == evidence) return (GhostClass) g;
+    }
+    return GH_UNKNOWN;
+}
+
+/*
+  Function: identifyGhost(enum EvidenceType evidence[])
+  Purpose: Identifies the ghost class from three pieces of collected evidence.
+
+  Parameters:
+    in evidence: MAX_COLLECTED_EVIDENCE pieces of evidence.
+
+  return
+    the ghost class that leaves exactly those three kinds of evidence, or GH_UNKNOWN
+*/
+GhostClass identifyGhost(enum EvidenceType evidence[]) {
+    unsigned mask = 0;
+    for (int i = 0; i < MAX_COLLECTED_EVIDENCE; i++) {
+        if (evidence[i] >= 0 && evidence[i] < EV_COUNT) mask |= 1u << evidence[i];
+    }
+    return identifyGhostMask(mask);
+}
+
+/*
+  Function: ghostTurn(Ghost* ghost)
+  Purpose: Performs one turn of the ghost.
+
+  Parameters:
+    in/out ghost: A pointer to the Ghost structure taking its turn.
+
+  Description:
+    The ghost checks for the presence of hunters in the room, then leaves evidence, moves to a random adjacent room or does nothing, and manages its boredom level. Once the boredom level reaches BOREDOM_MAX the ghost leaves the house.
+
+  return
+    C_TRUE if the ghost is still in the house, C_FALSE once it has exited
+*/
+static int ghostTurn(Ghost* ghost) {
+    HouseType* house = ghost->house;
+
+    // Check if the Ghost is in the room with a hunter
+    unsigned occupancy = atomic_load_explicit(&house->rooms[ghost->currentRoom].occupancy, memory_order_acquire);
+    int inRoomWithHunter = (occupancy & OCC_COUNT_MASK) != 0;
+
+    if (inRoomWithHunter) {
+        // Reset boredom timer since Ghost is in the room with a hunter
+        ghost->boredom = 0;
+
+        // Randomly choose to leave evidence or do nothing
+        int action = rngRange(&ghost->rng, 2);
+        switch (action) {
+            case 0:
+                // Do nothing
+                break;
+            case 1:
+                // Leave evidence
+                addEvidenceToRoom(house, ghost->currentRoom, randomGhostEvidence(ghost->type, &ghost->rng));
+                break;
+        }
+    } else {
+        // Ghost is not in the room with a hunter
+        // Increase the Ghost’s boredom counter by 1
+        ghost->boredom++;
+
+        // Randomly choose to move to an adjacent room, leave evidence, or do nothing
+        int action = rngRange(&ghost->rng, 3);
+        switch (action) {
+            case 0:
+                // Do nothing
+                break;
+            case 1:
+                // Leave evidence
+                addEvidenceToRoom(house, ghost->currentRoom, randomGhostEvidence(ghost->type, &ghost->rng));
+                break;
+            case 2:
+                // Move to an adjacent room
+                RoomId nextRoom = getRandomConnectedRoom(house->layout, ghost->currentRoom, &ghost->rng);
+                l_ghostMove(&house->log, roomName(house->layout, nextRoom));
+                traceEvent(house, TRACE_GHOST_MOVE, TRACE_GHOST, nextRoom, 0);
+
+                // Update the rooms' ghost markers
+                moveGhost(house, ghost->currentRoom, nextRoom);
+
+                // Update the Ghost’s Room
+                ghost->currentRoom = nextRoom;
+                break;
+        }
+    }
+
+    // Check if the ghost’s boredom counter has reached BOREDOM_MAX
+    if (ghost->boredom >= house->rules.boredomMax) {
+        l_ghostExit(&house->log, LOG_BORED);
+        traceEvent(house, TRACE_GHOST_EXIT, TRACE_GHOST, ghost->currentRoom, LOG_BORED);
+        moveGhost(house, ghost->currentRoom, NO_ROOM);
+        return C_FALSE;
+    }
+
+    return C_TRUE;
+}
+
+/*
+  Function: ghostStep(Ghost* ghost)
+  Purpose: Performs one turn of the ghost, see ghostTurn, and counts it when built with INSTRUMENT.
+
+  return
+    C_TRUE if the ghost is still in the house, C_FALSE once it has exited
+*/
+int ghostStep(Ghost* ghost) {
+    INST_TIME(start);
+    int active = ghostTurn(ghost);
+    INST_SINCE(INST_GHOST_TURN, start);
+    INST_COUNT(INST_GHOST_TURNS);
+    INST_TURN(ghost);
+    if (!active) INST_RECORD(INST_GHOST_LIFETIME, ghost->turns);
+    return active;
+}
+
+/*
+  Function: awaitTurn(Ghost* ghost)
+  Purpose: Waits up to the ghost wait of the house's rules for the ghost's next turn on its room's event counter.
+
+  Parameters:
+    in/out ghost: the ghost, in a house with room signals.
+
+  Description:
+    The ghost wakes early when a hunter enters its room while it had none, and goes back to sleep if an event brought nothing new, e.g. a second hunter. Its next regular turn is due a ghost wait after this one, as with usleep, whichever way it wakes.
+
+  return
+    C_TRUE if it was woken by a hunter, C_FALSE once its regular turn is due
+*/
+static int awaitTurn(Ghost* ghost) {
+    HouseType* house = ghost->house;
+    struct timespec deadline;
+    roomSignalDeadline(&deadline, house->rules.ghostWait);
+
+    unsigned seen = roomSignal(house, ghost->currentRoom);
+    int hunters = (atomic_load_explicit(&house->rooms[ghost->currentRoom].occupancy, memory_order_acquire) & OCC_COUNT_MASK) != 0;
+    while (waitForRoomSignal(house, ghost->currentRoom, seen, &deadline)) {
+        seen = roomSignal(house, ghost->currentRoom);
+        unsigned occupancy = atomic_load_explicit(&house->rooms[ghost->currentRoom].occupancy, memory_order_acquire);
+        if ((occupancy & OCC_COUNT_MASK) != 0 && !hunters) {
+            INST_COUNT(INST_WAKEUPS);
+            return C_TRUE;
+        }
+        hunters = (occupancy & OCC_COUNT_MASK) != 0;
+    }
+    return C_FALSE;
+}
+
 /*
   Function: ghostThread(void* arg)
   Purpose: Simulates the behavior of a ghost in a haunted environment within a ghost-hunting game.
@@ -9,7 +230,7 @@
     in/out arg: A void pointer to a Ghost structure, representing the ghost participating in the game.
 
   Description:
-    This function initializes a ghost and enters into an infinite loop, emulating the actions of a ghost in a haunted environment. The ghost's actions include checking for the presence of hunters in the room, leaving evidence, moving to random adjacent rooms, and managing boredom levels. The function monitors the ghost's boredom level, triggering an exit if it surpasses a predefined threshold.
+    This function initializes a ghost and calls ghostStep every GHOST_WAIT milliseconds until the ghost gets bored and leaves. In a house with room signals the ghost also takes a turn as soon as a hunter enters its room, see awaitTurn.
 
   Note:
     This function is intended to be executed in a separate thread using pthread.
@@ -32,76 +253,18 @@ void* ghostThread(void* arg) {
     Ghost* ghost = (Ghost*)arg;
 
     // Initialization log
-    l_ghostInit(ghost->type, ghost->currentRoom->name);
-
-    while (1) {
-        // Check if the Ghost is in the room with a hunter
-        int inRoomWithHunter = 0;
-        for (int i = 0; i < NUM_HUNTERS; i++) {
-            if (hunters[i].currentRoom == ghost->currentRoom) {
-                inRoomWithHunter = 1;
-                break;
-            }
-        }
+    l_ghostInit(&ghost->house->log, ghost->type, roomName(ghost->house->layout, ghost->currentRoom));
+    traceEvent(ghost->house, TRACE_GHOST_INIT, TRACE_GHOST, ghost->currentRoom, ghost->type);
 
-        if (inRoomWithHunter) {
-            // Reset boredom timer since Ghost is in the room with a hunter
-            ghost->boredom = 0;
-
-            // Randomly choose to leave evidence or do nothing
-            int action = randInt(0, 1);
-            switch (action) {
-                case 0:
-                    // Do nothing
-                    break;
-                case 1:
-                    // Leave evidence
-                    enum EvidenceType evidenceType = randomGhostEvidence();
-                    l_ghostEvidence(evidenceType, ghost->currentRoom->name);
-                    addEvidenceToRoom(ghost->currentRoom, evidenceType);
-                    break;
-            }
+    while (ghostStep(ghost)) {
+        // Introduce some delay before the next iteration
+        INST_TIME(asleep);
+        if (ghost->house->roomSignals != NULL) {
+            if (awaitTurn(ghost)) continue;
         } else {
-            // Ghost is not in the room with a hunter
-            // Increase the Ghost’s boredom counter by 1
-            ghost->boredom++;
-
-            // Randomly choose to move to an adjacent room, leave evidence, or do nothing
-            int action = randInt(0, 2);
-            switch (action) {
-                case 0:
-                    // Do nothing
-                    break;
-                case 1:
-                    // Leave evidence
-                    enum EvidenceType evidenceType = randomGhostEvidence();
-                    l_ghostEvidence(evidenceType, ghost->currentRoom->name);
-                    addEvidenceToRoom(ghost->currentRoom, evidenceType);
-                    break;
-                case 2:
-                    // Move to an adjacent room
-                    Room* nextRoom = getRandomConnectedRoom(ghost->currentRoom);
-                    if (nextRoom != NULL) {
-                        l_ghostMove(nextRoom->name);
-
-                        // Update the room’s Ghost pointer
-                        ghost->currentRoom->ghost = NULL;
-                        nextRoom->ghost = ghost;
-
-                        // Update the Ghost’s Room pointer
-                        ghost->currentRoom = nextRoom;
-                    }
-                    break;
-            }
-        }
-
-        // Check if the ghost’s boredom counter has reached BOREDOM_MAX
-        if (ghost->boredom >= BOREDOM_MAX) {
-            l_ghostExit(LOG_UNKNOWN);
-            pthread_exit(NULL);
+            usleep(ghost->house->rules.ghostWait * 1000);
         }
-
-        // Introduce some delay before the next iteration
-        usleep(GHOST_WAIT * 1000);
+        INST_SLEPT(asleep, ghost->house->rules.ghostWait);
     }
+    return NULL;
 }
@@ -1,329 +1,597 @@
 #include "defs.h"
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
-pthread_mutex_t evidenceMutex = PTHREAD_MUTEX_INITIALIZER;
-enum EvidenceType collectedEvidence[MAX_COLLECTED_EVIDENCE];
+// The rules of the game as defs.h sets them
+const GameRules defaultRules = { FEAR_MAX, BOREDOM_MAX, HUNTER_WAIT, GHOST_WAIT };
 
 
 /*
-    Dynamically allocates a room and initializes its values.
-    in: name - the name of the room.
-    out: returns a pointer to the created room.
+    Function: initHouse(HouseType* house, const HouseLayout* layout, uint64_t seed, Arena* arena)
+    Purpose: Initializes a house for one game: empty rooms, an empty evidence index, no hunters and no shared evidence.
+      The house starts single-threaded; call makeHouseThreaded before starting entity threads.
+
+    Parameters:
+      out: house - a pointer to the HouseType structure to be initialized.
+      in: layout - the topology of the house, which must outlive it.
+      in: seed - the game's stream key (see rngDerive); the same key replays the same game.
+      in/out: arena - where the room state and evidence index are allocated; they are freed with the arena.
+
+    Example Usage:
+      HouseType myHouse;
+      initHouse(&myHouse, &layout, rngDerive(masterSeed, gameIndex), arena);
 */
 
 
+void initHouse(HouseType* house, const HouseLayout* layout, uint64_t seed, Arena* arena) {
+    house->layout = layout;
+    house->arena = arena;
+    house->numRooms = layout->numRooms;
+    house->evidenceSlots = layout->evidenceSlots;
+    house->rooms = arenaAlloc(arena, layout->numRooms * sizeof(Room));
+    for (uint32_t i = 0; i < layout->numRooms; i++) {
+        atomic_init(&house->rooms[i].occupancy, 0);
+        house->rooms[i].numEvidence = 0;
+    }
+    house->evidenceIndex = arenaAlloc(arena, EV_COUNT * EVIDENCE_INDEX_WORDS(layout->numRooms) * sizeof(atomic_ullong));
+    clearEvidenceIndex(house);
+    house->roomLocks = NULL;
+    house->roomSignals = NULL;
+    house->hunters = NULL;
+    house->numHunters = 0;
+    initEvidenceBoard(&house->evidence);
+    house->threaded = C_FALSE;
+    house->rules = defaultRules;
+    house->now = 0;
+    house->seed = seed;
+    rngSeed(&house->rng, seed);
+    house->trace = NULL;
+    house->log.enabled = C_TRUE;
+    house->log.fd = STDOUT_FILENO;
+}
+
+
 /*
-    Function: createRoom(const char* name)
-    Purpose: Dynamically allocates a room and initializes its values.
-    
+    Function: makeHouseThreaded(HouseType* house)
+    Purpose: Creates the per-room locks so hunters and the ghost can run on their own threads.
+
     Parameters:
-      in: name - the name of the room.
-    
-    Returns:
-      out: A pointer to the created room.
+      in/out: house - an initialized house.
+*/
+
+
+void makeHouseThreaded(HouseType* house) {
+    if (house->roomLocks == NULL) {
+        house->roomLocks = arenaAlloc(house->arena, house->numRooms * sizeof(pthread_mutex_t));
+        for (int i = 0; i < house->numRooms; i++) {
+            pthread_mutex_init(&house->roomLocks[i], NULL);
+        }
+    }
+    house->threaded = C_TRUE;
+}
+
+
+/*
+    Function: enableRoomSignals(HouseType* house)
+    Purpose: Creates the per-room event counters, after which hunter and ghost threads wait for their next turn
+      on their room's counter: hunters wake as soon as the ghost enters or leaves evidence there, and the ghost
+      as soon as a hunter enters (--wake events).
+
+    Parameters:
+      in/out: house - a threaded house whose entities have not started yet.
+*/
+
+
+void enableRoomSignals(HouseType* house) {
+    if (house->roomSignals != NULL) return;
+    house->roomSignals = arenaAlloc(house->arena, house->numRooms * sizeof(RoomSignal));
+    for (int i = 0; i < house->numRooms; i++) {
+        atomic_init(&house->roomSignals[i].seq, 0);
+    }
+}
+
+
+/*
+    Function: cleanupHouse(HouseType* house)
+    Purpose: Destroys the house's locks. The room state and locks are freed with the house's arena.
+
+    Parameters:
+      in/out: house - a pointer to the house to clean up. The layout and hunters are owned by the caller.
 
     Example Usage:
-      struct Room* myRoom = createRoom("Living Room");
+      cleanupHouse(&myHouse);
 */
 
 
-struct Room* createRoom(const char* name) {
-    struct Room* newRoom = (struct Room*)malloc(sizeof(struct Room));
-    if (newRoom == NULL) {
-        perror("Error creating room");
-        exit(EXIT_FAILURE);
+void cleanupHouse(HouseType* house) {
+    if (house->roomLocks != NULL) {
+        for (int i = 0; i < house->numRooms; i++) {
+            pthread_mutex_destroy(&house->roomLocks[i]);
+        }
+        house->roomLocks = NULL;
     }
+    house->rooms = NULL;
+    house->numRooms = 0;
+}
+
+/*
+    Helper Function: lockRoom(HouseType* house, RoomId room)
+    Purpose: Takes a room's evidence lock. When built with INSTRUMENT, a lock that is already
+      held is counted as contended and the time spent waiting for it is recorded.
+*/
 
-    strncpy(newRoom->name, name, MAX_STR - 1);
-    newRoom->name[MAX_STR - 1] = '\0'; 
-    newRoom->evidenceType = EV_UNKNOWN;
-    newRoom->numConnectedRooms = 0;
-    pthread_mutex_init(&newRoom->roomMutex, NULL);
 
-    return newRoom;
+static void lockRoom(HouseType* house, RoomId room) {
+#ifdef INSTRUMENT
+    INST_COUNT(INST_ROOM_LOCKS);
+    if (pthread_mutex_trylock(&house->roomLocks[room]) == 0) return;
+    INST_COUNT(INST_ROOM_LOCKS_CONTENDED);
+    INST_TIME(start);
+    pthread_mutex_lock(&house->roomLocks[room]);
+    INST_SINCE(INST_ROOM_LOCK_WAIT, start);
+#else
+    pthread_mutex_lock(&house->roomLocks[room]);
+#endif
 }
 
 
+/*
+    Helper Function: evidenceWord(const HouseType* house, enum EvidenceType evidenceType, RoomId room)
+    Purpose: Returns the word of the evidence index that holds a room's bit for one kind of evidence.
+*/
+
+
+static atomic_ullong* evidenceWord(const HouseType* house, enum EvidenceType evidenceType, RoomId room) {
+    return &house->evidenceIndex[(size_t) evidenceType * EVIDENCE_INDEX_WORDS(house->numRooms) + room / 64];
+}
 
 
 /*
-    Connects two rooms in a two-way connection.
-    in: room1, room2 - the rooms to connect.
+    Helper Function: storeEvidence(HouseType* house, RoomId room, enum EvidenceType evidenceType)
+    Purpose: Puts a piece of evidence in a room and in the evidence index, without logging it.
+      The caller holds the room lock if the house is threaded.
+
+    Parameters:
+      in/out: house - the house the room belongs to.
+      in: room - the room to put the evidence in.
+      in: evidenceType - the type of evidence.
+
+    Returns:
+      out: C_TRUE if it was stored, C_FALSE if the room already held house->evidenceSlots pieces.
 */
 
 
+int storeEvidence(HouseType* house, RoomId room, enum EvidenceType evidenceType) {
+    Room* r = &house->rooms[room];
+    if (r->numEvidence >= house->evidenceSlots) return C_FALSE;
+    r->evidence[r->numEvidence++] = (unsigned char) evidenceType;
+    atomic_fetch_or_explicit(evidenceWord(house, evidenceType, room), 1ull << (room % 64), memory_order_release);
+    return C_TRUE;
+}
+
+
 /*
-    Function: connectRooms(struct Room* room1, struct Room* room2)
-    Purpose: Connects two rooms in a two-way connection.
-    
+    Helper Function: signalRoom(HouseType* house, RoomId room, unsigned waiters)
+    Purpose: Bumps a room's event counter and wakes the entities waiting on it. The futex call is only made when
+      the room's occupancy word shows someone the event is for (waiters, OCC_COUNT_MASK for the hunters or
+      OCC_GHOST for the ghost), so the ghost's own moves and evidence cost no system call in an empty room: an
+      entity enters the room before reading the counter, and the counter is bumped before the occupancy is
+      read, so either the wake sees the entity or the entity sees the new count and does not sleep.
+*/
+
+
+static void signalRoom(HouseType* house, RoomId room, unsigned waiters) {
+    RoomSignal* signal = &house->roomSignals[room];
+    INST_SIGNAL(signal);
+    atomic_fetch_add(&signal->seq, 1);
+    if (atomic_load(&house->rooms[room].occupancy) & waiters) {
+        syscall(SYS_futex, &signal->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+
+/*
+    Helper Function: roomSignal(HouseType* house, RoomId room)
+    Purpose: Reads a room's event counter, to be passed to waitForRoomSignal. Call it after entering the room.
+*/
+
+
+unsigned roomSignal(HouseType* house, RoomId room) {
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load(&house->roomSignals[room].seq);
+}
+
+
+/*
+    Helper Function: waitForRoomSignal(HouseType* house, RoomId room, unsigned seen, const struct timespec* deadline)
+    Purpose: Sleeps until a room's event counter moves on from a value read with roomSignal, or until a deadline.
+
     Parameters:
-      in: room1, room2 - the rooms to connect.
+      in/out: house - a house with room signals, see enableRoomSignals.
+      in: room - the room to wait on.
+      in: seen - the counter as last read.
+      in: deadline - when to stop waiting, on CLOCK_MONOTONIC.
 
-    Example Usage:
-      struct Room* roomA = createRoom("Room A");
-      struct Room* roomB = createRoom("Room B");
-      connectRooms(roomA, roomB);
+    Returns:
+      out: C_TRUE if something happened in the room, C_FALSE if the deadline passed first.
+*/
+
+
+int waitForRoomSignal(HouseType* house, RoomId room, unsigned seen, const struct timespec* deadline) {
+    RoomSignal* signal = &house->roomSignals[room];
+    while (atomic_load(&signal->seq) == seen) {
+        // An absolute CLOCK_MONOTONIC timeout needs FUTEX_WAIT_BITSET; EAGAIN and EINTR just check again
+        if (syscall(SYS_futex, &signal->seq, FUTEX_WAIT_BITSET_PRIVATE, seen, deadline, NULL, FUTEX_BITSET_MATCH_ANY) != 0 &&
+            errno == ETIMEDOUT) {
+            return C_FALSE;
+        }
+    }
+    INST_REACTED(signal);
+    return C_TRUE;
+}
+
+
+/*
+    Helper Function: roomSignalDeadline(struct timespec* deadline, long millis)
+    Purpose: Sets a deadline for waitForRoomSignal, a number of milliseconds from now.
 */
 
 
-void connectRooms(struct Room* room1, struct Room* room2) {
-    if (room1->numConnectedRooms < MAX_CONNECTED_ROOMS && room2->numConnectedRooms < MAX_CONNECTED_ROOMS) {
-        room1->connectedRooms[room1->numConnectedRooms++] = room2;
-        room2->connectedRooms[room2->numConnectedRooms++] = room1;
-    } else {
-        fprintf(stderr, "Error connecting rooms: Maximum connected rooms reached.\n");
-        exit(EXIT_FAILURE);
+void roomSignalDeadline(struct timespec* deadline, long millis) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += millis / 1000;
+    deadline->tv_nsec += (millis % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
     }
 }
 
+
 /*
-    Adds a room to the list of rooms in the house.
-    in: head - a pointer to the head of the room list.
-        room - the room to add to the list.
+    Helper Function: addEvidenceToRoom(HouseType* house, RoomId room, enum EvidenceType evidenceType)
+    Purpose: Adds evidence to a room, unless the room is full, in which case it is lost.
+
+    Parameters:
+      in/out: house - the house the room belongs to; its room lock is only taken when house->threaded is set.
+      in: room - the room to which evidence is added.
+      in: evidenceType - the type of evidence to add.
+
+    Example Usage:
+      addEvidenceToRoom(&myHouse, ghost->currentRoom, EMF);
 */
 
 
+void addEvidenceToRoom(HouseType* house, RoomId room, enum EvidenceType evidenceType) {
+    if (house->threaded) lockRoom(house, room);
+    int stored = storeEvidence(house, room, evidenceType);
+    if (stored) {
+        l_ghostEvidence(&house->log, evidenceType, roomName(house->layout, room));
+        traceEvent(house, TRACE_GHOST_EVIDENCE, TRACE_GHOST, room, evidenceType);
+    }
+    if (house->threaded) pthread_mutex_unlock(&house->roomLocks[room]);
+    if (stored && house->roomSignals != NULL) signalRoom(house, room, OCC_COUNT_MASK);
+}
+
+
 /*
-    Function: addRoom(struct Room** head, struct Room* room)
-    Purpose: Adds a room to the list of rooms in the house.
-    
+    Helper Function: takeEvidenceFromRoom(HouseType* house, RoomId room, enum EvidenceType equipment)
+    Purpose: Removes the oldest piece of evidence in a room that the given equipment can read.
+      The evidence index is checked first, so a room without any is not locked.
+
     Parameters:
-      in/out: head - a pointer to the head of the room list.
-      in: room - the room to add to the list.
+      in/out: house - the house the room belongs to.
+      in: room - the room being searched.
+      in: equipment - the type of evidence the searching hunter can detect.
+
+    Returns:
+      out: The evidence that was removed, or EV_UNKNOWN if there was nothing the equipment could read.
 
     Example Usage:
-      struct Room* newRoom = createRoom("Bedroom");
-      addRoom(&house->rooms, newRoom);
+      enum EvidenceType found = takeEvidenceFromRoom(&myHouse, hunter->currentRoom, hunter->equipment);
 */
 
 
-void addRoom(struct Room** head, struct Room* room) {
-    if (*head == NULL) {
-        *head = room;
-        room->nextRoom = NULL;
-    } else {
-        room->nextRoom = *head;
-        *head = room;
+enum EvidenceType takeEvidenceFromRoom(HouseType* house, RoomId room, enum EvidenceType equipment) {
+    if (equipment < 0 || equipment >= EV_COUNT) return EV_UNKNOWN;
+    atomic_ullong* word = evidenceWord(house, equipment, room);
+    uint64_t bit = 1ull << (room % 64);
+    if ((atomic_load_explicit(word, memory_order_acquire) & bit) == 0) return EV_UNKNOWN;
+
+    Room* r = &house->rooms[room];
+    enum EvidenceType found = EV_UNKNOWN;
+    int left = 0;
+    if (house->threaded) lockRoom(house, room);
+    for (int i = 0; i < r->numEvidence; i++) {
+        if (r->evidence[i] != equipment) continue;
+        if (found == EV_UNKNOWN) {
+            found = equipment;
+            memmove(&r->evidence[i], &r->evidence[i + 1], r->numEvidence - i - 1);
+            r->numEvidence--;
+            i--;
+        } else {
+            left = C_TRUE;
+            break;
+        }
     }
+    if (found != EV_UNKNOWN && !left) atomic_fetch_and_explicit(word, ~bit, memory_order_release);
+    if (house->threaded) pthread_mutex_unlock(&house->roomLocks[room]);
+    return found;
 }
 
+
 /*
-    Dynamically allocates several rooms and populates the provided house.
-    Note: You may modify this as long as room names and connections are maintained.
-        out: house - the house to populate with rooms. Assumes house has been initialized.
+    Helper Function: roomEvidenceKinds(const HouseType* house, RoomId room)
+    Purpose: Looks up what kinds of evidence a room holds in the evidence index, without locking it.
+
+    Parameters:
+      in: house - the house the room belongs to.
+      in: room - the room being looked at.
+
+    Returns:
+      out: bit e set for each kind of evidence e in the room.
 */
-void populateRooms(HouseType* house) {
-    // First, create each room
-
-    // createRoom assumes that we dynamically allocate a room, initializes the values, and returns a RoomType*
-    // create functions are pretty typical, but it means errors are harder to return aside from NULL
-    struct Room* van                = createRoom("Van");
-    struct Room* hallway            = createRoom("Hallway");
-    struct Room* master_bedroom     = createRoom("Master Bedroom");
-    struct Room* boys_bedroom       = createRoom("Boy's Bedroom");
-    struct Room* bathroom           = createRoom("Bathroom");
-    struct Room* basement           = createRoom("Basement");
-    struct Room* basement_hallway   = createRoom("Basement Hallway");
-    struct Room* right_storage_room = createRoom("Right Storage Room");
-    struct Room* left_storage_room  = createRoom("Left Storage Room");
-    struct Room* kitchen            = createRoom("Kitchen");
-    struct Room* living_room        = createRoom("Living Room");
-    struct Room* garage             = createRoom("Garage");
-    struct Room* utility_room       = createRoom("Utility Room");
-
-    // This adds each room to each other's room lists
-    // All rooms are two-way connections
-    connectRooms(van, hallway);
-    connectRooms(hallway, master_bedroom);
-    connectRooms(hallway, boys_bedroom);
-    connectRooms(hallway, bathroom);
-    connectRooms(hallway, kitchen);
-    connectRooms(hallway, basement);
-    connectRooms(basement, basement_hallway);
-    connectRooms(basement_hallway, right_storage_room);
-    connectRooms(basement_hallway, left_storage_room);
-    connectRooms(kitchen, living_room);
-    connectRooms(kitchen, garage);
-    connectRooms(garage, utility_room);
-
-    // Add each room to the house's room list
-    addRoom(&house->rooms, van);
-    addRoom(&house->rooms, hallway);
-    addRoom(&house->rooms, master_bedroom);
-    addRoom(&house->rooms, boys_bedroom);
-    addRoom(&house->rooms, bathroom);
-    addRoom(&house->rooms, basement);
-    addRoom(&house->rooms, basement_hallway);
-    addRoom(&house->rooms, right_storage_room);
-    addRoom(&house->rooms, left_storage_room);
-    addRoom(&house->rooms, kitchen);
-    addRoom(&house->rooms, living_room);
-    addRoom(&house->rooms, garage);
-    addRoom(&house->rooms, utility_room);
+
+
+unsigned roomEvidenceKinds(const HouseType* house, RoomId room) {
+    unsigned kinds = 0;
+    for (int e = 0; e < EV_COUNT; e++) {
+        uint64_t word = atomic_load_explicit(evidenceWord(house, (enum EvidenceType) e, room), memory_order_acquire);
+        kinds |= (unsigned) ((word >> (room % 64)) & 1) << e;
+    }
+    return kinds;
 }
 
 
 /*
-    Function: initHouseAndRooms(HouseType* house)
-    Purpose: Initializes a house and populates it with rooms.
+    Helper Function: countEvidenceRooms(const HouseType* house, enum EvidenceType evidenceType)
+    Purpose: Counts the rooms that hold a kind of evidence, a popcount over its bitset.
 
     Parameters:
-      in/out: house - a pointer to the HouseType structure to be initialized.
+      in: house - the house.
+      in: evidenceType - the kind of evidence.
 
-    Example Usage:
-      HouseType myHouse;
-      initHouseAndRooms(&myHouse);
+    Returns:
+      out: the number of rooms holding at least one piece of it.
 */
 
 
-void initHouseAndRooms(HouseType *house) {
-    house->numRooms = 0;
-    populateRooms(house); 
+uint32_t countEvidenceRooms(const HouseType* house, enum EvidenceType evidenceType) {
+    uint32_t words = EVIDENCE_INDEX_WORDS(house->numRooms);
+    const atomic_ullong* set = &house->evidenceIndex[(size_t) evidenceType * words];
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < words; w++) {
+        count += __builtin_popcountll(atomic_load_explicit(&set[w], memory_order_relaxed));
+    }
+    return count;
 }
 
+
 /*
-    Helper Function: addEvidenceToRoom(Room* room, enum EvidenceType evidenceType)
-    Purpose: Adds evidence to a room.
+    Helper Function: nextEvidenceRoom(const HouseType* house, enum EvidenceType evidenceType, RoomId from)
+    Purpose: Finds the first room from a given one on that holds a kind of evidence, skipping 64 empty rooms at a time.
 
     Parameters:
-      in/out: room - a pointer to the room to which evidence is added.
-      in: evidenceType - the type of evidence to add.
+      in: house - the house.
+      in: evidenceType - the kind of evidence.
+      in: from - the first room to consider.
+
+    Returns:
+      out: the lowest room id >= from holding the evidence, or NO_ROOM if there is none.
 
     Example Usage:
-      Room* myRoom = createRoom("Library");
-      addEvidenceToRoom(myRoom, EV_AUDIO);
+      for (RoomId r = nextEvidenceRoom(&myHouse, EMF, 0); r != NO_ROOM; r = nextEvidenceRoom(&myHouse, EMF, r + 1))
 */
 
 
-void addEvidenceToRoom(Room* room, enum EvidenceType evidenceType) {
-    pthread_mutex_lock(&room->roomMutex);
-    if (room->evidenceType == EV_UNKNOWN) {
-        room->evidenceType = evidenceType;
-        l_ghostEvidence(evidenceType, room->name);
+RoomId nextEvidenceRoom(const HouseType* house, enum EvidenceType evidenceType, RoomId from) {
+    uint32_t words = EVIDENCE_INDEX_WORDS(house->numRooms);
+    const atomic_ullong* set = &house->evidenceIndex[(size_t) evidenceType * words];
+    if (from >= (RoomId) house->numRooms) return NO_ROOM;
+    uint32_t w = from / 64;
+    uint64_t word = atomic_load_explicit(&set[w], memory_order_relaxed) & (~0ull << (from % 64));
+    while (word == 0) {
+        if (++w >= words) return NO_ROOM;
+        word = atomic_load_explicit(&set[w], memory_order_relaxed);
     }
-    pthread_mutex_unlock(&room->roomMutex);
+    return w * 64 + __builtin_ctzll(word);
 }
 
 
 /*
-    Helper Function: getRandomConnectedRoom(Room* currentRoom)
+    Helper Function: clearEvidenceIndex(HouseType* house)
+    Purpose: Empties the evidence index, for when every room has been emptied at once.
+
+    Parameters:
+      in/out: house - the house, with no evidence in any room.
+*/
+
+
+void clearEvidenceIndex(HouseType* house) {
+    size_t words = (size_t) EV_COUNT * EVIDENCE_INDEX_WORDS(house->numRooms);
+    for (size_t w = 0; w < words; w++) {
+        atomic_init(&house->evidenceIndex[w], 0);
+    }
+}
+
+
+/*
+    Helper Function: getRandomConnectedRoom(const HouseLayout* layout, RoomId currentRoom, Rng* rng)
     Purpose: Retrieves a random connected room.
 
     Parameters:
-      in: currentRoom - a pointer to the current room.
+      in: layout - the house topology.
+      in: currentRoom - the current room.
+      in/out: rng - the generator of the entity that is moving.
 
     Returns:
-      out: A pointer to a randomly selected connected room.
+      out: A randomly selected connected room, or currentRoom if it has no connections.
 
     Example Usage:
-      Room* currentRoom = getRandomConnectedRoom(myRoom);
+      RoomId nextRoom = getRandomConnectedRoom(house->layout, hunter->currentRoom, &hunter->rng);
 */
 
 
-Room* getRandomConnectedRoom(Room* currentRoom) {
-    int numConnectedRooms = currentRoom->numConnectedRooms;
+RoomId getRandomConnectedRoom(const HouseLayout* layout, RoomId currentRoom, Rng* rng) {
+    uint32_t start = layout->adjStart[currentRoom];
+    uint32_t numConnectedRooms = layout->adjStart[currentRoom + 1] - start;
     if (numConnectedRooms == 0) {
         return currentRoom;
     }
-    int randomIndex = randInt(0, numConnectedRooms - 1);
-    return currentRoom->connectedRooms[randomIndex];
+    return layout->adj[start + rngRange(rng, numConnectedRooms)];
 }
 
 
 /*
-    Helper Function: collectEvidence(enum EvidenceType evidenceType)
-    Purpose: Collects evidence.
+    Helper Function: moveHunter(HouseType* house, int hunterId, RoomId from, RoomId to)
+    Purpose: Updates the rooms' occupancy words when a hunter moves, enters or leaves, and signals a room it
+      enters while the ghost is there, so that a ghost waiting on it wakes.
 
     Parameters:
-      in: evidenceType - the type of evidence to collect.
-
-    Example Usage:
-      collectEvidence(EV_VIDEO);
+      in/out: house - the house being hunted.
+      in: hunterId - the id of the moving hunter, below OCC_MAX_HUNTERS.
+      in: from - the room the hunter leaves, or NO_ROOM when entering the house.
+      in: to - the room the hunter enters, or NO_ROOM when leaving the house.
+
+    Description:
+      Each room is a single atomic add or subtract, so no locks are taken. The hunter's
+      presence bit is unique to it, which makes adding it the same as setting it.
 */
 
 
-void collectEvidence(enum EvidenceType evidenceType) {
-    int evidenceAlreadyCollected = 0;
-    int numCollectedEvidence= 0;
-    pthread_mutex_lock(&evidenceMutex);
-    for (int i = 0; i < numCollectedEvidence; i++) {
-        if (collectedEvidence[i] == evidenceType) {
-            evidenceAlreadyCollected = 1;
-            break;
-        }
+void moveHunter(HouseType* house, int hunterId, RoomId from, RoomId to) {
+    unsigned occ = OCC_ONE_HUNTER;
+    if (hunterId < OCC_MASK_HUNTERS) occ |= 1u << hunterId;
+
+    if (from != NO_ROOM) atomic_fetch_sub_explicit(&house->rooms[from].occupancy, occ, memory_order_release);
+    if (to != NO_ROOM) {
+        unsigned before = atomic_fetch_add_explicit(&house->rooms[to].occupancy, occ, memory_order_acq_rel);
+        if ((before & OCC_GHOST) && house->roomSignals != NULL) signalRoom(house, to, OCC_GHOST);
     }
-    if (!evidenceAlreadyCollected && numCollectedEvidence < MAX_COLLECTED_EVIDENCE) {
-        collectedEvidence[numCollectedEvidence++] = evidenceType;
-        l_hunterCollect("Shared", evidenceType, "Shared");
+}
+
+
+/*
+    Helper Function: moveGhost(HouseType* house, RoomId from, RoomId to)
+    Purpose: Moves the ghost flag between rooms' occupancy words, and signals the room it enters. Either room may be NO_ROOM.
+*/
+
+
+void moveGhost(HouseType* house, RoomId from, RoomId to) {
+    if (from != NO_ROOM) atomic_fetch_and_explicit(&house->rooms[from].occupancy, ~OCC_GHOST, memory_order_release);
+    if (to != NO_ROOM) atomic_fetch_or_explicit(&house->rooms[to].occupancy, OCC_GHOST, memory_order_release);
+    if (to != NO_ROOM && house->roomSignals != NULL) signalRoom(house, to, OCC_COUNT_MASK);
+}
+
+
+/*
+    Helper Function: initEvidenceBoard(EvidenceBoard* board)
+    Purpose: Empties the evidence board shared by the hunters.
+
+    Parameters:
+      out: board - the board to reset.
+*/
+
+
+void initEvidenceBoard(EvidenceBoard* board) {
+    atomic_init(&board->collected, 0);
+    for (int i = 0; i < EV_COUNT; i++) {
+        atomic_init(&board->contributor[i], -1);
+        atomic_init(&board->lead[i], NO_ROOM);
     }
-    pthread_mutex_unlock(&evidenceMutex);
+    atomic_init(&board->sighting, NO_ROOM);
 }
+
+
 /*
-    Helper Function: reviewEvidence()
-    Purpose: Reviews evidence and checks if there are at least three unique pieces.
+    Helper Function: collectEvidence(HouseType* house, enum EvidenceType evidenceType, int hunterId)
+    Purpose: Adds evidence to the board shared by all hunters in the house.
+
+    Parameters:
+      in/out: house - the house holding the shared evidence.
+      in: evidenceType - the type of evidence to collect.
+      in: hunterId - the id of the hunter who found it.
+
+    Description:
+      Lock-free and O(1): the first hunter to claim the evidence's contributor slot is recorded
+      as having found it, then the evidence's bit is set. The release ordering makes the
+      contributor visible to anyone who sees the bit.
 
     Returns:
-      out: 1 if there are at least three unique pieces; otherwise, 0.
+      out: C_TRUE if this was new evidence, C_FALSE if it had already been collected.
 
     Example Usage:
-      int result = reviewEvidence();
+      collectEvidence(&myHouse, EMF, hunter->id);
 */
 
-int reviewEvidence() {
-    int uniqueEvidenceCount = 0;
-    int numCollectedEvidence = 0;
-    pthread_mutex_lock(&evidenceMutex);
-
-    for (int i = 0; i < numCollectedEvidence; i++) {
-        int isUnique = 1;
-        for (int j = i + 1; j < numCollectedEvidence; j++) {
-            if (collectedEvidence[i] == collectedEvidence[j]) {
-                isUnique = 0;
-                break;
-            }
-        }
 
-        if (isUnique) {
-            uniqueEvidenceCount++;
-        }
+int collectEvidence(HouseType* house, enum EvidenceType evidenceType, int hunterId) {
+    EvidenceBoard* board = &house->evidence;
+    if (evidenceType < 0 || evidenceType >= EV_COUNT) return C_FALSE;
+
+    int nobody = -1;
+    if (!atomic_compare_exchange_strong_explicit(&board->contributor[evidenceType], &nobody, hunterId,
+                                                 memory_order_release, memory_order_relaxed)) {
+        INST_COUNT(INST_EVIDENCE_LOST);
+        return C_FALSE;
     }
+    atomic_fetch_or_explicit(&board->collected, 1u << evidenceType, memory_order_release);
+    INST_COUNT(INST_EVIDENCE_CLAIMED);
+    return C_TRUE;
+}
+/*
+    Helper Function: reviewEvidence(HouseType* house)
+    Purpose: Reviews evidence and checks if there are at least three unique pieces.
 
-    pthread_mutex_unlock(&evidenceMutex);
+    Parameters:
+      in: house - the house holding the shared evidence.
+
+    Returns:
+      out: 1 if there are at least three unique pieces; otherwise, 0.
+
+    Example Usage:
+      int result = reviewEvidence(&myHouse);
+*/
 
-    return (uniqueEvidenceCount >= 3) ? 1 : 0;
+int reviewEvidence(HouseType* house) {
+    unsigned collected = atomic_load_explicit(&house->evidence.collected, memory_order_acquire);
+    return __builtin_popcount(collected) >= MAX_COLLECTED_EVIDENCE;
 }
 
 
 /*
-    Function: finalizeResults(const HouseType* house, const Hunter hunters[NUM_HUNTERS], const Ghost* ghost)
+    Function: finalizeResults(const HouseType* house, const Ghost* ghost)
     Purpose: Prints the final results of the ghost-hunting game.
 
     Parameters:
-      in: house - a pointer to the HouseType structure containing information about the house.
-      in: hunters - an array of Hunter structures containing information about each hunter.
+      in: house - a pointer to the HouseType structure holding the rooms, the hunters and the shared evidence.
       in: ghost - a pointer to the Ghost structure containing information about the ghost.
 
     Example Usage:
-      finalizeResults(&myHouse, myHunters, &myGhost);
+      finalizeResults(&myHouse, &myGhost);
 */
 
 
-void finalizeResults(const HouseType* house, const Hunter hunters[NUM_HUNTERS], const Ghost* ghost) {
-    int numCollectedEvidence = 0;
+void finalizeResults(const HouseType* house, const Ghost* ghost) {
+    const Hunter* hunters = house->hunters;
+    const GameRules* rules = &house->rules;
     printf("Hunters with fear >= FEAR_MAX:\n");
-    for (int i = 0; i < NUM_HUNTERS; i++) {
-        if (hunters[i].fear >= FEAR_MAX) {
+    for (int i = 0; i < house->numHunters; i++) {
+        if (hunters[i].fear >= rules->fearMax) {
             printf("- %s\n", hunters[i].name);
         }
     }
     printf("\nHunters with boredom >= BOREDOM_MAX:\n");
-    for (int i = 0; i < NUM_HUNTERS; i++) {
-        if (hunters[i].boredom >= BOREDOM_MAX && hunters[i].fear < FEAR_MAX) {
+    for (int i = 0; i < house->numHunters; i++) {
+        if (hunters[i].boredom >= rules->boredomMax && hunters[i].fear < rules->fearMax) {
             printf("- %s\n", hunters[i].name);
         }
     }
     int allHuntersInactive = 1;
-    for (int i = 0; i < NUM_HUNTERS; i++) {
-        if (hunters[i].fear < FEAR_MAX && hunters[i].boredom < BOREDOM_MAX) {
+    for (int i = 0; i < house->numHunters; i++) {
+        if (hunters[i].exitReason == LOG_EVIDENCE) {
             allHuntersInactive = 0;
             break;
         }
@@ -334,14 +602,19 @@ void finalizeResults(const HouseType* house, const Hunter hunters[NUM_HUNTERS],
     }
 
     printf("\nEvidence collected by hunters:\n");
-    for (int i = 0; i < numCollectedEvidence; i++) {
-        char evidenceTypeStr[MAX_STR];
-        evidenceToString(collectedEvidence[i], evidenceTypeStr);
-        printf("- %s\n", evidenceTypeStr);
+    unsigned collected = atomic_load(&((HouseType*) house)->evidence.collected);
+    for (int i = 0; i < EV_COUNT; i++) {
+        if (!(collected & (1u << i))) continue;
+        int contributor = atomic_load(&((HouseType*) house)->evidence.contributor[i]);
+        if (contributor >= 0 && contributor < house->numHunters) {
+            printf("- %s (found by %s)\n", evidenceName(i), hunters[contributor].name);
+        } else {
+            printf("- %s\n", evidenceName(i));
+        }
     }
 
-    if (numCollectedEvidence >= 3) {
-        GhostClass identifiedGhost = identifyGhost(collectedEvidence);
+    if (__builtin_popcount(collected) >= MAX_COLLECTED_EVIDENCE) {
+        GhostClass identifiedGhost = identifyGhostMask(collected);
         char identifiedGhostStr[MAX_STR];
         ghostToString(identifiedGhost, identifiedGhostStr);
         printf("\nIdentified Ghost Type: %s\n", identifiedGhostStr);
@@ -352,4 +625,3 @@ void finalizeResults(const HouseType* house, const Hunter hunters[NUM_HUNTERS],
         }
     }
 }
-
@@ -0,0 +1,137 @@
+// housegen.c
+#include "defs.h"
+#include <errno.h>
+
+/*
+    ghost_housegen: compiles a map into C source, so that a fixed house is built into the
+    program instead of being constructed when it starts.
+
+    The generated file defines one function that fills in a HouseLayout with pointers to
+    static const tables: the CSR adjacency (adjStart, adj), the name offsets and the interned
+    names, with each room's name and degree noted beside its neighbours. Nothing is allocated
+    or built at run time, and cleanupLayout has nothing to free. The makefile compiles
+    maps/default.map into populateRooms this way; --map still loads any other house at run time.
+*/
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s MAP FUNCTION OUT\n", program);
+    fprintf(stderr, "  writes C source to OUT defining void FUNCTION(HouseLayout* layout), which sets layout to the house in MAP\n");
+    fprintf(stderr, "  MAP is a text map or a compiled map, as for ghost_hunter_game --map\n");
+}
+
+/*
+    Writes a string as the body of a C string literal, escaping anything that is not plain
+    printable ASCII; '?' is escaped too so that no trigraph can appear.
+*/
+static void writeEscaped(FILE* out, const char* text) {
+    for (const unsigned char* c = (const unsigned char*) text; *c != '\0'; c++) {
+        if (*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\' && *c != '?') {
+            fputc(*c, out);
+        } else {
+            fprintf(out, "\\%03o", *c);
+        }
+    }
+}
+
+/*
+    Writes the body of an array initializer, ten numbers to a line.
+*/
+static void writeNumbers(FILE* out, const uint32_t* numbers, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(out, "%s%u,%s", i % 10 == 0 ? "    " : " ", numbers[i], i % 10 == 9 || i + 1 == count ? "\n" : "");
+    }
+}
+
+static void writeSource(FILE* out, const HouseLayout* layout, const char* mapPath, const char* function) {
+    uint32_t numRooms = layout->numRooms;
+
+    fprintf(out, "// Generated by ghost_housegen from %s; do not edit, change the map and rebuild instead.\n", mapPath);
+    fprintf(out, "#include \"defs.h\"\n\n");
+    fprintf(out, "// %u rooms, %u connections\n\n", numRooms, layout->numAdj / 2);
+
+    fprintf(out, "static const uint32_t adjStart[%u] = {\n", numRooms + 1);
+    writeNumbers(out, layout->adjStart, numRooms + 1);
+    fprintf(out, "};\n\n");
+
+    // Rooms without neighbours add nothing to adj, which may then be empty
+    fprintf(out, "static const RoomId adj[%u] = {\n", layout->numAdj > 0 ? layout->numAdj : 1);
+    for (uint32_t r = 0; r < numRooms; r++) {
+        uint32_t degree = layout->adjStart[r + 1] - layout->adjStart[r];
+        if (degree == 0) continue;
+        fprintf(out, "    ");
+        for (uint32_t i = layout->adjStart[r]; i < layout->adjStart[r + 1]; i++) {
+            fprintf(out, "%u, ", layout->adj[i]);
+        }
+        fprintf(out, "  // %u: ", r);
+        writeEscaped(out, roomName(layout, r));
+        fprintf(out, " (%u)\n", degree);
+    }
+    if (layout->numAdj == 0) fprintf(out, "    0,\n");
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint32_t nameOffset[%u] = {\n", numRooms > 0 ? numRooms : 1);
+    writeNumbers(out, layout->nameOffset, numRooms);
+    if (numRooms == 0) fprintf(out, "    0,\n");
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const char names[] =\n");
+    for (uint32_t r = 0; r < numRooms; r++) {
+        fprintf(out, "    \"");
+        writeEscaped(out, roomName(layout, r));
+        fprintf(out, "\\000\"%s\n", r + 1 < numRooms ? "" : ";");
+    }
+    if (numRooms == 0) fprintf(out, "    \"\";\n");
+    fprintf(out, "\n");
+
+    fprintf(out, "/*\n");
+    fprintf(out, "  Function: %s(HouseLayout* layout)\n", function);
+    fprintf(out, "  Purpose: Sets a layout to the house in %s, whose tables are compiled into the program.\n\n", mapPath);
+    fprintf(out, "  Parameters:\n");
+    fprintf(out, "    out layout: the layout; cleanupLayout has nothing to free but may still be called.\n\n");
+    fprintf(out, "  return\n");
+    fprintf(out, "    none\n");
+    fprintf(out, "*/\n");
+    fprintf(out, "void %s(HouseLayout* layout) {\n", function);
+    fprintf(out, "    layout->numRooms = %u;\n", numRooms);
+    fprintf(out, "    layout->numAdj = %u;\n", layout->numAdj);
+    fprintf(out, "    layout->adjStart = adjStart;\n");
+    fprintf(out, "    layout->adj = adj;\n");
+    fprintf(out, "    layout->nameOffset = nameOffset;\n");
+    fprintf(out, "    layout->names = names;\n");
+    fprintf(out, "    layout->namesSize = %u;\n", layout->namesSize);
+    fprintf(out, "    layout->storage = NULL;\n");
+    fprintf(out, "    layout->mappedSize = 0;\n");
+    fprintf(out, "    layout->nav = NULL;\n");
+    fprintf(out, "    layout->evidenceSlots = 1;\n");
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* mapPath = argv[1];
+    const char* function = argv[2];
+    const char* outPath = argv[3];
+
+    HouseLayout layout;
+    if (!loadLayout(mapPath, &layout)) return 1;
+
+    FILE* out = fopen(outPath, "w");
+    if (out == NULL) {
+        fprintf(stderr, "%s: %s\n", outPath, strerror(errno));
+        cleanupLayout(&layout);
+        return 1;
+    }
+    writeSource(out, &layout, mapPath, function);
+    int failed = ferror(out);
+    if (fclose(out) != 0) failed = C_TRUE;
+    cleanupLayout(&layout);
+    if (failed) {
+        fprintf(stderr, "%s: could not write the generated source\n", outPath);
+        remove(outPath);
+        return 1;
+    }
+    return 0;
+}
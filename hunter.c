@@ -1,6 +1,252 @@
 // hunter.c
 #include "defs.h"
 
+/*
+  Function: initHunter(Hunter* hunter, HouseType* house, const char* name, enum EvidenceType equipment, int id)
+  Purpose: Initializes a hunter and places them in the Van.
+    The hunter gets their own random stream derived from the game's and their id.
+
+  Parameters:
+    out hunter: the hunter to initialize.
+    in/out house: the house being hunted, its first room is the Van.
+    in name: the hunter's name.
+    in equipment: the type of evidence the hunter's equipment can read.
+    in id: the hunter's slot in the house's hunter array.
+
+  return
+    none
+*/
+void initHunter(Hunter* hunter, HouseType* house, const char* name, enum EvidenceType equipment, int id) {
+    strncpy(hunter->name, name, MAX_STR - 1);
+    hunter->name[MAX_STR - 1] = '\0';
+    hunter->equipment = equipment;
+    hunter->house = house;
+    hunter->fear = 0;
+    hunter->boredom = 0;
+    hunter->exitReason = LOG_UNKNOWN;
+    hunter->id = id;
+    hunter->turns = 0;
+    rngSeed(&hunter->rng, rngDerive(house->seed, id));
+    hunter->currentRoom = 0; // Start in the Van room
+    moveHunter(house, hunter->id, NO_ROOM, hunter->currentRoom);
+}
+
+/*
+  Function: hunterExit(Hunter* hunter, enum LoggerDetails reason)
+  Purpose: Logs the hunter leaving and removes them from their room.
+*/
+static int hunterExit(Hunter* hunter, enum LoggerDetails reason) {
+    l_hunterExit(&hunter->house->log, hunter->name, reason);
+    traceEvent(hunter->house, TRACE_HUNTER_EXIT, hunter->id, hunter->currentRoom, reason);
+    hunter->exitReason = reason;
+    moveHunter(hunter->house, hunter->id, hunter->currentRoom, NO_ROOM);
+    hunter->currentRoom = NO_ROOM;
+    return C_FALSE;
+}
+
+/*
+  Function: noteSurroundings(Hunter* hunter, int inRoomWithGhost)
+  Purpose: For navigating hunters, puts what a hunter sees on the evidence board: the ghost, or uncollected evidence only someone else's equipment can read. Leads that turn out to be stale, because the ghost or the evidence has gone, are taken off. What the room holds is read from the house's evidence index, without locking it.
+*/
+static void noteSurroundings(Hunter* hunter, int inRoomWithGhost) {
+    EvidenceBoard* board = &hunter->house->evidence;
+    RoomId here = hunter->currentRoom;
+    unsigned seen = roomEvidenceKinds(hunter->house, here);
+    unsigned collected = atomic_load_explicit(&board->collected, memory_order_relaxed);
+
+    RoomId stale = here;
+    if (inRoomWithGhost) {
+        atomic_store_explicit(&board->sighting, here, memory_order_relaxed);
+    } else {
+        atomic_compare_exchange_strong(&board->sighting, &stale, NO_ROOM);
+    }
+    for (int e = 0; e < EV_COUNT; e++) {
+        stale = here;
+        if ((seen & (1u << e)) && !(collected & (1u << e)) && e != (int) hunter->equipment) {
+            atomic_store_explicit(&board->lead[e], here, memory_order_relaxed);
+        } else if (!(seen & (1u << e))) {
+            atomic_compare_exchange_strong(&board->lead[e], &stale, NO_ROOM);
+        }
+    }
+}
+
+/*
+  Function: chooseRoom(Hunter* hunter)
+  Purpose: Picks the room a navigating hunter moves to.
+
+  Parameters:
+    in/out hunter: the hunter that is moving.
+
+  Description:
+    The hunter heads for the last room where evidence its equipment reads was seen, unless that evidence has already been collected, and waits there until it collects it; failing that, for the last room where the ghost was seen; failing that, it moves to a random connected room. Each step of the way is a lookup in the house's navigation tables.
+
+  return
+    the room to move to, possibly the one the hunter is in
+*/
+static RoomId chooseRoom(Hunter* hunter) {
+    HouseType* house = hunter->house;
+    const NavTable* nav = house->layout->nav;
+    EvidenceBoard* board = &house->evidence;
+    RoomId here = hunter->currentRoom;
+
+    unsigned collected = atomic_load_explicit(&board->collected, memory_order_relaxed);
+    if (!(collected & (1u << hunter->equipment))) {
+        RoomId lead = atomic_load_explicit(&board->lead[hunter->equipment], memory_order_relaxed);
+        if (lead == here) return here;
+        if (lead != NO_ROOM && navDistance(nav, here, lead) != NAV_FAR) return navNextRoom(nav, here, lead);
+    }
+
+    RoomId sighting = atomic_load_explicit(&board->sighting, memory_order_relaxed);
+    if (sighting != NO_ROOM && sighting != here && navDistance(nav, here, sighting) != NAV_FAR) {
+        return navNextRoom(nav, here, sighting);
+    }
+    return getRandomConnectedRoom(house->layout, here, &hunter->rng);
+}
+
+/*
+  Function: hunterTurn(Hunter* hunter)
+  Purpose: Performs one turn of a hunter.
+
+  Parameters:
+    in/out hunter: A pointer to the Hunter structure taking its turn.
+
+  Description:
+    The hunter checks for the presence of a ghost, then collects evidence, moves to a random connected room (or, in a house with navigation tables, towards a lead, see chooseRoom), or reviews the shared evidence. The function also monitors the hunter's fear and boredom levels, making the hunter leave if either surpasses predefined thresholds.
+
+  return
+    C_TRUE if the hunter is still in the house, C_FALSE once they have exited
+*/
+static int hunterTurn(Hunter* hunter) {
+    HouseType* house = hunter->house;
+
+    // Check if the hunter is in a room with a ghost
+    unsigned occupancy = atomic_load_explicit(&house->rooms[hunter->currentRoom].occupancy, memory_order_acquire);
+    int inRoomWithGhost = (occupancy & OCC_GHOST) != 0;
+    if (house->layout->nav != NULL) noteSurroundings(hunter, inRoomWithGhost);
+
+    if (inRoomWithGhost) {
+        // Increase fear field of the hunter by 1 and reset boredom timer
+        hunter->fear++;
+        hunter->boredom = 0;
+    } else {
+        // Hunter is not in a room with a ghost
+        // Increase boredom by 1
+        hunter->boredom++;
+    }
+
+    // Randomly choose to collect evidence, move, or review evidence
+    int action = rngRange(&hunter->rng, 3);
+    switch (action) {
+        case 0:
+            // Collect evidence
+            enum EvidenceType evidenceType = takeEvidenceFromRoom(house, hunter->currentRoom, hunter->equipment);
+            if (evidenceType != EV_UNKNOWN) {
+                l_hunterCollect(&house->log, hunter->name, evidenceType, roomName(house->layout, hunter->currentRoom));
+                traceEvent(house, TRACE_HUNTER_COLLECT, hunter->id, hunter->currentRoom, evidenceType);
+                collectEvidence(house, evidenceType, hunter->id);
+            }
+            break;
+        case 1:
+            // Move to a random, connected room, or towards a lead when the house has navigation tables
+            RoomId nextRoom = house->layout->nav != NULL ? chooseRoom(hunter)
+                                                         : getRandomConnectedRoom(house->layout, hunter->currentRoom, &hunter->rng);
+            // A hunter waiting on a lead stays put, which is not a move
+            if (nextRoom == hunter->currentRoom) break;
+            l_hunterMove(&house->log, hunter->name, roomName(house->layout, nextRoom));
+            traceEvent(house, TRACE_HUNTER_MOVE, hunter->id, nextRoom, 0);
+
+            // Update the hunter counts in the rooms
+            moveHunter(house, hunter->id, hunter->currentRoom, nextRoom);
+
+            // Update the hunter's current room
+            hunter->currentRoom = nextRoom;
+            break;
+        case 2:
+            // Review evidence
+            if (reviewEvidence(house)) {
+                l_hunterReview(&house->log, hunter->name, LOG_SUFFICIENT);
+                traceEvent(house, TRACE_HUNTER_REVIEW, hunter->id, hunter->currentRoom, LOG_SUFFICIENT);
+                return hunterExit(hunter, LOG_EVIDENCE);
+            }
+            l_hunterReview(&house->log, hunter->name, LOG_INSUFFICIENT);
+            traceEvent(house, TRACE_HUNTER_REVIEW, hunter->id, hunter->currentRoom, LOG_INSUFFICIENT);
+            break;
+    }
+
+    // Check if the fear of the hunter is greater than or equal to FEAR_MAX
+    if (hunter->fear >= house->rules.fearMax) {
+        return hunterExit(hunter, LOG_FEAR);
+    }
+
+    // Check if the hunter's boredom is greater than or equal to BOREDOM_MAX
+    if (hunter->boredom >= house->rules.boredomMax) {
+        return hunterExit(hunter, LOG_BORED);
+    }
+
+    return C_TRUE;
+}
+
+/*
+  Function: hunterStep(Hunter* hunter)
+  Purpose: Performs one turn of a hunter, see hunterTurn, and counts it when built with INSTRUMENT.
+
+  return
+    C_TRUE if the hunter is still in the house, C_FALSE once they have exited
+*/
+int hunterStep(Hunter* hunter) {
+    INST_TIME(start);
+    int active = hunterTurn(hunter);
+    INST_SINCE(INST_HUNTER_TURN, start);
+    INST_COUNT(INST_HUNTER_TURNS);
+    INST_TURN(hunter);
+    if (!active) INST_RECORD(INST_HUNTER_LIFETIME, hunter->turns);
+    return active;
+}
+
+/*
+  Function: roomNews(Hunter* hunter)
+  Purpose: What in the hunter's room is worth waking up for: the ghost (bit EV_COUNT) and evidence its equipment reads (its bit).
+*/
+static unsigned roomNews(Hunter* hunter) {
+    HouseType* house = hunter->house;
+    unsigned occupancy = atomic_load_explicit(&house->rooms[hunter->currentRoom].occupancy, memory_order_acquire);
+    unsigned news = roomEvidenceKinds(house, hunter->currentRoom) & (1u << hunter->equipment);
+    if (occupancy & OCC_GHOST) news |= 1u << EV_COUNT;
+    return news;
+}
+
+/*
+  Function: awaitTurn(Hunter* hunter)
+  Purpose: Waits up to the hunter wait of the house's rules for the hunter's next turn on its room's event counter.
+
+  Parameters:
+    in/out hunter: the hunter, in a house with room signals.
+
+  Description:
+    The hunter wakes early when the ghost enters its room or evidence it can read is left there, and goes back to sleep if an event brought nothing new, e.g. evidence for someone else's equipment. Its next regular turn is due a hunter wait after this one, as with usleep, whichever way it wakes.
+
+  return
+    C_TRUE if it was woken by news, C_FALSE once its regular turn is due
+*/
+static int awaitTurn(Hunter* hunter) {
+    HouseType* house = hunter->house;
+    struct timespec deadline;
+    roomSignalDeadline(&deadline, house->rules.hunterWait);
+
+    unsigned seen = roomSignal(house, hunter->currentRoom);
+    unsigned known = roomNews(hunter);
+    while (waitForRoomSignal(house, hunter->currentRoom, seen, &deadline)) {
+        seen = roomSignal(house, hunter->currentRoom);
+        unsigned news = roomNews(hunter);
+        if (news & ~known) {
+            INST_COUNT(INST_WAKEUPS);
+            return C_TRUE;
+        }
+        known = news;
+    }
+    return C_FALSE;
+}
+
 /*
   Function: hunterThread(void* arg)
   Purpose: Simulates the behavior of a hunter in a ghost-hunting game.
@@ -9,7 +255,7 @@
     in/out arg: A void pointer to a Hunter structure, representing the hunter participating in the game.
 
   Description:
-    This function initializes a hunter and enters into an infinite loop, emulating the actions of a ghost hunter in a haunted environment. The hunter's actions include checking for the presence of ghosts, collecting evidence, moving to random connected rooms, and reviewing evidence. The function also monitors the hunter's fear and boredom levels, triggering an exit if either surpasses predefined thresholds.
+    This function initializes a hunter and calls hunterStep every HUNTER_WAIT milliseconds until the hunter leaves the house because of fear, boredom or sufficient evidence. In a house with room signals the hunter also takes a turn as soon as the ghost or its evidence arrives in its room, see awaitTurn.
 
     pthread_t thread;
     Hunter myHunter;
@@ -30,72 +276,18 @@ void* hunterThread(void* arg) {
     Hunter* hunter = (Hunter*)arg;
 
     // Initialization log
-    l_hunterInit(hunter->name, hunter->equipment);
-
-    while (1) {
-        // Check if the hunter is in a room with a ghost
-        int inRoomWithGhost = (hunter->currentRoom->ghost != NULL);
+    l_hunterInit(&hunter->house->log, hunter->name, hunter->equipment);
+    traceEvent(hunter->house, TRACE_HUNTER_INIT, hunter->id, hunter->currentRoom, hunter->equipment);
 
-        if (inRoomWithGhost) {
-            // Increase fear field of the hunter by 1 and reset boredom timer
-            hunter->fear++;
-            hunter->boredom = 0;
+    while (hunterStep(hunter)) {
+        // Introduce some delay before the next iteration
+        INST_TIME(asleep);
+        if (hunter->house->roomSignals != NULL) {
+            if (awaitTurn(hunter)) continue;
         } else {
-            // Hunter is not in a room with a ghost
-            // Increase boredom by 1
-            hunter->boredom++;
+            usleep(hunter->house->rules.hunterWait * 1000);
         }
-
-        // Randomly choose to collect evidence, move, or review evidence
-        int action = randInt(0, 2);
-        switch (action) {
-            case 0:
-                // Collect evidence
-                if (inRoomWithGhost) {
-                    enum EvidenceType evidenceType = hunter->currentRoom->evidenceType;
-                    if (evidenceType != EV_UNKNOWN && evidenceType == hunter->equipment) {
-                        l_hunterCollect(hunter->name, evidenceType, hunter->currentRoom->name);
-                        collectEvidence(evidenceType);
-                        hunter->currentRoom->evidenceType = EV_UNKNOWN;
-                    }
-                }
-                break;
-            case 1:
-                // Move to a random, connected room
-                Room* nextRoom = getRandomConnectedRoom(hunter->currentRoom);
-                if (nextRoom != NULL) {
-                    l_hunterMove(hunter->name, nextRoom->name);
-
-                    // Update the room pointer in the hunter
-                    hunter->currentRoom->hunters[hunter->id] = NULL;
-                    nextRoom->hunters[hunter->id] = hunter;
-
-                    // Update the hunter's current room
-                    hunter->currentRoom = nextRoom;
-                }
-                break;
-            case 2:
-                // Review evidence
-                if (reviewEvidence()) {
-                    l_hunterReview(hunter->name, LOG_SUFFICIENT);
-                    pthread_exit(NULL);
-                }
-                break;
-        }
-
-        // Check if the fear of the hunter is greater than or equal to FEAR_MAX
-        if (hunter->fear >= FEAR_MAX) {
-            l_hunterExit(hunter->name, LOG_UNKNOWN);
-            pthread_exit(NULL);
-        }
-
-        // Check if the hunter's boredom is greater than or equal to BOREDOM_MAX
-        if (hunter->boredom >= BOREDOM_MAX) {
-            l_hunterExit(hunter->name, LOG_UNKNOWN);
-            pthread_exit(NULL);
-        }
-
-        // Introduce some delay before the next iteration
-        usleep(HUNTER_WAIT * 1000);
+        INST_SLEPT(asleep, hunter->house->rules.hunterWait);
     }
+    return NULL;
 }
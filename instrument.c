@@ -0,0 +1,297 @@
+// instrument.c
+#include "defs.h"
+
+/*
+    Opt-in instrumentation of the hot paths, compiled in with make INSTRUMENT=1. Without it this
+    file is empty and every INST_* macro in defs.h does nothing: INST_TIME expands to nothing and
+    the others to ((void) 0), so they remain statements.
+
+    Each thread counts into its own InstThread, found through a thread-local pointer, so recording
+    never takes a lock or shares a cache line. Only the owning thread writes its counters; they
+    are relaxed atomics so that a dump can read them while the threads keep running. Threads
+    register their InstThread on a lock-free list the first time they record anything, and it
+    outlives them so that a dump at exit still covers threads that have finished.
+
+    Latencies go into HDR-style log-linear histograms: values below 16 have a bucket each, and
+    every power of two above that is split into 16 buckets, so any value is known to within 1/16
+    of itself while a histogram spans nanoseconds to minutes in INST_BUCKETS counters.
+
+    The summary is printed to stderr at exit, and at any time on SIGUSR1 by a thread that waits
+    for the signal, so the threads being measured are never interrupted by a handler.
+*/
+
+#ifdef INSTRUMENT
+
+#include <signal.h>
+
+#define INST_SUB_BITS   4
+#define INST_SUB        (1 << INST_SUB_BITS)
+#define INST_MAX_EXP    40                      // values are clamped below 2^40, about 18 minutes in ns
+#define INST_BUCKETS    ((INST_MAX_EXP - INST_SUB_BITS + 1) * INST_SUB)
+
+typedef struct InstHistogramData {
+    _Atomic uint64_t buckets[INST_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+} InstHistogramData;
+
+typedef struct InstThread {
+    _Atomic uint64_t counters[INST_COUNTER_COUNT];
+    InstHistogramData histograms[INST_HISTOGRAM_COUNT];
+    int index;                                  // order of registration, for the per-thread rows
+    struct InstThread* next;
+} InstThread;
+
+// Full names for the totals and short ones for the per-thread columns
+static const struct { const char* name; const char* column; } counterNames[INST_EVENTS] = {
+    [INST_HUNTER_TURNS] = { "hunter turns", "hunter turns" },
+    [INST_GHOST_TURNS] = { "ghost turns", "ghost turns" },
+    [INST_ROOM_LOCKS] = { "room locks", "room locks" },
+    [INST_ROOM_LOCKS_CONTENDED] = { "room locks contended", "contended" },
+    [INST_EVIDENCE_CLAIMED] = { "evidence claimed", "claimed" },
+    [INST_EVIDENCE_LOST] = { "evidence already claimed", "lost" },
+    [INST_SLEEPS] = { "sleeps", "sleeps" },
+    [INST_WAKEUPS] = { "woken by room events", "woken" },
+};
+
+static const struct { const char* name; const char* unit; } histogramNames[INST_HISTOGRAM_COUNT] = {
+    [INST_ROOM_LOCK_WAIT] = { "room lock wait", "ns" },
+    [INST_HUNTER_TURN] = { "hunter turn", "ns" },
+    [INST_GHOST_TURN] = { "ghost turn", "ns" },
+    [INST_OVERSLEEP] = { "oversleep", "ns" },
+    [INST_HUNTER_LIFETIME] = { "turns per hunter", "turns" },
+    [INST_GHOST_LIFETIME] = { "turns per ghost", "turns" },
+    [INST_REACTION] = { "reaction to room event", "ns" },
+};
+
+static _Atomic(InstThread*) instThreads = NULL;
+static atomic_int instNumThreads = 0;
+static __thread InstThread* instSelf = NULL;
+static pthread_mutex_t instDumpLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+    Returns the calling thread's counters, creating and registering them on first use.
+*/
+static InstThread* instThread() {
+    if (instSelf == NULL) {
+        InstThread* self = calloc(1, sizeof(InstThread));
+        if (self == NULL) {
+            perror("Error starting instrumentation");
+            exit(EXIT_FAILURE);
+        }
+        self->index = atomic_fetch_add(&instNumThreads, 1);
+        self->next = atomic_load(&instThreads);
+        while (!atomic_compare_exchange_weak(&instThreads, &self->next, self)) { }
+        instSelf = self;
+    }
+    return instSelf;
+}
+
+/*
+    Adds to a counter only the calling thread writes.
+*/
+static void bump(_Atomic uint64_t* counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/*
+    Returns the histogram bucket of a value, and the smallest value in a bucket.
+*/
+static int bucketOf(uint64_t value) {
+    if (value >= (1ull << INST_MAX_EXP)) value = (1ull << INST_MAX_EXP) - 1;
+    if (value < INST_SUB) return (int) value;
+    int exp = 63 - __builtin_clzll(value);
+    return (exp - INST_SUB_BITS + 1) * INST_SUB + (int) ((value >> (exp - INST_SUB_BITS)) & (INST_SUB - 1));
+}
+
+static uint64_t bucketStart(int bucket) {
+    if (bucket < INST_SUB) return bucket;
+    int exp = bucket / INST_SUB + INST_SUB_BITS - 1;
+    return (uint64_t) (INST_SUB + bucket % INST_SUB) << (exp - INST_SUB_BITS);
+}
+
+/*
+  Function: instNow()
+  Purpose: Returns a monotonic timestamp in nanoseconds.
+*/
+uint64_t instNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/*
+  Function: instCount(enum InstCounter counter)
+  Purpose: Adds one to a counter of the calling thread.
+*/
+void instCount(enum InstCounter counter) {
+    bump(&instThread()->counters[counter], 1);
+}
+
+/*
+  Function: instRecord(enum InstHistogram histogram, uint64_t value)
+  Purpose: Adds a value to a histogram of the calling thread.
+*/
+void instRecord(enum InstHistogram histogram, uint64_t value) {
+    InstHistogramData* data = &instThread()->histograms[histogram];
+    bump(&data->buckets[bucketOf(value)], 1);
+    bump(&data->count, 1);
+    bump(&data->sum, value);
+    if (value > atomic_load_explicit(&data->max, memory_order_relaxed)) {
+        atomic_store_explicit(&data->max, value, memory_order_relaxed);
+    }
+}
+
+/*
+  Function: instSlept(uint64_t asleep, long millis)
+  Purpose: Records how much longer than millis a sleep that began at instNow() == asleep took.
+*/
+void instSlept(uint64_t asleep, long millis) {
+    uint64_t slept = instNow() - asleep;
+    uint64_t wanted = (uint64_t) millis * 1000000;
+    instCount(INST_SLEEPS);
+    instRecord(INST_OVERSLEEP, slept > wanted ? slept - wanted : 0);
+}
+
+/*
+  Function: instLate(const struct timespec* origin, long dueMillis)
+  Purpose: Records how late a turn due dueMillis after a CLOCK_MONOTONIC origin is starting now.
+*/
+void instLate(const struct timespec* origin, long dueMillis) {
+    uint64_t due = (uint64_t) origin->tv_sec * 1000000000u + origin->tv_nsec + (uint64_t) dueMillis * 1000000;
+    uint64_t now = instNow();
+    instCount(INST_SLEEPS);
+    instRecord(INST_OVERSLEEP, now > due ? now - due : 0);
+}
+
+/*
+    Returns the lower bound of the bucket holding the given fraction of a merged histogram's values.
+*/
+static uint64_t percentile(const uint64_t* buckets, uint64_t count, uint64_t max, double fraction) {
+    uint64_t rank = (uint64_t) (fraction * count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < INST_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            uint64_t value = bucketStart(b);
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+/*
+  Function: instDump(FILE* out)
+  Purpose: Prints every counter and histogram summed over all threads, then the main counters of each thread.
+
+  Description:
+    Safe to call while the measured threads are running; the figures are then a moment's snapshot and may be off by the few events in flight.
+*/
+void instDump(FILE* out) {
+    static uint64_t buckets[INST_BUCKETS];
+    uint64_t counters[INST_COUNTER_COUNT] = { 0 };
+
+    pthread_mutex_lock(&instDumpLock);
+    int numThreads = atomic_load(&instNumThreads);
+    fprintf(out, "\nInstrumentation, %d thread%s:\n", numThreads, numThreads == 1 ? "" : "s");
+
+    for (InstThread* thread = atomic_load(&instThreads); thread != NULL; thread = thread->next) {
+        for (int c = 0; c < INST_COUNTER_COUNT; c++) {
+            counters[c] += atomic_load_explicit(&thread->counters[c], memory_order_relaxed);
+        }
+    }
+    for (int c = 0; c < INST_COUNTER_COUNT; c++) {
+        if (c < INST_EVENTS) {
+            fprintf(out, "  %-26s %14llu\n", counterNames[c].name, (unsigned long long) counters[c]);
+        } else if (counters[c] > 0) {
+            char name[MAX_STR];
+            snprintf(name, MAX_STR, "%s events", traceTypeName(c - INST_EVENTS));
+            fprintf(out, "  %-26s %14llu\n", name, (unsigned long long) counters[c]);
+        }
+    }
+
+    fprintf(out, "  %-26s %10s %10s %10s %10s %10s %10s %10s\n", "", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int h = 0; h < INST_HISTOGRAM_COUNT; h++) {
+        uint64_t count = 0, sum = 0, max = 0;
+        memset(buckets, 0, sizeof(buckets));
+        for (InstThread* thread = atomic_load(&instThreads); thread != NULL; thread = thread->next) {
+            InstHistogramData* data = &thread->histograms[h];
+            for (int b = 0; b < INST_BUCKETS; b++) {
+                buckets[b] += atomic_load_explicit(&data->buckets[b], memory_order_relaxed);
+            }
+            count += atomic_load_explicit(&data->count, memory_order_relaxed);
+            sum += atomic_load_explicit(&data->sum, memory_order_relaxed);
+            uint64_t threadMax = atomic_load_explicit(&data->max, memory_order_relaxed);
+            if (threadMax > max) max = threadMax;
+        }
+        char name[MAX_STR];
+        snprintf(name, MAX_STR, "%s (%s)", histogramNames[h].name, histogramNames[h].unit);
+        if (count == 0) {
+            fprintf(out, "  %-26s %10d\n", name, 0);
+            continue;
+        }
+        fprintf(out, "  %-26s %10llu %10.0f %10llu %10llu %10llu %10llu %10llu\n", name, (unsigned long long) count,
+                (double) sum / count, (unsigned long long) percentile(buckets, count, max, 0.5),
+                (unsigned long long) percentile(buckets, count, max, 0.9),
+                (unsigned long long) percentile(buckets, count, max, 0.99),
+                (unsigned long long) percentile(buckets, count, max, 0.999), (unsigned long long) max);
+    }
+
+    // One row per thread, newest first, leaving out the event counts
+    int shown = 0;
+    fprintf(out, "  %-8s", "thread");
+    for (int c = 0; c < INST_EVENTS; c++) fprintf(out, " %12s", counterNames[c].column);
+    fprintf(out, "\n");
+    for (InstThread* thread = atomic_load(&instThreads); thread != NULL; thread = thread->next) {
+        if (shown++ == 32) {
+            fprintf(out, "  ... and %d more threads\n", numThreads - 32);
+            break;
+        }
+        fprintf(out, "  %-8d", thread->index);
+        for (int c = 0; c < INST_EVENTS; c++) {
+            fprintf(out, " %12llu", (unsigned long long) atomic_load_explicit(&thread->counters[c], memory_order_relaxed));
+        }
+        fprintf(out, "\n");
+    }
+    fflush(out);
+    pthread_mutex_unlock(&instDumpLock);
+}
+
+static void dumpAtExit() {
+    instDump(stderr);
+}
+
+/*
+    Waits for SIGUSR1 and dumps the figures each time it arrives.
+*/
+static void* signalThread(void* arg) {
+    sigset_t* signals = (sigset_t*) arg;
+    int signal;
+    for (;;) {
+        if (sigwait(signals, &signal) == 0) instDump(stderr);
+    }
+    return NULL;
+}
+
+/*
+  Function: instStart()
+  Purpose: Arranges for the figures to be dumped at exit and on SIGUSR1.
+
+  Description:
+    Call it at the start of main, before any other thread is created: SIGUSR1 is blocked in the calling thread, so every thread created afterwards inherits the mask and the signal is only ever taken by the dump thread.
+*/
+void instStart() {
+    static sigset_t signals;
+    pthread_t thread;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_create(&thread, NULL, signalThread, &signals);
+    pthread_detach(thread);
+    atexit(dumpAtExit);
+}
+
+#endif
@@ -0,0 +1,260 @@
+// layout.c
+#include "defs.h"
+#include <sys/mman.h>
+
+/*
+    The house topology is built once with a HouseBuilder and then frozen into a HouseLayout:
+    rooms are numbered 0..numRooms-1 (0 is always the Van), the connections are stored as a
+    compressed-sparse-row adjacency array, and the room names live in one interned string table.
+    A layout is never modified after buildLayout, so any number of games can share it.
+*/
+
+/*
+    Returns the FNV-1a hash of a room name.
+*/
+static uint32_t hashName(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+    Grows a builder array so it holds at least count elements of the given size.
+*/
+static void* growArray(void* array, uint32_t* capacity, uint32_t count, size_t size) {
+    if (count <= *capacity) return array;
+    uint32_t newCapacity = *capacity ? *capacity : 16;
+    while (newCapacity < count) newCapacity *= 2;
+    void* grown = realloc(array, newCapacity * size);
+    if (grown == NULL) {
+        perror("Error building house");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = newCapacity;
+    return grown;
+}
+
+/*
+    Rebuilds the name hash table with room for twice the current number of rooms.
+*/
+static void rehashNames(HouseBuilder* builder) {
+    uint32_t capacity = 64;
+    while (capacity < 2 * builder->numRooms + 2) capacity *= 2;
+    free(builder->hash);
+    builder->hash = malloc(capacity * sizeof(uint32_t));
+    if (builder->hash == NULL) {
+        perror("Error building house");
+        exit(EXIT_FAILURE);
+    }
+    memset(builder->hash, 0xff, capacity * sizeof(uint32_t));
+    builder->hashCapacity = capacity;
+    for (uint32_t id = 0; id < builder->numRooms; id++) {
+        uint32_t slot = hashName(builder->names + builder->nameOffset[id]) & (capacity - 1);
+        while (builder->hash[slot] != NO_ROOM) slot = (slot + 1) & (capacity - 1);
+        builder->hash[slot] = id;
+    }
+}
+
+/*
+    Function: initBuilder(HouseBuilder* builder)
+    Purpose: Initializes an empty house builder.
+
+    Parameters:
+      out: builder - the builder to initialize.
+
+    Example Usage:
+      HouseBuilder builder;
+      initBuilder(&builder);
+*/
+void initBuilder(HouseBuilder* builder) {
+    memset(builder, 0, sizeof(HouseBuilder));
+    rehashNames(builder);
+}
+
+/*
+    Function: cleanupBuilder(HouseBuilder* builder)
+    Purpose: Frees the builder's scratch memory. Layouts built from it stay valid.
+*/
+void cleanupBuilder(HouseBuilder* builder) {
+    free(builder->names);
+    free(builder->nameOffset);
+    free(builder->edges);
+    free(builder->hash);
+    memset(builder, 0, sizeof(HouseBuilder));
+}
+
+/*
+    Function: findRoom(const HouseBuilder* builder, const char* name)
+    Purpose: Looks up a room by name.
+
+    Returns:
+      out: The room's id, or NO_ROOM if no room has that name.
+*/
+RoomId findRoom(const HouseBuilder* builder, const char* name) {
+    uint32_t mask = builder->hashCapacity - 1;
+    uint32_t slot = hashName(name) & mask;
+    while (builder->hash[slot] != NO_ROOM) {
+        RoomId id = builder->hash[slot];
+        if (strcmp(builder->names + builder->nameOffset[id], name) == 0) return id;
+        slot = (slot + 1) & mask;
+    }
+    return NO_ROOM;
+}
+
+/*
+    Function: createRoom(HouseBuilder* builder, const char* name)
+    Purpose: Adds a room to the house being built. Names are interned: creating a room
+      with a name that already exists returns the existing room.
+
+    Parameters:
+      in/out: builder - the house being built.
+      in: name - the name of the room, at most MAX_STR - 1 characters are kept.
+
+    Returns:
+      out: The id of the room. The first room created gets id 0 and should be the Van.
+
+    Example Usage:
+      RoomId van = createRoom(&builder, "Van");
+*/
+RoomId createRoom(HouseBuilder* builder, const char* name) {
+    char interned[MAX_STR];
+    strncpy(interned, name, MAX_STR - 1);
+    interned[MAX_STR - 1] = '\0';
+
+    RoomId existing = findRoom(builder, interned);
+    if (existing != NO_ROOM) return existing;
+
+    uint32_t length = strlen(interned) + 1;
+    builder->names = growArray(builder->names, &builder->namesCapacity, builder->namesSize + length, 1);
+    builder->nameOffset = growArray(builder->nameOffset, &builder->roomsCapacity, builder->numRooms + 1, sizeof(uint32_t));
+    memcpy(builder->names + builder->namesSize, interned, length);
+
+    RoomId id = builder->numRooms++;
+    builder->nameOffset[id] = builder->namesSize;
+    builder->namesSize += length;
+
+    if (2 * builder->numRooms > builder->hashCapacity) {
+        rehashNames(builder);
+    } else {
+        uint32_t mask = builder->hashCapacity - 1;
+        uint32_t slot = hashName(interned) & mask;
+        while (builder->hash[slot] != NO_ROOM) slot = (slot + 1) & mask;
+        builder->hash[slot] = id;
+    }
+    return id;
+}
+
+/*
+    Function: connectRooms(HouseBuilder* builder, RoomId room1, RoomId room2)
+    Purpose: Connects two rooms in a two-way connection.
+
+    Parameters:
+      in/out: builder - the house being built.
+      in: room1, room2 - the rooms to connect.
+
+    Example Usage:
+      connectRooms(&builder, van, hallway);
+*/
+void connectRooms(HouseBuilder* builder, RoomId room1, RoomId room2) {
+    if (room1 >= builder->numRooms || room2 >= builder->numRooms) {
+        fprintf(stderr, "Error connecting rooms: unknown room.\n");
+        exit(EXIT_FAILURE);
+    }
+    builder->edges = growArray(builder->edges, &builder->edgesCapacity, builder->numEdges + 1, 2 * sizeof(RoomId));
+    builder->edges[2 * builder->numEdges] = room1;
+    builder->edges[2 * builder->numEdges + 1] = room2;
+    builder->numEdges++;
+}
+
+/*
+    Function: buildLayout(const HouseBuilder* builder, HouseLayout* layout)
+    Purpose: Freezes the rooms and connections added so far into a compact layout.
+
+    Parameters:
+      in: builder - the house being built.
+      out: layout - the layout, backed by a single allocation; free it with cleanupLayout.
+
+    Description:
+      The adjacency array is filled with a counting sort over the connections, so each room's
+      neighbours are contiguous and appear in the order the connections were made.
+*/
+void buildLayout(const HouseBuilder* builder, HouseLayout* layout) {
+    uint32_t numRooms = builder->numRooms;
+    uint32_t numAdj = 2 * builder->numEdges;
+    size_t size = (numRooms + 1) * sizeof(uint32_t)   // adjStart
+                + numAdj * sizeof(RoomId)             // adj
+                + numRooms * sizeof(uint32_t)         // nameOffset
+                + builder->namesSize;                 // names
+
+    char* storage = malloc(size > 0 ? size : 1);
+    if (storage == NULL) {
+        perror("Error building house");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t* adjStart = (uint32_t*) storage;
+    RoomId* adj = (RoomId*) (adjStart + numRooms + 1);
+    uint32_t* nameOffset = (uint32_t*) (adj + numAdj);
+    char* names = (char*) (nameOffset + numRooms);
+
+    // Count each room's degree, turn the counts into offsets, then place the neighbours
+    memset(adjStart, 0, (numRooms + 1) * sizeof(uint32_t));
+    for (uint32_t e = 0; e < builder->numEdges; e++) {
+        adjStart[builder->edges[2 * e] + 1]++;
+        adjStart[builder->edges[2 * e + 1] + 1]++;
+    }
+    for (uint32_t r = 0; r < numRooms; r++) {
+        adjStart[r + 1] += adjStart[r];
+    }
+    uint32_t* fill = malloc((numRooms + 1) * sizeof(uint32_t));
+    if (fill == NULL) {
+        perror("Error building house");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, adjStart, (numRooms + 1) * sizeof(uint32_t));
+    for (uint32_t e = 0; e < builder->numEdges; e++) {
+        RoomId a = builder->edges[2 * e], b = builder->edges[2 * e + 1];
+        adj[fill[a]++] = b;
+        adj[fill[b]++] = a;
+    }
+    free(fill);
+
+    memcpy(nameOffset, builder->nameOffset, numRooms * sizeof(uint32_t));
+    memcpy(names, builder->names, builder->namesSize);
+
+    layout->numRooms = numRooms;
+    layout->numAdj = numAdj;
+    layout->adjStart = adjStart;
+    layout->adj = adj;
+    layout->nameOffset = nameOffset;
+    layout->names = names;
+    layout->namesSize = builder->namesSize;
+    layout->storage = storage;
+    layout->mappedSize = 0;
+    layout->nav = NULL;
+    layout->evidenceSlots = 1;
+}
+
+/*
+    Function: cleanupLayout(HouseLayout* layout)
+    Purpose: Frees or unmaps the memory backing a layout, and its navigation tables. Every house using it must be cleaned up first.
+*/
+void cleanupLayout(HouseLayout* layout) {
+    freeNavTable((NavTable*) layout->nav);
+    if (layout->mappedSize > 0) {
+        munmap(layout->storage, layout->mappedSize);
+    } else {
+        free(layout->storage);
+    }
+    memset(layout, 0, sizeof(HouseLayout));
+}
+
+/*
+    Function: roomName(const HouseLayout* layout, RoomId room)
+    Purpose: Returns the interned name of a room.
+*/
+const char* roomName(const HouseLayout* layout, RoomId room) {
+    return layout->names + layout->nameOffset[room];
+}
@@ -0,0 +1,842 @@
+// lockstep.c
+#include "defs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LANES_X86
+#endif
+
+/*
+    The lockstep engine plays many games side by side, one per lane of a block, for batches.
+
+    A game's turns fall at the same simulated times in every game: the ghost's every GHOST_WAIT
+    ms and the hunters' every HUNTER_WAIT ms, in the order simStep takes them. So instead of
+    running one game's turns one after the other, the engine runs one kind of turn for every
+    lane at once. The state is kept as a struct of arrays, one array per field with one entry per
+    lane, and a whole turn is taken by a SIMD kernel across 8 (AVX2), 4 (SSE4.2) or 1 (scalar)
+    lanes at a time: the fear and boredom updates, the ghost's check for hunters, every random
+    draw, with a vectorised xoshiro256** and Lemire's range reduction that advances only the
+    generators of the lanes whose entity draws, and the exits. Rooms, exits and evidence are
+    read with gathers; evidence picked up or left, rare per turn, is written lane by lane. The
+    kernels are picked at run time with __builtin_cpu_supports.
+
+    Each lane draws exactly the numbers simStep would, from the same streams, and rare draws the
+    vector reduction cannot settle are redone with rngRange, so a game gives the same result here
+    as in a SimContext and a batch has the same totals whichever engine plays it. A lane whose
+    game ends waits for the end of the period, when the hunters' and the ghost's turns line up
+    again, to start the next one.
+*/
+
+// Kernels that take a turn in every lane of a block; lanes is always a multiple of LOCKSTEP_WIDTH
+struct LaneKernels {
+    void (*hunter)(Lockstep* block, int h, long time);                  // hunter h, wherever it is still in the house
+    void (*ghost)(Lockstep* block, const int32_t* active, long time);   // the ghost, in the lanes where active[k] is set
+};
+
+/*
+    Scalar kernels: hunterStep and ghostStep in lanes [from, to), one lane at a time. The vector
+    kernels fall back on them for a group of lanes with a draw they cannot settle.
+*/
+static void hunterLanes(Lockstep* block, int h, long time, int from, int to) {
+    const HouseLayout* layout = block->layout;
+    size_t e = (size_t) h * block->lanes;
+    size_t g = (size_t) block->numHunters * block->lanes;
+    enum EvidenceType equipment = (enum EvidenceType) (h % EV_COUNT);
+
+    for (int k = from; k < to; k++) {
+        size_t i = e + k;
+        if (!block->present[i]) continue;
+        Rng rng = { { block->rng[0][i], block->rng[1][i], block->rng[2][i], block->rng[3][i] } };
+        RoomId room = (RoomId) block->room[i];
+        int reason = LOG_UNKNOWN;
+
+        if (block->present[g + k] && block->room[g + k] == block->room[i]) {
+            block->fear[i]++;
+            block->boredom[i] = 0;
+        } else {
+            block->boredom[i]++;
+        }
+        switch (rngRange(&rng, 3)) {
+            case 0: {
+                unsigned char* evidence = block->evidence + (size_t) k * layout->numRooms + room;
+                if (*evidence == equipment) {
+                    *evidence = EV_UNKNOWN;
+                    block->collected[k] |= 1u << equipment;
+                }
+                break;
+            }
+            case 1:
+                block->room[i] = (int32_t) getRandomConnectedRoom(layout, room, &rng);
+                break;
+            case 2:
+                if (__builtin_popcount(block->collected[k]) >= MAX_COLLECTED_EVIDENCE) reason = LOG_EVIDENCE;
+                break;
+        }
+        if (reason == LOG_UNKNOWN && block->fear[i] >= FEAR_MAX) reason = LOG_FEAR;
+        if (reason == LOG_UNKNOWN && block->boredom[i] >= BOREDOM_MAX) reason = LOG_BORED;
+        if (reason != LOG_UNKNOWN) {
+            block->present[i] = 0;
+            block->exitReason[i] = reason;
+            block->lastTurn[k] = time;
+        }
+        for (int w = 0; w < 4; w++) {
+            block->rng[w][i] = rng.s[w];
+        }
+    }
+}
+
+static void ghostLanes(Lockstep* block, const int32_t* active, long time, int from, int to) {
+    const HouseLayout* layout = block->layout;
+    int lanes = block->lanes;
+    size_t g = (size_t) block->numHunters * lanes;
+
+    for (int k = from; k < to; k++) {
+        if (!active[k]) continue;
+        size_t i = g + k;
+        Rng rng = { { block->rng[0][i], block->rng[1][i], block->rng[2][i], block->rng[3][i] } };
+        RoomId room = (RoomId) block->room[i];
+        int hunterHere = C_FALSE;
+        for (int h = 0; h < block->numHunters; h++) {
+            hunterHere |= block->present[(size_t) h * lanes + k] && block->room[(size_t) h * lanes + k] == block->room[i];
+        }
+
+        int action;
+        if (hunterHere) {
+            block->boredom[i] = 0;
+            action = rngRange(&rng, 2);
+        } else {
+            block->boredom[i]++;
+            action = rngRange(&rng, 3);
+        }
+        if (action == 1) {
+            enum EvidenceType kind = randomGhostEvidence(block->ghostType[k], &rng);
+            unsigned char* evidence = block->evidence + (size_t) k * layout->numRooms + room;
+            if (*evidence == EV_UNKNOWN) *evidence = kind;
+        } else if (action == 2) {
+            block->room[i] = (int32_t) getRandomConnectedRoom(layout, room, &rng);
+        }
+        if (block->boredom[i] >= BOREDOM_MAX) {
+            block->present[i] = 0;
+            block->lastTurn[k] = time;
+        }
+        for (int w = 0; w < 4; w++) {
+            block->rng[w][i] = rng.s[w];
+        }
+    }
+}
+
+static void hunterScalar(Lockstep* block, int h, long time) {
+    hunterLanes(block, h, time, 0, block->lanes);
+}
+
+static void ghostScalar(Lockstep* block, const int32_t* active, long time) {
+    ghostLanes(block, active, time, 0, block->lanes);
+}
+
+static const LaneKernels scalarKernels = { hunterScalar, ghostScalar };
+
+#ifdef LANES_X86
+
+/*
+    AVX2 kernels: a group of 8 lanes at a time, their generators 4 to a register. Rooms, exits
+    and evidence are read with gathers; the evidence picked up or left is written lane by lane.
+*/
+typedef struct Gen8 {
+    __m256i s[4][2];                    // state word w of lanes 0-3 and 4-7
+} Gen8;
+
+__attribute__((target("avx2"), always_inline))
+static inline void loadGen8(Gen8* gen, const Lockstep* block, size_t i) {
+    for (int w = 0; w < 4; w++) {
+        gen->s[w][0] = _mm256_loadu_si256((const __m256i*) (block->rng[w] + i));
+        gen->s[w][1] = _mm256_loadu_si256((const __m256i*) (block->rng[w] + i + 4));
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void storeGen8(const Gen8* gen, Lockstep* block, size_t i) {
+    for (int w = 0; w < 4; w++) {
+        _mm256_storeu_si256((__m256i*) (block->rng[w] + i), gen->s[w][0]);
+        _mm256_storeu_si256((__m256i*) (block->rng[w] + i + 4), gen->s[w][1]);
+    }
+}
+
+/*
+    rngRange(n) in the lanes where mask is set, advancing only their generators. Lanes where
+    Lemire's method might have to draw again are added to unsure.
+*/
+__attribute__((target("avx2"), always_inline))
+static inline __m256i draw8(Gen8* gen, __m256i n, __m256i mask, __m256i* unsure) {
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffffLL);
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i value[2], doubt[2];
+    for (int j = 0; j < 2; j++) {
+        __m256i m64 = _mm256_cvtepi32_epi64(j == 0 ? _mm256_castsi256_si128(mask) : _mm256_extracti128_si256(mask, 1));
+        __m256i n64 = _mm256_cvtepu32_epi64(j == 0 ? _mm256_castsi256_si128(n) : _mm256_extracti128_si256(n, 1));
+        __m256i a = gen->s[0][j], b = gen->s[1][j], c = gen->s[2][j], d = gen->s[3][j];
+
+        // rotl(s[1] * 5, 7) * 9, then the xoshiro256 state update
+        __m256i x = _mm256_add_epi64(_mm256_slli_epi64(b, 2), b);
+        x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+        x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+        __m256i t = _mm256_slli_epi64(b, 17);
+        __m256i c1 = _mm256_xor_si256(c, a);
+        __m256i d1 = _mm256_xor_si256(d, b);
+        __m256i b1 = _mm256_xor_si256(b, c1);
+        __m256i a1 = _mm256_xor_si256(a, d1);
+        c1 = _mm256_xor_si256(c1, t);
+        d1 = _mm256_or_si256(_mm256_slli_epi64(d1, 45), _mm256_srli_epi64(d1, 19));
+        gen->s[0][j] = _mm256_blendv_epi8(a, a1, m64);
+        gen->s[1][j] = _mm256_blendv_epi8(b, b1, m64);
+        gen->s[2][j] = _mm256_blendv_epi8(c, c1, m64);
+        gen->s[3][j] = _mm256_blendv_epi8(d, d1, m64);
+
+        // The top 32 bits times the range; a low half below the range may need a redraw
+        __m256i m = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), n64);
+        doubt[j] = _mm256_and_si256(m64, _mm256_cmpgt_epi64(n64, _mm256_and_si256(m, low32)));
+        value[j] = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(m, 32), evens);
+        doubt[j] = _mm256_permutevar8x32_epi32(doubt[j], evens);
+    }
+    *unsure = _mm256_or_si256(*unsure, _mm256_permute2x128_si256(doubt[0], doubt[1], 0x20));
+    return _mm256_permute2x128_si256(value[0], value[1], 0x20);
+}
+
+__attribute__((target("avx2")))
+static void hunterAvx2(Lockstep* block, int h, long time) {
+    const HouseLayout* layout = block->layout;
+    int lanes = block->lanes;
+    size_t e = (size_t) h * lanes;
+    size_t g = (size_t) block->numHunters * lanes;
+    int equipment = h % EV_COUNT;
+    const int* adjStart = (const int*) layout->adjStart;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i fearLimit = _mm256_set1_epi32(FEAR_MAX - 1);
+    const __m256i boredomLimit = _mm256_set1_epi32(BOREDOM_MAX - 1);
+    const __m256i enough = _mm256_set1_epi32(MAX_COLLECTED_EVIDENCE - 1);
+    const __m256i unknown = _mm256_set1_epi32(LOG_UNKNOWN);
+    const __m256i scared = _mm256_set1_epi32(LOG_FEAR);
+    const __m256i bored = _mm256_set1_epi32(LOG_BORED);
+    const __m256i solved = _mm256_set1_epi32(LOG_EVIDENCE);
+    const __m256i lowByte = _mm256_set1_epi32(0xff);
+    const __m256i reads = _mm256_set1_epi32(equipment);
+    const __m256i bit = _mm256_set1_epi32(1 << equipment);
+    const __m256i laneRooms = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(layout->numRooms));
+
+    for (int k = 0; k < lanes; k += 8) {
+        __m256i alive = _mm256_loadu_si256((const __m256i*) (block->present + e + k));
+        if (_mm256_testz_si256(alive, alive)) continue;
+        __m256i room = _mm256_loadu_si256((const __m256i*) (block->room + e + k));
+        __m256i ghostHere = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (block->present + g + k)),
+                                             _mm256_cmpeq_epi32(room, _mm256_loadu_si256((const __m256i*) (block->room + g + k))));
+        __m256i fear = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*) (block->fear + e + k)), _mm256_and_si256(alive, ghostHere));
+        __m256i boredom = _mm256_loadu_si256((const __m256i*) (block->boredom + e + k));
+        boredom = _mm256_blendv_epi8(boredom, _mm256_andnot_si256(ghostHere, _mm256_add_epi32(boredom, one)), alive);
+
+        Gen8 gen;
+        loadGen8(&gen, block, e + k);
+        __m256i unsure = zero;
+        __m256i action = draw8(&gen, three, alive, &unsure);
+
+        // 0: pick up the evidence in the room if the equipment reads it
+        __m256i where = _mm256_add_epi32(_mm256_set1_epi32(k * layout->numRooms), _mm256_add_epi32(laneRooms, room));
+        __m256i left = _mm256_and_si256(_mm256_i32gather_epi32((const int*) block->evidence, where, 1), lowByte);
+        __m256i found = _mm256_and_si256(_mm256_and_si256(alive, _mm256_cmpeq_epi32(action, zero)), _mm256_cmpeq_epi32(left, reads));
+        __m256i collected = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (block->collected + k)), _mm256_and_si256(found, bit));
+
+        // 2: leave once the board holds three kinds of evidence
+        __m256i kinds = zero;
+        for (int b = 0; b < EV_COUNT; b++) {
+            kinds = _mm256_add_epi32(kinds, _mm256_and_si256(_mm256_srli_epi32(collected, b), one));
+        }
+        __m256i done = _mm256_and_si256(_mm256_and_si256(alive, _mm256_cmpeq_epi32(action, two)), _mm256_cmpgt_epi32(kinds, enough));
+
+        // 1: move through one of the room's exits, picked with a second draw
+        __m256i start = _mm256_i32gather_epi32(adjStart, room, 4);
+        __m256i exits = _mm256_sub_epi32(_mm256_i32gather_epi32(adjStart + 1, room, 4), start);
+        __m256i move = _mm256_and_si256(_mm256_and_si256(alive, _mm256_cmpeq_epi32(action, one)), _mm256_cmpgt_epi32(exits, zero));
+        __m256i pick = draw8(&gen, exits, move, &unsure);
+        if (!_mm256_testz_si256(unsure, unsure)) {
+            hunterLanes(block, h, time, k, k + 8);
+            continue;
+        }
+        room = _mm256_mask_i32gather_epi32(room, (const int*) layout->adj, _mm256_add_epi32(start, pick), move, 4);
+
+        __m256i reason = _mm256_blendv_epi8(unknown, bored, _mm256_cmpgt_epi32(boredom, boredomLimit));
+        reason = _mm256_blendv_epi8(reason, scared, _mm256_cmpgt_epi32(fear, fearLimit));
+        reason = _mm256_blendv_epi8(reason, solved, done);
+        __m256i leaving = _mm256_andnot_si256(_mm256_cmpeq_epi32(reason, unknown), alive);
+
+        storeGen8(&gen, block, e + k);
+        _mm256_storeu_si256((__m256i*) (block->room + e + k), room);
+        _mm256_storeu_si256((__m256i*) (block->fear + e + k), fear);
+        _mm256_storeu_si256((__m256i*) (block->boredom + e + k), boredom);
+        _mm256_storeu_si256((__m256i*) (block->collected + k), collected);
+        _mm256_storeu_si256((__m256i*) (block->present + e + k), _mm256_andnot_si256(leaving, alive));
+        _mm256_storeu_si256((__m256i*) (block->exitReason + e + k),
+                            _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i*) (block->exitReason + e + k)), reason, leaving));
+
+        int lanesFound = _mm256_movemask_ps(_mm256_castsi256_ps(found));
+        if (lanesFound) {
+            int32_t at[8];
+            _mm256_storeu_si256((__m256i*) at, where);
+            for (; lanesFound; lanesFound &= lanesFound - 1) {
+                block->evidence[at[__builtin_ctz(lanesFound)]] = EV_UNKNOWN;
+            }
+        }
+        for (int gone = _mm256_movemask_ps(_mm256_castsi256_ps(leaving)); gone; gone &= gone - 1) {
+            block->lastTurn[k + __builtin_ctz(gone)] = time;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void ghostAvx2(Lockstep* block, const int32_t* active, long time) {
+    const HouseLayout* layout = block->layout;
+    int lanes = block->lanes;
+    size_t g = (size_t) block->numHunters * lanes;
+    const int* adjStart = (const int*) layout->adjStart;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i boredomLimit = _mm256_set1_epi32(BOREDOM_MAX - 1);
+    const __m256i laneRooms = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(layout->numRooms));
+
+    for (int k = 0; k < lanes; k += 8) {
+        __m256i act = _mm256_loadu_si256((const __m256i*) (active + k));
+        if (_mm256_testz_si256(act, act)) continue;
+        __m256i room = _mm256_loadu_si256((const __m256i*) (block->room + g + k));
+        __m256i hunterHere = zero;
+        for (int h = 0; h < block->numHunters; h++) {
+            size_t i = (size_t) h * lanes + k;
+            hunterHere = _mm256_or_si256(hunterHere, _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (block->present + i)),
+                                                                      _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (block->room + i)), room)));
+        }
+        __m256i boredom = _mm256_loadu_si256((const __m256i*) (block->boredom + g + k));
+        boredom = _mm256_blendv_epi8(boredom, _mm256_andnot_si256(hunterHere, _mm256_add_epi32(boredom, one)), act);
+
+        // With a hunter in the room: nothing or evidence; alone: nothing, evidence or a move
+        Gen8 gen;
+        loadGen8(&gen, block, g + k);
+        __m256i unsure = zero;
+        __m256i action = draw8(&gen, _mm256_blendv_epi8(three, two, hunterHere), act, &unsure);
+        __m256i start = _mm256_i32gather_epi32(adjStart, room, 4);
+        __m256i exits = _mm256_sub_epi32(_mm256_i32gather_epi32(adjStart + 1, room, 4), start);
+        __m256i drop = _mm256_and_si256(act, _mm256_cmpeq_epi32(action, one));
+        __m256i move = _mm256_and_si256(_mm256_and_si256(act, _mm256_cmpeq_epi32(action, two)), _mm256_cmpgt_epi32(exits, zero));
+        __m256i pick = draw8(&gen, _mm256_blendv_epi8(exits, three, drop), _mm256_or_si256(drop, move), &unsure);
+        if (!_mm256_testz_si256(unsure, unsure)) {
+            ghostLanes(block, active, time, k, k + 8);
+            continue;
+        }
+        __m256i moved = _mm256_mask_i32gather_epi32(room, (const int*) layout->adj, _mm256_add_epi32(start, pick), move, 4);
+        __m256i leaving = _mm256_and_si256(act, _mm256_cmpgt_epi32(boredom, boredomLimit));
+
+        storeGen8(&gen, block, g + k);
+        _mm256_storeu_si256((__m256i*) (block->room + g + k), moved);
+        _mm256_storeu_si256((__m256i*) (block->boredom + g + k), boredom);
+        _mm256_storeu_si256((__m256i*) (block->present + g + k),
+                            _mm256_andnot_si256(leaving, _mm256_loadu_si256((const __m256i*) (block->present + g + k))));
+
+        int dropped = _mm256_movemask_ps(_mm256_castsi256_ps(drop));
+        if (dropped) {
+            int32_t at[8], kind[8];
+            _mm256_storeu_si256((__m256i*) at, _mm256_add_epi32(_mm256_set1_epi32(k * layout->numRooms), _mm256_add_epi32(laneRooms, room)));
+            _mm256_storeu_si256((__m256i*) kind, pick);
+            for (; dropped; dropped &= dropped - 1) {
+                int i = __builtin_ctz(dropped);
+                if (block->evidence[at[i]] == EV_UNKNOWN) block->evidence[at[i]] = ghostEvidenceKind(block->ghostType[k + i], kind[i]);
+            }
+        }
+        for (int gone = _mm256_movemask_ps(_mm256_castsi256_ps(leaving)); gone; gone &= gone - 1) {
+            block->lastTurn[k + __builtin_ctz(gone)] = time;
+        }
+    }
+}
+
+static const LaneKernels avx2Kernels = { hunterAvx2, ghostAvx2 };
+
+/*
+    SSE4.2 kernels: a group of 4 lanes at a time, their generators 2 to a register. SSE has no
+    gathers, so rooms, exits and evidence are loaded lane by lane.
+*/
+typedef struct Gen4 {
+    __m128i s[4][2];                    // state word w of lanes 0-1 and 2-3
+} Gen4;
+
+__attribute__((target("sse4.2"), always_inline))
+static inline void loadGen4(Gen4* gen, const Lockstep* block, size_t i) {
+    for (int w = 0; w < 4; w++) {
+        gen->s[w][0] = _mm_loadu_si128((const __m128i*) (block->rng[w] + i));
+        gen->s[w][1] = _mm_loadu_si128((const __m128i*) (block->rng[w] + i + 2));
+    }
+}
+
+__attribute__((target("sse4.2"), always_inline))
+static inline void storeGen4(const Gen4* gen, Lockstep* block, size_t i) {
+    for (int w = 0; w < 4; w++) {
+        _mm_storeu_si128((__m128i*) (block->rng[w] + i), gen->s[w][0]);
+        _mm_storeu_si128((__m128i*) (block->rng[w] + i + 2), gen->s[w][1]);
+    }
+}
+
+/*
+    base[index] in the 4 lanes where mask is set, fallback elsewhere.
+*/
+__attribute__((target("sse4.2"), always_inline))
+static inline __m128i gather4(const int32_t* base, __m128i index, __m128i mask, __m128i fallback) {
+    int32_t at[4], on[4], out[4];
+    _mm_storeu_si128((__m128i*) at, index);
+    _mm_storeu_si128((__m128i*) on, mask);
+    _mm_storeu_si128((__m128i*) out, fallback);
+    for (int i = 0; i < 4; i++) {
+        if (on[i]) out[i] = base[at[i]];
+    }
+    return _mm_loadu_si128((const __m128i*) out);
+}
+
+/*
+    See draw8.
+*/
+__attribute__((target("sse4.2"), always_inline))
+static inline __m128i draw4(Gen4* gen, __m128i n, __m128i mask, __m128i* unsure) {
+    const __m128i low32 = _mm_set1_epi64x(0xffffffffLL);
+    __m128i value[2], doubt[2];
+    for (int j = 0; j < 2; j++) {
+        __m128i m64 = _mm_cvtepi32_epi64(j == 0 ? mask : _mm_srli_si128(mask, 8));
+        __m128i n64 = _mm_cvtepu32_epi64(j == 0 ? n : _mm_srli_si128(n, 8));
+        __m128i a = gen->s[0][j], b = gen->s[1][j], c = gen->s[2][j], d = gen->s[3][j];
+
+        __m128i x = _mm_add_epi64(_mm_slli_epi64(b, 2), b);
+        x = _mm_or_si128(_mm_slli_epi64(x, 7), _mm_srli_epi64(x, 57));
+        x = _mm_add_epi64(_mm_slli_epi64(x, 3), x);
+        __m128i t = _mm_slli_epi64(b, 17);
+        __m128i c1 = _mm_xor_si128(c, a);
+        __m128i d1 = _mm_xor_si128(d, b);
+        __m128i b1 = _mm_xor_si128(b, c1);
+        __m128i a1 = _mm_xor_si128(a, d1);
+        c1 = _mm_xor_si128(c1, t);
+        d1 = _mm_or_si128(_mm_slli_epi64(d1, 45), _mm_srli_epi64(d1, 19));
+        gen->s[0][j] = _mm_blendv_epi8(a, a1, m64);
+        gen->s[1][j] = _mm_blendv_epi8(b, b1, m64);
+        gen->s[2][j] = _mm_blendv_epi8(c, c1, m64);
+        gen->s[3][j] = _mm_blendv_epi8(d, d1, m64);
+
+        __m128i m = _mm_mul_epu32(_mm_srli_epi64(x, 32), n64);
+        doubt[j] = _mm_shuffle_epi32(_mm_and_si128(m64, _mm_cmpgt_epi64(n64, _mm_and_si128(m, low32))), _MM_SHUFFLE(3, 1, 2, 0));
+        value[j] = _mm_shuffle_epi32(_mm_srli_epi64(m, 32), _MM_SHUFFLE(3, 1, 2, 0));
+    }
+    *unsure = _mm_or_si128(*unsure, _mm_unpacklo_epi64(doubt[0], doubt[1]));
+    return _mm_unpacklo_epi64(value[0], value[1]);
+}
+
+__attribute__((target("sse4.2")))
+static void hunterSse4(Lockstep* block, int h, long time) {
+    const HouseLayout* layout = block->layout;
+    int lanes = block->lanes;
+    size_t e = (size_t) h * lanes;
+    size_t g = (size_t) block->numHunters * lanes;
+    int equipment = h % EV_COUNT;
+    const int32_t* adjStart = (const int32_t*) layout->adjStart;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i all = _mm_set1_epi32(-1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i three = _mm_set1_epi32(3);
+    const __m128i fearLimit = _mm_set1_epi32(FEAR_MAX - 1);
+    const __m128i boredomLimit = _mm_set1_epi32(BOREDOM_MAX - 1);
+    const __m128i enough = _mm_set1_epi32(MAX_COLLECTED_EVIDENCE - 1);
+    const __m128i unknown = _mm_set1_epi32(LOG_UNKNOWN);
+    const __m128i scared = _mm_set1_epi32(LOG_FEAR);
+    const __m128i bored = _mm_set1_epi32(LOG_BORED);
+    const __m128i solved = _mm_set1_epi32(LOG_EVIDENCE);
+    const __m128i reads = _mm_set1_epi32(equipment);
+    const __m128i bit = _mm_set1_epi32(1 << equipment);
+
+    for (int k = 0; k < lanes; k += 4) {
+        __m128i alive = _mm_loadu_si128((const __m128i*) (block->present + e + k));
+        if (_mm_testz_si128(alive, alive)) continue;
+        __m128i room = _mm_loadu_si128((const __m128i*) (block->room + e + k));
+        __m128i ghostHere = _mm_and_si128(_mm_loadu_si128((const __m128i*) (block->present + g + k)),
+                                          _mm_cmpeq_epi32(room, _mm_loadu_si128((const __m128i*) (block->room + g + k))));
+        __m128i fear = _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (block->fear + e + k)), _mm_and_si128(alive, ghostHere));
+        __m128i boredom = _mm_loadu_si128((const __m128i*) (block->boredom + e + k));
+        boredom = _mm_blendv_epi8(boredom, _mm_andnot_si128(ghostHere, _mm_add_epi32(boredom, one)), alive);
+
+        Gen4 gen;
+        loadGen4(&gen, block, e + k);
+        __m128i unsure = zero;
+        __m128i action = draw4(&gen, three, alive, &unsure);
+
+        // 0: pick up the evidence in the room if the equipment reads it
+        __m128i collect = _mm_and_si128(alive, _mm_cmpeq_epi32(action, zero));
+        int32_t rooms[4], left[4];
+        _mm_storeu_si128((__m128i*) rooms, room);
+        for (int i = 0; i < 4; i++) {
+            left[i] = block->evidence[(size_t) (k + i) * layout->numRooms + rooms[i]];
+        }
+        __m128i found = _mm_and_si128(collect, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) left), reads));
+        __m128i collected = _mm_or_si128(_mm_loadu_si128((const __m128i*) (block->collected + k)), _mm_and_si128(found, bit));
+
+        // 2: leave once the board holds three kinds of evidence
+        __m128i kinds = zero;
+        for (int b = 0; b < EV_COUNT; b++) {
+            kinds = _mm_add_epi32(kinds, _mm_and_si128(_mm_srli_epi32(collected, b), one));
+        }
+        __m128i done = _mm_and_si128(_mm_and_si128(alive, _mm_cmpeq_epi32(action, two)), _mm_cmpgt_epi32(kinds, enough));
+
+        // 1: move through one of the room's exits, picked with a second draw
+        __m128i start = gather4(adjStart, room, all, zero);
+        __m128i exits = _mm_sub_epi32(gather4(adjStart + 1, room, all, zero), start);
+        __m128i move = _mm_and_si128(_mm_and_si128(alive, _mm_cmpeq_epi32(action, one)), _mm_cmpgt_epi32(exits, zero));
+        __m128i pick = draw4(&gen, exits, move, &unsure);
+        if (!_mm_testz_si128(unsure, unsure)) {
+            hunterLanes(block, h, time, k, k + 4);
+            continue;
+        }
+        room = gather4((const int32_t*) layout->adj, _mm_add_epi32(start, pick), move, room);
+
+        __m128i reason = _mm_blendv_epi8(unknown, bored, _mm_cmpgt_epi32(boredom, boredomLimit));
+        reason = _mm_blendv_epi8(reason, scared, _mm_cmpgt_epi32(fear, fearLimit));
+        reason = _mm_blendv_epi8(reason, solved, done);
+        __m128i leaving = _mm_andnot_si128(_mm_cmpeq_epi32(reason, unknown), alive);
+
+        storeGen4(&gen, block, e + k);
+        _mm_storeu_si128((__m128i*) (block->room + e + k), room);
+        _mm_storeu_si128((__m128i*) (block->fear + e + k), fear);
+        _mm_storeu_si128((__m128i*) (block->boredom + e + k), boredom);
+        _mm_storeu_si128((__m128i*) (block->collected + k), collected);
+        _mm_storeu_si128((__m128i*) (block->present + e + k), _mm_andnot_si128(leaving, alive));
+        _mm_storeu_si128((__m128i*) (block->exitReason + e + k),
+                         _mm_blendv_epi8(_mm_loadu_si128((const __m128i*) (block->exitReason + e + k)), reason, leaving));
+
+        for (int lanesFound = _mm_movemask_ps(_mm_castsi128_ps(found)); lanesFound; lanesFound &= lanesFound - 1) {
+            int i = __builtin_ctz(lanesFound);
+            block->evidence[(size_t) (k + i) * layout->numRooms + rooms[i]] = EV_UNKNOWN;
+        }
+        for (int gone = _mm_movemask_ps(_mm_castsi128_ps(leaving)); gone; gone &= gone - 1) {
+            block->lastTurn[k + __builtin_ctz(gone)] = time;
+        }
+    }
+}
+
+__attribute__((target("sse4.2")))
+static void ghostSse4(Lockstep* block, const int32_t* active, long time) {
+    const HouseLayout* layout = block->layout;
+    int lanes = block->lanes;
+    size_t g = (size_t) block->numHunters * lanes;
+    const int32_t* adjStart = (const int32_t*) layout->adjStart;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i all = _mm_set1_epi32(-1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i three = _mm_set1_epi32(3);
+    const __m128i boredomLimit = _mm_set1_epi32(BOREDOM_MAX - 1);
+
+    for (int k = 0; k < lanes; k += 4) {
+        __m128i act = _mm_loadu_si128((const __m128i*) (active + k));
+        if (_mm_testz_si128(act, act)) continue;
+        __m128i room = _mm_loadu_si128((const __m128i*) (block->room + g + k));
+        __m128i hunterHere = zero;
+        for (int h = 0; h < block->numHunters; h++) {
+            size_t i = (size_t) h * lanes + k;
+            hunterHere = _mm_or_si128(hunterHere, _mm_and_si128(_mm_loadu_si128((const __m128i*) (block->present + i)),
+                                                                _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (block->room + i)), room)));
+        }
+        __m128i boredom = _mm_loadu_si128((const __m128i*) (block->boredom + g + k));
+        boredom = _mm_blendv_epi8(boredom, _mm_andnot_si128(hunterHere, _mm_add_epi32(boredom, one)), act);
+
+        Gen4 gen;
+        loadGen4(&gen, block, g + k);
+        __m128i unsure = zero;
+        __m128i action = draw4(&gen, _mm_blendv_epi8(three, two, hunterHere), act, &unsure);
+        __m128i start = gather4(adjStart, room, all, zero);
+        __m128i exits = _mm_sub_epi32(gather4(adjStart + 1, room, all, zero), start);
+        __m128i drop = _mm_and_si128(act, _mm_cmpeq_epi32(action, one));
+        __m128i move = _mm_and_si128(_mm_and_si128(act, _mm_cmpeq_epi32(action, two)), _mm_cmpgt_epi32(exits, zero));
+        __m128i pick = draw4(&gen, _mm_blendv_epi8(exits, three, drop), _mm_or_si128(drop, move), &unsure);
+        if (!_mm_testz_si128(unsure, unsure)) {
+            ghostLanes(block, active, time, k, k + 4);
+            continue;
+        }
+        __m128i moved = gather4((const int32_t*) layout->adj, _mm_add_epi32(start, pick), move, room);
+        __m128i leaving = _mm_and_si128(act, _mm_cmpgt_epi32(boredom, boredomLimit));
+
+        storeGen4(&gen, block, g + k);
+        _mm_storeu_si128((__m128i*) (block->room + g + k), moved);
+        _mm_storeu_si128((__m128i*) (block->boredom + g + k), boredom);
+        _mm_storeu_si128((__m128i*) (block->present + g + k),
+                         _mm_andnot_si128(leaving, _mm_loadu_si128((const __m128i*) (block->present + g + k))));
+
+        int dropped = _mm_movemask_ps(_mm_castsi128_ps(drop));
+        if (dropped) {
+            int32_t rooms[4], kind[4];
+            _mm_storeu_si128((__m128i*) rooms, room);
+            _mm_storeu_si128((__m128i*) kind, pick);
+            for (; dropped; dropped &= dropped - 1) {
+                int i = __builtin_ctz(dropped);
+                unsigned char* evidence = block->evidence + (size_t) (k + i) * layout->numRooms + rooms[i];
+                if (*evidence == EV_UNKNOWN) *evidence = ghostEvidenceKind(block->ghostType[k + i], kind[i]);
+            }
+        }
+        for (int gone = _mm_movemask_ps(_mm_castsi128_ps(leaving)); gone; gone &= gone - 1) {
+            block->lastTurn[k + __builtin_ctz(gone)] = time;
+        }
+    }
+}
+
+static const LaneKernels sse4Kernels = { hunterSse4, ghostSse4 };
+
+#endif
+
+/*
+  Function: resolveLaneIsa(enum LaneIsa isa)
+  Purpose: Returns the kernels a block asking for isa gets: the requested ones if the CPU supports them, otherwise the next narrower ones.
+*/
+enum LaneIsa resolveLaneIsa(enum LaneIsa isa) {
+#ifdef LANES_X86
+    __builtin_cpu_init();
+    if (isa == LANES_AUTO) isa = LANES_AVX2;
+    if (isa == LANES_AVX2 && !__builtin_cpu_supports("avx2")) isa = LANES_SSE4;
+    if (isa == LANES_SSE4 && !__builtin_cpu_supports("sse4.2")) isa = LANES_SCALAR;
+    return isa;
+#else
+    return LANES_SCALAR;
+#endif
+}
+
+const char* laneIsaName(enum LaneIsa isa) {
+    switch (isa) {
+        case LANES_AUTO:   return "auto";
+        case LANES_SCALAR: return "scalar";
+        case LANES_SSE4:   return "sse4";
+        case LANES_AVX2:   return "avx2";
+    }
+    return "unknown";
+}
+
+/*
+    Allocates a zeroed array of count entries from the block's arena.
+*/
+static void* laneArray(Arena* arena, size_t count, size_t size) {
+    void* array = arenaAlloc(arena, count * size);
+    memset(array, 0, count * size);
+    return array;
+}
+
+/*
+  Function: lockstepCreate(const HouseLayout* layout, int numHunters, int lanes, enum LaneIsa isa)
+  Purpose: Creates a block of lanes for playing games in lockstep, all of them idle.
+
+  Parameters:
+    in layout: the house every game is played in; it must outlive the block.
+    in numHunters: hunters in every game.
+    in lanes: games played side by side, rounded up to a multiple of LOCKSTEP_WIDTH; LOCKSTEP_LANES if not positive.
+    in isa: the kernels to use, see resolveLaneIsa.
+
+  Description:
+    All of the block's state comes from one arena sized up front. Start games in it with lockstepLoad, play them with lockstepPeriod and take their results with lockstepResult.
+
+  return
+    the new block; free it with lockstepDestroy
+*/
+Lockstep* lockstepCreate(const HouseLayout* layout, int numHunters, int lanes, enum LaneIsa isa) {
+    if (numHunters < 1) numHunters = 1;
+    if (lanes < 1) lanes = LOCKSTEP_LANES;
+    // Evidence offsets in a block are 32-bit gather indices
+    if ((long) lanes * layout->numRooms > INT32_MAX / 2) lanes = INT32_MAX / 2 / layout->numRooms;
+    lanes = (lanes + LOCKSTEP_WIDTH - 1) / LOCKSTEP_WIDTH * LOCKSTEP_WIDTH;
+    size_t entities = (size_t) (numHunters + 1) * lanes;
+    size_t hunters = (size_t) numHunters * lanes;
+    size_t size = sizeof(Lockstep) + entities * (4 * sizeof(uint64_t) + 3 * sizeof(int32_t)) + hunters * 2 * sizeof(int32_t)
+                  + lanes * (5 * sizeof(int32_t) + 2 * sizeof(long)) + (size_t) lanes * layout->numRooms + 4 + 17 * 16;
+    Arena* arena = arenaCreate(size);
+
+    Lockstep* block = arenaAlloc(arena, sizeof(Lockstep));
+    block->layout = layout;
+    block->isa = resolveLaneIsa(isa);
+    block->kernels = &scalarKernels;
+#ifdef LANES_X86
+    if (block->isa == LANES_AVX2) block->kernels = &avx2Kernels;
+    if (block->isa == LANES_SSE4) block->kernels = &sse4Kernels;
+#endif
+    block->arena = arena;
+    block->lanes = lanes;
+    block->numHunters = numHunters;
+
+    // The turns line up again after the least common multiple of the two waits
+    long a = HUNTER_WAIT, b = GHOST_WAIT;
+    while (b != 0) {
+        long r = a % b;
+        a = b;
+        b = r;
+    }
+    block->period = (long) HUNTER_WAIT / a * GHOST_WAIT;
+    block->now = 0;
+    block->games = 0;
+
+    for (int i = 0; i < 4; i++) {
+        block->rng[i] = laneArray(arena, entities, sizeof(uint64_t));
+    }
+    block->room = laneArray(arena, entities, sizeof(int32_t));
+    block->present = laneArray(arena, entities, sizeof(int32_t));
+    block->boredom = laneArray(arena, entities, sizeof(int32_t));
+    block->fear = laneArray(arena, hunters, sizeof(int32_t));
+    block->exitReason = laneArray(arena, hunters, sizeof(int32_t));
+    block->ghostType = laneArray(arena, lanes, sizeof(int32_t));
+    block->collected = laneArray(arena, lanes, sizeof(uint32_t));
+    block->busy = laneArray(arena, lanes, sizeof(int32_t));
+    block->fresh = laneArray(arena, lanes, sizeof(int32_t));
+    block->startedAt = laneArray(arena, lanes, sizeof(long));
+    block->lastTurn = laneArray(arena, lanes, sizeof(long));
+    // The AVX2 kernels read the evidence 4 bytes at a time
+    block->evidence = laneArray(arena, (size_t) lanes * layout->numRooms + 4, 1);
+    block->active = laneArray(arena, lanes, sizeof(int32_t));
+    return block;
+}
+
+/*
+    Starts entity i's generator on a stream.
+*/
+static void seedEntity(Lockstep* block, size_t i, uint64_t key) {
+    Rng rng;
+    rngSeed(&rng, key);
+    for (int w = 0; w < 4; w++) {
+        block->rng[w][i] = rng.s[w];
+    }
+}
+
+/*
+  Function: lockstepLoad(Lockstep* block, int lane, uint64_t seed)
+  Purpose: Sets up a new game in an idle lane, as simReset would in a SimContext; it takes its first turns in the next lockstepPeriod.
+
+  Parameters:
+    in/out block: the block.
+    in lane: a lane that is not busy.
+    in seed: the game's stream key.
+
+  return
+    none
+*/
+void lockstepLoad(Lockstep* block, int lane, uint64_t seed) {
+    int lanes = block->lanes;
+    size_t ghost = (size_t) block->numHunters * lanes + lane;
+    Rng rng;
+
+    // The same draws as initGhost, from the game's own stream
+    rngSeed(&rng, seed);
+    block->ghostType[lane] = (int32_t) rngRange(&rng, GHOST_COUNT);
+    block->room[ghost] = 1 + (int32_t) rngRange(&rng, block->layout->numRooms - 1);
+    block->present[ghost] = ~0;
+    block->boredom[ghost] = 0;
+    seedEntity(block, ghost, rngDerive(seed, TRACE_GHOST));
+
+    for (int h = 0; h < block->numHunters; h++) {
+        size_t i = (size_t) h * lanes + lane;
+        block->room[i] = 0;
+        block->present[i] = ~0;
+        block->boredom[i] = 0;
+        block->fear[i] = 0;
+        block->exitReason[i] = LOG_UNKNOWN;
+        seedEntity(block, i, rngDerive(seed, h));
+    }
+    block->collected[lane] = 0;
+    memset(block->evidence + (size_t) lane * block->layout->numRooms, EV_UNKNOWN, block->layout->numRooms);
+    block->busy[lane] = C_TRUE;
+    block->fresh[lane] = ~0;
+    block->startedAt[lane] = block->now;
+    block->lastTurn[lane] = block->now;
+    block->games++;
+}
+
+/*
+  Function: lockstepPeriod(Lockstep* block)
+  Purpose: Plays every lane for one period, block->period simulated ms, after which the hunters' and the ghost's turns line up again.
+
+  Parameters:
+    in/out block: the block.
+
+  Description:
+    The turns are taken in the order simStep takes them. At the start of a period a game that was just loaded lets its ghost go first, as simStep queues the ghost first; in a game under way, turns due at the same time go in the order they were queued, so the hunters go before the ghost when their wait is the longer one.
+
+  return
+    none
+*/
+void lockstepPeriod(Lockstep* block) {
+    int lanes = block->lanes;
+    int32_t* ghostPresent = block->present + (size_t) block->numHunters * lanes;
+    long start = block->now;
+
+    for (int k = 0; k < lanes; k++) {
+        block->active[k] = ghostPresent[k] & block->fresh[k];
+    }
+    block->kernels->ghost(block, block->active, start);
+    for (int k = 0; k < lanes; k++) {
+        block->active[k] = ghostPresent[k] & ~block->fresh[k];
+        block->fresh[k] = 0;
+    }
+
+    long hunterAt = 0, ghostAt = 0;
+    while (hunterAt < block->period || ghostAt < block->period) {
+        if (hunterAt < ghostAt || (hunterAt == ghostAt && HUNTER_WAIT > GHOST_WAIT)) {
+            for (int h = 0; h < block->numHunters; h++) {
+                block->kernels->hunter(block, h, start + hunterAt);
+            }
+            hunterAt += HUNTER_WAIT;
+        } else {
+            block->kernels->ghost(block, ghostAt == 0 ? block->active : ghostPresent, start + ghostAt);
+            ghostAt += GHOST_WAIT;
+        }
+    }
+    block->now += block->period;
+}
+
+/*
+  Function: lockstepResult(Lockstep* block, int lane, GameResult* result)
+  Purpose: Takes the result of a lane's game once every entity has left, which frees the lane for lockstepLoad.
+
+  Parameters:
+    in/out block: the block.
+    in lane: the lane.
+    out result: the outcome of its game, as simResult gives it.
+
+  return
+    C_TRUE if the lane's game had ended, C_FALSE if it is idle or still being played
+*/
+int lockstepResult(Lockstep* block, int lane, GameResult* result) {
+    if (!block->busy[lane]) return C_FALSE;
+    for (int e = 0; e <= block->numHunters; e++) {
+        if (block->present[(size_t) e * block->lanes + lane]) return C_FALSE;
+    }
+
+    result->ghostType = (enum GhostClass) block->ghostType[lane];
+    result->exitFear = result->exitBored = result->exitEvidence = 0;
+    for (int h = 0; h < block->numHunters; h++) {
+        switch (block->exitReason[(size_t) h * block->lanes + lane]) {
+            case LOG_FEAR:     result->exitFear++;     break;
+            case LOG_BORED:    result->exitBored++;    break;
+            case LOG_EVIDENCE: result->exitEvidence++; break;
+            default: break;
+        }
+    }
+    result->ghostWon = (result->exitEvidence == 0);
+    result->identifiedType = GH_UNKNOWN;
+    if (__builtin_popcount(block->collected[lane]) >= MAX_COLLECTED_EVIDENCE) {
+        result->identifiedType = identifyGhostMask(block->collected[lane]);
+    }
+    result->ticks = block->lastTurn[lane] - block->startedAt[lane];
+    block->busy[lane] = C_FALSE;
+    return C_TRUE;
+}
+
+/*
+  Function: lockstepDestroy(Lockstep* block)
+  Purpose: Frees a block and everything in it with its arena. The layout belongs to the caller.
+*/
+void lockstepDestroy(Lockstep* block) {
+    if (block == NULL) return;
+    arenaDestroy(block->arena);
+}
@@ -1,134 +1,472 @@
 #include "defs.h"
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+
+/*
+    Log lines are built in a small stack buffer without stdio. When the asynchronous logger is
+    running (see l_startAsync), each thread appends its lines to its own single-producer ring
+    buffer and a background writer thread merges the rings in timestamp order and writes them to
+    their sinks in large batches. Otherwise lines go straight to the sink as before. Either way the
+    text is identical. Each game logs to its own LogSink, so games sharing the process can be
+    silenced or sent elsewhere independently.
+*/
+
+#define LOG_LINE_MAX    256
+#define LOG_RING_SIZE   (1 << 16)       // bytes per thread, a power of two
+#define LOG_WRITE_BATCH (1 << 18)       // bytes the writer collects before calling write
+#define LOG_SKIP        0xffffffffu     // record length marking unused space up to the end of the ring
+
+typedef struct LogLine {
+    char text[LOG_LINE_MAX];
+    int length;
+} LogLine;
+
+// Every record starts on a 16-byte boundary, so a header never wraps around the ring
+typedef struct LogRecord {
+    uint32_t length;            // bytes of text following the header, or LOG_SKIP
+    int32_t fd;                 // the sink's file descriptor
+    uint64_t time;              // CLOCK_MONOTONIC nanoseconds, used to merge the rings
+} LogRecord;
+
+// head and tail are each written by one side only and kept on their own cache lines; each side
+// also keeps a private copy of the other's progress so the line is only shared when it must be
+typedef struct LogRing {
+    _Atomic uint64_t head;      // bytes ever written, only the owning thread stores it
+    uint64_t knownTail;         // the owning thread's last reading of tail
+    char pad1[48];
+    _Atomic uint64_t tail;      // bytes ever consumed, published by the writer thread once per batch
+    uint64_t readTail;          // the writer thread's own position, ahead of tail until it publishes
+    char pad2[48];
+    _Atomic long dropped;
+    struct LogRing* next;
+    char data[LOG_RING_SIZE];
+} LogRing;
+
+static _Atomic(LogRing*) logRings = NULL;
+static __thread LogRing* myRing = NULL;
+static __thread unsigned myGeneration = 0;
+static atomic_uint logGeneration = 1;   // bumped by l_stopAsync, which frees every ring
+static atomic_int logAsync = C_FALSE;
+static atomic_int logStopping = C_FALSE;
+static enum LogPolicy logPolicy = LOG_BLOCK;
+static pthread_t logWriter;
+static atomic_uint writerWake = 0;      // bumped to wake the writer, which waits on it with a futex when idle
+static atomic_int writerIdle = C_FALSE; // set while the writer waits, so producers only make the call then
+
+/*
+    Appends a string to a log line, truncating at LOG_LINE_MAX.
+*/
+static void put(LogLine* line, const char* str) {
+    while (*str && line->length < LOG_LINE_MAX) {
+        line->text[line->length++] = *str++;
+    }
+}
+
+/*
+    Returns the bracketed word logged for an exit or review reason.
+*/
+static const char* exitName(enum LoggerDetails reason) {
+    switch (reason) {
+        case LOG_FEAR:     return "[FEAR]\n";
+        case LOG_BORED:    return "[BORED]\n";
+        case LOG_EVIDENCE: return "[EVIDENCE]\n";
+        default:           return "[UNKNOWN]\n";
+    }
+}
+
+static const char* reviewName(enum LoggerDetails result) {
+    switch (result) {
+        case LOG_SUFFICIENT:   return "[SUFFICIENT]\n";
+        case LOG_INSUFFICIENT: return "[INSUFFICIENT]\n";
+        default:               return "[UNKNOWN]\n";
+    }
+}
+
+static uint64_t nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/*
+    Writes all of a buffer to a file descriptor.
+*/
+static void writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+/*
+    Returns the calling thread's ring, creating and registering it on first use in each session
+    of the asynchronous logger; a ring left from an earlier session has been freed by l_stopAsync.
+*/
+static LogRing* threadRing() {
+    unsigned generation = atomic_load_explicit(&logGeneration, memory_order_relaxed);
+    if (myRing == NULL || myGeneration != generation) {
+        LogRing* ring = calloc(1, sizeof(LogRing));
+        if (ring == NULL) {
+            perror("Error creating log buffer");
+            exit(EXIT_FAILURE);
+        }
+        ring->next = atomic_load(&logRings);
+        while (!atomic_compare_exchange_weak(&logRings, &ring->next, ring)) { }
+        myRing = ring;
+        myGeneration = generation;
+    }
+    return myRing;
+}
+
+/*
+    Wakes the writer if it is waiting for work; costs no system call while it is busy.
+*/
+static void wakeWriter() {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&writerIdle, memory_order_relaxed) && atomic_exchange(&writerIdle, C_FALSE)) {
+        atomic_fetch_add(&writerWake, 1);
+        syscall(SYS_futex, &writerWake, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/*
+    Appends one line to the calling thread's ring, waiting for space or dropping the line
+    depending on the policy. tail is only read again when the last reading leaves too little room.
+    The writer is woken once the ring is half full rather than left to notice on its own.
+*/
+static void pushLine(const LogLine* line, int fd) {
+    LogRing* ring = threadRing();
+    uint64_t need = sizeof(LogRecord) + ((line->length + 15) & ~15);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t contiguous = LOG_RING_SIZE - (head & (LOG_RING_SIZE - 1));
+    uint64_t total = need + (contiguous < need ? contiguous : 0);
+
+    while (LOG_RING_SIZE - (head - ring->knownTail) < total) {
+        ring->knownTail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (LOG_RING_SIZE - (head - ring->knownTail) >= total) break;
+        if (logPolicy == LOG_DROP) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        wakeWriter();
+        sched_yield();
+    }
+
+    if (contiguous < need) {
+        LogRecord* skip = (LogRecord*) (ring->data + (head & (LOG_RING_SIZE - 1)));
+        skip->length = LOG_SKIP;
+        head += contiguous;
+    }
+    LogRecord* record = (LogRecord*) (ring->data + (head & (LOG_RING_SIZE - 1)));
+    record->length = line->length;
+    record->fd = fd;
+    record->time = nowNanos();
+    memcpy(record + 1, line->text, line->length);
+    atomic_store_explicit(&ring->head, head + need, memory_order_release);
+    uint64_t used = head - ring->knownTail;
+    if (used <= LOG_RING_SIZE / 2 && used + need > LOG_RING_SIZE / 2) wakeWriter();
+}
+
+/*
+    Returns the oldest unread record in a ring, or NULL if it is empty.
+*/
+static LogRecord* peekRing(LogRing* ring) {
+    uint64_t tail = ring->readTail;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) return NULL;
+
+    LogRecord* record = (LogRecord*) (ring->data + (tail & (LOG_RING_SIZE - 1)));
+    if (record->length == LOG_SKIP) {
+        tail += LOG_RING_SIZE - (tail & (LOG_RING_SIZE - 1));
+        ring->readTail = tail;
+        if (tail == head) return NULL;
+        record = (LogRecord*) ring->data;
+    }
+    return record;
+}
+
+/*
+    Hands the space of every record read so far back to the threads that wrote them.
+*/
+static void publishTails() {
+    for (LogRing* ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+        if (atomic_load_explicit(&ring->tail, memory_order_relaxed) != ring->readTail) {
+            atomic_store_explicit(&ring->tail, ring->readTail, memory_order_release);
+        }
+    }
+}
+
+/*
+    Moves every record currently in the rings to the output buffer, oldest first,
+    writing the buffer out to *fd whenever it fills up or the next record goes to another sink.
+    The space read is handed back with every write and once the rings are empty.
+        return: the number of records moved
+*/
+static long drainRings(char* out, size_t* used, int* fd) {
+    long moved = 0;
+    for (;;) {
+        LogRing* oldestRing = NULL;
+        LogRecord* oldest = NULL;
+        for (LogRing* ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+            LogRecord* record = peekRing(ring);
+            if (record != NULL && (oldest == NULL || record->time < oldest->time)) {
+                oldest = record;
+                oldestRing = ring;
+            }
+        }
+        if (oldest == NULL) {
+            publishTails();
+            return moved;
+        }
+
+        if (*used + oldest->length > LOG_WRITE_BATCH || (*used > 0 && oldest->fd != *fd)) {
+            writeAll(*fd, out, *used);
+            *used = 0;
+            publishTails();
+        }
+        *fd = oldest->fd;
+        memcpy(out + *used, oldest + 1, oldest->length);
+        *used += oldest->length;
+        oldestRing->readTail += sizeof(LogRecord) + ((oldest->length + 15) & ~15);
+        moved++;
+    }
+}
+
+static void* writerThread(void* arg) {
+    char* out = malloc(LOG_WRITE_BATCH);
+    size_t used = 0;
+    int fd = STDOUT_FILENO;
+    if (out == NULL) {
+        perror("Error starting logger");
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        // Read the flag first so the final pass sees everything logged before l_stopAsync
+        int stopping = atomic_load(&logStopping);
+        long moved = drainRings(out, &used, &fd);
+        if (moved == 0) {
+            if (used > 0) {
+                writeAll(fd, out, used);
+                used = 0;
+            }
+            if (stopping) break;
+            // Read the counter before going idle, so a wake in between makes the wait return at once
+            unsigned seen = atomic_load(&writerWake);
+            atomic_store(&writerIdle, C_TRUE);
+            struct timespec idle = { 0, 1000000 };
+            syscall(SYS_futex, &writerWake, FUTEX_WAIT_PRIVATE, seen, &idle, NULL, 0);
+            atomic_store(&writerIdle, C_FALSE);
+        }
+    }
+    free(out);
+    return NULL;
+}
+
+/*
+    Sends a finished line to the rings or, if the asynchronous logger is not running, to the sink.
+*/
+static void emit(const LogSink* sink, const LogLine* line) {
+    if (atomic_load_explicit(&logAsync, memory_order_acquire)) {
+        pushLine(line, sink->fd);
+    } else if (sink->fd == STDOUT_FILENO) {
+        fwrite(line->text, 1, line->length, stdout);
+    } else {
+        writeAll(sink->fd, line->text, line->length);
+    }
+}
+
+/*
+    Starts the background writer; from now on l_* calls only append to per-thread buffers.
+    in: policy - LOG_BLOCK to wait for the writer when a thread's buffer is full,
+                 LOG_DROP to discard the line and count it instead
+*/
+void l_startAsync(enum LogPolicy policy) {
+    if (!LOGGING || atomic_load(&logAsync)) return;
+    fflush(stdout);
+    logPolicy = policy;
+    atomic_store(&logStopping, C_FALSE);
+    pthread_create(&logWriter, NULL, writerThread, NULL);
+    atomic_store_explicit(&logAsync, C_TRUE, memory_order_release);
+}
+
+/*
+    Writes out everything still buffered and stops the background writer. Threads still
+    logging must have finished first; threads that live on make themselves a new ring when they
+    next log. Reports dropped lines, if any, on stderr.
+*/
+void l_stopAsync() {
+    if (!atomic_load(&logAsync)) return;
+    atomic_store_explicit(&logAsync, C_FALSE, memory_order_release);
+    atomic_store(&logStopping, C_TRUE);
+    pthread_join(logWriter, NULL);
+
+    long dropped = 0;
+    LogRing* ring = atomic_exchange(&logRings, NULL);
+    while (ring != NULL) {
+        LogRing* next = ring->next;
+        dropped += atomic_load(&ring->dropped);
+        free(ring);
+        ring = next;
+    }
+    myRing = NULL;
+    atomic_fetch_add(&logGeneration, 1);
+    if (dropped > 0) {
+        fprintf(stderr, "logger: dropped %ld lines because the log buffers were full\n", dropped);
+    }
+}
 
 /* 
     Logs the hunter being created.
+    in: sink - where the game logs to
     in: hunter - the hunter name to log
     in: equipment - the hunter's equipment
 */
-void l_hunterInit(char* hunter, enum EvidenceType equipment) {
-    if (!LOGGING) return;
-    char ev_str[MAX_STR];
-    evidenceToString(equipment, ev_str);
-    printf("[HUNTER INIT] [%s] is a [%s] hunter\n", hunter, ev_str);    
+void l_hunterInit(const LogSink* sink, const char* hunter, enum EvidenceType equipment) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[HUNTER INIT] [");
+    put(&line, hunter);
+    put(&line, "] is a [");
+    put(&line, evidenceName(equipment));
+    put(&line, "] hunter\n");
+    emit(sink, &line);
 }
 
 /*
     Logs the hunter moving into a new room.
+    in: sink - where the game logs to
     in: hunter - the hunter name to log
     in: room - the room name to log
 */
-void l_hunterMove(char* hunter, char* room) {
-    if (!LOGGING) return;
-    printf("[HUNTER MOVE] [%s] has moved into [%s]\n", hunter, room);
+void l_hunterMove(const LogSink* sink, const char* hunter, const char* room) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[HUNTER MOVE] [");
+    put(&line, hunter);
+    put(&line, "] has moved into [");
+    put(&line, room);
+    put(&line, "]\n");
+    emit(sink, &line);
 }
 
 /*
     Logs the hunter exiting the house.
+    in: sink - where the game logs to
     in: hunter - the hunter name to log
     in: reason - the reason for exiting, either LOG_FEAR, LOG_BORED, or LOG_EVIDENCE
 */
-void l_hunterExit(char* hunter, enum LoggerDetails reason) {
-    if (!LOGGING) return;
-    printf("[HUNTER EXIT] [%s] exited because ", hunter);
-    switch (reason) {
-        case LOG_FEAR:
-            printf("[FEAR]\n");
-            break;
-        case LOG_BORED:
-            printf("[BORED]\n");
-            break;
-        case LOG_EVIDENCE:
-            printf("[EVIDENCE]\n");
-            break;
-        default:
-            printf("[UNKNOWN]\n");
-    }
+void l_hunterExit(const LogSink* sink, const char* hunter, enum LoggerDetails reason) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[HUNTER EXIT] [");
+    put(&line, hunter);
+    put(&line, "] exited because ");
+    put(&line, exitName(reason));
+    emit(sink, &line);
 }
 
 /*
     Logs the hunter reviewing evidence.
+    in: sink - where the game logs to
     in: hunter - the hunter name to log
     in: result - the result of the review, either LOG_SUFFICIENT or LOG_INSUFFICIENT
 */
-void l_hunterReview(char* hunter, enum LoggerDetails result) {
-    if (!LOGGING) return;
-    printf("[HUNTER REVIEW] [%s] reviewed evidence and found ", hunter);
-    switch (result) {
-        case LOG_SUFFICIENT:
-            printf("[SUFFICIENT]\n");
-            break;
-        case LOG_INSUFFICIENT:
-            printf("[INSUFFICIENT]\n");
-            break;
-        default:
-            printf("[UNKNOWN]\n");
-    }
+void l_hunterReview(const LogSink* sink, const char* hunter, enum LoggerDetails result) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[HUNTER REVIEW] [");
+    put(&line, hunter);
+    put(&line, "] reviewed evidence and found ");
+    put(&line, reviewName(result));
+    emit(sink, &line);
 }
 
 /*
     Logs the hunter collecting evidence.
+    in: sink - where the game logs to
     in: hunter - the hunter name to log
     in: evidence - the evidence type to log
     in: room - the room name to log
 */
-void l_hunterCollect(char* hunter, enum EvidenceType evidence, char* room) {
-    if (!LOGGING) return;
-    char ev_str[MAX_STR];
-    evidenceToString(evidence, ev_str);
-    printf("[HUNTER EVIDENCE] [%s] found [%s] in [%s] and [COLLECTED]\n", hunter, ev_str, room);
+void l_hunterCollect(const LogSink* sink, const char* hunter, enum EvidenceType evidence, const char* room) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[HUNTER EVIDENCE] [");
+    put(&line, hunter);
+    put(&line, "] found [");
+    put(&line, evidenceName(evidence));
+    put(&line, "] in [");
+    put(&line, room);
+    put(&line, "] and [COLLECTED]\n");
+    emit(sink, &line);
 }
 
 /*
     Logs the ghost moving into a new room.
+    in: sink - where the game logs to
     in: room - the room name to log
 */
-void l_ghostMove(char* room) {
-    if (!LOGGING) return;
-    printf("[GHOST MOVE] Ghost has moved into [%s]\n", room);
+void l_ghostMove(const LogSink* sink, const char* room) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[GHOST MOVE] Ghost has moved into [");
+    put(&line, room);
+    put(&line, "]\n");
+    emit(sink, &line);
 }
 
 /*
     Logs the ghost exiting the house.
+    in: sink - where the game logs to
     in: reason - the reason for exiting, either LOG_FEAR, LOG_BORED, or LOG_EVIDENCE
 */
-void l_ghostExit(enum LoggerDetails reason) {
-    if (!LOGGING) return;
-    printf("[GHOST EXIT] Exited because ");
-    switch (reason) {
-        case LOG_FEAR:
-            printf("[FEAR]\n");
-            break;
-        case LOG_BORED:
-            printf("[BORED]\n");
-            break;
-        case LOG_EVIDENCE:
-            printf("[EVIDENCE]\n");
-            break;
-        default:
-            printf("[UNKNOWN]\n");
-    }
+void l_ghostExit(const LogSink* sink, enum LoggerDetails reason) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[GHOST EXIT] Exited because ");
+    put(&line, exitName(reason));
+    emit(sink, &line);
 }
 
 /*
     Logs the ghost leaving evidence in a room.
+    in: sink - where the game logs to
     in: evidence - the evidence type to log
     in: room - the room name to log
 */
-void l_ghostEvidence(enum EvidenceType evidence, char* room) {
-    if (!LOGGING) return;
-    char ev_str[MAX_STR];
-    evidenceToString(evidence, ev_str);
-    printf("[GHOST EVIDENCE] Ghost left [%s] in [%s]\n", ev_str, room);
+void l_ghostEvidence(const LogSink* sink, enum EvidenceType evidence, const char* room) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[GHOST EVIDENCE] Ghost left [");
+    put(&line, evidenceName(evidence));
+    put(&line, "] in [");
+    put(&line, room);
+    put(&line, "]\n");
+    emit(sink, &line);
 }
 
 /*
     Logs the ghost being created.
+    in: sink - where the game logs to
     in: ghost - the ghost type to log
     in: room - the room name that the ghost is starting in
 */
-void l_ghostInit(enum GhostClass ghost, char* room) {
-    if (!LOGGING) return;
-    char ghost_str[MAX_STR];
-    ghostToString(ghost, ghost_str);
-    printf("[GHOST INIT] Ghost is a [%s] in room [%s]\n", ghost_str, room);
-}
\ No newline at end of file
+void l_ghostInit(const LogSink* sink, enum GhostClass ghost, const char* room) {
+    if (!LOGGING || !sink->enabled) return;
+    LogLine line = { .length = 0 };
+    put(&line, "[GHOST INIT] Ghost is a [");
+    put(&line, ghostName(ghost));
+    put(&line, "] in room [");
+    put(&line, room);
+    put(&line, "]\n");
+    emit(sink, &line);
+}
@@ -1,36 +1,453 @@
 #include "defs.h"
 
-int main() {
-    srand(time(NULL));
-
-    HouseType house;
-    initHouse(&house);
-    populateRooms(&house);
-
-    // Create and initialize hunters
-    Hunter hunters[NUM_HUNTERS];
-    char hunterNames[NUM_HUNTERS][MAX_STR];
-
-    for (int i = 0; i < NUM_HUNTERS; i++) {
-        printf("Enter name for Hunter %d: ", i + 1);
-        fgets(hunterNames[i], MAX_STR, stdin);
-        strtok(hunterNames[i], "\n"); // Remove newline character
-        hunters[i].fear = 0;
-        hunters[i].boredom = 0;
-        strcpy(hunters[i].name, hunterNames[i]);
-        hunters[i].equipment = randomGhost(); // Assign random equipment for demonstration purposes
-        hunters[i].currentRoom = &house.rooms[0]; // Start in the Van room
-        pthread_create(&hunters[i].thread, NULL, hunterThread, (void*)&hunters[i]);
-    }
-
-    // Create and initialize the ghost
-    Ghost ghost;
-    ghost.type = randomGhost();
-    ghost.currentRoom = &house.rooms[randInt(1, house.numRooms - 1)]; // Random room (not the Van)
-    pthread_create(&ghost.thread, NULL, ghostThread, (void*)&ghost);
-
-    // Add code to wait for threads to finish (pthread_join)
-
-    return 0;
+// How a single interactive game is run
+enum Engine { ENGINE_THREADS, ENGINE_VIRTUAL, ENGINE_TASKS, ENGINE_LOCKSTEP };
+
+/*
+    Prints how to run the program.
+*/
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--map FILE] [--navigate] [--evidence-slots K] [--engine threads|virtual|tasks] [--wake tick|events] [--hunters H] [--log-policy block|drop] [--trace FILE] [--seed S] [--runs N [--results FILE]] [--jobs J]\n", program);
+    fprintf(stderr, "       %s --engine lockstep --runs N [--lanes K] [--simd auto|avx2|sse4|scalar] [--map FILE] [--hunters H] [--seed S] [--jobs J] [--results FILE]\n", program);
+    fprintf(stderr, "       %s --solve [--solve-states N] [--map FILE] [--hunters H] [--jobs J]\n", program);
+    fprintf(stderr, "       %s --map FILE --compile-map OUT\n", program);
+    fprintf(stderr, "       %s --checkpoint FILE --checkpoint-at MS [--seed S] [--hunters H]\n", program);
+    fprintf(stderr, "       %s --restore FILE [--runs N [--jobs J] [--results FILE]]\n", program);
+    fprintf(stderr, "  any of these can add --telemetry NAME and --telemetry-socket PATH\n");
+    fprintf(stderr, "  with no options, asks for %d hunter names and plays one game in real time\n", NUM_HUNTERS);
+    fprintf(stderr, "  --engine   threads: one sleeping thread per entity (default)\n");
+    fprintf(stderr, "             virtual: play the game instantly in simulated time on one thread\n");
+    fprintf(stderr, "             tasks: real time, with every entity a small task run by --jobs worker threads\n");
+    fprintf(stderr, "             lockstep: with --runs, every worker plays --lanes games side by side with SIMD kernels; same totals\n");
+    fprintf(stderr, "  --wake     threads engine: hunters and the ghost sleep HUNTER_WAIT and GHOST_WAIT ms between turns (tick, default),\n");
+    fprintf(stderr, "             or also wake as soon as the ghost or evidence they can read arrives in a hunter's room, or a hunter\n");
+    fprintf(stderr, "             in the ghost's (events)\n");
+    fprintf(stderr, "  --hunters H  number of hunters, up to %d (default %d; names are only asked for up to %d)\n", OCC_MAX_HUNTERS, NUM_HUNTERS, NUM_HUNTERS);
+    fprintf(stderr, "  --runs N   play N games headless, as fast as possible, and print the totals\n");
+    fprintf(stderr, "  --log-policy  when a thread's log buffer is full, block until it drains (default) or drop the line\n");
+    fprintf(stderr, "  --trace FILE  record every event to a binary trace; read it back with ghost_trace\n");
+    fprintf(stderr, "  --results FILE  with --runs, store every game's outcome in a columnar results file; query it with ghost_results\n");
+    fprintf(stderr, "  --seed S   master random seed; the same seed replays the same games (default: from the clock)\n");
+    fprintf(stderr, "  --jobs J   worker threads for --runs and --engine tasks (default: number of cores)\n");
+    fprintf(stderr, "  --lanes K  games each lockstep worker plays at once, a multiple of %d (default %d)\n", LOCKSTEP_WIDTH, LOCKSTEP_LANES);
+    fprintf(stderr, "  --simd     the lockstep kernels: the widest the CPU supports (auto, default), avx2, sse4 or scalar\n");
+    fprintf(stderr, "  --solve    work out the exact averages over every way a game can go instead of sampling games; small houses only\n");
+    fprintf(stderr, "  --solve-states N  give up once the games turn out to have more than N states (default %d)\n", SOLVE_STATES);
+    fprintf(stderr, "  --map FILE play in the house described by a text map or compiled map (default: built-in house)\n");
+    fprintf(stderr, "  --navigate hunters head for uncollected evidence their equipment reads and for ghost sightings, using navigation tables built at load\n");
+    fprintf(stderr, "  --evidence-slots K  pieces of evidence a room holds at once, up to %d (default 1: the ghost's evidence is lost while its room holds some)\n", ROOM_EVIDENCE_SLOTS);
+    fprintf(stderr, "  --compile-map OUT  write the house as a compiled map that loads with mmap and no parsing\n");
+    fprintf(stderr, "  --checkpoint FILE  play in simulated time until --checkpoint-at MS, then save the whole game state and stop\n");
+    fprintf(stderr, "  --restore FILE     continue a saved game to the end; with --runs N, play N different continuations of it\n");
+    fprintf(stderr, "  --telemetry NAME   publish live statistics to the shared-memory segment NAME (e.g. /ghosthunt); watch them with ghost_stats NAME\n");
+    fprintf(stderr, "  --telemetry-socket PATH  answer every connection to the Unix socket PATH with the live statistics as JSON\n");
+}
+
+/*
+    Stops publishing a finished game's hunters, counts the game in the live statistics and frees it.
+*/
+static void finishWatching(SimContext* sim) {
+    GameResult result;
+    telemetryWatch(NULL);
+    simResult(sim, &result);
+    telemetryGame(sim, &result);
+    simDestroy(sim);
+}
+
+/*
+    Plays one game with the named hunters.
+        in: layout - the house to play in
+        in: seed - master random seed
+        in: engine - one sleeping thread per entity, the virtual-time engine, or the task runtime
+        in: wakeOnEvents - with one thread per entity, hunters also wake when the ghost or its evidence arrives in their room, and the ghost when a hunter arrives in its
+        in: numHunters - how many hunters take part; they are asked for names if there are at most NUM_HUNTERS
+        in: jobs - worker threads of the task runtime
+        in: logPolicy - what the logger does when it cannot keep up
+        in: trace - an open trace file to record the game to, or NULL
+        in: checkpointPath - where to save the game at checkpointAt simulated milliseconds, or NULL to play to the end;
+                             the game is played on the virtual-time engine
+        return: C_TRUE on success, C_FALSE if the checkpoint could not be saved
+*/
+static int playInteractive(const HouseLayout* layout, uint64_t seed, enum Engine engine, int wakeOnEvents, int numHunters, int jobs,
+                           enum LogPolicy logPolicy, TraceFile* trace, const char* checkpointPath, long checkpointAt) {
+    TraceBuffer traceBuffer;
+    if (trace != NULL) {
+        initTraceBuffer(&traceBuffer, trace);
+    }
+
+    // Ask for the hunters' names when there are only a few of them
+    char (*names)[MAX_STR] = NULL;
+    const char* namePointers[NUM_HUNTERS];
+    if (numHunters <= NUM_HUNTERS) {
+        names = malloc(numHunters * sizeof(*names));
+        if (names == NULL) {
+            perror("Error creating hunters");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < numHunters; i++) {
+            printf("Enter name for Hunter %d: ", i + 1);
+            if (fgets(names[i], MAX_STR, stdin) == NULL) {
+                snprintf(names[i], MAX_STR, "Hunter %d", i + 1);
+            }
+            names[i][strcspn(names[i], "\n")] = '\0'; // Remove newline character
+            namePointers[i] = names[i];
+        }
+    }
+
+    // Create the hunters in the Van and the ghost
+    SimConfig config = { layout, rngDerive(seed, 0), numHunters, names != NULL ? namePointers : NULL,
+                         { C_TRUE, STDOUT_FILENO }, trace != NULL ? &traceBuffer : NULL, NULL };
+    SimContext* sim = simCreate(&config);
+    free(names);
+    HouseType* house = &sim->house;
+    Ghost* ghost = &sim->ghost;
+
+    telemetryWatch(house);
+    l_startAsync(logPolicy);
+    if (checkpointPath != NULL) {
+        int running = simRunUntil(sim, checkpointAt);
+        l_stopAsync();
+        if (running) {
+            SimSnapshot snapshot;
+            simCheckpoint(sim, &snapshot);
+            int ok = saveSnapshot(&snapshot, checkpointPath);
+            if (ok) {
+                printf("\nSaved the game at %ld simulated ms to %s (%zu bytes); continue it with --restore %s\n",
+                       sim->sched.now, checkpointPath, snapshot.size, checkpointPath);
+            }
+            freeSnapshot(&snapshot);
+            if (trace != NULL) cleanupTraceBuffer(&traceBuffer);
+            telemetryWatch(NULL);
+            simDestroy(sim);
+            return ok;
+        }
+        printf("\nThe game ended before %ld simulated ms, so there was nothing to save\n", checkpointAt);
+    } else if (engine == ENGINE_VIRTUAL) {
+        simRun(sim);
+    } else if (engine == ENGINE_TASKS) {
+        runTaskGame(sim, jobs);
+    } else {
+        makeHouseThreaded(house);
+        if (wakeOnEvents) enableRoomSignals(house);
+        traceGameStart(house, ghost);
+        pthread_create(&ghost->thread, NULL, ghostThread, (void*)ghost);
+        for (int i = 0; i < numHunters; i++) {
+            pthread_create(&sim->hunters[i].thread, NULL, hunterThread, (void*)&sim->hunters[i]);
+        }
+
+        for (int i = 0; i < numHunters; i++) {
+            pthread_join(sim->hunters[i].thread, NULL);
+        }
+        pthread_join(ghost->thread, NULL);
+        traceGameEnd(house);
+    }
+    l_stopAsync();
+    if (trace != NULL) {
+        cleanupTraceBuffer(&traceBuffer);
+    }
+
+    printf("\n");
+    finalizeResults(house, ghost);
+    finishWatching(sim);
+    return C_TRUE;
+}
+
+/*
+    Checks that a saved game can be restored over a layout before forking continuations of it.
+*/
+static int snapshotFits(const HouseLayout* layout, const SimSnapshot* snapshot) {
+    LogSink quiet = { C_FALSE, STDOUT_FILENO };
+    SimContext* sim = simCreateFromSnapshot(layout, snapshot, quiet, NULL);
+    int fits = sim != NULL;
+    simDestroy(sim);
+    return fits;
 }
 
+/*
+    Continues a saved game to the end in simulated time, logging it like any other game.
+        in: layout - the house the game was saved in
+        in: snapshot - the saved game
+        in: logPolicy - what the logger does when it cannot keep up
+        return: C_TRUE on success, C_FALSE if the snapshot belongs to another house
+*/
+static int playFromSnapshot(const HouseLayout* layout, const SimSnapshot* snapshot, enum LogPolicy logPolicy) {
+    LogSink log = { C_TRUE, STDOUT_FILENO };
+    SimContext* sim = simCreateFromSnapshot(layout, snapshot, log, NULL);
+    if (sim == NULL) {
+        fprintf(stderr, "the snapshot was taken in a different house; pass the same --map\n");
+        return C_FALSE;
+    }
+
+    printf("Continuing the game from %ld simulated ms\n", sim->sched.now);
+    telemetryWatch(&sim->house);
+    l_startAsync(logPolicy);
+    simRun(sim);
+    l_stopAsync();
+
+    printf("\n");
+    finalizeResults(&sim->house, &sim->ghost);
+    finishWatching(sim);
+    return C_TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    long runs = 0;
+    enum Engine engine = ENGINE_THREADS;
+    int numHunters = NUM_HUNTERS;
+    const char* mapPath = NULL;
+    const char* compilePath = NULL;
+    enum LogPolicy logPolicy = LOG_BLOCK;
+    const char* tracePath = NULL;
+    const char* resultsPath = NULL;
+    const char* checkpointPath = NULL;
+    long checkpointAt = -1;
+    const char* restorePath = NULL;
+    const char* telemetryName = NULL;
+    const char* telemetrySocket = NULL;
+    int lanes = LOCKSTEP_LANES;
+    enum LaneIsa isa = LANES_AUTO;
+    int solve = C_FALSE;
+    int navigate = C_FALSE;
+    int evidenceSlots = 1;
+    int wakeOnEvents = C_FALSE;
+    long solveStates = SOLVE_STATES;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t seed = (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    // With make INSTRUMENT=1, print the hot-path figures at exit and on SIGUSR1
+    INST_START();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--hunters") == 0 && i + 1 < argc) {
+            numHunters = atoi(argv[++i]);
+            if (numHunters < 1 || numHunters > OCC_MAX_HUNTERS) {
+                fprintf(stderr, "--hunters must be between 1 and %d\n", OCC_MAX_HUNTERS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc) {
+            lanes = atoi(argv[++i]);
+            if (lanes < 1) {
+                fprintf(stderr, "--lanes must be at least 1\n");
+                return 1;
+            }
+            lanes = (lanes + LOCKSTEP_WIDTH - 1) / LOCKSTEP_WIDTH * LOCKSTEP_WIDTH;
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                isa = LANES_AUTO;
+            } else if (strcmp(argv[i], "avx2") == 0) {
+                isa = LANES_AVX2;
+            } else if (strcmp(argv[i], "sse4") == 0) {
+                isa = LANES_SSE4;
+            } else if (strcmp(argv[i], "scalar") == 0) {
+                isa = LANES_SCALAR;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--navigate") == 0) {
+            navigate = C_TRUE;
+        } else if (strcmp(argv[i], "--evidence-slots") == 0 && i + 1 < argc) {
+            evidenceSlots = atoi(argv[++i]);
+            if (evidenceSlots < 1 || evidenceSlots > ROOM_EVIDENCE_SLOTS) {
+                fprintf(stderr, "--evidence-slots must be between 1 and %d\n", ROOM_EVIDENCE_SLOTS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--solve") == 0) {
+            solve = C_TRUE;
+        } else if (strcmp(argv[i], "--solve-states") == 0 && i + 1 < argc) {
+            solveStates = atol(argv[++i]);
+            if (solveStates < 1 || solveStates > SOLVE_STATES_MAX) {
+                fprintf(stderr, "--solve-states must be between 1 and %d\n", SOLVE_STATES_MAX);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            mapPath = argv[++i];
+        } else if (strcmp(argv[i], "--compile-map") == 0 && i + 1 < argc) {
+            compilePath = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-at") == 0 && i + 1 < argc) {
+            checkpointAt = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restorePath = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetryName = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry-socket") == 0 && i + 1 < argc) {
+            telemetrySocket = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+            resultsPath = argv[++i];
+        } else if (strcmp(argv[i], "--log-policy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "drop") == 0) {
+                logPolicy = LOG_DROP;
+            } else if (strcmp(argv[i], "block") == 0) {
+                logPolicy = LOG_BLOCK;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--wake") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "tick") == 0) {
+                wakeOnEvents = C_FALSE;
+            } else if (strcmp(argv[i], "events") == 0) {
+                wakeOnEvents = C_TRUE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "virtual") == 0) {
+                engine = ENGINE_VIRTUAL;
+            } else if (strcmp(argv[i], "threads") == 0) {
+                engine = ENGINE_THREADS;
+            } else if (strcmp(argv[i], "tasks") == 0) {
+                engine = ENGINE_TASKS;
+            } else if (strcmp(argv[i], "lockstep") == 0) {
+                engine = ENGINE_LOCKSTEP;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((checkpointPath != NULL) != (checkpointAt >= 0) || (checkpointPath != NULL && (runs > 0 || restorePath != NULL))) {
+        fprintf(stderr, "--checkpoint and --checkpoint-at go together, and not with --runs or --restore\n");
+        return 1;
+    }
+    if (engine == ENGINE_LOCKSTEP && (runs <= 0 || tracePath != NULL || restorePath != NULL)) {
+        fprintf(stderr, "--engine lockstep plays --runs games, without --trace or --restore\n");
+        return 1;
+    }
+    if (solve && (runs > 0 || tracePath != NULL || restorePath != NULL || checkpointPath != NULL || engine != ENGINE_THREADS)) {
+        fprintf(stderr, "--solve replaces playing games, so it goes without --runs, --engine, --trace, --restore or --checkpoint\n");
+        return 1;
+    }
+    if (navigate && (solve || engine == ENGINE_LOCKSTEP)) {
+        fprintf(stderr, "--navigate is not supported by --solve or --engine lockstep, whose hunters always move at random\n");
+        return 1;
+    }
+    if (evidenceSlots > 1 && (solve || engine == ENGINE_LOCKSTEP)) {
+        fprintf(stderr, "--evidence-slots is not supported by --solve or --engine lockstep, whose rooms hold one piece of evidence\n");
+        return 1;
+    }
+    if (wakeOnEvents && (engine != ENGINE_THREADS || runs > 0 || solve || checkpointPath != NULL || restorePath != NULL)) {
+        fprintf(stderr, "--wake events is for a single game on the threads engine, where every hunter waits on its own thread\n");
+        return 1;
+    }
+    if (resultsPath != NULL && runs <= 0) {
+        fprintf(stderr, "--results stores the games of --runs\n");
+        return 1;
+    }
+    if (restorePath != NULL && tracePath != NULL) {
+        fprintf(stderr, "--trace cannot record a game restored from the middle\n");
+        return 1;
+    }
+
+    seedRandom(seed);
+
+    HouseLayout layout;
+    if (mapPath == NULL) {
+        populateRooms(&layout);
+    } else if (!loadLayout(mapPath, &layout)) {
+        return 1;
+    }
+
+    if (compilePath != NULL) {
+        int ok = saveCompiledMap(&layout, compilePath);
+        cleanupLayout(&layout);
+        return ok ? 0 : 1;
+    }
+
+    layout.evidenceSlots = evidenceSlots;
+    if (navigate) buildNavTable(&layout, jobs);
+
+    if (solve) {
+        SolveResult result;
+        int ok = solveExact(&layout, numHunters, jobs, solveStates, &result);
+        if (ok) printSolveResult(&result);
+        cleanupLayout(&layout);
+        return ok ? 0 : 1;
+    }
+
+    TraceFile trace;
+    if (tracePath != NULL && !openTrace(&trace, tracePath, &layout)) {
+        cleanupLayout(&layout);
+        return 1;
+    }
+    TraceFile* tracing = tracePath != NULL ? &trace : NULL;
+    int status = 0;
+
+    SimSnapshot snapshot = { NULL, 0 };
+    if (restorePath != NULL && !loadSnapshot(&snapshot, restorePath)) {
+        cleanupLayout(&layout);
+        return 1;
+    }
+    ResultsFile results;
+    if (resultsPath != NULL && !openResults(&results, resultsPath)) {
+        if (tracing != NULL) closeTrace(&trace);
+        freeSnapshot(&snapshot);
+        cleanupLayout(&layout);
+        return 1;
+    }
+    ResultsFile* storing = resultsPath != NULL ? &results : NULL;
+    if ((telemetryName != NULL || telemetrySocket != NULL) &&
+        !telemetryStart(telemetryName, telemetrySocket, runs > 0 ? runs : 1)) {
+        if (tracing != NULL) closeTrace(&trace);
+        if (storing != NULL) closeResults(&results);
+        freeSnapshot(&snapshot);
+        cleanupLayout(&layout);
+        return 1;
+    }
+
+    if (restorePath != NULL && runs <= 0) {
+        if (!playFromSnapshot(&layout, &snapshot, logPolicy)) status = 1;
+    } else if (runs <= 0) {
+        if (!playInteractive(&layout, seed, checkpointPath != NULL ? ENGINE_VIRTUAL : engine, wakeOnEvents, numHunters, jobs,
+                             logPolicy, tracing, checkpointPath, checkpointAt)) {
+            status = 1;
+        }
+    } else if (restorePath != NULL && !snapshotFits(&layout, &snapshot)) {
+        fprintf(stderr, "the snapshot was taken in a different house; pass the same --map\n");
+        status = 1;
+    } else {
+        struct timespec start, end;
+        BatchStats stats;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (engine == ENGINE_LOCKSTEP) {
+            runLockstepBatch(&layout, seed, numHunters, runs, jobs, lanes, isa, storing, &stats);
+        } else {
+            runBatch(&layout, seed, numHunters, runs, jobs, tracing, storing, restorePath != NULL ? &snapshot : NULL, &stats);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Seed:                    %llu\n", (unsigned long long) seed);
+        if (engine == ENGINE_LOCKSTEP) {
+            printf("Lockstep:                %d lanes per worker, %s kernels\n", lanes, laneIsaName(resolveLaneIsa(isa)));
+        }
+        printBatchStats(&stats, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+        cleanupBatchStats(&stats);
+    }
+
+    telemetryStop();
+    if (tracing != NULL && !closeTrace(&trace)) status = 1;
+    if (storing != NULL && !closeResults(&results)) status = 1;
+    freeSnapshot(&snapshot);
+    cleanupLayout(&layout);
+    return status;
+}
@@ -0,0 +1,312 @@
+// mapfile.c
+#include "defs.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    House layouts can be loaded from two kinds of file:
+
+    A text map (see maps/default.map) lists "room <name>" and "connect <name> -- <name>" lines.
+
+    A compiled map is the layout's arrays written out as-is behind a small header. It is mapped
+    read-only with mmap and used in place, so loading it costs one page fault per page touched
+    and every process that maps the same file shares its memory. Compiled maps use the byte order
+    of the machine that wrote them.
+*/
+
+#define MAP_MAGIC   "GHMAP\0\0\0"
+#define MAP_VERSION 1
+
+typedef struct MapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numRooms;
+    uint32_t numAdj;
+    uint32_t namesSize;
+    uint64_t adjStartOffset;    // byte offsets of each array from the start of the file
+    uint64_t adjOffset;
+    uint64_t nameOffsetOffset;
+    uint64_t namesOffset;
+    uint64_t fileSize;
+} MapHeader;
+
+/*
+    Removes leading and trailing whitespace from a string, in place.
+*/
+static char* trim(char* str) {
+    while (isspace((unsigned char) *str)) str++;
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char) end[-1])) end--;
+    *end = '\0';
+    return str;
+}
+
+/*
+    Function: loadTextMap(const char* path, HouseLayout* layout)
+    Purpose: Parses a text map file into a layout.
+
+    Parameters:
+      in: path - the map file.
+      out: layout - the loaded layout; free it with cleanupLayout.
+
+    Returns:
+      out: C_TRUE on success, C_FALSE after printing the problem to stderr.
+*/
+int loadTextMap(const char* path, HouseLayout* layout) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+
+    HouseBuilder builder;
+    initBuilder(&builder);
+
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int lineNumber = 0;
+    int ok = C_TRUE;
+
+    while (ok && getline(&line, &lineCapacity, file) != -1) {
+        lineNumber++;
+        char* text = trim(line);
+        if (*text == '\0' || *text == '#') continue;
+
+        if (strncmp(text, "room", 4) == 0 && isspace((unsigned char) text[4])) {
+            char* name = trim(text + 4);
+            if (strlen(name) >= MAX_STR) {
+                fprintf(stderr, "%s:%d: room name longer than %d characters\n", path, lineNumber, MAX_STR - 1);
+                ok = C_FALSE;
+            } else if (findRoom(&builder, name) != NO_ROOM) {
+                fprintf(stderr, "%s:%d: room \"%s\" declared twice\n", path, lineNumber, name);
+                ok = C_FALSE;
+            } else {
+                createRoom(&builder, name);
+            }
+        } else if (strncmp(text, "connect", 7) == 0 && isspace((unsigned char) text[7])) {
+            char* from = text + 7;
+            char* separator = strstr(from, " -- ");
+            if (separator == NULL) {
+                fprintf(stderr, "%s:%d: expected \"connect <room> -- <room>\"\n", path, lineNumber);
+                ok = C_FALSE;
+                continue;
+            }
+            *separator = '\0';
+            from = trim(from);
+            char* to = trim(separator + 4);
+            RoomId a = findRoom(&builder, from);
+            RoomId b = findRoom(&builder, to);
+            if (a == NO_ROOM || b == NO_ROOM) {
+                fprintf(stderr, "%s:%d: unknown room \"%s\"\n", path, lineNumber, a == NO_ROOM ? from : to);
+                ok = C_FALSE;
+            } else {
+                connectRooms(&builder, a, b);
+            }
+        } else {
+            fprintf(stderr, "%s:%d: expected \"room\" or \"connect\"\n", path, lineNumber);
+            ok = C_FALSE;
+        }
+    }
+
+    if (ok && builder.numRooms < 2) {
+        fprintf(stderr, "%s: a house needs the Van and at least one other room\n", path);
+        ok = C_FALSE;
+    }
+    if (ok) {
+        buildLayout(&builder, layout);
+    }
+
+    free(line);
+    fclose(file);
+    cleanupBuilder(&builder);
+    return ok;
+}
+
+/*
+    Rounds a file offset up to the next multiple of 8.
+*/
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+/*
+    Function: saveCompiledMap(const HouseLayout* layout, const char* path)
+    Purpose: Writes a layout as a compiled map that mapCompiledMap can use in place.
+
+    Returns:
+      out: C_TRUE on success, C_FALSE after printing the problem to stderr.
+*/
+int saveCompiledMap(const HouseLayout* layout, const char* path) {
+    MapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_MAGIC, sizeof(header.magic));
+    header.version = MAP_VERSION;
+    header.numRooms = layout->numRooms;
+    header.numAdj = layout->numAdj;
+    header.namesSize = layout->namesSize;
+    header.adjStartOffset = align8(sizeof(MapHeader));
+    header.adjOffset = align8(header.adjStartOffset + (layout->numRooms + 1) * sizeof(uint32_t));
+    header.nameOffsetOffset = align8(header.adjOffset + layout->numAdj * sizeof(RoomId));
+    header.namesOffset = align8(header.nameOffsetOffset + layout->numRooms * sizeof(uint32_t));
+    header.fileSize = header.namesOffset + layout->namesSize;
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+
+    static const char padding[8];
+    struct { const void* data; uint64_t size; uint64_t offset; } sections[] = {
+        { &header,            sizeof(header),                                0 },
+        { layout->adjStart,   (layout->numRooms + 1) * sizeof(uint32_t),     header.adjStartOffset },
+        { layout->adj,        layout->numAdj * sizeof(RoomId),               header.adjOffset },
+        { layout->nameOffset, layout->numRooms * sizeof(uint32_t),           header.nameOffsetOffset },
+        { layout->names,      layout->namesSize,                             header.namesOffset },
+    };
+
+    int ok = C_TRUE;
+    uint64_t written = 0;
+    for (int i = 0; ok && i < (int) (sizeof(sections) / sizeof(sections[0])); i++) {
+        if (sections[i].offset > written) {
+            ok = fwrite(padding, 1, sections[i].offset - written, file) == sections[i].offset - written;
+            written = sections[i].offset;
+        }
+        if (ok && sections[i].size > 0) {
+            ok = fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+        }
+        written += sections[i].size;
+    }
+    if (fclose(file) != 0) ok = C_FALSE;
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+    }
+    return ok;
+}
+
+/*
+    Checks the arrays of a compiled map whose header has been checked: adjStart must rise from 0
+    to numAdj, every neighbour and name offset must be in range, and the names must end in a NUL,
+    so that nothing read through the layout can leave the file.
+*/
+static int checkCompiledArrays(const MapHeader* header, const char* bytes) {
+    const uint32_t* adjStart = (const uint32_t*) (bytes + header->adjStartOffset);
+    const RoomId* adj = (const RoomId*) (bytes + header->adjOffset);
+    const uint32_t* nameOffset = (const uint32_t*) (bytes + header->nameOffsetOffset);
+    const char* names = bytes + header->namesOffset;
+
+    if (adjStart[0] != 0 || adjStart[header->numRooms] != header->numAdj) return C_FALSE;
+    for (uint32_t r = 0; r < header->numRooms; r++) {
+        if (adjStart[r] > adjStart[r + 1]) return C_FALSE;
+    }
+    for (uint32_t i = 0; i < header->numAdj; i++) {
+        if (adj[i] >= header->numRooms) return C_FALSE;
+    }
+    if (header->namesSize == 0 || names[header->namesSize - 1] != '\0') return C_FALSE;
+    for (uint32_t r = 0; r < header->numRooms; r++) {
+        if (nameOffset[r] >= header->namesSize) return C_FALSE;
+    }
+    return C_TRUE;
+}
+
+/*
+    Function: mapCompiledMap(const char* path, HouseLayout* layout)
+    Purpose: Maps a compiled map read-only and points the layout's arrays into it.
+
+    Parameters:
+      in: path - the compiled map file.
+      out: layout - the layout; cleanupLayout unmaps the file.
+
+    Description:
+      The arrays are used exactly as they are in the file, so they are checked once here
+      (see checkCompiledArrays) and a damaged file is rejected like a bad text map.
+
+    Returns:
+      out: C_TRUE on success, C_FALSE after printing the problem to stderr.
+*/
+int mapCompiledMap(const char* path, HouseLayout* layout) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(MapHeader)) {
+        fprintf(stderr, "%s: not a compiled map\n", path);
+        close(fd);
+        return C_FALSE;
+    }
+
+    void* base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+
+    const MapHeader* header = base;
+    const char* bytes = base;
+    int ok = memcmp(header->magic, MAP_MAGIC, sizeof(header->magic)) == 0
+          && header->version == MAP_VERSION
+          && header->fileSize == (uint64_t) info.st_size
+          && header->numRooms >= 2
+          && header->adjStartOffset >= sizeof(MapHeader)
+          // Every offset lies within the file, so the differences below cannot wrap
+          && header->adjStartOffset <= header->fileSize
+          && header->adjOffset <= header->fileSize
+          && header->nameOffsetOffset <= header->fileSize
+          && header->namesOffset <= header->fileSize
+          && header->adjStartOffset % sizeof(uint32_t) == 0
+          && header->adjOffset % sizeof(RoomId) == 0
+          && header->nameOffsetOffset % sizeof(uint32_t) == 0
+          && header->adjOffset >= header->adjStartOffset
+          && header->adjOffset - header->adjStartOffset >= ((uint64_t) header->numRooms + 1) * sizeof(uint32_t)
+          && header->nameOffsetOffset >= header->adjOffset
+          && header->nameOffsetOffset - header->adjOffset >= header->numAdj * (uint64_t) sizeof(RoomId)
+          && header->namesOffset >= header->nameOffsetOffset
+          && header->namesOffset - header->nameOffsetOffset >= header->numRooms * (uint64_t) sizeof(uint32_t)
+          && header->fileSize - header->namesOffset >= header->namesSize
+          && checkCompiledArrays(header, bytes);
+    if (!ok) {
+        fprintf(stderr, "%s: not a compiled map, damaged, or written by a different version or byte order\n", path);
+        munmap(base, info.st_size);
+        return C_FALSE;
+    }
+
+    layout->numRooms = header->numRooms;
+    layout->numAdj = header->numAdj;
+    layout->adjStart = (const uint32_t*) (bytes + header->adjStartOffset);
+    layout->adj = (const RoomId*) (bytes + header->adjOffset);
+    layout->nameOffset = (const uint32_t*) (bytes + header->nameOffsetOffset);
+    layout->names = bytes + header->namesOffset;
+    layout->namesSize = header->namesSize;
+    layout->storage = base;
+    layout->mappedSize = info.st_size;
+    layout->nav = NULL;
+    layout->evidenceSlots = 1;
+    return C_TRUE;
+}
+
+/*
+    Function: loadLayout(const char* path, HouseLayout* layout)
+    Purpose: Loads a house from either a compiled map or a text map, whichever the file is.
+
+    Returns:
+      out: C_TRUE on success, C_FALSE after printing the problem to stderr.
+*/
+int loadLayout(const char* path, HouseLayout* layout) {
+    char magic[sizeof(((MapHeader*) 0)->magic)];
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    int compiled = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+                && memcmp(magic, MAP_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+
+    return compiled ? mapCompiledMap(path, layout) : loadTextMap(path, layout);
+}
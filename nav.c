@@ -0,0 +1,273 @@
+// nav.c
+#include "defs.h"
+
+/*
+    Navigation tables: the next room on a shortest route between any two rooms, looked up
+    instead of searched for, so that hunters can head somewhere rather than wander.
+
+    Houses of up to NAV_MAX_ROOMS rooms get a table for every pair: a breadth-first search from
+    every room, shared among threads, records for each other room its distance and the room it
+    was reached from, which is the next room on the way back. Both fit in 16 bits.
+
+    A table for every pair of a bigger house would not fit in memory (10^10 pairs for 10^5
+    rooms), so bigger houses route along a breadth-first spanning tree instead, which takes O(R)
+    space: rooms are numbered in preorder, so a room's subtree is an interval of numbers, and
+    the way to a room is down into the child whose interval holds it, or else up to the parent.
+    Routes are shortest from the Van and never longer than going through the root.
+*/
+
+typedef struct NavBuild {
+    NavTable* nav;
+    const HouseLayout* layout;
+    atomic_uint next;                   // the next room to search from
+} NavBuild;
+
+/*
+    Searches from every room in turn until none are left, writing rows of the all-pairs tables.
+*/
+static void* buildRows(void* arg) {
+    NavBuild* build = arg;
+    const HouseLayout* layout = build->layout;
+    uint32_t numRooms = layout->numRooms;
+    RoomId* queue = malloc(numRooms * sizeof(RoomId));
+    if (queue == NULL) {
+        perror("Error building navigation tables");
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        RoomId to = atomic_fetch_add(&build->next, 1);
+        if (to >= numRooms) break;
+        uint16_t* hop = build->nav->hop + (size_t) to * numRooms;
+        uint16_t* dist = build->nav->dist + (size_t) to * numRooms;
+        for (uint32_t r = 0; r < numRooms; r++) {
+            hop[r] = (uint16_t) r;
+            dist[r] = UINT16_MAX;
+        }
+        uint32_t head = 0, tail = 0;
+        dist[to] = 0;
+        queue[tail++] = to;
+        while (head < tail) {
+            RoomId room = queue[head++];
+            for (uint32_t i = layout->adjStart[room]; i < layout->adjStart[room + 1]; i++) {
+                RoomId next = layout->adj[i];
+                if (dist[next] != UINT16_MAX) continue;
+                dist[next] = dist[room] + 1;
+                hop[next] = (uint16_t) room;
+                queue[tail++] = next;
+            }
+        }
+    }
+    free(queue);
+    return NULL;
+}
+
+/*
+    Builds the spanning forest of a house too big for all-pairs tables: a breadth-first tree from
+    the Van, and from the first room of every part of the house the Van cannot reach.
+*/
+static void buildTree(NavTable* nav, const HouseLayout* layout) {
+    uint32_t numRooms = layout->numRooms;
+    RoomId* order = malloc(numRooms * sizeof(RoomId));
+    uint32_t* next = malloc(numRooms * sizeof(uint32_t));
+    if (order == NULL || next == NULL) {
+        perror("Error building navigation tables");
+        exit(EXIT_FAILURE);
+    }
+
+    // Breadth first: parents, depths and the roots of the parts
+    for (uint32_t r = 0; r < numRooms; r++) {
+        nav->up[r] = NO_ROOM;
+        nav->root[r] = NO_ROOM;
+    }
+    uint32_t tail = 0;
+    for (RoomId start = 0; start < numRooms; start++) {
+        if (nav->root[start] != NO_ROOM) continue;
+        uint32_t head = tail;
+        nav->root[start] = start;
+        nav->depth[start] = 0;
+        order[tail++] = start;
+        while (head < tail) {
+            RoomId room = order[head++];
+            for (uint32_t i = layout->adjStart[room]; i < layout->adjStart[room + 1]; i++) {
+                RoomId child = layout->adj[i];
+                if (nav->root[child] != NO_ROOM) continue;
+                nav->root[child] = start;
+                nav->up[child] = room;
+                nav->depth[child] = nav->depth[room] + 1;
+                order[tail++] = child;
+            }
+        }
+    }
+
+    // Children of every room, grouped by parent
+    memset(nav->childStart, 0, (numRooms + 1) * sizeof(uint32_t));
+    for (uint32_t r = 0; r < numRooms; r++) {
+        if (nav->up[r] != NO_ROOM) nav->childStart[nav->up[r] + 1]++;
+    }
+    for (uint32_t r = 0; r < numRooms; r++) {
+        nav->childStart[r + 1] += nav->childStart[r];
+    }
+    memcpy(next, nav->childStart, numRooms * sizeof(uint32_t));
+    for (uint32_t i = 0; i < numRooms; i++) {
+        RoomId room = order[i];
+        if (nav->up[room] != NO_ROOM) nav->child[next[nav->up[room]]++] = room;
+    }
+
+    // Preorder numbers, depth first without recursion; children are numbered in the order they
+    // are stored, so each room's children come out sorted by preorder number
+    uint32_t number = 0, top = 0;
+    for (RoomId start = 0; start < numRooms; start++) {
+        if (nav->root[start] != start) continue;
+        order[top] = start;
+        next[top++] = 0;
+        nav->pre[start] = number++;
+        while (top > 0) {
+            RoomId room = order[top - 1];
+            uint32_t i = nav->childStart[room] + next[top - 1];
+            if (i < nav->childStart[room + 1]) {
+                RoomId child = nav->child[i];
+                next[top - 1]++;
+                nav->pre[child] = number++;
+                order[top] = child;
+                next[top++] = 0;
+            } else {
+                nav->last[room] = number - 1;
+                top--;
+            }
+        }
+    }
+    free(order);
+    free(next);
+}
+
+/*
+  Function: buildNavTable(HouseLayout* layout, int jobs)
+  Purpose: Builds a house's navigation tables and attaches them to its layout, after which every hunter playing in it navigates.
+
+  Parameters:
+    in/out layout: the house; cleanupLayout frees the tables with it.
+    in jobs: threads that build all-pairs tables.
+
+  return
+    none
+*/
+void buildNavTable(HouseLayout* layout, int jobs) {
+    uint32_t numRooms = layout->numRooms;
+    NavTable* nav = calloc(1, sizeof(NavTable));
+    if (nav == NULL) {
+        perror("Error building navigation tables");
+        exit(EXIT_FAILURE);
+    }
+    nav->numRooms = numRooms;
+    nav->allPairs = numRooms <= NAV_MAX_ROOMS;
+
+    if (nav->allPairs) {
+        nav->hop = malloc((size_t) numRooms * numRooms * sizeof(uint16_t));
+        nav->dist = malloc((size_t) numRooms * numRooms * sizeof(uint16_t));
+        if (nav->hop == NULL || nav->dist == NULL) {
+            perror("Error building navigation tables");
+            exit(EXIT_FAILURE);
+        }
+        NavBuild build = { nav, layout, 0 };
+        if (jobs < 1) jobs = 1;
+        if ((uint32_t) jobs > numRooms) jobs = (int) numRooms;
+        pthread_t* threads = malloc(jobs * sizeof(pthread_t));
+        if (threads == NULL) {
+            perror("Error building navigation tables");
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 1; t < jobs; t++) {
+            pthread_create(&threads[t], NULL, buildRows, &build);
+        }
+        buildRows(&build);
+        for (int t = 1; t < jobs; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        free(threads);
+    } else {
+        nav->up = malloc(numRooms * sizeof(RoomId));
+        nav->root = malloc(numRooms * sizeof(RoomId));
+        nav->depth = malloc(numRooms * sizeof(uint32_t));
+        nav->pre = malloc(numRooms * sizeof(uint32_t));
+        nav->last = malloc(numRooms * sizeof(uint32_t));
+        nav->childStart = malloc((numRooms + 1) * sizeof(uint32_t));
+        nav->child = malloc(numRooms * sizeof(RoomId));
+        if (nav->up == NULL || nav->root == NULL || nav->depth == NULL || nav->pre == NULL || nav->last == NULL ||
+            nav->childStart == NULL || nav->child == NULL) {
+            perror("Error building navigation tables");
+            exit(EXIT_FAILURE);
+        }
+        buildTree(nav, layout);
+    }
+    layout->nav = nav;
+}
+
+/*
+  Function: freeNavTable(NavTable* nav)
+  Purpose: Frees navigation tables; cleanupLayout calls it for tables attached to a layout.
+*/
+void freeNavTable(NavTable* nav) {
+    if (nav == NULL) return;
+    free(nav->hop);
+    free(nav->dist);
+    free(nav->up);
+    free(nav->root);
+    free(nav->depth);
+    free(nav->pre);
+    free(nav->last);
+    free(nav->childStart);
+    free(nav->child);
+    free(nav);
+}
+
+/*
+  Function: navNextRoom(const NavTable* nav, RoomId from, RoomId to)
+  Purpose: Returns the next room on the way from one room to another.
+
+  Parameters:
+    in nav: the house's tables.
+    in from: where the hunter is.
+    in to: where it is going.
+
+  return
+    a room connected to from, or from itself if it is already there or cannot get there
+*/
+RoomId navNextRoom(const NavTable* nav, RoomId from, RoomId to) {
+    if (from == to) return from;
+    if (nav->allPairs) return nav->hop[(size_t) to * nav->numRooms + from];
+    if (nav->root[from] != nav->root[to]) return from;
+
+    // Down into the child whose subtree holds the room, or up
+    if (nav->pre[to] > nav->pre[from] && nav->pre[to] <= nav->last[from]) {
+        uint32_t low = nav->childStart[from], high = nav->childStart[from + 1] - 1;
+        while (low < high) {
+            uint32_t mid = (low + high + 1) / 2;
+            if (nav->pre[nav->child[mid]] <= nav->pre[to]) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+        return nav->child[low];
+    }
+    return nav->up[from];
+}
+
+/*
+  Function: navDistance(const NavTable* nav, RoomId from, RoomId to)
+  Purpose: Returns how many moves the way from one room to another takes.
+
+  return
+    the length of a shortest route in an all-pairs table; along the tree, exact when one room is below the other and otherwise an upper bound; NAV_FAR if there is no way
+*/
+uint32_t navDistance(const NavTable* nav, RoomId from, RoomId to) {
+    if (nav->allPairs) {
+        uint16_t dist = nav->dist[(size_t) to * nav->numRooms + from];
+        return dist == UINT16_MAX ? NAV_FAR : dist;
+    }
+    if (nav->root[from] != nav->root[to]) return NAV_FAR;
+    if (nav->pre[to] >= nav->pre[from] && nav->pre[to] <= nav->last[from]) return nav->depth[to] - nav->depth[from];
+    if (nav->pre[from] >= nav->pre[to] && nav->pre[from] <= nav->last[to]) return nav->depth[from] - nav->depth[to];
+    return nav->depth[from] + nav->depth[to];
+}
@@ -0,0 +1,350 @@
+// results.c
+#include "defs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    A results file holds one row per game, stored column by column in blocks:
+
+        ResultsFileHeader
+        block, block, ...       ResultsBlockHeader, then each column of the block's rows in
+                                enum ResultsColumn order, padded to 8 bytes
+        uint64_t[numBlocks]     offset of every block, at header.indexOffset
+
+    Every batch worker fills a ResultsBuffer of RESULTS_BLOCK_ROWS games and appends it as a
+    block when it is full, so blocks from different workers interleave and the last block of
+    each worker may be short. The block header keeps the smallest and largest value of every
+    column, so a query can skip whole blocks, and only the columns a query uses are ever read.
+    The index and the final header are written when the file is closed; a file that was never
+    closed does not open. The file uses the writer's byte order.
+*/
+
+static const int columnWidths[RES_COLUMN_COUNT] = {
+    [RES_SEED] = 8, [RES_EXITS] = 8, [RES_CONFIG] = 4, [RES_TICKS] = 4, [RES_EXIT_FEAR] = 2,
+    [RES_EXIT_BORED] = 2, [RES_EXIT_EVIDENCE] = 2, [RES_GHOST] = 1, [RES_IDENTIFIED] = 1, [RES_EVIDENCE] = 1,
+};
+
+static const char* columnNames[RES_COLUMN_COUNT] = {
+    [RES_SEED] = "seed", [RES_EXITS] = "exits", [RES_CONFIG] = "config", [RES_TICKS] = "ticks",
+    [RES_EXIT_FEAR] = "exit_fear", [RES_EXIT_BORED] = "exit_bored", [RES_EXIT_EVIDENCE] = "exit_evidence",
+    [RES_GHOST] = "ghost", [RES_IDENTIFIED] = "identified", [RES_EVIDENCE] = "evidence",
+};
+
+/*
+    Function: resultsColumnWidth(enum ResultsColumn column)
+    Purpose: Returns the bytes one value of a column takes.
+*/
+int resultsColumnWidth(enum ResultsColumn column) {
+    return columnWidths[column];
+}
+
+/*
+    Function: resultsColumnName(enum ResultsColumn column)
+    Purpose: Returns the name of a column, e.g. "exit_fear", or NULL if there is none.
+*/
+const char* resultsColumnName(enum ResultsColumn column) {
+    return column >= 0 && column < RES_COLUMN_COUNT ? columnNames[column] : NULL;
+}
+
+/*
+    Bytes of the columns of a block of the given number of rows, padded to 8.
+*/
+static uint64_t blockDataSize(uint32_t rows) {
+    uint64_t size = 0;
+    for (int c = 0; c < RES_COLUMN_COUNT; c++) size += (uint64_t) columnWidths[c] * rows;
+    return (size + 7) & ~(uint64_t) 7;
+}
+
+/*
+    Function: openResults(ResultsFile* results, const char* path)
+    Purpose: Creates a results file and writes a header that closeResults completes.
+
+    Returns:
+      C_TRUE on success, C_FALSE after printing the problem to stderr
+*/
+int openResults(ResultsFile* results, const char* path) {
+    results->file = fopen(path, "wb");
+    if (results->file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    setvbuf(results->file, NULL, _IOFBF, 1 << 20);
+    pthread_mutex_init(&results->lock, NULL);
+    results->numGames = 0;
+    results->numBlocks = 0;
+    results->capacity = 64;
+    results->blocks = malloc(results->capacity * sizeof(uint64_t));
+    if (results->blocks == NULL) {
+        perror("Error creating results file");
+        exit(EXIT_FAILURE);
+    }
+
+    ResultsFileHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, results->file);
+    results->offset = sizeof(header);
+    return C_TRUE;
+}
+
+/*
+    Function: closeResults(ResultsFile* results)
+    Purpose: Writes the block index and the header, and closes the file. Every buffer writing to it must be cleaned up first.
+
+    Returns:
+      C_TRUE if everything reached the file, C_FALSE after printing the problem to stderr
+*/
+int closeResults(ResultsFile* results) {
+    ResultsFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESULTS_MAGIC, sizeof(header.magic));
+    header.version = RESULTS_VERSION;
+    header.blockRows = RESULTS_BLOCK_ROWS;
+    header.numGames = results->numGames;
+    header.numBlocks = results->numBlocks;
+    header.indexOffset = results->offset;
+
+    fwrite(results->blocks, sizeof(uint64_t), results->numBlocks, results->file);
+    int ok = fseek(results->file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, results->file) == 1;
+    if (ferror(results->file)) ok = C_FALSE;
+    if (fclose(results->file) != 0) ok = C_FALSE;
+    pthread_mutex_destroy(&results->lock);
+    free(results->blocks);
+    results->blocks = NULL;
+    if (!ok) {
+        fprintf(stderr, "results: write failed\n");
+    }
+    return ok;
+}
+
+/*
+    Function: initResultsBuffer(ResultsBuffer* buffer, ResultsFile* results)
+    Purpose: Initializes a buffer that collects a block of the games played on one thread.
+*/
+void initResultsBuffer(ResultsBuffer* buffer, ResultsFile* results) {
+    buffer->results = results;
+    buffer->rows = 0;
+    buffer->storage = malloc(blockDataSize(RESULTS_BLOCK_ROWS));
+    if (buffer->storage == NULL) {
+        perror("Error creating results buffer");
+        exit(EXIT_FAILURE);
+    }
+    unsigned char* column = buffer->storage;
+    for (int c = 0; c < RES_COLUMN_COUNT; c++) {
+        buffer->columns[c] = column;
+        column += columnWidths[c] * RESULTS_BLOCK_ROWS;
+    }
+}
+
+/*
+    Returns value number row of a column of the given width.
+*/
+static uint64_t columnValue(const unsigned char* column, int width, uint32_t row) {
+    switch (width) {
+        case 8:  return ((const uint64_t*) column)[row];
+        case 4:  return ((const uint32_t*) column)[row];
+        case 2:  return ((const uint16_t*) column)[row];
+        default: return column[row];
+    }
+}
+
+/*
+    Appends the buffered rows to the file as one block, with the bounds of every column.
+*/
+static void flushResultsBuffer(ResultsBuffer* buffer) {
+    uint32_t rows = buffer->rows;
+    if (rows == 0) return;
+
+    ResultsBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rows = rows;
+    for (int c = 0; c < RES_COLUMN_COUNT; c++) {
+        uint64_t low = UINT64_MAX, high = 0;
+        for (uint32_t r = 0; r < rows; r++) {
+            uint64_t value = columnValue(buffer->columns[c], columnWidths[c], r);
+            if (value < low) low = value;
+            if (value > high) high = value;
+        }
+        header.min[c] = low;
+        header.max[c] = high;
+    }
+
+    static const char padding[8];
+    uint64_t used = 0;
+    for (int c = 0; c < RES_COLUMN_COUNT; c++) used += (uint64_t) columnWidths[c] * rows;
+
+    ResultsFile* results = buffer->results;
+    pthread_mutex_lock(&results->lock);
+    if (results->numBlocks == results->capacity) {
+        uint64_t* grown = realloc(results->blocks, 2 * results->capacity * sizeof(uint64_t));
+        if (grown == NULL) {
+            perror("Error growing results index");
+            exit(EXIT_FAILURE);
+        }
+        results->blocks = grown;
+        results->capacity *= 2;
+    }
+    results->blocks[results->numBlocks++] = results->offset;
+    fwrite(&header, sizeof(header), 1, results->file);
+    for (int c = 0; c < RES_COLUMN_COUNT; c++) {
+        fwrite(buffer->columns[c], columnWidths[c], rows, results->file);
+    }
+    fwrite(padding, 1, blockDataSize(rows) - used, results->file);
+    results->offset += sizeof(header) + blockDataSize(rows);
+    results->numGames += rows;
+    pthread_mutex_unlock(&results->lock);
+    buffer->rows = 0;
+}
+
+/*
+    Function: cleanupResultsBuffer(ResultsBuffer* buffer)
+    Purpose: Writes out the buffer's remaining games as a last, possibly short, block and frees it.
+*/
+void cleanupResultsBuffer(ResultsBuffer* buffer) {
+    flushResultsBuffer(buffer);
+    free(buffer->storage);
+    buffer->storage = NULL;
+}
+
+/*
+    Function: recordResult(ResultsBuffer* buffer, uint64_t seed, uint32_t config, const GameResult* result, unsigned collected, const int* exitReason, int numHunters, size_t stride)
+    Purpose: Adds a finished game to the buffer, writing the buffer out once it holds a whole block.
+
+    Parameters:
+      in/out buffer: the thread's buffer.
+      in seed: the game's stream key.
+      in config: what the game was played with, 0 unless the caller numbers its configurations.
+      in result: the game's outcome.
+      in collected: the evidence board's bits.
+      in exitReason: the first hunter's enum LoggerDetails exit reason ...
+      in numHunters, stride: ... and the others' every stride bytes, as for telemetryCount.
+
+    Returns:
+      none
+*/
+void recordResult(ResultsBuffer* buffer, uint64_t seed, uint32_t config, const GameResult* result, unsigned collected,
+                  const int* exitReason, int numHunters, size_t stride) {
+    uint32_t row = buffer->rows;
+    uint64_t exits = 0;
+    int limit = numHunters < RESULTS_EXIT_HUNTERS ? numHunters : RESULTS_EXIT_HUNTERS;
+    for (int h = 0; h < limit; h++) {
+        int reason = *(const int*) ((const char*) exitReason + h * stride);
+        if (reason == LOG_FEAR || reason == LOG_BORED || reason == LOG_EVIDENCE) {
+            exits |= (uint64_t) (reason + 1) << (2 * h);
+        }
+    }
+    ((uint64_t*) buffer->columns[RES_SEED])[row] = seed;
+    ((uint64_t*) buffer->columns[RES_EXITS])[row] = exits;
+    ((uint32_t*) buffer->columns[RES_CONFIG])[row] = config;
+    ((uint32_t*) buffer->columns[RES_TICKS])[row] = result->ticks > UINT32_MAX ? UINT32_MAX : (uint32_t) result->ticks;
+    ((uint16_t*) buffer->columns[RES_EXIT_FEAR])[row] = result->exitFear;
+    ((uint16_t*) buffer->columns[RES_EXIT_BORED])[row] = result->exitBored;
+    ((uint16_t*) buffer->columns[RES_EXIT_EVIDENCE])[row] = result->exitEvidence;
+    buffer->columns[RES_GHOST][row] = result->ghostType;
+    buffer->columns[RES_IDENTIFIED][row] = result->identifiedType;
+    buffer->columns[RES_EVIDENCE][row] = collected;
+    if (++buffer->rows == RESULTS_BLOCK_ROWS) flushResultsBuffer(buffer);
+}
+
+/*
+    Function: recordGame(ResultsBuffer* buffer, uint32_t config, const SimContext* sim, const GameResult* result)
+    Purpose: Adds a game finished in a simulation context to the buffer, see recordResult.
+*/
+void recordGame(ResultsBuffer* buffer, uint32_t config, const SimContext* sim, const GameResult* result) {
+    const HouseType* house = &sim->house;
+    unsigned collected = atomic_load_explicit(&((HouseType*) house)->evidence.collected, memory_order_relaxed);
+    recordResult(buffer, house->seed, config, result, collected, (const int*) &house->hunters[0].exitReason,
+                 house->numHunters, sizeof(Hunter));
+}
+
+/*
+    Function: mapResults(ResultsView* view, const char* path)
+    Purpose: Maps a results file read-only for queries.
+
+    Description:
+      Only the header and the index are checked here; resultsBlock checks each block as it is used.
+      The kernel is told the file will be read in order, so it reads ahead.
+
+    Returns:
+      C_TRUE on success, C_FALSE after printing the problem to stderr
+*/
+int mapResults(ResultsView* view, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(ResultsFileHeader)) {
+        fprintf(stderr, "%s: not a results file\n", path);
+        close(fd);
+        return C_FALSE;
+    }
+    void* base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    madvise(base, info.st_size, MADV_SEQUENTIAL);
+
+    const ResultsFileHeader* header = base;
+    int ok = memcmp(header->magic, RESULTS_MAGIC, sizeof(header->magic)) == 0
+          && header->version == RESULTS_VERSION
+          && header->blockRows == RESULTS_BLOCK_ROWS
+          && header->indexOffset >= sizeof(ResultsFileHeader)
+          && header->indexOffset <= (uint64_t) info.st_size
+          && header->numBlocks <= ((uint64_t) info.st_size - header->indexOffset) / sizeof(uint64_t)
+          && header->indexOffset % 8 == 0;
+    if (!ok) {
+        fprintf(stderr, "%s: not a complete results file, or written by a different version or byte order\n", path);
+        munmap(base, info.st_size);
+        return C_FALSE;
+    }
+    view->data = base;
+    view->size = info.st_size;
+    view->header = header;
+    view->blocks = (const uint64_t*) (view->data + header->indexOffset);
+    return C_TRUE;
+}
+
+/*
+    Function: unmapResults(ResultsView* view)
+    Purpose: Unmaps a file mapped by mapResults.
+*/
+void unmapResults(ResultsView* view) {
+    if (view->data != NULL) munmap((void*) view->data, view->size);
+    view->data = NULL;
+}
+
+/*
+    Function: resultsBlock(const ResultsView* view, uint64_t block)
+    Purpose: Returns the header of a block of a mapped file, followed by its columns, see resultsColumn.
+
+    Returns:
+      the block, or NULL if it lies outside the file or is damaged
+*/
+const ResultsBlockHeader* resultsBlock(const ResultsView* view, uint64_t block) {
+    if (block >= view->header->numBlocks) return NULL;
+    uint64_t offset = view->blocks[block];
+    if (offset % 8 != 0 || offset < sizeof(ResultsFileHeader) || offset + sizeof(ResultsBlockHeader) > view->header->indexOffset) {
+        return NULL;
+    }
+    const ResultsBlockHeader* header = (const ResultsBlockHeader*) (view->data + offset);
+    if (header->rows == 0 || header->rows > RESULTS_BLOCK_ROWS ||
+        offset + sizeof(ResultsBlockHeader) + blockDataSize(header->rows) > view->header->indexOffset) {
+        return NULL;
+    }
+    return header;
+}
+
+/*
+    Function: resultsColumn(const ResultsBlockHeader* block, enum ResultsColumn column)
+    Purpose: Returns where a column of a block starts; it holds block->rows values of resultsColumnWidth(column) bytes.
+*/
+const void* resultsColumn(const ResultsBlockHeader* block, enum ResultsColumn column) {
+    const unsigned char* data = (const unsigned char*) (block + 1);
+    for (int c = 0; c < column; c++) data += (uint64_t) columnWidths[c] * block->rows;
+    return data;
+}
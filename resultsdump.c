@@ -0,0 +1,500 @@
+// resultsdump.c
+#include "defs.h"
+
+/*
+    ghost_results: grouped totals over a results file written with --results.
+
+    The file is mapped, not read into memory, and worker threads take its blocks one at a time.
+    A block whose column bounds rule out a --where condition is skipped without touching its
+    rows, a condition every row of a block meets is not evaluated, and of the rest only the
+    columns the query needs are read, so a query runs at about the speed the disk delivers them.
+*/
+
+#define QUERY_MAX_FILTERS   16
+#define QUERY_MAX_GROUPS    (1 << 20)
+
+enum GroupBy { GROUP_NONE, GROUP_CONFIG, GROUP_GHOST, GROUP_IDENTIFIED, GROUP_HUNTERS, GROUP_EVIDENCE };
+enum QueryFormat { QUERY_TABLE, QUERY_CSV };
+
+static const char* groupNames[] = {
+    [GROUP_NONE] = "none", [GROUP_CONFIG] = "config", [GROUP_GHOST] = "ghost",
+    [GROUP_IDENTIFIED] = "identified", [GROUP_HUNTERS] = "hunters", [GROUP_EVIDENCE] = "evidence",
+};
+
+// Rows whose column value lies in [low, high]
+typedef struct Filter {
+    enum ResultsColumn column;
+    uint64_t low;
+    uint64_t high;
+} Filter;
+
+// Totals of one group
+typedef struct Aggregate {
+    uint64_t games;
+    uint64_t ghostWins;
+    uint64_t identified;
+    uint64_t identifiedCorrect;
+    uint64_t ticks;
+    uint64_t exitFear;
+    uint64_t exitBored;
+    uint64_t exitEvidence;
+} Aggregate;
+
+typedef struct Query {
+    const ResultsView* view;
+    enum GroupBy groupBy;
+    Filter filters[QUERY_MAX_FILTERS];
+    int numFilters;
+    uint64_t numGroups;                 // group keys run from 0 to numGroups - 1
+    atomic_ullong nextBlock;
+} Query;
+
+typedef struct QueryWorker {
+    Query* query;
+    Aggregate* groups;
+    uint64_t blocks;                    // blocks looked at
+    uint64_t skipped;                   // ... of which the bounds ruled out
+    uint64_t damaged;
+    uint64_t damagedRows;               // rows outside their block's bounds, whose group does not exist
+    uint64_t bytes;                     // column bytes read
+    pthread_t thread;
+} QueryWorker;
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s FILE [--group-by none|config|ghost|identified|hunters|evidence] [--where COLUMN=VALUE[:HIGH]]...\n", program);
+    fprintf(stderr, "          [--format table|csv] [--jobs J] [--list N]\n");
+    fprintf(stderr, "  --group-by  one line of totals per value (default none); hunters is the hunters in the game\n");
+    fprintf(stderr, "  --where     only games whose COLUMN is VALUE, or between VALUE and HIGH; repeat to combine\n");
+    fprintf(stderr, "              COLUMN is seed, exits, config, ticks, exit_fear, exit_bored, exit_evidence, ghost, identified\n");
+    fprintf(stderr, "              or evidence; ghost and identified also take names, e.g. ghost=Phantom\n");
+    fprintf(stderr, "  --format    a readable table (default) or csv\n");
+    fprintf(stderr, "  --jobs      threads scanning the file (default: number of cores)\n");
+    fprintf(stderr, "  --list N    print the first N matching games instead of totals\n");
+}
+
+/*
+    Parses one value of a --where condition: a number, or a ghost's name for the ghost columns.
+*/
+static int parseValue(enum ResultsColumn column, const char* text, uint64_t* value) {
+    if (column == RES_GHOST || column == RES_IDENTIFIED) {
+        for (int g = 0; g < GHOST_COUNT; g++) {
+            if (strcmp(text, ghostName((enum GhostClass) g)) == 0) {
+                *value = g;
+                return C_TRUE;
+            }
+        }
+        if (strcmp(text, ghostName(GH_UNKNOWN)) == 0) {
+            *value = GH_UNKNOWN;
+            return C_TRUE;
+        }
+    }
+    char* end;
+    *value = strtoull(text, &end, 0);
+    return end != text && *end == '\0';
+}
+
+/*
+    Parses COLUMN=VALUE or COLUMN=LOW:HIGH into a filter.
+*/
+static int parseFilter(Filter* filter, char* text) {
+    char* equals = strchr(text, '=');
+    if (equals == NULL) return C_FALSE;
+    *equals = '\0';
+    int column = 0;
+    while (column < RES_COLUMN_COUNT && strcmp(text, resultsColumnName(column)) != 0) column++;
+    if (column == RES_COLUMN_COUNT) return C_FALSE;
+    filter->column = column;
+
+    char* colon = strchr(equals + 1, ':');
+    if (colon != NULL) *colon = '\0';
+    if (!parseValue(column, equals + 1, &filter->low)) return C_FALSE;
+    filter->high = filter->low;
+    return colon == NULL || parseValue(column, colon + 1, &filter->high);
+}
+
+/*
+    Clears keep[r] for every row whose value is outside the filter's range.
+*/
+static void matchFilter(unsigned char* keep, const void* column, int width, uint32_t rows, uint64_t low, uint64_t high) {
+    switch (width) {
+        case 8:
+            for (uint32_t r = 0; r < rows; r++) keep[r] &= ((const uint64_t*) column)[r] >= low && ((const uint64_t*) column)[r] <= high;
+            break;
+        case 4:
+            for (uint32_t r = 0; r < rows; r++) keep[r] &= ((const uint32_t*) column)[r] >= low && ((const uint32_t*) column)[r] <= high;
+            break;
+        case 2:
+            for (uint32_t r = 0; r < rows; r++) keep[r] &= ((const uint16_t*) column)[r] >= low && ((const uint16_t*) column)[r] <= high;
+            break;
+        default:
+            for (uint32_t r = 0; r < rows; r++) keep[r] &= ((const uint8_t*) column)[r] >= low && ((const uint8_t*) column)[r] <= high;
+            break;
+    }
+}
+
+/*
+    Works out every row's group key, reading only the columns the grouping needs.
+    Returns the bytes read.
+*/
+static uint64_t groupKeys(enum GroupBy groupBy, const ResultsBlockHeader* block, uint32_t* keys) {
+    uint32_t rows = block->rows;
+    switch (groupBy) {
+        case GROUP_CONFIG: {
+            const uint32_t* config = resultsColumn(block, RES_CONFIG);
+            memcpy(keys, config, rows * sizeof(uint32_t));
+            return rows * sizeof(uint32_t);
+        }
+        case GROUP_GHOST:
+        case GROUP_IDENTIFIED:
+        case GROUP_EVIDENCE: {
+            const uint8_t* column = resultsColumn(block, groupBy == GROUP_GHOST ? RES_GHOST :
+                                                         groupBy == GROUP_IDENTIFIED ? RES_IDENTIFIED : RES_EVIDENCE);
+            uint32_t last = groupBy == GROUP_EVIDENCE ? (1u << EV_COUNT) - 1 : GH_UNKNOWN;
+            for (uint32_t r = 0; r < rows; r++) keys[r] = column[r] <= last ? column[r] : last;
+            return rows;
+        }
+        case GROUP_HUNTERS: {
+            // Exits are read again for the totals, so they count once
+            const uint16_t* fear = resultsColumn(block, RES_EXIT_FEAR);
+            const uint16_t* bored = resultsColumn(block, RES_EXIT_BORED);
+            const uint16_t* evidence = resultsColumn(block, RES_EXIT_EVIDENCE);
+            for (uint32_t r = 0; r < rows; r++) keys[r] = (uint32_t) fear[r] + bored[r] + evidence[r];
+            return 0;
+        }
+        default:
+            memset(keys, 0, rows * sizeof(uint32_t));
+            return 0;
+    }
+}
+
+/*
+    Adds the matching rows of one block to the worker's groups.
+*/
+static void scanBlock(QueryWorker* worker, const ResultsBlockHeader* block) {
+    const Query* query = worker->query;
+    uint32_t rows = block->rows;
+    unsigned char keep[RESULTS_BLOCK_ROWS];
+    uint32_t keys[RESULTS_BLOCK_ROWS];
+    int filtering = C_FALSE;
+
+    for (int f = 0; f < query->numFilters; f++) {
+        const Filter* filter = &query->filters[f];
+        if (block->max[filter->column] < filter->low || block->min[filter->column] > filter->high) {
+            worker->skipped++;
+            return;
+        }
+        if (block->min[filter->column] >= filter->low && block->max[filter->column] <= filter->high) continue;
+        if (!filtering) {
+            memset(keep, 1, rows);
+            filtering = C_TRUE;
+        }
+        int width = resultsColumnWidth(filter->column);
+        matchFilter(keep, resultsColumn(block, filter->column), width, rows, filter->low, filter->high);
+        worker->bytes += (uint64_t) width * rows;
+    }
+
+    worker->bytes += groupKeys(query->groupBy, block, keys);
+    const uint8_t* ghost = resultsColumn(block, RES_GHOST);
+    const uint8_t* identified = resultsColumn(block, RES_IDENTIFIED);
+    const uint32_t* ticks = resultsColumn(block, RES_TICKS);
+    const uint16_t* fear = resultsColumn(block, RES_EXIT_FEAR);
+    const uint16_t* bored = resultsColumn(block, RES_EXIT_BORED);
+    const uint16_t* evidence = resultsColumn(block, RES_EXIT_EVIDENCE);
+    worker->bytes += (uint64_t) rows * (2 * sizeof(uint8_t) + sizeof(uint32_t) + 3 * sizeof(uint16_t));
+
+    for (uint32_t r = 0; r < rows; r++) {
+        if (filtering && !keep[r]) continue;
+        if (keys[r] >= query->numGroups) {
+            worker->damagedRows++;
+            continue;
+        }
+        Aggregate* group = &worker->groups[keys[r]];
+        int known = identified[r] != GH_UNKNOWN;
+        group->games++;
+        group->ghostWins += evidence[r] == 0;
+        group->identified += known;
+        group->identifiedCorrect += known && identified[r] == ghost[r];
+        group->ticks += ticks[r];
+        group->exitFear += fear[r];
+        group->exitBored += bored[r];
+        group->exitEvidence += evidence[r];
+    }
+}
+
+static void* queryThread(void* arg) {
+    QueryWorker* worker = (QueryWorker*)arg;
+    Query* query = worker->query;
+    for (;;) {
+        uint64_t b = atomic_fetch_add_explicit(&query->nextBlock, 1, memory_order_relaxed);
+        if (b >= query->view->header->numBlocks) break;
+        const ResultsBlockHeader* block = resultsBlock(query->view, b);
+        worker->blocks++;
+        if (block == NULL) {
+            worker->damaged++;
+            continue;
+        }
+        scanBlock(worker, block);
+    }
+    return NULL;
+}
+
+/*
+    Finds how many groups the query can have from the blocks' bounds, without reading any rows.
+*/
+static uint64_t countGroups(const ResultsView* view, enum GroupBy groupBy) {
+    switch (groupBy) {
+        case GROUP_GHOST:
+        case GROUP_IDENTIFIED:
+            return GH_UNKNOWN + 1;
+        case GROUP_EVIDENCE:
+            return 1u << EV_COUNT;
+        case GROUP_CONFIG:
+        case GROUP_HUNTERS: {
+            uint64_t most = 0;
+            for (uint64_t b = 0; b < view->header->numBlocks; b++) {
+                const ResultsBlockHeader* block = resultsBlock(view, b);
+                if (block == NULL) continue;
+                uint64_t high = groupBy == GROUP_CONFIG ? block->max[RES_CONFIG]
+                              : block->max[RES_EXIT_FEAR] + block->max[RES_EXIT_BORED] + block->max[RES_EXIT_EVIDENCE];
+                if (high > most) most = high;
+            }
+            return most + 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+/*
+    Writes a group's name, e.g. a ghost or the evidence collected.
+*/
+static void groupLabel(enum GroupBy groupBy, uint64_t key, char* label, size_t size) {
+    switch (groupBy) {
+        case GROUP_NONE:
+            snprintf(label, size, "all");
+            break;
+        case GROUP_GHOST:
+        case GROUP_IDENTIFIED:
+            snprintf(label, size, "%s", ghostName((enum GhostClass) key));
+            break;
+        case GROUP_EVIDENCE: {
+            size_t used = 0;
+            label[0] = '\0';
+            for (int e = 0; e < EV_COUNT; e++) {
+                if (key & (1u << e)) {
+                    used += snprintf(label + used, size - used, "%s%s", used > 0 ? "+" : "", evidenceName((enum EvidenceType) e));
+                    if (used >= size) break;
+                }
+            }
+            if (key == 0) snprintf(label, size, "none");
+            break;
+        }
+        default:
+            snprintf(label, size, "%llu", (unsigned long long) key);
+            break;
+    }
+}
+
+static void writeTotals(FILE* out, const Query* query, const Aggregate* groups, enum QueryFormat format) {
+    const char* heading = groupNames[query->groupBy];
+    if (format == QUERY_CSV) {
+        fprintf(out, "%s,games,ghost_wins,identified,identified_correct,mean_ticks_ms,exit_fear,exit_bored,exit_evidence\n", heading);
+    } else {
+        fprintf(out, "%-24s %12s %9s %9s %9s %9s %7s %7s %8s\n", heading, "games", "ghost win", "3 found", "correct",
+                "length s", "fear", "bored", "evidence");
+    }
+    for (uint64_t key = 0; key < query->numGroups; key++) {
+        const Aggregate* group = &groups[key];
+        if (group->games == 0) continue;
+        char label[MAX_STR];
+        groupLabel(query->groupBy, key, label, sizeof(label));
+        double games = (double) group->games;
+        if (format == QUERY_CSV) {
+            fprintf(out, "%s,%llu,%llu,%llu,%llu,%.1f,%llu,%llu,%llu\n", label, (unsigned long long) group->games,
+                    (unsigned long long) group->ghostWins, (unsigned long long) group->identified,
+                    (unsigned long long) group->identifiedCorrect, group->ticks / games,
+                    (unsigned long long) group->exitFear, (unsigned long long) group->exitBored,
+                    (unsigned long long) group->exitEvidence);
+        } else {
+            fprintf(out, "%-24s %12llu %8.2f%% %8.2f%% %8.2f%% %9.1f %7.2f %7.2f %8.2f\n", label,
+                    (unsigned long long) group->games, 100.0 * group->ghostWins / games, 100.0 * group->identified / games,
+                    group->identified > 0 ? 100.0 * group->identifiedCorrect / group->identified : 0.0,
+                    group->ticks / games / 1000.0, group->exitFear / games, group->exitBored / games,
+                    group->exitEvidence / games);
+        }
+    }
+}
+
+/*
+    Prints the first count games that meet every condition, in the order they are stored.
+*/
+static void listGames(const Query* query, long count) {
+    const ResultsView* view = query->view;
+    static const char exitLetters[4] = { '-', 'F', 'B', 'E' };
+    printf("seed,config,ghost,identified,ticks,exit_fear,exit_bored,exit_evidence,evidence,exits\n");
+    for (uint64_t b = 0; b < view->header->numBlocks && count > 0; b++) {
+        const ResultsBlockHeader* block = resultsBlock(view, b);
+        if (block == NULL) continue;
+        for (uint32_t r = 0; r < block->rows && count > 0; r++) {
+            uint64_t values[RES_COLUMN_COUNT];
+            int match = C_TRUE;
+            for (int c = 0; c < RES_COLUMN_COUNT; c++) {
+                const unsigned char* column = resultsColumn(block, c);
+                switch (resultsColumnWidth(c)) {
+                    case 8:  values[c] = ((const uint64_t*) column)[r]; break;
+                    case 4:  values[c] = ((const uint32_t*) column)[r]; break;
+                    case 2:  values[c] = ((const uint16_t*) column)[r]; break;
+                    default: values[c] = column[r]; break;
+                }
+            }
+            for (int f = 0; f < query->numFilters; f++) {
+                const Filter* filter = &query->filters[f];
+                if (values[filter->column] < filter->low || values[filter->column] > filter->high) match = C_FALSE;
+            }
+            if (!match) continue;
+
+            char evidence[MAX_STR], exits[RESULTS_EXIT_HUNTERS + 1];
+            groupLabel(GROUP_EVIDENCE, values[RES_EVIDENCE], evidence, sizeof(evidence));
+            int hunters = (int) (values[RES_EXIT_FEAR] + values[RES_EXIT_BORED] + values[RES_EXIT_EVIDENCE]);
+            if (hunters > RESULTS_EXIT_HUNTERS) hunters = RESULTS_EXIT_HUNTERS;
+            for (int h = 0; h < hunters; h++) exits[h] = exitLetters[(values[RES_EXITS] >> (2 * h)) & 3];
+            exits[hunters] = '\0';
+            printf("0x%016llx,%llu,%s,%s,%llu,%llu,%llu,%llu,%s,%s\n", (unsigned long long) values[RES_SEED],
+                   (unsigned long long) values[RES_CONFIG], ghostName((enum GhostClass) values[RES_GHOST]),
+                   ghostName((enum GhostClass) values[RES_IDENTIFIED]), (unsigned long long) values[RES_TICKS],
+                   (unsigned long long) values[RES_EXIT_FEAR], (unsigned long long) values[RES_EXIT_BORED],
+                   (unsigned long long) values[RES_EXIT_EVIDENCE], evidence, exits);
+            count--;
+        }
+    }
+}
+
+static double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = NULL;
+    Query query;
+    memset(&query, 0, sizeof(query));
+    query.groupBy = GROUP_NONE;
+    enum QueryFormat format = QUERY_TABLE;
+    long list = 0;
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        int ok = C_TRUE;
+        if (strcmp(argv[i], "--group-by") == 0 && i + 1 < argc) {
+            i++;
+            ok = C_FALSE;
+            for (int g = GROUP_NONE; g <= GROUP_EVIDENCE; g++) {
+                if (strcmp(argv[i], groupNames[g]) == 0) {
+                    query.groupBy = g;
+                    ok = C_TRUE;
+                }
+            }
+        } else if (strcmp(argv[i], "--where") == 0 && i + 1 < argc) {
+            ok = query.numFilters < QUERY_MAX_FILTERS && parseFilter(&query.filters[query.numFilters++], argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "table") == 0) {
+                format = QUERY_TABLE;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                format = QUERY_CSV;
+            } else {
+                ok = C_FALSE;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+            list = atol(argv[++i]);
+            ok = list > 0;
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            ok = C_FALSE;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path == NULL || jobs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ResultsView view;
+    if (!mapResults(&view, path)) return 1;
+    query.view = &view;
+    if (list > 0) {
+        listGames(&query, list);
+        unmapResults(&view);
+        return 0;
+    }
+
+    double started = nowSeconds();
+    query.numGroups = countGroups(&view, query.groupBy);
+    if (query.numGroups > QUERY_MAX_GROUPS) {
+        fprintf(stderr, "%s: too many values of %s to group by\n", path, groupNames[query.groupBy]);
+        unmapResults(&view);
+        return 1;
+    }
+    atomic_init(&query.nextBlock, 0);
+    if ((uint64_t) jobs > view.header->numBlocks) jobs = view.header->numBlocks > 0 ? (int) view.header->numBlocks : 1;
+
+    QueryWorker* workers = calloc(jobs, sizeof(QueryWorker));
+    Aggregate* groups = calloc((size_t) jobs * query.numGroups, sizeof(Aggregate));
+    if (workers == NULL || groups == NULL) {
+        perror("Error starting query");
+        return 1;
+    }
+    for (int i = 0; i < jobs; i++) {
+        workers[i].query = &query;
+        workers[i].groups = groups + (size_t) i * query.numGroups;
+        pthread_create(&workers[i].thread, NULL, queryThread, &workers[i]);
+    }
+
+    // Every worker's totals go into the first worker's
+    uint64_t blocks = 0, skipped = 0, damaged = 0, damagedRows = 0, bytes = 0;
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(workers[i].thread, NULL);
+        blocks += workers[i].blocks;
+        skipped += workers[i].skipped;
+        damaged += workers[i].damaged;
+        damagedRows += workers[i].damagedRows;
+        bytes += workers[i].bytes;
+        if (i == 0) continue;
+        for (uint64_t key = 0; key < query.numGroups; key++) {
+            Aggregate* total = &groups[key];
+            const Aggregate* part = &workers[i].groups[key];
+            total->games += part->games;
+            total->ghostWins += part->ghostWins;
+            total->identified += part->identified;
+            total->identifiedCorrect += part->identifiedCorrect;
+            total->ticks += part->ticks;
+            total->exitFear += part->exitFear;
+            total->exitBored += part->exitBored;
+            total->exitEvidence += part->exitEvidence;
+        }
+    }
+    double seconds = nowSeconds() - started;
+
+    uint64_t matched = 0;
+    for (uint64_t key = 0; key < query.numGroups; key++) matched += groups[key].games;
+    writeTotals(stdout, &query, groups, format);
+    fprintf(stderr, "%llu of %llu games matched; %llu blocks, %llu skipped by their bounds; %.1f MB of columns in %.3f s (%.0f MB/s)\n",
+            (unsigned long long) matched, (unsigned long long) view.header->numGames, (unsigned long long) blocks,
+            (unsigned long long) skipped, bytes / 1e6, seconds, seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+    if (damaged > 0) fprintf(stderr, "%s: %llu damaged blocks were left out\n", path, (unsigned long long) damaged);
+    if (damagedRows > 0) {
+        fprintf(stderr, "%s: %llu rows outside their block's bounds were left out\n", path, (unsigned long long) damagedRows);
+    }
+
+    free(groups);
+    free(workers);
+    unmapResults(&view);
+    return damaged > 0 || damagedRows > 0 ? 1 : 0;
+}
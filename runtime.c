@@ -0,0 +1,147 @@
+// runtime.c
+#include "defs.h"
+
+// Shared state of one game on the task runtime
+typedef struct TaskRuntime {
+    HouseType* house;
+    Ghost* ghost;
+    Scheduler queue;            // each pending entity turn, timed in milliseconds since started
+    pthread_mutex_t lock;       // guards queue and active
+    pthread_cond_t wake;        // signalled when a turn is queued or the last entity leaves
+    int active;                 // entities still in the house
+    struct timespec started;
+} TaskRuntime;
+
+/*
+  Returns the milliseconds elapsed since the runtime started.
+*/
+static long runtimeNow(const TaskRuntime* rt) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - rt->started.tv_sec) * 1000 + (now.tv_nsec - rt->started.tv_nsec) / 1000000;
+}
+
+/*
+  Function: taskWorker(void* arg)
+  Purpose: One worker thread of the task runtime.
+
+  Parameters:
+    in/out arg: the TaskRuntime the worker serves.
+
+  Description:
+    Repeatedly takes the earliest turn off the queue, waits until it is due, and runs one hunterStep or ghostStep for that entity outside the lock. An entity that is still in the house is queued again the hunter or ghost wait of the house's rules later. Every entity has at most one queued turn, so no entity ever runs on two workers at once. The worker returns once every entity has left.
+
+  return
+    NULL
+*/
+static void* taskWorker(void* arg) {
+    TaskRuntime* rt = (TaskRuntime*) arg;
+    Event event;
+
+    pthread_mutex_lock(&rt->lock);
+    while (rt->active > 0) {
+        if (rt->queue.size == 0) {
+            // Every remaining entity is running on another worker
+            pthread_cond_wait(&rt->wake, &rt->lock);
+            continue;
+        }
+
+        long due = rt->queue.heap[0].time;
+        long now = runtimeNow(rt);
+        if (due > now) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += (due - now) / 1000;
+            until.tv_nsec += ((due - now) % 1000) * 1000000;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&rt->wake, &rt->lock, &until);
+            continue;
+        }
+
+        nextEvent(&rt->queue, &event);
+        pthread_mutex_unlock(&rt->lock);
+        INST_LATE(&rt->started, event.time);
+
+        int stillActive;
+        long wait;
+        if (event.kind == EVENT_GHOST) {
+            stillActive = ghostStep(rt->ghost);
+            wait = rt->house->rules.ghostWait;
+        } else {
+            stillActive = hunterStep(&rt->house->hunters[event.entity]);
+            wait = rt->house->rules.hunterWait;
+        }
+
+        pthread_mutex_lock(&rt->lock);
+        if (stillActive) {
+            scheduleEvent(&rt->queue, runtimeNow(rt) + wait, event.kind, event.entity);
+            pthread_cond_signal(&rt->wake);
+        } else if (--rt->active == 0) {
+            pthread_cond_broadcast(&rt->wake);
+        }
+    }
+    pthread_mutex_unlock(&rt->lock);
+    return NULL;
+}
+
+/*
+  Function: runTaskGame(SimContext* sim, int workers)
+  Purpose: Plays a game in real time with every entity as a lightweight task on a small pool of threads.
+
+  Parameters:
+    in/out sim: a game from simCreate that has not been started.
+    in workers: number of worker threads, normally the number of cores.
+
+  Description:
+    The same hunterStep and ghostStep as hunterThread and ghostThread, at the same pace, but instead of sleeping in its own thread each entity is a queued turn, so an entity costs its Hunter or Ghost struct plus one queue slot rather than a thread stack, and thousands of hunters share a handful of threads.
+
+  return
+    none
+*/
+void runTaskGame(SimContext* sim, int workers) {
+    HouseType* house = &sim->house;
+    Ghost* ghost = &sim->ghost;
+    TaskRuntime rt;
+
+    if (workers < 1) workers = 1;
+    makeHouseThreaded(house);
+    rt.house = house;
+    rt.ghost = ghost;
+    rt.active = house->numHunters + 1;
+    initScheduler(&rt.queue, house->numHunters + 1);
+    pthread_mutex_init(&rt.lock, NULL);
+    pthread_cond_init(&rt.wake, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &rt.started);
+
+    traceGameStart(house, ghost);
+    l_ghostInit(&house->log, ghost->type, roomName(house->layout, ghost->currentRoom));
+    traceEvent(house, TRACE_GHOST_INIT, TRACE_GHOST, ghost->currentRoom, ghost->type);
+    scheduleEvent(&rt.queue, 0, EVENT_GHOST, 0);
+    for (int i = 0; i < house->numHunters; i++) {
+        Hunter* hunter = &house->hunters[i];
+        l_hunterInit(&house->log, hunter->name, hunter->equipment);
+        traceEvent(house, TRACE_HUNTER_INIT, hunter->id, hunter->currentRoom, hunter->equipment);
+        scheduleEvent(&rt.queue, 0, EVENT_HUNTER, i);
+    }
+
+    pthread_t* threads = malloc(workers * sizeof(pthread_t));
+    if (threads == NULL) {
+        perror("Error creating task runtime");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_create(&threads[i], NULL, taskWorker, &rt);
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    traceGameEnd(house);
+    pthread_cond_destroy(&rt.wake);
+    pthread_mutex_destroy(&rt.lock);
+    cleanupScheduler(&rt.queue);
+}
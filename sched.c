@@ -0,0 +1,137 @@
+// sched.c
+#include "defs.h"
+
+/*
+  Function: initScheduler(Scheduler* sched, int capacity)
+  Purpose: Initializes an empty event queue starting at simulated time 0.
+
+  Parameters:
+    out sched: the scheduler to initialize.
+    in capacity: initial number of pending events; the queue grows if needed.
+
+  return
+    none
+*/
+void initScheduler(Scheduler* sched, int capacity) {
+    if (capacity < 1) capacity = 1;
+    sched->heap = malloc(capacity * sizeof(Event));
+    if (sched->heap == NULL) {
+        perror("Error creating scheduler");
+        exit(EXIT_FAILURE);
+    }
+    sched->size = 0;
+    sched->capacity = capacity;
+    sched->owned = C_TRUE;
+    sched->now = 0;
+    sched->seq = 0;
+}
+
+/*
+  Function: initSchedulerIn(Scheduler* sched, Event* heap, int capacity)
+  Purpose: Initializes an empty event queue in storage owned by the caller, e.g. an arena.
+    If the queue ever outgrows it, the queue moves to memory of its own.
+*/
+void initSchedulerIn(Scheduler* sched, Event* heap, int capacity) {
+    sched->heap = heap;
+    sched->size = 0;
+    sched->capacity = capacity;
+    sched->owned = C_FALSE;
+    sched->now = 0;
+    sched->seq = 0;
+}
+
+/*
+  Function: cleanupScheduler(Scheduler* sched)
+  Purpose: Frees the event queue if it owns its storage.
+*/
+void cleanupScheduler(Scheduler* sched) {
+    if (sched->owned) free(sched->heap);
+    sched->heap = NULL;
+    sched->size = sched->capacity = 0;
+}
+
+/*
+  Returns non-zero if event a has to fire before event b.
+*/
+static int eventBefore(const Event* a, const Event* b) {
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+/*
+  Function: scheduleEvent(Scheduler* sched, long time, EventKind kind, int entity)
+  Purpose: Queues an entity's turn at the given simulated time.
+
+  Parameters:
+    in/out sched: the scheduler.
+    in time: simulated milliseconds at which the event fires.
+    in kind: which kind of entity takes the turn.
+    in entity: index of the entity, e.g. the hunter's id.
+
+  return
+    none
+*/
+void scheduleEvent(Scheduler* sched, long time, EventKind kind, int entity) {
+    if (sched->size == sched->capacity) {
+        Event* grown = sched->owned ? realloc(sched->heap, 2 * sched->capacity * sizeof(Event))
+                                    : malloc(2 * sched->capacity * sizeof(Event));
+        if (grown == NULL) {
+            perror("Error growing scheduler");
+            exit(EXIT_FAILURE);
+        }
+        if (!sched->owned) memcpy(grown, sched->heap, sched->size * sizeof(Event));
+        sched->heap = grown;
+        sched->capacity *= 2;
+        sched->owned = C_TRUE;
+    }
+
+    Event event = { time, sched->seq++, kind, entity };
+    int i = sched->size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!eventBefore(&event, &sched->heap[parent])) break;
+        sched->heap[i] = sched->heap[parent];
+        i = parent;
+    }
+    sched->heap[i] = event;
+}
+
+/*
+  Function: nextEvent(Scheduler* sched, Event* event)
+  Purpose: Removes the earliest pending event and advances the simulated clock to it.
+
+  Parameters:
+    in/out sched: the scheduler.
+    out event: the event that fires next.
+
+  return
+    C_TRUE if an event was returned, C_FALSE if the queue is empty
+*/
+int nextEvent(Scheduler* sched, Event* event) {
+    if (sched->size == 0) return C_FALSE;
+
+    *event = sched->heap[0];
+    sched->now = event->time;
+
+    Event last = sched->heap[--sched->size];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= sched->size) break;
+        if (child + 1 < sched->size && eventBefore(&sched->heap[child + 1], &sched->heap[child])) child++;
+        if (!eventBefore(&sched->heap[child], &last)) break;
+        sched->heap[i] = sched->heap[child];
+        i = child;
+    }
+    sched->heap[i] = last;
+    return C_TRUE;
+}
+
+/*
+  Function: resetScheduler(Scheduler* sched)
+  Purpose: Empties the event queue and rewinds it to simulated time 0, keeping its storage.
+*/
+void resetScheduler(Scheduler* sched) {
+    sched->size = 0;
+    sched->now = 0;
+    sched->seq = 0;
+}
@@ -0,0 +1,229 @@
+// sim.c
+#include "defs.h"
+
+/*
+  Function: startGame(SimContext* sim, uint64_t seed)
+  Purpose: Lays out a fresh game in a context by copying the template over the dynamic state.
+
+  Parameters:
+    in/out sim: the context.
+    in seed: the game's stream key.
+
+  Description:
+    The rooms and hunters are copied back from the snapshot taken by simCreate, so no memory is allocated and nothing is rebuilt. Only what depends on the seed is redone: the random streams and where the ghost starts.
+
+  return
+    none
+*/
+static void startGame(SimContext* sim, uint64_t seed) {
+    HouseType* house = &sim->house;
+
+    memcpy(house->rooms, sim->templateRooms, house->numRooms * sizeof(Room));
+    memcpy(sim->hunters, sim->templateHunters, house->numHunters * sizeof(Hunter));
+    clearEvidenceIndex(house);
+    house->evidenceSlots = house->layout->evidenceSlots;
+    house->rules = sim->rules;
+    initEvidenceBoard(&house->evidence);
+    house->now = 0;
+    house->seed = seed;
+    rngSeed(&house->rng, seed);
+    for (int i = 0; i < house->numHunters; i++) {
+        rngSeed(&sim->hunters[i].rng, rngDerive(seed, i));
+    }
+    initGhost(&sim->ghost, house);
+
+    resetScheduler(&sim->sched);
+    sim->started = C_FALSE;
+}
+
+/*
+  Function: simCreate(const SimConfig* config)
+  Purpose: Creates a self-contained game: house state, hunters in the Van, the ghost, and its own event queue.
+
+  Parameters:
+    in config: the layout, seed, hunters, log sink, trace buffer and rules of the game.
+
+  Description:
+    Nothing in the context is shared with other contexts except the read-only layout, so games can be created and played concurrently on different threads. The context, its rooms, hunters and event queue, and a snapshot of the rooms and hunters before the game starts all come from one arena sized up front. Play it with simStep or simRun, or hand its house and entities to one of the real-time engines.
+
+  return
+    the new context; free it with simDestroy
+*/
+SimContext* simCreate(const SimConfig* config) {
+    int numHunters = config->numHunters > 0 ? config->numHunters : 1;
+    size_t roomsSize = config->layout->numRooms * sizeof(Room);
+    size_t huntersSize = numHunters * sizeof(Hunter);
+    size_t queueSize = (numHunters + 1) * sizeof(Event);
+    size_t indexSize = EV_COUNT * EVIDENCE_INDEX_WORDS(config->layout->numRooms) * sizeof(atomic_ullong);
+    Arena* arena = arenaCreate(sizeof(SimContext) + 2 * (roomsSize + huntersSize) + queueSize + indexSize + 7 * 16);
+
+    SimContext* sim = arenaAlloc(arena, sizeof(SimContext));
+    sim->arena = arena;
+    sim->hunters = arenaAlloc(arena, huntersSize);
+    sim->templateRooms = arenaAlloc(arena, roomsSize);
+    sim->templateHunters = arenaAlloc(arena, huntersSize);
+    initSchedulerIn(&sim->sched, arenaAlloc(arena, queueSize), numHunters + 1);
+    sim->resets = 0;
+    sim->layoutHash = 0;
+    sim->rules = config->rules != NULL ? *config->rules : defaultRules;
+
+    HouseType* house = &sim->house;
+    initHouse(house, config->layout, config->seed, arena);
+    house->log = config->log;
+    house->trace = config->trace;
+    house->hunters = sim->hunters;
+    house->numHunters = numHunters;
+    for (int i = 0; i < numHunters; i++) {
+        char name[MAX_STR];
+        if (config->names != NULL) {
+            strncpy(name, config->names[i], MAX_STR - 1);
+            name[MAX_STR - 1] = '\0';
+        } else {
+            snprintf(name, MAX_STR, "Hunter %d", i + 1);
+        }
+        initHunter(&sim->hunters[i], house, name, (enum EvidenceType) (i % EV_COUNT), i);
+    }
+    memcpy(sim->templateRooms, house->rooms, roomsSize);
+    memcpy(sim->templateHunters, sim->hunters, huntersSize);
+
+    startGame(sim, config->seed);
+    return sim;
+}
+
+/*
+  Function: simReset(SimContext* sim, uint64_t seed)
+  Purpose: Starts a new game in an existing context, keeping its layout, hunters' names, log sink, trace buffer and storage.
+
+  Parameters:
+    in/out sim: a context from simCreate; any threads playing it must have finished.
+    in seed: the new game's stream key.
+
+  return
+    none
+*/
+void simReset(SimContext* sim, uint64_t seed) {
+    sim->resets++;
+    startGame(sim, seed);
+}
+
+/*
+  Function: simStep(SimContext* sim)
+  Purpose: Takes the next turn of the game in simulated time.
+
+  Parameters:
+    in/out sim: the context.
+
+  Description:
+    The first call logs the entities' arrival and queues everyone's first turn at time 0. Each call then runs the earliest pending hunterStep or ghostStep, the same steps hunterThread and ghostThread take, and queues that entity's next turn the hunter or ghost wait of the game's rules (HUNTER_WAIT or GHOST_WAIT by default) later in simulated time unless it left the house. No sleeping and no locking takes place.
+
+  return
+    C_TRUE if a turn was taken, C_FALSE once every entity has left the house
+*/
+int simStep(SimContext* sim) {
+    HouseType* house = &sim->house;
+    Ghost* ghost = &sim->ghost;
+    Event event;
+
+    if (!sim->started) {
+        sim->started = C_TRUE;
+        house->threaded = C_FALSE;
+        house->now = 0;
+        traceGameStart(house, ghost);
+        l_ghostInit(&house->log, ghost->type, roomName(house->layout, ghost->currentRoom));
+        traceEvent(house, TRACE_GHOST_INIT, TRACE_GHOST, ghost->currentRoom, ghost->type);
+        scheduleEvent(&sim->sched, 0, EVENT_GHOST, 0);
+        for (int i = 0; i < house->numHunters; i++) {
+            Hunter* hunter = &house->hunters[i];
+            l_hunterInit(&house->log, hunter->name, hunter->equipment);
+            traceEvent(house, TRACE_HUNTER_INIT, hunter->id, hunter->currentRoom, hunter->equipment);
+            scheduleEvent(&sim->sched, 0, EVENT_HUNTER, i);
+        }
+    }
+
+    if (!nextEvent(&sim->sched, &event)) return C_FALSE;
+
+    house->now = event.time;
+    if (event.kind == EVENT_GHOST) {
+        if (ghostStep(ghost)) {
+            scheduleEvent(&sim->sched, event.time + house->rules.ghostWait, EVENT_GHOST, 0);
+        }
+    } else {
+        if (hunterStep(&house->hunters[event.entity])) {
+            scheduleEvent(&sim->sched, event.time + house->rules.hunterWait, EVENT_HUNTER, event.entity);
+        }
+    }
+    if (sim->sched.size == 0) traceGameEnd(house);
+    return C_TRUE;
+}
+
+/*
+  Function: simRun(SimContext* sim)
+  Purpose: Plays the rest of the game in simulated time, see simStep.
+
+  return
+    the simulated time, in milliseconds, of the last turn taken
+*/
+long simRun(SimContext* sim) {
+    while (simStep(sim)) { }
+    return sim->sched.now;
+}
+
+/*
+  Function: simRunUntil(SimContext* sim, long time)
+  Purpose: Plays the game in simulated time up to and including the turns due at the given time.
+
+  return
+    C_TRUE if the game is still going, C_FALSE once every entity has left the house
+*/
+int simRunUntil(SimContext* sim, long time) {
+    for (;;) {
+        if (sim->started && (sim->sched.size == 0 || sim->sched.heap[0].time > time)) {
+            return sim->sched.size > 0;
+        }
+        if (!simStep(sim)) return C_FALSE;
+    }
+}
+
+/*
+  Function: simResult(const SimContext* sim, GameResult* result)
+  Purpose: Summarizes a finished game.
+
+  Parameters:
+    in sim: a context whose entities have all left the house.
+    out result: the outcome of the game.
+
+  return
+    none
+*/
+void simResult(const SimContext* sim, GameResult* result) {
+    const HouseType* house = &sim->house;
+
+    result->ghostType = sim->ghost.type;
+    result->exitFear = result->exitBored = result->exitEvidence = 0;
+    for (int i = 0; i < house->numHunters; i++) {
+        switch (house->hunters[i].exitReason) {
+            case LOG_FEAR:     result->exitFear++;     break;
+            case LOG_BORED:    result->exitBored++;    break;
+            case LOG_EVIDENCE: result->exitEvidence++; break;
+            default: break;
+        }
+    }
+    result->ghostWon = (result->exitEvidence == 0);
+    result->identifiedType = GH_UNKNOWN;
+    unsigned collected = atomic_load(&((HouseType*) house)->evidence.collected);
+    if (__builtin_popcount(collected) >= MAX_COLLECTED_EVIDENCE) {
+        result->identifiedType = identifyGhostMask(collected);
+    }
+    result->ticks = sim->sched.now;
+}
+
+/*
+  Function: simDestroy(SimContext* sim)
+  Purpose: Frees a context and everything it owns with its arena. The layout and trace buffer belong to the caller.
+*/
+void simDestroy(SimContext* sim) {
+    if (sim == NULL) return;
+    cleanupHouse(&sim->house);
+    cleanupScheduler(&sim->sched);
+    arenaDestroy(sim->arena);
+}
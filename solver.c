@@ -0,0 +1,795 @@
+// solver.c
+#include "defs.h"
+
+/*
+    The exact solver works out what a batch of games would converge to, without sampling.
+
+    A game is a Markov chain. Between two turns, its whole future depends only on which turn
+    comes next, which ghost it is, where every entity is, their fear and boredom, the evidence
+    left in every room and the evidence board; every draw is uniform, so a turn leads to a
+    handful of next states with known probabilities. The solver finds every state reachable from
+    the start of a game, with each state packed into a few words and kept once in a hash table,
+    and then the probability of every outcome and the expected value of every count from each of
+    them.
+
+    No state can be reached twice on the way through a game: the turns come round in the same
+    order every period, every hunter still in the house takes a turn each period and each of its
+    turns raises its fear or its boredom, and once the hunters have all gone each of the ghost's
+    turns raises its boredom. So the states form a DAG and the absorbing chain's linear system is
+    triangular. Instead of iterating towards its solution the solver substitutes back exactly:
+    it numbers each state by the longest path from it to the end of a game, and solves one
+    level at a time from the end, with the states of a level shared among worker threads.
+
+    The number of states grows with every hunter, room and counter, so this is for small houses
+    with few hunters; a run stops with a message once it finds more than its state limit.
+*/
+
+#define SOLVE_KEY_WORDS     4                   // 256 bits per packed state
+#define SOLVE_MAX_HUNTERS   8
+#define SOLVE_MAX_ROOMS     64
+
+#define HEIGHT_NEW          UINT32_MAX          // found but not explored yet
+#define HEIGHT_OPEN         (UINT32_MAX - 1)    // on the exploration stack
+
+// Values solved for every state, each the expected value from that state to the end of the game
+enum SolveValue { VALUE_GHOST_WIN, VALUE_IDENTIFIED, VALUE_CORRECT, VALUE_FEAR, VALUE_BORED, VALUE_EVIDENCE, VALUE_TICKS, VALUE_COUNT };
+
+// A state unpacked; entity numHunters is the ghost, and an entity that has left has room, fear and boredom 0
+typedef struct SolveState {
+    int slot;                                   // the turn that comes next, see Solver.slotEntity
+    int ghostType;
+    int evidenceExit;                           // C_TRUE once a hunter has left with enough evidence
+    unsigned collected;                         // the evidence board
+    int present[SOLVE_MAX_HUNTERS + 1];
+    int room[SOLVE_MAX_HUNTERS + 1];
+    int boredom[SOLVE_MAX_HUNTERS + 1];
+    int fear[SOLVE_MAX_HUNTERS + 1];            // 0 for the ghost
+    unsigned char evidence[SOLVE_MAX_ROOMS];    // EV_UNKNOWN when the room is empty
+} SolveState;
+
+// One way a turn can go
+typedef struct Outcome {
+    uint64_t key[SOLVE_KEY_WORDS];              // the next state, unless the game ended
+    double p;
+    long dt;                                    // simulated ms to the next turn
+    int reason;                                 // why an entity left on this turn, LOG_UNKNOWN if none did
+    int end;                                    // the last entity left
+    double final[3];                            // if so: ghost won, identified, identified correctly
+} Outcome;
+
+typedef struct Solver {
+    const HouseLayout* layout;
+    int numHunters;
+    int roomBits;
+    int words;                                  // of SOLVE_KEY_WORDS a packed state uses
+    int maxOutcomes;
+
+    // The turns in order: those at time 0 once, then those of (0, period] over and over
+    int numSlots;
+    int firstCyclic;
+    int* slotEntity;
+    long* slotTime;
+    long period;
+
+    // The states found, in the order they were found
+    uint64_t* keys;
+    uint32_t* height;
+    long numStates;
+    long maxStates;
+    long capacity;
+
+    uint32_t* table;                            // open addressing, state id + 1, 0 when empty
+    uint64_t tableMask;
+
+    double* values;                             // VALUE_COUNT per state
+
+    // Levels for the solving pass
+    uint32_t* order;                            // state ids by height
+    long* levelStart;                           // levels + 1 entries
+    long numLevels;
+    int jobs;
+    pthread_barrier_t barrier;
+} Solver;
+
+/*
+    Writes a field of the given width at bit position *at and moves past it; fields may straddle
+    two words.
+*/
+static void putBits(uint64_t* key, int* at, int bits, uint64_t value) {
+    int word = *at / 64, shift = *at % 64;
+    key[word] |= value << shift;
+    if (shift + bits > 64) key[word + 1] |= value >> (64 - shift);
+    *at += bits;
+}
+
+static int getBits(const uint64_t* key, int* at, int bits) {
+    int word = *at / 64, shift = *at % 64;
+    uint64_t value = key[word] >> shift;
+    if (shift + bits > 64) value |= key[word + 1] << (64 - shift);
+    *at += bits;
+    return (int) (value & ((1ull << bits) - 1));
+}
+
+static int bitsFor(long count) {
+    int bits = 0;
+    while ((1l << bits) < count) bits++;
+    return bits;
+}
+
+/*
+    Packs a state into a key; an empty room's evidence is stored as 0, evidence e as e + 1.
+*/
+static void encodeState(const Solver* solver, const SolveState* state, uint64_t* key) {
+    int at = 0;
+    memset(key, 0, SOLVE_KEY_WORDS * sizeof(uint64_t));
+    putBits(key, &at, bitsFor(solver->numSlots), state->slot);
+    putBits(key, &at, bitsFor(GHOST_COUNT), state->ghostType);
+    putBits(key, &at, 1, state->evidenceExit);
+    putBits(key, &at, EV_COUNT, state->collected);
+    for (int e = 0; e <= solver->numHunters; e++) {
+        putBits(key, &at, 1, state->present[e]);
+        putBits(key, &at, solver->roomBits, state->room[e]);
+        putBits(key, &at, bitsFor(BOREDOM_MAX), state->boredom[e]);
+        if (e < solver->numHunters) putBits(key, &at, bitsFor(FEAR_MAX), state->fear[e]);
+    }
+    for (uint32_t r = 0; r < solver->layout->numRooms; r++) {
+        putBits(key, &at, bitsFor(EV_COUNT + 1), state->evidence[r] == EV_UNKNOWN ? 0 : state->evidence[r] + 1);
+    }
+}
+
+static void decodeState(const Solver* solver, const uint64_t* key, SolveState* state) {
+    int at = 0;
+    state->slot = getBits(key, &at, bitsFor(solver->numSlots));
+    state->ghostType = getBits(key, &at, bitsFor(GHOST_COUNT));
+    state->evidenceExit = getBits(key, &at, 1);
+    state->collected = (unsigned) getBits(key, &at, EV_COUNT);
+    for (int e = 0; e <= solver->numHunters; e++) {
+        state->present[e] = getBits(key, &at, 1);
+        state->room[e] = getBits(key, &at, solver->roomBits);
+        state->boredom[e] = getBits(key, &at, bitsFor(BOREDOM_MAX));
+        if (e < solver->numHunters) state->fear[e] = getBits(key, &at, bitsFor(FEAR_MAX));
+    }
+    for (uint32_t r = 0; r < solver->layout->numRooms; r++) {
+        int value = getBits(key, &at, bitsFor(EV_COUNT + 1));
+        state->evidence[r] = value == 0 ? EV_UNKNOWN : value - 1;
+    }
+}
+
+static uint64_t hashKey(const Solver* solver, const uint64_t* key) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (int w = 0; w < solver->words; w++) {
+        hash = (hash ^ key[w]) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+/*
+    Returns the id of the state with this key, or -1 if it has not been found.
+*/
+static long findState(const Solver* solver, const uint64_t* key) {
+    for (uint64_t i = hashKey(solver, key) & solver->tableMask;; i = (i + 1) & solver->tableMask) {
+        uint32_t entry = solver->table[i];
+        if (entry == 0) return -1;
+        if (memcmp(solver->keys + (size_t) (entry - 1) * solver->words, key, solver->words * sizeof(uint64_t)) == 0) {
+            return entry - 1;
+        }
+    }
+}
+
+/*
+    Returns the id of the state with this key, adding it if it is new, or -1 if that would
+    take more than maxStates states.
+*/
+static long addState(Solver* solver, const uint64_t* key) {
+    uint64_t i = hashKey(solver, key) & solver->tableMask;
+    for (;; i = (i + 1) & solver->tableMask) {
+        uint32_t entry = solver->table[i];
+        if (entry == 0) break;
+        if (memcmp(solver->keys + (size_t) (entry - 1) * solver->words, key, solver->words * sizeof(uint64_t)) == 0) {
+            return entry - 1;
+        }
+    }
+    if (solver->numStates == solver->maxStates) return -1;
+    if (solver->numStates == solver->capacity) {
+        solver->capacity *= 2;
+        uint64_t* keys = realloc(solver->keys, (size_t) solver->capacity * solver->words * sizeof(uint64_t));
+        uint32_t* height = realloc(solver->height, (size_t) solver->capacity * sizeof(uint32_t));
+        if (keys == NULL || height == NULL) {
+            perror("Error growing the solver's states");
+            exit(EXIT_FAILURE);
+        }
+        solver->keys = keys;
+        solver->height = height;
+    }
+    long id = solver->numStates++;
+    memcpy(solver->keys + (size_t) id * solver->words, key, solver->words * sizeof(uint64_t));
+    solver->height[id] = HEIGHT_NEW;
+    solver->table[i] = (uint32_t) id + 1;
+    return id;
+}
+
+/*
+    Forgets what cannot change the rest of the game, so that states that only differ in it are
+    kept once: evidence no hunter left in the house can pick up only keeps its room from taking
+    more, so any such kind is stored as the first of them, and once the hunters have all gone the
+    evidence in the rooms no longer matters at all.
+*/
+static void canonicalState(const Solver* solver, SolveState* state) {
+    unsigned readable = 0;
+    for (int h = 0; h < solver->numHunters; h++) {
+        if (state->present[h]) readable |= 1u << (h % EV_COUNT);
+    }
+    if (readable == 0) {
+        memset(state->evidence, EV_UNKNOWN, solver->layout->numRooms);
+        return;
+    }
+    int unreadable = __builtin_ctz(~readable);
+    for (uint32_t r = 0; r < solver->layout->numRooms; r++) {
+        if (state->evidence[r] != EV_UNKNOWN && !(readable >> state->evidence[r] & 1)) state->evidence[r] = unreadable;
+    }
+}
+
+/*
+    Finishes an outcome from the state after the turn: finds the next turn of an entity still in
+    the house and packs the state, or records how the game ended if none is left.
+*/
+static void finishOutcome(const Solver* solver, SolveState* next, double p, int reason, Outcome* out) {
+    int slot = next->slot;
+    out->p = p;
+    out->reason = reason;
+    out->end = C_TRUE;
+    out->dt = 0;
+    for (int e = 0; e <= solver->numHunters; e++) {
+        out->end &= !next->present[e];
+    }
+    if (out->end) {
+        int identified = __builtin_popcount(next->collected) >= MAX_COLLECTED_EVIDENCE;
+        out->final[0] = !next->evidenceExit;
+        out->final[1] = identified;
+        out->final[2] = identified && identifyGhostMask(next->collected) == (GhostClass) next->ghostType;
+        return;
+    }
+
+    long wrapped = 0;
+    do {
+        next->slot++;
+        if (next->slot == solver->numSlots) {
+            next->slot = solver->firstCyclic;
+            wrapped += solver->period;
+        }
+    } while (!next->present[solver->slotEntity[next->slot]]);
+    out->dt = solver->slotTime[next->slot] + wrapped - solver->slotTime[slot];
+    canonicalState(solver, next);
+    encodeState(solver, next, out->key);
+}
+
+/*
+    Takes an entity out of the house.
+*/
+static void leaveHouse(SolveState* state, int e) {
+    state->present[e] = C_FALSE;
+    state->room[e] = 0;
+    state->boredom[e] = 0;
+    state->fear[e] = 0;
+}
+
+/*
+    The end of a hunter's turn, as in hunterStep: it leaves with enough evidence after a review,
+    or when too afraid or too bored.
+*/
+static int finishHunterTurn(const Solver* solver, SolveState* next, int h, int reviewed, double p, Outcome* out) {
+    int reason = LOG_UNKNOWN;
+    if (reviewed && __builtin_popcount(next->collected) >= MAX_COLLECTED_EVIDENCE) {
+        reason = LOG_EVIDENCE;
+        next->evidenceExit = C_TRUE;
+    } else if (next->fear[h] >= FEAR_MAX) {
+        reason = LOG_FEAR;
+    } else if (next->boredom[h] >= BOREDOM_MAX) {
+        reason = LOG_BORED;
+    }
+    if (reason != LOG_UNKNOWN) leaveHouse(next, h);
+    finishOutcome(solver, next, p, reason, out);
+    return 1;
+}
+
+static int hunterTurn(const Solver* solver, const SolveState* state, int h, Outcome* out) {
+    const HouseLayout* layout = solver->layout;
+    int g = solver->numHunters;
+    int room = state->room[h];
+    enum EvidenceType equipment = (enum EvidenceType) (h % EV_COUNT);
+    SolveState base = *state;
+    int n = 0;
+
+    if (base.present[g] && base.room[g] == room) {
+        base.fear[h]++;
+        base.boredom[h] = 0;
+    } else {
+        base.boredom[h]++;
+    }
+
+    // Collect
+    SolveState next = base;
+    if (next.evidence[room] == equipment) {
+        next.evidence[room] = EV_UNKNOWN;
+        next.collected |= 1u << equipment;
+    }
+    n += finishHunterTurn(solver, &next, h, C_FALSE, 1.0 / 3, out + n);
+
+    // Move
+    uint32_t exits = layout->adjStart[room + 1] - layout->adjStart[room];
+    if (exits == 0) {
+        next = base;
+        n += finishHunterTurn(solver, &next, h, C_FALSE, 1.0 / 3, out + n);
+    }
+    for (uint32_t x = 0; x < exits; x++) {
+        next = base;
+        next.room[h] = (int) layout->adj[layout->adjStart[room] + x];
+        n += finishHunterTurn(solver, &next, h, C_FALSE, 1.0 / 3 / exits, out + n);
+    }
+
+    // Review
+    next = base;
+    n += finishHunterTurn(solver, &next, h, C_TRUE, 1.0 / 3, out + n);
+    return n;
+}
+
+/*
+    The end of the ghost's turn, as in ghostStep: it leaves when too bored.
+*/
+static int finishGhostTurn(const Solver* solver, SolveState* next, double p, Outcome* out) {
+    int g = solver->numHunters;
+    int reason = LOG_UNKNOWN;
+    if (next->boredom[g] >= BOREDOM_MAX) {
+        reason = LOG_BORED;
+        leaveHouse(next, g);
+    }
+    finishOutcome(solver, next, p, reason, out);
+    return 1;
+}
+
+static int ghostTurn(const Solver* solver, const SolveState* state, Outcome* out) {
+    const HouseLayout* layout = solver->layout;
+    int g = solver->numHunters;
+    int room = state->room[g];
+    SolveState base = *state;
+    int hunterHere = C_FALSE;
+    int n = 0;
+
+    for (int h = 0; h < solver->numHunters; h++) {
+        hunterHere |= base.present[h] && base.room[h] == room;
+    }
+    if (hunterHere) {
+        base.boredom[g] = 0;
+    } else {
+        base.boredom[g]++;
+    }
+    double action = hunterHere ? 1.0 / 2 : 1.0 / 3;
+
+    // Nothing
+    SolveState next = base;
+    n += finishGhostTurn(solver, &next, action, out + n);
+
+    // Evidence, left only in an empty room
+    for (int which = 0; which < 3; which++) {
+        next = base;
+        if (next.evidence[room] == EV_UNKNOWN) next.evidence[room] = ghostEvidenceKind(next.ghostType, which);
+        n += finishGhostTurn(solver, &next, action / 3, out + n);
+    }
+
+    // Move, when no hunter is in the room
+    if (!hunterHere) {
+        uint32_t exits = layout->adjStart[room + 1] - layout->adjStart[room];
+        if (exits == 0) {
+            next = base;
+            n += finishGhostTurn(solver, &next, action, out + n);
+        }
+        for (uint32_t x = 0; x < exits; x++) {
+            next = base;
+            next.room[g] = (int) layout->adj[layout->adjStart[room] + x];
+            n += finishGhostTurn(solver, &next, action / exits, out + n);
+        }
+    }
+    return n;
+}
+
+/*
+    Lists every way the next turn from a state can go.
+*/
+static int expandState(const Solver* solver, const SolveState* state, Outcome* out) {
+    int e = solver->slotEntity[state->slot];
+    return e == solver->numHunters ? ghostTurn(solver, state, out) : hunterTurn(solver, state, e, out);
+}
+
+/*
+    Lays out the turns in the order simStep takes them: at time 0 the ghost and then the hunters,
+    as they are queued; after that, turns due at the same time go in the order they were queued
+    again, so the hunters go first when their wait is the longer one.
+*/
+static void buildSlots(Solver* solver) {
+    long a = HUNTER_WAIT, b = GHOST_WAIT;
+    while (b != 0) {
+        long r = a % b;
+        a = b;
+        b = r;
+    }
+    solver->period = (long) HUNTER_WAIT / a * GHOST_WAIT;
+
+    int cyclic = (int) (solver->period / GHOST_WAIT + solver->period / HUNTER_WAIT * solver->numHunters);
+    solver->numSlots = solver->numHunters + 1 + cyclic;
+    solver->firstCyclic = solver->numHunters + 1;
+    solver->slotEntity = malloc(solver->numSlots * sizeof(int));
+    solver->slotTime = malloc(solver->numSlots * sizeof(long));
+    if (solver->slotEntity == NULL || solver->slotTime == NULL) {
+        perror("Error starting the solver");
+        exit(EXIT_FAILURE);
+    }
+
+    int n = 0;
+    solver->slotEntity[n] = solver->numHunters;
+    solver->slotTime[n++] = 0;
+    for (int h = 0; h < solver->numHunters; h++) {
+        solver->slotEntity[n] = h;
+        solver->slotTime[n++] = 0;
+    }
+    long hunterAt = HUNTER_WAIT, ghostAt = GHOST_WAIT;
+    while (hunterAt <= solver->period || ghostAt <= solver->period) {
+        if (hunterAt < ghostAt || (hunterAt == ghostAt && HUNTER_WAIT > GHOST_WAIT)) {
+            for (int h = 0; h < solver->numHunters; h++) {
+                solver->slotEntity[n] = h;
+                solver->slotTime[n++] = hunterAt;
+            }
+            hunterAt += HUNTER_WAIT;
+        } else {
+            solver->slotEntity[n] = solver->numHunters;
+            solver->slotTime[n++] = ghostAt;
+            ghostAt += GHOST_WAIT;
+        }
+    }
+}
+
+/*
+    Finds every state reachable from a start state, depth first, and numbers each by the longest
+    path from it to the end of the game. Returns C_FALSE if there are more than maxStates or the
+    states turn out not to form a DAG.
+*/
+typedef struct Frame {
+    long id;
+    long first;                                 // its successors in the successor stack
+    long count;
+    long next;
+} Frame;
+
+static int exploreFrom(Solver* solver, long start, Outcome* out) {
+    Frame* frames = malloc(64 * sizeof(Frame));
+    long* successors = malloc(1024 * sizeof(long));
+    if (frames == NULL || successors == NULL) {
+        perror("Error exploring states");
+        exit(EXIT_FAILURE);
+    }
+    long numFrames = 0, maxFrames = 64, numSuccessors = 0, maxSuccessors = 1024;
+    int ok = C_TRUE;
+
+    if (solver->height[start] != HEIGHT_NEW) {
+        free(frames);
+        free(successors);
+        return C_TRUE;
+    }
+    long push = start;
+    while (ok) {
+        if (push >= 0) {
+            // Enter a state: list its successors, adding the new ones
+            SolveState state;
+            decodeState(solver, solver->keys + (size_t) push * solver->words, &state);
+            int n = expandState(solver, &state, out);
+            if (numFrames == maxFrames) frames = realloc(frames, (maxFrames *= 2) * sizeof(Frame));
+            if (numSuccessors + n > maxSuccessors) successors = realloc(successors, (maxSuccessors = 2 * (maxSuccessors + n)) * sizeof(long));
+            if (frames == NULL || successors == NULL) {
+                perror("Error exploring states");
+                exit(EXIT_FAILURE);
+            }
+            Frame* frame = &frames[numFrames++];
+            frame->id = push;
+            frame->first = numSuccessors;
+            frame->count = 0;
+            frame->next = 0;
+            solver->height[push] = HEIGHT_OPEN;
+            for (int i = 0; i < n && ok; i++) {
+                if (out[i].end) continue;
+                long id = addState(solver, out[i].key);
+                if (id < 0) ok = C_FALSE;
+                successors[numSuccessors++] = id;
+                frame->count++;
+            }
+            push = -1;
+            continue;
+        }
+
+        Frame* frame = &frames[numFrames - 1];
+        while (frame->next < frame->count && solver->height[successors[frame->first + frame->next]] != HEIGHT_NEW) {
+            if (solver->height[successors[frame->first + frame->next]] == HEIGHT_OPEN) {
+                fprintf(stderr, "the game's states are not acyclic\n");
+                ok = C_FALSE;
+                break;
+            }
+            frame->next++;
+        }
+        if (!ok) break;
+        if (frame->next < frame->count) {
+            push = successors[frame->first + frame->next++];
+            continue;
+        }
+
+        // Leave a state once every successor has its height
+        uint32_t height = 0;
+        for (long i = 0; i < frame->count; i++) {
+            uint32_t below = solver->height[successors[frame->first + i]] + 1;
+            if (below > height) height = below;
+        }
+        solver->height[frame->id] = height;
+        numSuccessors = frame->first;
+        if (--numFrames == 0) break;
+    }
+    free(frames);
+    free(successors);
+    return ok;
+}
+
+/*
+    Solves one state from its successors, which are all on lower levels.
+*/
+static void solveState(Solver* solver, long id, Outcome* out) {
+    SolveState state;
+    double value[VALUE_COUNT] = { 0 };
+    decodeState(solver, solver->keys + (size_t) id * solver->words, &state);
+    int n = expandState(solver, &state, out);
+
+    for (int i = 0; i < n; i++) {
+        double p = out[i].p;
+        if (out[i].reason != LOG_UNKNOWN && solver->slotEntity[state.slot] < solver->numHunters) {
+            value[out[i].reason == LOG_FEAR ? VALUE_FEAR : out[i].reason == LOG_BORED ? VALUE_BORED : VALUE_EVIDENCE] += p;
+        }
+        value[VALUE_TICKS] += p * out[i].dt;
+        if (out[i].end) {
+            value[VALUE_GHOST_WIN] += p * out[i].final[0];
+            value[VALUE_IDENTIFIED] += p * out[i].final[1];
+            value[VALUE_CORRECT] += p * out[i].final[2];
+        } else {
+            const double* after = solver->values + (size_t) findState(solver, out[i].key) * VALUE_COUNT;
+            for (int v = 0; v < VALUE_COUNT; v++) {
+                value[v] += p * after[v];
+            }
+        }
+    }
+    memcpy(solver->values + (size_t) id * VALUE_COUNT, value, sizeof(value));
+}
+
+typedef struct SolveWorker {
+    Solver* solver;
+    int index;
+} SolveWorker;
+
+static void* solveThread(void* arg) {
+    SolveWorker* worker = arg;
+    Solver* solver = worker->solver;
+    Outcome* out = malloc(solver->maxOutcomes * sizeof(Outcome));
+    if (out == NULL) {
+        perror("Error solving states");
+        exit(EXIT_FAILURE);
+    }
+
+    for (long level = 0; level < solver->numLevels; level++) {
+        for (long i = solver->levelStart[level] + worker->index; i < solver->levelStart[level + 1]; i += solver->jobs) {
+            solveState(solver, solver->order[i], out);
+        }
+        pthread_barrier_wait(&solver->barrier);
+    }
+    free(out);
+    return NULL;
+}
+
+/*
+    Sorts the states by level and solves the levels in order on jobs threads.
+*/
+static void solveLevels(Solver* solver) {
+    solver->numLevels = 0;
+    for (long id = 0; id < solver->numStates; id++) {
+        if (solver->height[id] + 1 > solver->numLevels) solver->numLevels = solver->height[id] + 1;
+    }
+    solver->levelStart = calloc(solver->numLevels + 1, sizeof(long));
+    solver->order = malloc(solver->numStates * sizeof(uint32_t));
+    if (solver->levelStart == NULL || solver->order == NULL) {
+        perror("Error solving states");
+        exit(EXIT_FAILURE);
+    }
+    for (long id = 0; id < solver->numStates; id++) {
+        solver->levelStart[solver->height[id] + 1]++;
+    }
+    for (long level = 0; level < solver->numLevels; level++) {
+        solver->levelStart[level + 1] += solver->levelStart[level];
+    }
+    long* fill = malloc(solver->numLevels * sizeof(long));
+    if (fill == NULL) {
+        perror("Error solving states");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, solver->levelStart, solver->numLevels * sizeof(long));
+    for (long id = 0; id < solver->numStates; id++) {
+        solver->order[fill[solver->height[id]]++] = (uint32_t) id;
+    }
+    free(fill);
+
+    solver->values = malloc((size_t) solver->numStates * VALUE_COUNT * sizeof(double));
+    pthread_t* threads = malloc(solver->jobs * sizeof(pthread_t));
+    SolveWorker* workers = malloc(solver->jobs * sizeof(SolveWorker));
+    if (solver->values == NULL || threads == NULL || workers == NULL) {
+        perror("Error solving states");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&solver->barrier, NULL, solver->jobs);
+    for (int t = 0; t < solver->jobs; t++) {
+        workers[t].solver = solver;
+        workers[t].index = t;
+        pthread_create(&threads[t], NULL, solveThread, &workers[t]);
+    }
+    for (int t = 0; t < solver->jobs; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&solver->barrier);
+    free(workers);
+    free(threads);
+}
+
+static void cleanupSolver(Solver* solver) {
+    free(solver->slotEntity);
+    free(solver->slotTime);
+    free(solver->keys);
+    free(solver->height);
+    free(solver->table);
+    free(solver->values);
+    free(solver->order);
+    free(solver->levelStart);
+}
+
+/*
+  Function: solveExact(const HouseLayout* layout, int numHunters, int jobs, long maxStates, SolveResult* result)
+  Purpose: Works out exactly what games in a house come to on average, as a batch of infinitely many games would.
+
+  Parameters:
+    in layout: the house; it needs at least 2 rooms and at most SOLVE_MAX_ROOMS.
+    in numHunters: hunters in every game, at most SOLVE_MAX_HUNTERS.
+    in jobs: threads that solve the states.
+    in maxStates: most states to find before giving up; SOLVE_STATES if not positive, and at most SOLVE_STATES_MAX.
+    out result: the probabilities and expectations, over the ghost types and starting rooms as initGhost draws them.
+
+  return
+    C_TRUE if solved, C_FALSE, with a message, if the house or the state space is too big
+*/
+int solveExact(const HouseLayout* layout, int numHunters, int jobs, long maxStates, SolveResult* result) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (layout->numRooms < 2 || layout->numRooms > SOLVE_MAX_ROOMS || numHunters < 1 || numHunters > SOLVE_MAX_HUNTERS) {
+        fprintf(stderr, "the exact solver takes 2 to %d rooms and 1 to %d hunters\n", SOLVE_MAX_ROOMS, SOLVE_MAX_HUNTERS);
+        return C_FALSE;
+    }
+    Solver solver;
+    memset(&solver, 0, sizeof(solver));
+    solver.layout = layout;
+    solver.numHunters = numHunters;
+    solver.roomBits = bitsFor(layout->numRooms);
+    solver.jobs = jobs < 1 ? 1 : jobs;
+    solver.maxStates = maxStates > 0 ? maxStates : SOLVE_STATES;
+    if (solver.maxStates > SOLVE_STATES_MAX) solver.maxStates = SOLVE_STATES_MAX;
+    buildSlots(&solver);
+
+    int bits = bitsFor(solver.numSlots) + bitsFor(GHOST_COUNT) + 1 + EV_COUNT
+               + (numHunters + 1) * (1 + solver.roomBits + bitsFor(BOREDOM_MAX)) + numHunters * bitsFor(FEAR_MAX)
+               + (int) layout->numRooms * bitsFor(EV_COUNT + 1);
+    if (bits > SOLVE_KEY_WORDS * 64) {
+        fprintf(stderr, "a state of this house takes %d bits, more than the solver's %d\n", bits, SOLVE_KEY_WORDS * 64);
+        cleanupSolver(&solver);
+        return C_FALSE;
+    }
+    solver.words = (bits + 63) / 64;
+
+    uint32_t maxExits = 0;
+    for (uint32_t r = 0; r < layout->numRooms; r++) {
+        uint32_t exits = layout->adjStart[r + 1] - layout->adjStart[r];
+        if (exits > maxExits) maxExits = exits;
+    }
+    solver.maxOutcomes = 5 + (int) maxExits;
+
+    uint64_t size = 1024;
+    while (size < 2 * (uint64_t) solver.maxStates) size *= 2;
+    solver.table = calloc(size, sizeof(uint32_t));
+    if (solver.table == NULL) {
+        fprintf(stderr, "the table for %ld states needs %llu MB, more than could be allocated; lower --solve-states\n",
+                solver.maxStates, (unsigned long long) (size * sizeof(uint32_t) >> 20));
+        cleanupSolver(&solver);
+        return C_FALSE;
+    }
+    solver.tableMask = size - 1;
+    solver.capacity = 1024;
+    solver.keys = malloc(solver.capacity * solver.words * sizeof(uint64_t));
+    solver.height = malloc(solver.capacity * sizeof(uint32_t));
+    if (solver.keys == NULL || solver.height == NULL) {
+        perror("Error starting the solver");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every game starts the same way but for the ghost's type and room, each drawn uniformly
+    int starts = GHOST_COUNT * (layout->numRooms - 1);
+    long* startIds = malloc(starts * sizeof(long));
+    Outcome* out = malloc(solver.maxOutcomes * sizeof(Outcome));
+    if (startIds == NULL || out == NULL) {
+        perror("Error starting the solver");
+        exit(EXIT_FAILURE);
+    }
+    int ok = C_TRUE;
+    for (int i = 0; i < starts && ok; i++) {
+        SolveState state;
+        uint64_t key[SOLVE_KEY_WORDS];
+        memset(&state, 0, sizeof(state));
+        state.ghostType = i / (layout->numRooms - 1);
+        for (int e = 0; e <= numHunters; e++) {
+            state.present[e] = C_TRUE;
+        }
+        state.room[numHunters] = 1 + i % (layout->numRooms - 1);
+        memset(state.evidence, EV_UNKNOWN, sizeof(state.evidence));
+        encodeState(&solver, &state, key);
+        startIds[i] = addState(&solver, key);
+        ok = startIds[i] >= 0 && exploreFrom(&solver, startIds[i], out);
+    }
+    free(out);
+    if (!ok) {
+        if (solver.numStates == solver.maxStates) {
+            fprintf(stderr, "these games have more than %ld states; the exact solver is for small houses with few hunters "
+                            "(--solve-states raises the limit)\n", solver.maxStates);
+        }
+        free(startIds);
+        cleanupSolver(&solver);
+        return C_FALSE;
+    }
+
+    solveLevels(&solver);
+    double total[VALUE_COUNT] = { 0 };
+    for (int i = 0; i < starts; i++) {
+        for (int v = 0; v < VALUE_COUNT; v++) {
+            total[v] += solver.values[(size_t) startIds[i] * VALUE_COUNT + v] / starts;
+        }
+    }
+    free(startIds);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->states = solver.numStates;
+    result->levels = solver.numLevels;
+    result->threads = solver.jobs;
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    result->ghostWin = total[VALUE_GHOST_WIN];
+    result->identified = total[VALUE_IDENTIFIED];
+    result->identifiedCorrect = total[VALUE_CORRECT];
+    result->exitFear = total[VALUE_FEAR];
+    result->exitBored = total[VALUE_BORED];
+    result->exitEvidence = total[VALUE_EVIDENCE];
+    result->ticks = total[VALUE_TICKS];
+    cleanupSolver(&solver);
+    return C_TRUE;
+}
+
+/*
+  Function: printSolveResult(const SolveResult* result)
+  Purpose: Prints an exact solution in the layout of printBatchStats, with per-game averages for the counts.
+*/
+void printSolveResult(const SolveResult* result) {
+    double identified = result->identified > 0 ? result->identified : 1.0;
+
+    printf("Exact solution:          %ld states in %ld levels, solved in %.3f s on %d threads\n",
+           result->states, result->levels, result->seconds, result->threads);
+    printf("Ghost win rate:          %.6f%%\n", 100.0 * result->ghostWin);
+    printf("Games with 3 evidence:   %.6f%%\n", 100.0 * result->identified);
+    printf("Identification accuracy: %.6f%%\n", 100.0 * result->identifiedCorrect / identified);
+    printf("Hunter exits per game:   %.6f fear, %.6f bored, %.6f evidence\n",
+           result->exitFear, result->exitBored, result->exitEvidence);
+    printf("Average game length:     %.3f simulated seconds\n", result->ticks / 1000.0);
+}
@@ -0,0 +1,116 @@
+// statsdump.c
+#include "defs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/*
+    ghost_stats: reads the live statistics a run publishes with --telemetry NAME.
+
+    The segment is mapped read-only and copied through its seqlock, so reading never slows the
+    run down, however often it is done.
+*/
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--json] [--watch SECONDS] NAME\n", program);
+    fprintf(stderr, "  prints the statistics published to the shared-memory segment NAME by ghost_hunter_game --telemetry NAME\n");
+    fprintf(stderr, "  --json     print them as one JSON object, as the --telemetry-socket endpoint does\n");
+    fprintf(stderr, "  --watch S  print them again every S seconds until the run ends\n");
+}
+
+/*
+    Prints a distribution as one row of bucket:count pairs and the number of hunters in it.
+*/
+static void printDistribution(const char* label, const uint64_t* counts, int buckets, int step) {
+    uint64_t total = 0;
+    for (int b = 0; b < buckets; b++) total += counts[b];
+    printf("%-17s", label);
+    for (int b = 0; b < buckets; b++) {
+        printf(" %d:%llu", b * step, (unsigned long long) counts[b]);
+    }
+    printf("  (%llu hunters)\n", (unsigned long long) total);
+}
+
+static void printStats(const StatsBlock* stats) {
+    double games = stats->gamesDone > 0 ? (double) stats->gamesDone : 1.0;
+    double identified = stats->identified > 0 ? (double) stats->identified : 1.0;
+
+    printf("Process:         %u (%s)\n", stats->pid, stats->running ? "running" : "finished");
+    if (stats->gamesPlanned > 0) {
+        printf("Games:           %llu of %llu (%.1f%%)\n", (unsigned long long) stats->gamesDone,
+               (unsigned long long) stats->gamesPlanned, 100.0 * stats->gamesDone / stats->gamesPlanned);
+    } else {
+        printf("Games:           %llu\n", (unsigned long long) stats->gamesDone);
+    }
+    printf("Throughput:      %.0f games/sec now, %.0f on average over %.1f s\n", stats->gamesPerSec,
+           stats->updated > stats->started ? stats->gamesDone / (stats->updated - stats->started) : 0.0,
+           stats->updated - stats->started);
+    printf("Ghost win rate:  %.2f%%\n", 100.0 * stats->ghostWins / games);
+    printf("Identified:      %llu games, %.2f%% correctly\n", (unsigned long long) stats->identified,
+           100.0 * stats->identifiedCorrect / identified);
+    printf("Hunter exits:    %llu fear, %llu bored, %llu evidence\n", (unsigned long long) stats->exitFear,
+           (unsigned long long) stats->exitBored, (unsigned long long) stats->exitEvidence);
+    printf("Evidence:       ");
+    for (int e = 0; e < EV_COUNT; e++) {
+        printf(" %s %llu", evidenceName(e), (unsigned long long) stats->evidence[e]);
+    }
+    printf("\n");
+    printDistribution("Fear:", stats->fear, FEAR_MAX + 1, 1);
+    printDistribution("Boredom:", stats->boredom, STATS_BOREDOM_BUCKETS + 1, BOREDOM_MAX / STATS_BOREDOM_BUCKETS);
+}
+
+int main(int argc, char* argv[]) {
+    int json = C_FALSE;
+    double watch = 0;
+    const char* name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = C_TRUE;
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch = atof(argv[++i]);
+        } else if (argv[i][0] != '-' && name == NULL) {
+            name = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (name == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s (is a run publishing with --telemetry %s?)\n", name, strerror(errno), name);
+        return 1;
+    }
+    const StatsBlock* shared = mmap(NULL, sizeof(StatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return 1;
+    }
+
+    StatsBlock stats;
+    char text[4096];
+    for (;;) {
+        if (!readStats(shared, &stats)) {
+            fprintf(stderr, "%s: not a statistics segment of this version\n", name);
+            return 1;
+        }
+        if (json) {
+            statsToJson(&stats, text, sizeof(text));
+            fputs(text, stdout);
+        } else {
+            printStats(&stats);
+        }
+        fflush(stdout);
+        if (watch <= 0 || !stats.running) break;
+        if (!json) printf("\n");
+        usleep((useconds_t) (watch * 1e6));
+    }
+    munmap((void*) shared, sizeof(StatsBlock));
+    return 0;
+}
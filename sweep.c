@@ -0,0 +1,504 @@
+// sweep.c
+#include "defs.h"
+#include <math.h>
+
+/*
+    ghost_sweep: estimates the ghost's win rate over a grid of rules, hunter counts and houses,
+    without rebuilding for every combination.
+
+    Each point of the grid is sampled until the Wilson interval on its win rate is at most
+    --precision either side, after at least --min-games and at most --max-games games. Worker
+    threads take chunks of games for whichever unfinished point has the widest interval, so a
+    point whose outcome is nearly certain stops after a few thousand games and the uncertain
+    ones get the rest of the time. Game i of every point is played with stream key
+    rngDerive(seed, i), so all points are compared on the same random numbers and the results
+    do not depend on the number of threads beyond how many games each point ends up with.
+*/
+
+#define SWEEP_MAX_VALUES    64      // values one parameter can take
+#define SWEEP_MAX_MAPS      8
+#define SWEEP_MAX_POINTS    100000  // combinations of all of them
+
+enum SweepFormat { SWEEP_TABLE, SWEEP_CSV };
+
+// The values one parameter of the grid takes
+typedef struct SweepAxis {
+    long values[SWEEP_MAX_VALUES];
+    int count;
+} SweepAxis;
+
+typedef struct SweepOptions {
+    SweepAxis fear;
+    SweepAxis boredom;
+    SweepAxis hunterWait;
+    SweepAxis ghostWait;
+    SweepAxis hunters;
+    const char* maps[SWEEP_MAX_MAPS];   // "default" is the built-in house
+    int numMaps;
+    double precision;                   // wanted half-width of the interval on the win rate
+    double confidence;
+    long minGames;
+    long maxGames;
+    long chunk;                         // games a worker takes at a time
+    int jobs;
+    uint64_t seed;
+    enum SweepFormat format;
+    const char* output;
+    const char* results;                // where every game is stored, with its point's config number
+} SweepOptions;
+
+// One combination of parameters and what its games have come to so far
+typedef struct SweepPoint {
+    const HouseLayout* layout;
+    const char* map;
+    int numHunters;
+    GameRules rules;
+    long claimed;                       // games handed out to the workers, numbered from 0
+    BatchStats stats;                   // ... of which these have finished
+    int done;                           // C_TRUE once precise enough or out of games
+} SweepPoint;
+
+typedef struct Sweep {
+    const SweepOptions* options;
+    double z;                           // standard normal quantile of the confidence level
+    SweepPoint* points;
+    int numPoints;
+    ResultsFile* results;               // NULL unless --results
+    pthread_mutex_t lock;               // guards the points' counts
+    pthread_cond_t finished;            // signalled whenever a chunk of games finishes
+} Sweep;
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--fear LIST] [--boredom LIST] [--hunter-wait LIST] [--ghost-wait LIST] [--hunters LIST]\n", program);
+    fprintf(stderr, "          [--map FILE[,FILE...]] [--precision P] [--confidence C] [--min-games N] [--max-games N]\n");
+    fprintf(stderr, "          [--chunk N] [--jobs J] [--seed S] [--format table|csv] [--output FILE] [--results FILE]\n");
+    fprintf(stderr, "  a LIST is values and ranges separated by commas, e.g. 5,10,20 or 4:16:4 (from 4 to 16 in steps of 4)\n");
+    fprintf(stderr, "  --fear         fear at which a hunter leaves (default %d)\n", FEAR_MAX);
+    fprintf(stderr, "  --boredom      boredom at which hunters and the ghost leave (default %d)\n", BOREDOM_MAX);
+    fprintf(stderr, "  --hunter-wait  simulated ms between a hunter's turns (default %d)\n", HUNTER_WAIT);
+    fprintf(stderr, "  --ghost-wait   simulated ms between the ghost's turns (default %d)\n", GHOST_WAIT);
+    fprintf(stderr, "  --hunters      hunters in every game, up to %d (default %d)\n", OCC_MAX_HUNTERS, NUM_HUNTERS);
+    fprintf(stderr, "  --map          houses to play in, text or compiled maps; default is the built-in house\n");
+    fprintf(stderr, "  --precision    stop sampling a point once its win rate is known to within P either side (default 0.01)\n");
+    fprintf(stderr, "  --confidence   confidence level of that interval (default 0.95)\n");
+    fprintf(stderr, "  --min-games    games every point plays at least (default 1000)\n");
+    fprintf(stderr, "  --max-games    games any point plays at most (default 1000000)\n");
+    fprintf(stderr, "  --chunk        games a worker plays for a point before choosing again (default 256)\n");
+    fprintf(stderr, "  --jobs         worker threads (default: number of cores)\n");
+    fprintf(stderr, "  --seed         master seed; game i of every point is played with stream rngDerive(seed, i) (default 42)\n");
+    fprintf(stderr, "  --format       a readable table (default) or csv\n");
+    fprintf(stderr, "  --output       write the results to FILE instead of stdout\n");
+    fprintf(stderr, "  --results      also store every game in a results file, with the point's config number; query it with ghost_results\n");
+}
+
+/*
+    Parses a number that must take up the whole of text. Returns C_FALSE if it does not.
+*/
+static int parseNumber(const char* text, long* value) {
+    char* end;
+    *value = strtol(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+/*
+    Fills an axis from a comma-separated list of values and START:END[:STEP] ranges, each within
+    [min, max]. Returns C_FALSE if the list is malformed, out of range or too long.
+*/
+static int parseAxis(SweepAxis* axis, char* list, long min, long max) {
+    axis->count = 0;
+    for (char* part = strtok(list, ","); part != NULL; part = strtok(NULL, ",")) {
+        long start, end, step = 1;
+        char* colon = strchr(part, ':');
+        if (colon == NULL) {
+            if (!parseNumber(part, &start)) return C_FALSE;
+            end = start;
+        } else {
+            *colon = '\0';
+            char* second = strchr(colon + 1, ':');
+            if (second != NULL) {
+                *second = '\0';
+                if (!parseNumber(second + 1, &step)) return C_FALSE;
+            }
+            if (!parseNumber(part, &start) || !parseNumber(colon + 1, &end)) return C_FALSE;
+        }
+        if (start < min || end > max || start > end || step < 1) return C_FALSE;
+        for (long value = start; value <= end; value += step) {
+            if (axis->count == SWEEP_MAX_VALUES) return C_FALSE;
+            axis->values[axis->count++] = value;
+        }
+    }
+    return axis->count > 0;
+}
+
+static int parseMaps(SweepOptions* options, char* list) {
+    options->numMaps = 0;
+    for (char* part = strtok(list, ","); part != NULL; part = strtok(NULL, ",")) {
+        if (options->numMaps == SWEEP_MAX_MAPS) return C_FALSE;
+        options->maps[options->numMaps++] = part;
+    }
+    return options->numMaps > 0;
+}
+
+/*
+    Returns z with P(Z < z) = p for a standard normal Z and 0 < p < 1, by the rational
+    approximation of Abramowitz and Stegun 26.2.23, good to 4.5e-4.
+*/
+static double normalQuantile(double p) {
+    double q = p < 0.5 ? p : 1.0 - p;
+    double t = sqrt(-2.0 * log(q));
+    double z = t - (2.515517 + t * (0.802853 + t * 0.010328)) / (1.0 + t * (1.432788 + t * (0.189269 + t * 0.001308)));
+    return p < 0.5 ? -z : z;
+}
+
+/*
+    Returns the half-width of the Wilson score interval on a rate estimated as rate from games
+    games, or 1 before any.
+*/
+static double wilsonHalfWidth(double rate, long games, double z) {
+    if (games <= 0) return 1.0;
+    double n = (double) games;
+    return z * sqrt(rate * (1.0 - rate) / n + z * z / (4.0 * n * n)) / (1.0 + z * z / n);
+}
+
+/*
+    The ghost's win rate at a point so far, or one half before any game has finished.
+*/
+static double winRate(const SweepPoint* point) {
+    return point->stats.games > 0 ? (double) point->stats.ghostWins / point->stats.games : 0.5;
+}
+
+/*
+    Hands a worker the next games of the point with the widest interval, counting the games it
+    has out as if they had already finished at the current rate, so that the workers spread out
+    over the points instead of all piling onto one. When every unfinished point only waits for
+    games already handed out, waits for one of them to finish. Returns C_FALSE once every point
+    is done.
+*/
+static int claimChunk(Sweep* sweep, SweepPoint** claimed, long* first, long* count) {
+    const SweepOptions* options = sweep->options;
+    pthread_mutex_lock(&sweep->lock);
+    for (;;) {
+        SweepPoint* best = NULL;
+        double widest = 0;
+        int unfinished = 0;
+        for (int i = 0; i < sweep->numPoints; i++) {
+            SweepPoint* point = &sweep->points[i];
+            if (point->done) continue;
+            unfinished++;
+            if (point->claimed >= options->maxGames) continue;
+            double width = wilsonHalfWidth(winRate(point), point->claimed, sweep->z);
+            if (point->claimed >= options->minGames && width <= options->precision) continue;
+            if (best == NULL || width > widest) {
+                best = point;
+                widest = width;
+            }
+        }
+        if (best != NULL) {
+            *claimed = best;
+            *first = best->claimed;
+            *count = options->maxGames - best->claimed < options->chunk ? options->maxGames - best->claimed : options->chunk;
+            best->claimed += *count;
+            pthread_mutex_unlock(&sweep->lock);
+            return C_TRUE;
+        }
+        if (unfinished == 0) break;
+        pthread_cond_wait(&sweep->finished, &sweep->lock);
+    }
+    pthread_mutex_unlock(&sweep->lock);
+    return C_FALSE;
+}
+
+/*
+    Adds one game result to a running total.
+*/
+static void addResult(BatchStats* stats, const GameResult* result) {
+    stats->games++;
+    stats->ghostWins += result->ghostWon;
+    if (result->identifiedType != GH_UNKNOWN) {
+        stats->identified++;
+        stats->identifiedCorrect += (result->identifiedType == result->ghostType);
+    }
+    stats->exitFear += result->exitFear;
+    stats->exitBored += result->exitBored;
+    stats->exitEvidence += result->exitEvidence;
+    stats->ticks += result->ticks;
+}
+
+/*
+    Adds a finished chunk to its point and decides whether the point needs more games.
+*/
+static void finishChunk(Sweep* sweep, SweepPoint* point, const BatchStats* chunk) {
+    const SweepOptions* options = sweep->options;
+    pthread_mutex_lock(&sweep->lock);
+    BatchStats* stats = &point->stats;
+    stats->games += chunk->games;
+    stats->ghostWins += chunk->ghostWins;
+    stats->identified += chunk->identified;
+    stats->identifiedCorrect += chunk->identifiedCorrect;
+    stats->exitFear += chunk->exitFear;
+    stats->exitBored += chunk->exitBored;
+    stats->exitEvidence += chunk->exitEvidence;
+    stats->ticks += chunk->ticks;
+    if (stats->games == point->claimed &&
+        (stats->games >= options->maxGames ||
+         (stats->games >= options->minGames && wilsonHalfWidth(winRate(point), stats->games, sweep->z) <= options->precision))) {
+        point->done = C_TRUE;
+    }
+    pthread_cond_broadcast(&sweep->finished);
+    pthread_mutex_unlock(&sweep->lock);
+}
+
+static void* sweepThread(void* arg) {
+    Sweep* sweep = (Sweep*)arg;
+    LogSink silent = { C_FALSE, STDOUT_FILENO };
+    SimContext* sim = NULL;
+    SweepPoint* simPoint = NULL;
+    SweepPoint* point;
+    long first, count;
+    ResultsBuffer results;
+    if (sweep->results != NULL) initResultsBuffer(&results, sweep->results);
+
+    while (claimChunk(sweep, &point, &first, &count)) {
+        // One context at a time, reset for every game until the worker moves to another point
+        if (point != simPoint) {
+            simDestroy(sim);
+            SimConfig config = { point->layout, 0, point->numHunters, NULL, silent, NULL, &point->rules };
+            sim = simCreate(&config);
+            simPoint = point;
+        }
+        BatchStats chunk;
+        memset(&chunk, 0, sizeof(chunk));
+        for (long game = first; game < first + count; game++) {
+            GameResult result;
+            simReset(sim, rngDerive(sweep->options->seed, game));
+            simRun(sim);
+            simResult(sim, &result);
+            addResult(&chunk, &result);
+            if (sweep->results != NULL) recordGame(&results, (uint32_t) (point - sweep->points), sim, &result);
+        }
+        finishChunk(sweep, point, &chunk);
+    }
+    simDestroy(sim);
+    if (sweep->results != NULL) cleanupResultsBuffer(&results);
+    return NULL;
+}
+
+/*
+    Lays out every combination of the options' values, the map varying slowest.
+        return: the points, or NULL after printing the problem if there are more than SWEEP_MAX_POINTS
+*/
+static SweepPoint* makeGrid(const SweepOptions* options, const HouseLayout* layouts, int* numPoints) {
+    // At most SWEEP_MAX_MAPS * SWEEP_MAX_VALUES^5, which does not fit in an int
+    size_t count = (size_t) options->numMaps * options->hunters.count * options->fear.count * options->boredom.count
+                 * options->hunterWait.count * options->ghostWait.count;
+    if (count > SWEEP_MAX_POINTS) {
+        fprintf(stderr, "the grid has %zu points, more than the %d a sweep can take\n", count, SWEEP_MAX_POINTS);
+        return NULL;
+    }
+    *numPoints = (int) count;
+    SweepPoint* points = calloc(count, sizeof(SweepPoint));
+    if (points == NULL) {
+        perror("Error starting sweep");
+        exit(EXIT_FAILURE);
+    }
+    SweepPoint* point = points;
+    for (int m = 0; m < options->numMaps; m++)
+    for (int h = 0; h < options->hunters.count; h++)
+    for (int f = 0; f < options->fear.count; f++)
+    for (int b = 0; b < options->boredom.count; b++)
+    for (int hw = 0; hw < options->hunterWait.count; hw++)
+    for (int gw = 0; gw < options->ghostWait.count; gw++) {
+        point->layout = &layouts[m];
+        point->map = options->maps[m];
+        point->numHunters = (int) options->hunters.values[h];
+        point->rules.fearMax = (int) options->fear.values[f];
+        point->rules.boredomMax = (int) options->boredom.values[b];
+        point->rules.hunterWait = options->hunterWait.values[hw];
+        point->rules.ghostWait = options->ghostWait.values[gw];
+        point++;
+    }
+    return points;
+}
+
+static void writeTable(FILE* out, const Sweep* sweep) {
+    fprintf(out, "%6s %-20s %7s %5s %7s %9s %9s %9s %9s %8s %9s %9s\n", "config", "map", "hunters", "fear", "boredom",
+            "hunter ms", "ghost ms", "games", "ghost win", "+/-", "correct", "length s");
+    for (int i = 0; i < sweep->numPoints; i++) {
+        const SweepPoint* point = &sweep->points[i];
+        const BatchStats* stats = &point->stats;
+        double rate = winRate(point);
+        double halfWidth = wilsonHalfWidth(rate, stats->games, sweep->z);
+        fprintf(out, "%6d %-20s %7d %5d %7d %9ld %9ld %9ld %8.2f%% %7.2f%% %8.2f%% %9.1f%s\n", i, point->map, point->numHunters,
+                point->rules.fearMax, point->rules.boredomMax, point->rules.hunterWait, point->rules.ghostWait,
+                stats->games, 100.0 * rate, 100.0 * halfWidth,
+                stats->identified > 0 ? 100.0 * stats->identifiedCorrect / stats->identified : 0.0,
+                stats->games > 0 ? stats->ticks / (double) stats->games / 1000.0 : 0.0,
+                halfWidth > sweep->options->precision ? "  (max games)" : "");
+    }
+}
+
+static void writeCsv(FILE* out, const Sweep* sweep) {
+    fprintf(out, "config,map,hunters,fear_max,boredom_max,hunter_wait_ms,ghost_wait_ms,games,ghost_win_rate,half_width,"
+                 "identified,identified_correct,exit_fear,exit_bored,exit_evidence,mean_ticks_ms\n");
+    for (int i = 0; i < sweep->numPoints; i++) {
+        const SweepPoint* point = &sweep->points[i];
+        const BatchStats* stats = &point->stats;
+        double rate = winRate(point);
+        fprintf(out, "%d,%s,%d,%d,%d,%ld,%ld,%ld,%.6f,%.6f,%ld,%ld,%ld,%ld,%ld,%.1f\n", i, point->map, point->numHunters,
+                point->rules.fearMax, point->rules.boredomMax, point->rules.hunterWait, point->rules.ghostWait,
+                stats->games, rate, wilsonHalfWidth(rate, stats->games, sweep->z), stats->identified,
+                stats->identifiedCorrect, stats->exitFear, stats->exitBored, stats->exitEvidence,
+                stats->games > 0 ? stats->ticks / (double) stats->games : 0.0);
+    }
+}
+
+static double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    SweepOptions options;
+    memset(&options, 0, sizeof(options));
+    options.fear = (SweepAxis) { { FEAR_MAX }, 1 };
+    options.boredom = (SweepAxis) { { BOREDOM_MAX }, 1 };
+    options.hunterWait = (SweepAxis) { { HUNTER_WAIT }, 1 };
+    options.ghostWait = (SweepAxis) { { GHOST_WAIT }, 1 };
+    options.hunters = (SweepAxis) { { NUM_HUNTERS }, 1 };
+    options.maps[0] = "default";
+    options.numMaps = 1;
+    options.precision = 0.01;
+    options.confidence = 0.95;
+    options.minGames = 1000;
+    options.maxGames = 1000000;
+    options.chunk = 256;
+    options.jobs = cores > 0 ? cores : 1;
+    options.seed = 42;
+    options.format = SWEEP_TABLE;
+
+    for (int i = 1; i < argc; i++) {
+        int ok = C_TRUE;
+        if (strcmp(argv[i], "--fear") == 0 && i + 1 < argc) {
+            ok = parseAxis(&options.fear, argv[++i], 1, 1000000);
+        } else if (strcmp(argv[i], "--boredom") == 0 && i + 1 < argc) {
+            ok = parseAxis(&options.boredom, argv[++i], 1, 1000000);
+        } else if (strcmp(argv[i], "--hunter-wait") == 0 && i + 1 < argc) {
+            ok = parseAxis(&options.hunterWait, argv[++i], 1, 86400000);
+        } else if (strcmp(argv[i], "--ghost-wait") == 0 && i + 1 < argc) {
+            ok = parseAxis(&options.ghostWait, argv[++i], 1, 86400000);
+        } else if (strcmp(argv[i], "--hunters") == 0 && i + 1 < argc) {
+            ok = parseAxis(&options.hunters, argv[++i], 1, OCC_MAX_HUNTERS);
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            ok = parseMaps(&options, argv[++i]);
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            options.precision = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--confidence") == 0 && i + 1 < argc) {
+            options.confidence = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-games") == 0 && i + 1 < argc) {
+            options.minGames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-games") == 0 && i + 1 < argc) {
+            options.maxGames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            options.chunk = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "table") == 0) {
+                options.format = SWEEP_TABLE;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                options.format = SWEEP_CSV;
+            } else {
+                ok = C_FALSE;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+            options.results = argv[++i];
+        } else {
+            ok = C_FALSE;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.precision <= 0 || options.confidence <= 0 || options.confidence >= 1 || options.minGames < 1 ||
+        options.maxGames < options.minGames || options.chunk < 1 || options.jobs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    HouseLayout layouts[SWEEP_MAX_MAPS];
+    for (int m = 0; m < options.numMaps; m++) {
+        if (strcmp(options.maps[m], "default") == 0) {
+            populateRooms(&layouts[m]);
+        } else if (!loadLayout(options.maps[m], &layouts[m])) {
+            return 1;
+        }
+    }
+
+    int numPoints;
+    SweepPoint* points = makeGrid(&options, layouts, &numPoints);
+    if (points == NULL) return 1;
+
+    FILE* out = stdout;
+    if (options.output != NULL && (out = fopen(options.output, "w")) == NULL) {
+        perror(options.output);
+        return 1;
+    }
+
+    ResultsFile results;
+    if (options.results != NULL && !openResults(&results, options.results)) return 1;
+
+    Sweep sweep;
+    sweep.options = &options;
+    sweep.results = options.results != NULL ? &results : NULL;
+    sweep.z = normalQuantile(0.5 + options.confidence / 2);
+    sweep.points = points;
+    sweep.numPoints = numPoints;
+    pthread_mutex_init(&sweep.lock, NULL);
+    pthread_cond_init(&sweep.finished, NULL);
+
+    double started = nowSeconds();
+    pthread_t* threads = malloc(options.jobs * sizeof(pthread_t));
+    if (threads == NULL) {
+        perror("Error starting sweep");
+        return 1;
+    }
+    for (int i = 0; i < options.jobs; i++) pthread_create(&threads[i], NULL, sweepThread, &sweep);
+    for (int i = 0; i < options.jobs; i++) pthread_join(threads[i], NULL);
+    double seconds = nowSeconds() - started;
+    free(threads);
+
+    if (options.format == SWEEP_TABLE) {
+        writeTable(out, &sweep);
+    } else {
+        writeCsv(out, &sweep);
+    }
+
+    // What a fixed number of games per point would have cost to reach the same precision everywhere
+    long played = 0, most = 0;
+    for (int i = 0; i < sweep.numPoints; i++) {
+        played += sweep.points[i].stats.games;
+        if (sweep.points[i].stats.games > most) most = sweep.points[i].stats.games;
+    }
+    FILE* summary = options.format == SWEEP_TABLE ? out : stderr;
+    fprintf(summary, "%s%d points, %ld games in %.2f s (%.0f games/sec), win rates to within %.3g at %.3g confidence\n",
+            options.format == SWEEP_TABLE ? "\n" : "", sweep.numPoints, played, seconds,
+            seconds > 0 ? played / seconds : 0.0, options.precision, options.confidence);
+    fprintf(summary, "A fixed %ld games per point would have played %ld games, %.1f times as many\n",
+            most, most * sweep.numPoints, played > 0 ? (double) most * sweep.numPoints / played : 0.0);
+    if (out != stdout) fclose(out);
+    int status = sweep.results != NULL && !closeResults(&results) ? 1 : 0;
+
+    pthread_cond_destroy(&sweep.finished);
+    pthread_mutex_destroy(&sweep.lock);
+    free(sweep.points);
+    for (int m = 0; m < options.numMaps; m++) cleanupLayout(&layouts[m]);
+    return status;
+}
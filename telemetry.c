@@ -0,0 +1,506 @@
+// telemetry.c
+#include "defs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+    Live statistics for watching a long run without parsing its output.
+
+    The threads playing games never touch anything shared: each adds its finished games to its
+    own TelemetrySlot, found through a thread-local pointer, with relaxed stores that only it
+    makes. A publisher thread wakes every TELEMETRY_INTERVAL_MS, sums the slots and writes the
+    totals into a StatsBlock in a POSIX shared-memory segment, guarded by a seqlock: the sequence
+    number is odd while the block is being written, so a reader copies the block and retries if
+    the number changed or was odd. Readers never block the publisher, and the publisher never
+    blocks the games. ghost_stats reads the segment from another process.
+
+    The optional Unix socket is served by a thread of its own, which answers every connection
+    with a JSON copy of the block, read through the same seqlock.
+*/
+
+#define TELEMETRY_INTERVAL_MS   200
+#define TELEMETRY_JSON_MAX      4096
+
+// What one thread has counted, written only by that thread
+typedef struct TelemetrySlot {
+    _Atomic uint64_t games;
+    _Atomic uint64_t ghostWins;
+    _Atomic uint64_t identified;
+    _Atomic uint64_t identifiedCorrect;
+    _Atomic uint64_t exitFear;
+    _Atomic uint64_t exitBored;
+    _Atomic uint64_t exitEvidence;
+    _Atomic uint64_t evidence[EV_COUNT];
+    _Atomic uint64_t fear[FEAR_MAX + 1];
+    _Atomic uint64_t boredom[STATS_BOREDOM_BUCKETS + 1];
+    struct TelemetrySlot* next;
+} TelemetrySlot;
+
+typedef struct Telemetry {
+    StatsBlock* block;              // the shared segment, or private memory when only serving the socket
+    char shmName[MAX_STR];          // empty when the block is private
+    char socketPath[sizeof(((struct sockaddr_un*) 0)->sun_path)];
+    int listener;                   // -1 without a socket
+    pthread_t publisher;
+    pthread_t server;
+    pthread_mutex_t lock;           // guards watched
+    pthread_cond_t wake;            // signalled to stop the publisher early
+    const HouseType* watched;
+    double lastTime;
+    uint64_t lastGames;
+} Telemetry;
+
+static atomic_int telemetryOn = C_FALSE;
+static atomic_int telemetryStopping = C_FALSE;
+static _Atomic(TelemetrySlot*) telemetrySlots = NULL;
+static __thread TelemetrySlot* mySlot = NULL;
+static Telemetry telemetry;
+
+static double realSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+    Returns the calling thread's slot, creating and registering it on first use.
+*/
+static TelemetrySlot* threadSlot() {
+    if (mySlot == NULL) {
+        TelemetrySlot* slot = calloc(1, sizeof(TelemetrySlot));
+        if (slot == NULL) {
+            perror("Error starting telemetry");
+            exit(EXIT_FAILURE);
+        }
+        slot->next = atomic_load(&telemetrySlots);
+        while (!atomic_compare_exchange_weak(&telemetrySlots, &slot->next, slot)) { }
+        mySlot = slot;
+    }
+    return mySlot;
+}
+
+/*
+    Adds to a slot counter, which only the owning thread writes.
+*/
+static void bump(_Atomic uint64_t* counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+static uint64_t get(_Atomic uint64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static int boredomBucket(int boredom) {
+    int bucket = boredom * STATS_BOREDOM_BUCKETS / BOREDOM_MAX;
+    if (bucket < 0) return 0;
+    return bucket > STATS_BOREDOM_BUCKETS ? STATS_BOREDOM_BUCKETS : bucket;
+}
+
+/*
+  Function: telemetryGame(const SimContext* sim, const GameResult* result)
+  Purpose: Counts a finished game towards the published statistics; does nothing unless telemetry was started.
+
+  Parameters:
+    in sim: the game, whose hunters' final fear and boredom are counted.
+    in result: its outcome, from simResult.
+
+  return
+    none
+*/
+void telemetryGame(const SimContext* sim, const GameResult* result) {
+    if (!atomic_load_explicit(&telemetryOn, memory_order_relaxed)) return;
+    const HouseType* house = &sim->house;
+    unsigned collected = atomic_load_explicit(&((HouseType*) house)->evidence.collected, memory_order_relaxed);
+    telemetryCount(result, collected, &house->hunters[0].fear, &house->hunters[0].boredom, house->numHunters,
+                   sizeof(Hunter));
+}
+
+/*
+  Function: telemetryCount(const GameResult* result, unsigned collected, const int* fear, const int* boredom, int numHunters, size_t stride)
+  Purpose: Counts a finished game that was not played in a SimContext, e.g. by the lockstep engine; see telemetryGame.
+
+  Parameters:
+    in result: the game's outcome.
+    in collected: its evidence board, bit e set for each collected evidence type e.
+    in fear, boredom: the first hunter's final fear and boredom.
+    in numHunters: the number of hunters.
+    in stride: bytes from one hunter's fear or boredom to the next one's.
+
+  return
+    none
+*/
+void telemetryCount(const GameResult* result, unsigned collected, const int* fear, const int* boredom, int numHunters,
+                    size_t stride) {
+    if (!atomic_load_explicit(&telemetryOn, memory_order_relaxed)) return;
+    TelemetrySlot* slot = threadSlot();
+
+    bump(&slot->games, 1);
+    bump(&slot->ghostWins, result->ghostWon);
+    if (result->identifiedType != GH_UNKNOWN) {
+        bump(&slot->identified, 1);
+        bump(&slot->identifiedCorrect, result->identifiedType == result->ghostType);
+    }
+    bump(&slot->exitFear, result->exitFear);
+    bump(&slot->exitBored, result->exitBored);
+    bump(&slot->exitEvidence, result->exitEvidence);
+    for (int e = 0; e < EV_COUNT; e++) {
+        if (collected & (1u << e)) bump(&slot->evidence[e], 1);
+    }
+    for (int i = 0; i < numHunters; i++) {
+        int f = *(const int*) ((const char*) fear + i * stride);
+        int b = *(const int*) ((const char*) boredom + i * stride);
+        bump(&slot->fear[f < 0 ? 0 : f > FEAR_MAX ? FEAR_MAX : f], 1);
+        bump(&slot->boredom[boredomBucket(b)], 1);
+    }
+}
+
+/*
+  Function: telemetryWatch(const HouseType* house)
+  Purpose: Publishes the fear and boredom of a game while it is being played.
+
+  Parameters:
+    in house: a game in progress, or NULL to stop watching it; stop watching before the house is freed.
+
+  Description:
+    While a house is watched, the published fear and boredom distributions are those of its hunters still in the house rather than of the hunters of finished games, and its evidence counts as collected as soon as a hunter collects it. The hunters are read without locking, so a figure may be one turn old.
+
+  return
+    none
+*/
+void telemetryWatch(const HouseType* house) {
+    if (!atomic_load(&telemetryOn)) return;
+    pthread_mutex_lock(&telemetry.lock);
+    telemetry.watched = house;
+    pthread_mutex_unlock(&telemetry.lock);
+}
+
+/*
+    Sums the slots, and the watched game if any, into a block.
+*/
+static void collectStats(StatsBlock* stats) {
+    memset(stats->evidence, 0, sizeof(stats->evidence));
+    memset(stats->fear, 0, sizeof(stats->fear));
+    memset(stats->boredom, 0, sizeof(stats->boredom));
+    stats->gamesDone = stats->ghostWins = stats->identified = stats->identifiedCorrect = 0;
+    stats->exitFear = stats->exitBored = stats->exitEvidence = 0;
+
+    for (TelemetrySlot* slot = atomic_load(&telemetrySlots); slot != NULL; slot = slot->next) {
+        stats->gamesDone += get(&slot->games);
+        stats->ghostWins += get(&slot->ghostWins);
+        stats->identified += get(&slot->identified);
+        stats->identifiedCorrect += get(&slot->identifiedCorrect);
+        stats->exitFear += get(&slot->exitFear);
+        stats->exitBored += get(&slot->exitBored);
+        stats->exitEvidence += get(&slot->exitEvidence);
+        for (int e = 0; e < EV_COUNT; e++) stats->evidence[e] += get(&slot->evidence[e]);
+        for (int f = 0; f <= FEAR_MAX; f++) stats->fear[f] += get(&slot->fear[f]);
+        for (int b = 0; b <= STATS_BOREDOM_BUCKETS; b++) stats->boredom[b] += get(&slot->boredom[b]);
+    }
+
+    pthread_mutex_lock(&telemetry.lock);
+    const HouseType* house = telemetry.watched;
+    if (house != NULL) {
+        memset(stats->fear, 0, sizeof(stats->fear));
+        memset(stats->boredom, 0, sizeof(stats->boredom));
+        for (int i = 0; i < house->numHunters; i++) {
+            const Hunter* hunter = &house->hunters[i];
+            if (__atomic_load_n(&hunter->currentRoom, __ATOMIC_RELAXED) == NO_ROOM) continue;
+            int fear = __atomic_load_n(&hunter->fear, __ATOMIC_RELAXED);
+            stats->fear[fear < 0 ? 0 : fear > FEAR_MAX ? FEAR_MAX : fear]++;
+            stats->boredom[boredomBucket(__atomic_load_n(&hunter->boredom, __ATOMIC_RELAXED))]++;
+        }
+        unsigned collected = atomic_load_explicit(&((HouseType*) house)->evidence.collected, memory_order_relaxed);
+        for (int e = 0; e < EV_COUNT; e++) {
+            if (collected & (1u << e)) stats->evidence[e]++;
+        }
+    }
+    pthread_mutex_unlock(&telemetry.lock);
+}
+
+/*
+    Writes the current totals into the shared block under the seqlock.
+*/
+static void publish(int running) {
+    StatsBlock* block = telemetry.block;
+    StatsBlock scratch;
+    memcpy(&scratch, block, sizeof(StatsBlock));
+    collectStats(&scratch);
+
+    // The rate over the last interval while running, and over the whole run once it has ended
+    double now = realSeconds();
+    double since = running ? telemetry.lastTime : scratch.started;
+    uint64_t before = running ? telemetry.lastGames : 0;
+    if (now > since) {
+        scratch.gamesPerSec = (scratch.gamesDone - before) / (now - since);
+    }
+    telemetry.lastTime = now;
+    telemetry.lastGames = scratch.gamesDone;
+    scratch.updated = now;
+    scratch.running = running;
+
+    uint32_t seq = atomic_load_explicit(&block->seq, memory_order_relaxed);
+    atomic_store_explicit(&block->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy((char*) block + offsetof(StatsBlock, running), (char*) &scratch + offsetof(StatsBlock, running),
+           sizeof(StatsBlock) - offsetof(StatsBlock, running));
+    atomic_store_explicit(&block->seq, seq + 2, memory_order_release);
+}
+
+static void* publisherThread(void* arg) {
+    pthread_mutex_lock(&telemetry.lock);
+    while (!atomic_load(&telemetryStopping)) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += TELEMETRY_INTERVAL_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&telemetry.wake, &telemetry.lock, &until);
+        pthread_mutex_unlock(&telemetry.lock);
+        publish(C_TRUE);
+        pthread_mutex_lock(&telemetry.lock);
+    }
+    pthread_mutex_unlock(&telemetry.lock);
+    return NULL;
+}
+
+/*
+  Function: readStats(const StatsBlock* shared, StatsBlock* copy)
+  Purpose: Takes a consistent copy of a published block, retrying while the publisher is writing it.
+
+  return
+    C_TRUE on success, C_FALSE if the block is not a statistics block of this version
+*/
+int readStats(const StatsBlock* shared, StatsBlock* copy) {
+    if (memcmp(shared->magic, STATS_MAGIC, sizeof(shared->magic)) != 0 || shared->version != STATS_VERSION) {
+        return C_FALSE;
+    }
+    StatsBlock* block = (StatsBlock*) shared;
+    for (;;) {
+        uint32_t before = atomic_load_explicit(&block->seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy((char*) copy + offsetof(StatsBlock, running), (const char*) shared + offsetof(StatsBlock, running),
+               sizeof(StatsBlock) - offsetof(StatsBlock, running));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&block->seq, memory_order_relaxed) == before) break;
+    }
+    memcpy(copy->magic, shared->magic, sizeof(copy->magic));
+    copy->version = shared->version;
+    copy->pid = shared->pid;
+    atomic_init(&copy->seq, 0);
+    return C_TRUE;
+}
+
+/*
+  Function: statsToJson(const StatsBlock* stats, char* out, size_t size)
+  Purpose: Formats a copy of the statistics as a single JSON object followed by a newline.
+
+  return
+    the length of the text, truncated to size - 1 characters
+*/
+int statsToJson(const StatsBlock* stats, char* out, size_t size) {
+    double games = stats->gamesDone > 0 ? (double) stats->gamesDone : 1.0;
+    size_t length = 0;
+
+    #define APPEND(...) do { \
+        int n = snprintf(out + length, length < size ? size - length : 0, __VA_ARGS__); \
+        if (n > 0) length += n; \
+    } while (0)
+
+    APPEND("{\"pid\": %u, \"running\": %s, \"games_planned\": %llu, \"games_done\": %llu, "
+           "\"games_per_sec\": %.1f, \"elapsed\": %.3f, \"ghost_win_rate\": %.4f, \"identified\": %llu, "
+           "\"identified_correct\": %llu, \"exits\": {\"fear\": %llu, \"bored\": %llu, \"evidence\": %llu}, \"evidence\": {",
+           stats->pid, stats->running ? "true" : "false", (unsigned long long) stats->gamesPlanned,
+           (unsigned long long) stats->gamesDone, stats->gamesPerSec, stats->updated - stats->started,
+           stats->ghostWins / games, (unsigned long long) stats->identified,
+           (unsigned long long) stats->identifiedCorrect, (unsigned long long) stats->exitFear,
+           (unsigned long long) stats->exitBored, (unsigned long long) stats->exitEvidence);
+    for (int e = 0; e < EV_COUNT; e++) {
+        APPEND("%s\"%s\": %llu", e > 0 ? ", " : "", evidenceName(e), (unsigned long long) stats->evidence[e]);
+    }
+    APPEND("}, \"fear\": [");
+    for (int f = 0; f <= FEAR_MAX; f++) {
+        APPEND("%s%llu", f > 0 ? ", " : "", (unsigned long long) stats->fear[f]);
+    }
+    APPEND("], \"boredom\": [");
+    for (int b = 0; b <= STATS_BOREDOM_BUCKETS; b++) {
+        APPEND("%s%llu", b > 0 ? ", " : "", (unsigned long long) stats->boredom[b]);
+    }
+    APPEND("]}\n");
+    #undef APPEND
+
+    if (length >= size) length = size > 0 ? size - 1 : 0;
+    return (int) length;
+}
+
+/*
+    Answers each connection to the socket with the latest published statistics as JSON.
+*/
+static void* serverThread(void* arg) {
+    struct pollfd poller = { telemetry.listener, POLLIN, 0 };
+    char json[TELEMETRY_JSON_MAX];
+
+    while (!atomic_load(&telemetryStopping)) {
+        if (poll(&poller, 1, TELEMETRY_INTERVAL_MS) <= 0) continue;
+        int client = accept(telemetry.listener, NULL, NULL);
+        if (client < 0) continue;
+
+        StatsBlock copy;
+        readStats(telemetry.block, &copy);
+        int length = statsToJson(&copy, json, sizeof(json));
+        for (int sent = 0; sent < length; ) {
+            ssize_t n = send(client, json + sent, length - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+/*
+    Creates the listening socket, replacing a stale socket file left by an earlier run.
+*/
+static int openSocket(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("telemetry socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+  Function: telemetryStart(const char* shmName, const char* socketPath, long gamesPlanned)
+  Purpose: Starts publishing live statistics.
+
+  Parameters:
+    in shmName: name of the POSIX shared-memory segment to publish to, e.g. "/ghosthunt", or NULL for none.
+    in socketPath: path of a Unix socket that answers with JSON, or NULL for none.
+    in gamesPlanned: how many games the run will play, 0 if unknown.
+
+  Description:
+    Call it before the games start and telemetryStop after they end. The segment and the socket file are removed by telemetryStop.
+
+  return
+    C_TRUE on success, C_FALSE after printing the problem to stderr
+*/
+int telemetryStart(const char* shmName, const char* socketPath, long gamesPlanned) {
+    memset(&telemetry, 0, sizeof(telemetry));
+    telemetry.listener = -1;
+
+    if (shmName != NULL) {
+        int fd = shm_open(shmName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, sizeof(StatsBlock)) < 0) {
+            fprintf(stderr, "%s: %s\n", shmName, strerror(errno));
+            if (fd >= 0) close(fd);
+            return C_FALSE;
+        }
+        telemetry.block = mmap(NULL, sizeof(StatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (telemetry.block == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", shmName, strerror(errno));
+            shm_unlink(shmName);
+            return C_FALSE;
+        }
+        snprintf(telemetry.shmName, MAX_STR, "%s", shmName);
+    } else {
+        telemetry.block = calloc(1, sizeof(StatsBlock));
+        if (telemetry.block == NULL) {
+            perror("Error starting telemetry");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    StatsBlock* block = telemetry.block;
+    memset(block, 0, sizeof(StatsBlock));
+    block->version = STATS_VERSION;
+    block->pid = (uint32_t) getpid();
+    block->running = C_TRUE;
+    block->gamesPlanned = gamesPlanned > 0 ? gamesPlanned : 0;
+    block->started = block->updated = telemetry.lastTime = realSeconds();
+    atomic_thread_fence(memory_order_release);
+    memcpy(block->magic, STATS_MAGIC, sizeof(block->magic));
+
+    if (socketPath != NULL) {
+        telemetry.listener = openSocket(socketPath);
+        if (telemetry.listener < 0) {
+            if (shmName != NULL) {
+                munmap(telemetry.block, sizeof(StatsBlock));
+                shm_unlink(shmName);
+            } else {
+                free(telemetry.block);
+            }
+            return C_FALSE;
+        }
+        snprintf(telemetry.socketPath, sizeof(telemetry.socketPath), "%s", socketPath);
+    }
+
+    // Slots outlive a run because their threads may still point to them; a new run starts them from zero
+    for (TelemetrySlot* slot = atomic_load(&telemetrySlots); slot != NULL; slot = slot->next) {
+        memset(slot, 0, offsetof(TelemetrySlot, next));
+    }
+
+    pthread_mutex_init(&telemetry.lock, NULL);
+    pthread_cond_init(&telemetry.wake, NULL);
+    atomic_store(&telemetryStopping, C_FALSE);
+    atomic_store(&telemetryOn, C_TRUE);
+    pthread_create(&telemetry.publisher, NULL, publisherThread, NULL);
+    if (telemetry.listener >= 0) pthread_create(&telemetry.server, NULL, serverThread, NULL);
+    return C_TRUE;
+}
+
+/*
+  Function: telemetryStop()
+  Purpose: Publishes the final totals, stops the publisher and the socket, and removes the segment and the socket file.
+*/
+void telemetryStop() {
+    if (!atomic_load(&telemetryOn)) return;
+    pthread_mutex_lock(&telemetry.lock);
+    telemetry.watched = NULL;
+    atomic_store(&telemetryStopping, C_TRUE);
+    pthread_cond_signal(&telemetry.wake);
+    pthread_mutex_unlock(&telemetry.lock);
+    pthread_join(telemetry.publisher, NULL);
+    if (telemetry.listener >= 0) {
+        pthread_join(telemetry.server, NULL);
+        close(telemetry.listener);
+        unlink(telemetry.socketPath);
+    }
+    publish(C_FALSE);
+    atomic_store(&telemetryOn, C_FALSE);
+
+    if (telemetry.shmName[0] != '\0') {
+        munmap(telemetry.block, sizeof(StatsBlock));
+        shm_unlink(telemetry.shmName);
+    } else {
+        free(telemetry.block);
+    }
+    pthread_cond_destroy(&telemetry.wake);
+    pthread_mutex_destroy(&telemetry.lock);
+}
@@ -0,0 +1,237 @@
+// trace.c
+#include "defs.h"
+#include <errno.h>
+
+/*
+    A trace file is a TraceFileHeader, the room name table of the house, and then a stream of
+    16-byte TraceRecords. Each game is written as one contiguous run of records starting with
+    TRACE_GAME_START and ending with TRACE_GAME_END, even when several batch workers share the file:
+    records are appended to a per-game TraceBuffer and only copied to the file between games.
+    Hunter names follow TRACE_GAME_START as TRACE_HUNTER_NAME records, each followed by the name
+    packed into as many raw 16-byte blocks as it needs. The file uses the writer's byte order.
+*/
+
+#define TRACE_FLUSH_RECORDS 4096    // write a worker's buffer out once it holds this many records
+
+static const char* traceTypeNames[TRACE_TYPE_COUNT] = {
+    [TRACE_GAME_START] = "game-start",
+    [TRACE_GAME_END] = "game-end",
+    [TRACE_HUNTER_NAME] = "hunter-name",
+    [TRACE_HUNTER_INIT] = "hunter-init",
+    [TRACE_HUNTER_MOVE] = "hunter-move",
+    [TRACE_HUNTER_REVIEW] = "hunter-review",
+    [TRACE_HUNTER_COLLECT] = "hunter-collect",
+    [TRACE_HUNTER_EXIT] = "hunter-exit",
+    [TRACE_GHOST_INIT] = "ghost-init",
+    [TRACE_GHOST_MOVE] = "ghost-move",
+    [TRACE_GHOST_EVIDENCE] = "ghost-evidence",
+    [TRACE_GHOST_EXIT] = "ghost-exit",
+};
+
+/*
+    Function: traceTypeName(enum TraceType type)
+    Purpose: Returns the short name of an event type, e.g. "hunter-move", or NULL if there is none.
+*/
+const char* traceTypeName(enum TraceType type) {
+    return type >= 0 && type < TRACE_TYPE_COUNT ? traceTypeNames[type] : NULL;
+}
+
+/*
+    Function: openTrace(TraceFile* trace, const char* path, const HouseLayout* layout)
+    Purpose: Creates a trace file and writes its header and the house's room names.
+
+    Returns:
+      C_TRUE on success, C_FALSE after printing the problem to stderr
+*/
+int openTrace(TraceFile* trace, const char* path, const HouseLayout* layout) {
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return C_FALSE;
+    }
+    setvbuf(trace->file, NULL, _IOFBF, 1 << 20);
+    pthread_mutex_init(&trace->lock, NULL);
+    atomic_init(&trace->nextGame, 0);
+
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.numRooms = layout->numRooms;
+    header.namesSize = layout->namesSize;
+
+    static const char padding[sizeof(TraceRecord)];
+    size_t tableSize = layout->numRooms * sizeof(uint32_t) + layout->namesSize;
+    size_t pad = (sizeof(TraceRecord) - tableSize % sizeof(TraceRecord)) % sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, trace->file);
+    fwrite(layout->nameOffset, sizeof(uint32_t), layout->numRooms, trace->file);
+    fwrite(layout->names, 1, layout->namesSize, trace->file);
+    fwrite(padding, 1, pad, trace->file);
+    return C_TRUE;
+}
+
+/*
+    Function: closeTrace(TraceFile* trace)
+    Purpose: Closes a trace file. Every buffer writing to it must be cleaned up first.
+
+    Returns:
+      C_TRUE if everything reached the file, C_FALSE after printing the problem to stderr
+*/
+int closeTrace(TraceFile* trace) {
+    int ok = !ferror(trace->file);
+    if (fclose(trace->file) != 0) ok = C_FALSE;
+    pthread_mutex_destroy(&trace->lock);
+    if (!ok) {
+        fprintf(stderr, "trace: write failed\n");
+    }
+    return ok;
+}
+
+/*
+    Function: initTraceBuffer(TraceBuffer* buffer, TraceFile* trace)
+    Purpose: Initializes a buffer that collects the records of the games played on one thread.
+*/
+void initTraceBuffer(TraceBuffer* buffer, TraceFile* trace) {
+    buffer->trace = trace;
+    buffer->count = 0;
+    buffer->capacity = 2 * TRACE_FLUSH_RECORDS;
+    buffer->records = malloc(buffer->capacity * sizeof(TraceRecord));
+    if (buffer->records == NULL) {
+        perror("Error creating trace buffer");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&buffer->lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &buffer->started);
+}
+
+/*
+    Copies every buffered record to the file.
+*/
+static void flushTraceBuffer(TraceBuffer* buffer) {
+    if (buffer->count == 0) return;
+    pthread_mutex_lock(&buffer->trace->lock);
+    fwrite(buffer->records, sizeof(TraceRecord), buffer->count, buffer->trace->file);
+    pthread_mutex_unlock(&buffer->trace->lock);
+    buffer->count = 0;
+}
+
+/*
+    Function: cleanupTraceBuffer(TraceBuffer* buffer)
+    Purpose: Writes out the buffer's remaining games and frees it.
+*/
+void cleanupTraceBuffer(TraceBuffer* buffer) {
+    flushTraceBuffer(buffer);
+    free(buffer->records);
+    buffer->records = NULL;
+    pthread_mutex_destroy(&buffer->lock);
+}
+
+/*
+    Appends one record, growing the buffer so a game in progress is never split.
+*/
+static void appendRecord(TraceBuffer* buffer, const TraceRecord* record) {
+    if (buffer->count == buffer->capacity) {
+        TraceRecord* grown = realloc(buffer->records, 2 * buffer->capacity * sizeof(TraceRecord));
+        if (grown == NULL) {
+            perror("Error growing trace buffer");
+            exit(EXIT_FAILURE);
+        }
+        buffer->records = grown;
+        buffer->capacity *= 2;
+    }
+    buffer->records[buffer->count++] = *record;
+}
+
+/*
+    Function: recordTrace(TraceBuffer* buffer, HouseType* house, enum TraceType type, int entity, RoomId room, int detail)
+    Purpose: Appends one event to a trace buffer. Called through traceEvent.
+
+    Description:
+      The timestamp is the house's simulated clock, or wall-clock milliseconds since the buffer
+      was created when entities run on their own threads (which also take the buffer's lock).
+*/
+void recordTrace(TraceBuffer* buffer, HouseType* house, enum TraceType type, int entity, RoomId room, int detail) {
+    TraceRecord record;
+    record.room = room;
+    record.entity = (uint16_t) entity;
+    record.type = (uint8_t) type;
+    record.detail = (uint8_t) detail;
+
+    if (house->threaded) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        record.time = (now.tv_sec - buffer->started.tv_sec) * 1000 + (now.tv_nsec - buffer->started.tv_nsec) / 1000000;
+        pthread_mutex_lock(&buffer->lock);
+        appendRecord(buffer, &record);
+        pthread_mutex_unlock(&buffer->lock);
+    } else {
+        record.time = house->now;
+        appendRecord(buffer, &record);
+    }
+}
+
+/*
+    Function: traceEvent(HouseType* house, enum TraceType type, int entity, RoomId room, int detail)
+    Purpose: Records an event if the house is being traced.
+
+    Parameters:
+      in: house - the house the event happened in.
+      in: type - what happened.
+      in: entity - the hunter's id, or TRACE_GHOST.
+      in: room - the room it happened in, or NO_ROOM.
+      in: detail - the evidence, ghost class or LoggerDetails the event carries, see enum TraceType.
+*/
+void traceEvent(HouseType* house, enum TraceType type, int entity, RoomId room, int detail) {
+    INST_COUNT(INST_EVENTS + type);
+    if (house->trace != NULL) {
+        recordTrace(house->trace, house, type, entity, room, detail);
+    }
+}
+
+/*
+    Function: traceGameStart(HouseType* house, const Ghost* ghost)
+    Purpose: Numbers the game and records its start and its hunters' names.
+
+    Description:
+      TRACE_GAME_START carries the game number in its time field, the hunter count in entity
+      and the ghost class in detail.
+*/
+void traceGameStart(HouseType* house, const Ghost* ghost) {
+    TraceBuffer* buffer = house->trace;
+    if (buffer == NULL) return;
+
+    TraceRecord start;
+    start.time = atomic_fetch_add(&buffer->trace->nextGame, 1);
+    start.room = ghost->currentRoom;
+    start.entity = (uint16_t) house->numHunters;
+    start.type = TRACE_GAME_START;
+    start.detail = ghost->type;
+    appendRecord(buffer, &start);
+
+    for (int i = 0; i < house->numHunters; i++) {
+        const char* name = house->hunters[i].name;
+        uint32_t length = strlen(name);
+        TraceRecord header = { 0, length, (uint16_t) i, TRACE_HUNTER_NAME, 0 };
+        appendRecord(buffer, &header);
+        for (uint32_t done = 0; done < length; done += sizeof(TraceRecord)) {
+            TraceRecord block;
+            memset(&block, 0, sizeof(block));
+            memcpy(&block, name + done, length - done < sizeof(block) ? length - done : sizeof(block));
+            appendRecord(buffer, &block);
+        }
+    }
+}
+
+/*
+    Function: traceGameEnd(HouseType* house)
+    Purpose: Records the end of a game and writes the buffer out if it has grown large.
+*/
+void traceGameEnd(HouseType* house) {
+    TraceBuffer* buffer = house->trace;
+    if (buffer == NULL) return;
+
+    traceEvent(house, TRACE_GAME_END, TRACE_GHOST, NO_ROOM, 0);
+    if (buffer->count >= TRACE_FLUSH_RECORDS) {
+        flushTraceBuffer(buffer);
+    }
+}
@@ -0,0 +1,345 @@
+// tracedump.c
+#include "defs.h"
+
+/*
+    ghost_trace: decodes a binary trace written with --trace.
+
+    By default it prints every event exactly as logger.c would have printed it. Events can be
+    filtered by game, hunter or type, counted instead of printed, or replayed to rebuild each
+    game's state and print its final results.
+*/
+
+typedef struct TraceOptions {
+    long game;              // -1 for every game
+    long hunter;            // -1 for every entity, TRACE_GHOST for the ghost only
+    int type;               // -1 for every type
+    int count;
+    int replay;
+} TraceOptions;
+
+// What the decoder knows about the game being read
+typedef struct TraceGame {
+    long number;
+    enum GhostClass ghostType;
+    RoomId ghostRoom;
+    int numHunters;
+    Hunter* hunters;
+    unsigned char* roomEvidence;   // pieces of each kind of evidence in each room, [room * EV_COUNT + kind]
+    EvidenceBoard evidence;
+    long inconsistencies;
+} TraceGame;
+
+typedef struct TraceReader {
+    FILE* file;
+    TraceRecord records[4096];
+    size_t count;
+    size_t next;
+} TraceReader;
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--game N] [--hunter ID | --ghost] [--type NAME] [--count | --replay] TRACE\n", program);
+    fprintf(stderr, "  prints the events in TRACE in the simulator's log format\n");
+    fprintf(stderr, "  --game N     only game number N (games are numbered from 0)\n");
+    fprintf(stderr, "  --hunter ID  only events of the hunter with this id (0-based)\n");
+    fprintf(stderr, "  --ghost      only events of the ghost\n");
+    fprintf(stderr, "  --type NAME  only one kind of event, e.g. hunter-move or ghost-evidence\n");
+    fprintf(stderr, "  --count      print how many events of each kind matched instead\n");
+    fprintf(stderr, "  --replay     rebuild each game from its events and print its final results\n");
+}
+
+static int readRecord(TraceReader* reader, TraceRecord* record) {
+    if (reader->next == reader->count) {
+        reader->count = fread(reader->records, sizeof(TraceRecord), 4096, reader->file);
+        reader->next = 0;
+        if (reader->count == 0) return C_FALSE;
+    }
+    *record = reader->records[reader->next++];
+    return C_TRUE;
+}
+
+static const char* hunterName(const TraceGame* game, int id) {
+    return (id >= 0 && id < game->numHunters) ? game->hunters[id].name : "?";
+}
+
+static const char* traceRoomName(const HouseLayout* layout, RoomId room) {
+    return room < layout->numRooms ? roomName(layout, room) : "?";
+}
+
+/*
+    Prints one event with the logger, exactly as the simulator logged it.
+*/
+static void printEvent(const TraceRecord* record, const TraceGame* game, const HouseLayout* layout) {
+    static const LogSink sink = { C_TRUE, STDOUT_FILENO };
+    const char* room = traceRoomName(layout, record->room);
+    switch (record->type) {
+        case TRACE_HUNTER_INIT:    l_hunterInit(&sink, hunterName(game, record->entity), record->detail); break;
+        case TRACE_HUNTER_MOVE:    l_hunterMove(&sink, hunterName(game, record->entity), room); break;
+        case TRACE_HUNTER_REVIEW:  l_hunterReview(&sink, hunterName(game, record->entity), record->detail); break;
+        case TRACE_HUNTER_COLLECT: l_hunterCollect(&sink, hunterName(game, record->entity), record->detail, room); break;
+        case TRACE_HUNTER_EXIT:    l_hunterExit(&sink, hunterName(game, record->entity), record->detail); break;
+        case TRACE_GHOST_INIT:     l_ghostInit(&sink, record->detail, room); break;
+        case TRACE_GHOST_MOVE:     l_ghostMove(&sink, room); break;
+        case TRACE_GHOST_EVIDENCE: l_ghostEvidence(&sink, record->detail, room); break;
+        case TRACE_GHOST_EXIT:     l_ghostExit(&sink, record->detail); break;
+        default: break;
+    }
+}
+
+/*
+    Applies one event to the rebuilt game state, counting events that could not have happened.
+*/
+static void replayEvent(const TraceRecord* record, TraceGame* game, const HouseLayout* layout) {
+    Hunter* hunter = record->entity < game->numHunters ? &game->hunters[record->entity] : NULL;
+    int isHunterEvent = record->type >= TRACE_HUNTER_INIT && record->type <= TRACE_HUNTER_EXIT;
+    if ((isHunterEvent && hunter == NULL) || (record->room != NO_ROOM && record->room >= layout->numRooms)) {
+        game->inconsistencies++;
+        return;
+    }
+
+    switch (record->type) {
+        case TRACE_HUNTER_INIT:
+            hunter->equipment = record->detail;
+            hunter->currentRoom = record->room;
+            break;
+        case TRACE_HUNTER_MOVE:
+            hunter->currentRoom = record->room;
+            break;
+        case TRACE_HUNTER_COLLECT: {
+            if (record->room == NO_ROOM || record->detail >= EV_COUNT) {
+                game->inconsistencies++;
+                break;
+            }
+            unsigned char* held = &game->roomEvidence[record->room * EV_COUNT + record->detail];
+            if (hunter->currentRoom != record->room || *held == 0) {
+                game->inconsistencies++;
+            } else {
+                (*held)--;
+            }
+            int nobody = -1;
+            if (atomic_compare_exchange_strong(&game->evidence.contributor[record->detail], &nobody, record->entity)) {
+                atomic_fetch_or(&game->evidence.collected, 1u << record->detail);
+            }
+            break;
+        }
+        case TRACE_HUNTER_EXIT:
+            hunter->exitReason = record->detail;
+            // Exits happen exactly at the thresholds, which is all finalizeResults looks at
+            if (record->detail == LOG_FEAR) hunter->fear = FEAR_MAX;
+            if (record->detail == LOG_BORED) hunter->boredom = BOREDOM_MAX;
+            hunter->currentRoom = NO_ROOM;
+            break;
+        case TRACE_GHOST_INIT:
+        case TRACE_GHOST_MOVE:
+            game->ghostRoom = record->room;
+            break;
+        case TRACE_GHOST_EVIDENCE: {
+            if (record->room == NO_ROOM || record->detail >= EV_COUNT) {
+                game->inconsistencies++;
+                break;
+            }
+            int held = 0;
+            for (int e = 0; e < EV_COUNT; e++) held += game->roomEvidence[record->room * EV_COUNT + e];
+            if (game->ghostRoom != record->room || held >= ROOM_EVIDENCE_SLOTS) {
+                game->inconsistencies++;
+            } else {
+                game->roomEvidence[record->room * EV_COUNT + record->detail]++;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/*
+    Prints a replayed game's final results the way the simulator does at the end of a game.
+*/
+static void printReplay(const TraceGame* game) {
+    HouseType house;
+    Ghost ghost;
+    memset(&house, 0, sizeof(house));
+    memset(&ghost, 0, sizeof(ghost));
+    house.hunters = game->hunters;
+    house.numHunters = game->numHunters;
+    atomic_store(&house.evidence.collected, atomic_load(&game->evidence.collected));
+    for (int i = 0; i < EV_COUNT; i++) {
+        atomic_store(&house.evidence.contributor[i], atomic_load(&game->evidence.contributor[i]));
+    }
+    ghost.type = game->ghostType;
+
+    printf("=== Game %ld: the ghost was a %s ===\n", game->number, ghostName(game->ghostType));
+    finalizeResults(&house, &ghost);
+    if (game->inconsistencies > 0) {
+        printf("Warning: %ld events did not match the rebuilt state\n", game->inconsistencies);
+    }
+    printf("\n");
+}
+
+/*
+    Resets the decoder state for a new game from its TRACE_GAME_START record and hunter names.
+*/
+static int startGame(TraceReader* reader, const TraceRecord* start, TraceGame* game, const HouseLayout* layout) {
+    free(game->hunters);
+    game->number = (long) start->time;
+    game->ghostType = start->detail;
+    game->ghostRoom = start->room;
+    game->numHunters = start->entity;
+    game->hunters = calloc(game->numHunters > 0 ? game->numHunters : 1, sizeof(Hunter));
+    initEvidenceBoard(&game->evidence);
+    game->inconsistencies = 0;
+    memset(game->roomEvidence, 0, (size_t) layout->numRooms * EV_COUNT);
+    if (game->hunters == NULL) {
+        perror("ghost_trace");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < game->numHunters; i++) {
+        snprintf(game->hunters[i].name, MAX_STR, "Hunter %d", i + 1);
+        game->hunters[i].id = i;
+        game->hunters[i].exitReason = LOG_UNKNOWN;
+    }
+
+    // Names follow the start record: a header record and the name in raw blocks
+    for (int i = 0; i < game->numHunters; i++) {
+        TraceRecord header, block;
+        if (!readRecord(reader, &header) || header.type != TRACE_HUNTER_NAME) return C_FALSE;
+        char name[MAX_STR + sizeof(TraceRecord)];
+        uint32_t length = header.room < MAX_STR ? header.room : MAX_STR - 1;
+        for (uint32_t done = 0; done < header.room; done += sizeof(TraceRecord)) {
+            if (!readRecord(reader, &block)) return C_FALSE;
+            if (done < MAX_STR) memcpy(name + done, &block, sizeof(block));
+        }
+        name[length] = '\0';
+        if (header.entity < game->numHunters) {
+            strcpy(game->hunters[header.entity].name, name);
+        }
+    }
+    return C_TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    TraceOptions options = { -1, -1, -1, C_FALSE, C_FALSE };
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--game") == 0 && i + 1 < argc) {
+            options.game = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--hunter") == 0 && i + 1 < argc) {
+            options.hunter = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--ghost") == 0) {
+            options.hunter = TRACE_GHOST;
+        } else if (strcmp(argv[i], "--type") == 0 && i + 1 < argc) {
+            i++;
+            for (int t = 0; t < TRACE_TYPE_COUNT; t++) {
+                if (strcmp(argv[i], traceTypeName(t)) == 0) options.type = t;
+            }
+            if (options.type < 0) {
+                fprintf(stderr, "unknown event type \"%s\"\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--count") == 0) {
+            options.count = C_TRUE;
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            options.replay = C_TRUE;
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceReader reader = { .count = 0, .next = 0 };
+    reader.file = fopen(path, "rb");
+    if (reader.file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    // The header carries the room names so events can be printed without the map
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, reader.file) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace file, or written by a different version or byte order\n", path);
+        return 1;
+    }
+    size_t tableSize = header.numRooms * sizeof(uint32_t) + header.namesSize;
+    size_t paddedSize = (tableSize + sizeof(TraceRecord) - 1) / sizeof(TraceRecord) * sizeof(TraceRecord);
+    char* table = malloc(paddedSize + 1);
+    if (table == NULL || fread(table, 1, paddedSize, reader.file) != paddedSize) {
+        fprintf(stderr, "%s: truncated header\n", path);
+        return 1;
+    }
+    table[paddedSize] = '\0';
+    // Every name must start inside the names and end with a NUL there, as in a compiled map
+    const uint32_t* nameOffset = (const uint32_t*) table;
+    const char* names = table + header.numRooms * sizeof(uint32_t);
+    int namesOk = header.numRooms == 0 || (header.namesSize > 0 && names[header.namesSize - 1] == '\0');
+    for (uint32_t r = 0; namesOk && r < header.numRooms; r++) {
+        namesOk = nameOffset[r] < header.namesSize;
+    }
+    if (!namesOk) {
+        fprintf(stderr, "%s: corrupt room names\n", path);
+        return 1;
+    }
+    HouseLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.numRooms = header.numRooms;
+    layout.nameOffset = (const uint32_t*) table;
+    layout.names = table + header.numRooms * sizeof(uint32_t);
+    layout.namesSize = header.namesSize;
+
+    TraceGame game;
+    memset(&game, 0, sizeof(game));
+    game.number = -1;
+    game.roomEvidence = malloc(layout.numRooms > 0 ? (size_t) layout.numRooms * EV_COUNT : 1);
+    if (game.roomEvidence == NULL) {
+        perror("Error reading trace");
+        exit(EXIT_FAILURE);
+    }
+
+    long counts[TRACE_TYPE_COUNT] = { 0 };
+    long games = 0;
+    TraceRecord record;
+    while (readRecord(&reader, &record)) {
+        if (record.type >= TRACE_TYPE_COUNT) {
+            fprintf(stderr, "%s: corrupt record\n", path);
+            return 1;
+        }
+        if (record.type == TRACE_GAME_START) {
+            if (!startGame(&reader, &record, &game, &layout)) {
+                fprintf(stderr, "%s: truncated game %ld\n", path, game.number);
+                return 1;
+            }
+            if (options.game < 0 || options.game == game.number) games++;
+        }
+        if (options.game >= 0 && options.game != game.number) continue;
+
+        if (options.replay) {
+            replayEvent(&record, &game, &layout);
+            if (record.type == TRACE_GAME_END) printReplay(&game);
+            continue;
+        }
+        if (options.hunter >= 0 && options.hunter != record.entity) continue;
+        if (options.type >= 0 && options.type != record.type) continue;
+
+        counts[record.type]++;
+        if (!options.count) printEvent(&record, &game, &layout);
+    }
+
+    if (options.count) {
+        printf("games %ld\n", games);
+        for (int t = TRACE_HUNTER_INIT; t < TRACE_TYPE_COUNT; t++) {
+            printf("%s %ld\n", traceTypeName(t), counts[t]);
+        }
+    }
+
+    free(game.hunters);
+    free(game.roomEvidence);
+    free(table);
+    fclose(reader.file);
+    return 0;
+}
@@ -1,33 +1,151 @@
 #include "defs.h"
 
+/*
+    Random numbers come from xoshiro256** generators. Every generator is keyed by a 64-bit stream
+    key derived from the master seed with rngDerive, e.g. seed -> game index -> entity id, so each
+    game and each entity in it draws from its own independent stream and a batch gives the same
+    results no matter how many threads play it or in what order.
+*/
+
+/*
+    The splitmix64 finalizer: a bijective 64-bit mix with good avalanche.
+*/
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/*
+    Returns the key of sub-stream number stream of the given key.
+        in:   key - a master seed or a key returned by rngDerive
+        in:   stream - which sub-stream, e.g. a game index or an entity id
+*/
+uint64_t rngDerive(uint64_t key, uint64_t stream) {
+    return mix64(key ^ mix64(stream + 0x9e3779b97f4a7c15ULL));
+}
+
+/*
+    Initializes a generator from a stream key.
+        out:  rng - the generator
+        in:   key - a stream key, see rngDerive
+*/
+void rngSeed(Rng* rng, uint64_t key) {
+    uint64_t x = key;
+    for (int i = 0; i < 4; i++) {
+        x += 0x9e3779b97f4a7c15ULL;
+        rng->s[i] = mix64(x);
+    }
+}
+
+/*
+    Returns the next 64 random bits.
+*/
+uint64_t rngNext(Rng* rng) {
+    uint64_t* s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/*
+    Returns a uniformly distributed integer in [0, n), without modulo bias.
+    Uses Lemire's multiply-and-reject method, which almost never needs a division.
+        in:   n - size of the range, at least 1
+*/
+uint32_t rngRange(Rng* rng, uint32_t n) {
+    uint64_t m = (uint64_t) (uint32_t) (rngNext(rng) >> 32) * n;
+    uint32_t low = (uint32_t) m;
+    if (low < n) {
+        uint32_t threshold = -n % n;
+        while (low < threshold) {
+            m = (uint64_t) (uint32_t) (rngNext(rng) >> 32) * n;
+            low = (uint32_t) m;
+        }
+    }
+    return (uint32_t) (m >> 32);
+}
+
+/*
+    Returns a uniformly distributed double in [0, 1) with 53 random bits.
+*/
+double rngDouble(Rng* rng) {
+    return (rngNext(rng) >> 11) * 0x1.0p-53;
+}
+
+/*
+    Fills an array with random 64-bit words, for code that consumes random bits in bulk.
+        out:  out - the array to fill
+        in:   count - the number of words
+*/
+void rngFill(Rng* rng, uint64_t* out, size_t count) {
+    Rng local = *rng;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = rngNext(&local);
+    }
+    *rng = local;
+}
+
+static __thread Rng threadRng;
+static __thread int threadRngSeeded = C_FALSE;
+static atomic_ulong threadStreams = 0;
+
+/*
+    Seeds the calling thread's generator used by randInt, randFloat and randomGhost.
+        in:   seed - master seed; each call derives a different stream from it
+*/
+void seedRandom(uint64_t seed) {
+    rngSeed(&threadRng, rngDerive(seed, atomic_fetch_add(&threadStreams, 1)));
+    threadRngSeeded = C_TRUE;
+}
+
+/*
+    Returns the calling thread's generator, seeding it from the clock on first use.
+*/
+static Rng* getThreadRng() {
+    if (!threadRngSeeded) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        seedRandom((uint64_t) now.tv_sec * 1000000000u + now.tv_nsec);
+    }
+    return &threadRng;
+}
+
 /*
     Returns a pseudo randomly generated number, in the range min to (max - 1), inclusively
         in:   lower end of the range of the generated number
         in:   upper end of the range of the generated number
-    return:   randomly generated integer in the range [0, max-1) 
+    return:   randomly generated integer in the range [min, max), uniformly distributed
 */
 int randInt(int min, int max)
 {
-    return (int) randFloat(min, max);
+    if (max <= min) return min;
+    return min + (int) rngRange(getThreadRng(), (uint32_t) (max - min));
 }
 
 /*
     Returns a pseudo randomly generated floating point number.
-    A few tricks to make this thread safe, just to reduce any chance of issues using random
+    Uses the calling thread's own generator, so it is thread safe.
         in:   lower end of the range of the generated number
         in:   upper end of the range of the generated number
     return:   randomly generated floating point number in the range [min, max)
 */
 float randFloat(float min, float max) {
-    static __thread unsigned int seed = 0;
-    if (seed == 0) {
-        seed = (unsigned int)time(NULL) ^ (unsigned int)pthread_self();
-    }
-
-    float random = ((float) rand_r(&seed)) / (float) RAND_MAX;
+    float random = (float) rngDouble(getThreadRng());
     float diff = max - min;
     float r = random * diff;
-    return min + r;
+    float result = min + r;
+    return result < max ? result : min;
 }
 
 /* 
@@ -37,29 +155,37 @@ enum GhostClass randomGhost() {
     return (enum GhostClass) randInt(0, GHOST_COUNT);
 }
 
+/*
+    Returns the name of the given enum EvidenceType, without copying.
+        in: type - the enum EvidenceType to name
+    return: a static string, "UNKNOWN" for anything that is not a piece of evidence
+*/
+const char* evidenceName(enum EvidenceType type) {
+    static const char* names[EV_COUNT] = {
+        [EMF] = "EMF", [TEMPERATURE] = "TEMPERATURE", [FINGERPRINTS] = "FINGERPRINTS", [SOUND] = "SOUND"
+    };
+    return (type >= 0 && type < EV_COUNT) ? names[type] : "UNKNOWN";
+}
+
+/*
+    Returns the name of the given enum GhostClass, without copying.
+        in: ghost - the enum GhostClass to name
+    return: a static string, "Unknown" for anything that is not a ghost class
+*/
+const char* ghostName(enum GhostClass ghost) {
+    static const char* names[GHOST_COUNT] = {
+        [POLTERGEIST] = "Poltergeist", [BANSHEE] = "Banshee", [BULLIES] = "Bullies", [PHANTOM] = "Phantom"
+    };
+    return (ghost >= 0 && ghost < GHOST_COUNT) ? names[ghost] : "Unknown";
+}
+
 /*
     Returns the string representation of the given enum EvidenceType.
         in: type - the enum EvidenceType to convert
         out: str - the string representation of the given enum EvidenceType, minimum 16 characters
 */
 void evidenceToString(enum EvidenceType type, char* str) {
-    switch (type) {
-        case EMF:
-            strcpy(str, "EMF");
-            break;
-        case TEMPERATURE:
-            strcpy(str, "TEMPERATURE");
-            break;
-        case FINGERPRINTS:
-            strcpy(str, "FINGERPRINTS");
-            break;
-        case SOUND:
-            strcpy(str, "SOUND");
-            break;
-        default:
-            strcpy(str, "UNKNOWN");
-            break;
-    }
+    strcpy(str, evidenceName(type));
 }
 
 /* 
@@ -68,22 +194,5 @@ void evidenceToString(enum EvidenceType type, char* str) {
         out: buffer - the string representation of the given enum GhostClass, minimum 16 characters
 */
 void ghostToString(enum GhostClass ghost, char* buffer) {
-    switch(ghost) {
-        case BANSHEE:
-            strcpy(buffer, "Banshee");
-            break;
-        case BULLIES:
-            strcpy(buffer, "Bullies");
-            break;
-        case PHANTOM:
-            strcpy(buffer, "Phantom");
-            break;
-        case POLTERGEIST:
-            strcpy(buffer, "Poltergeist");
-            break;
-        default:
-            strcpy(buffer, "Unknown");
-            break;
-        
-    }
+    strcpy(buffer, ghostName(ghost));
 }